@@ -24,6 +24,31 @@ static int genders_file_exists (const char *genders_file)
 }
 
 
+/*
+ *  Allocate a list of n strings of len bytes each in one block.
+ *   Only the local node's attributes are needed, so the lists hold
+ *   maxattrs entries rather than one per attribute in the cluster.
+ */
+static char ** strlist_create (int n, int len)
+{
+	char **list;
+	char *buf;
+	int i;
+
+	if (n == 0)
+		n = 1;
+
+	if (!(list = malloc (n * sizeof (char *) + n * len)))
+		return (NULL);
+
+	buf = (char *) (list + n);
+	memset (buf, '\0', n * len);
+	for (i = 0; i < n; i++)
+		list[i] = buf + i * len;
+
+	return (list);
+}
+
 /*
  *  This is a helper symbol exported by cfengine to allow
  *   modules to export new hard classes.
@@ -33,13 +58,14 @@ extern CfRegisterHardClass (const char *class);
 int cfagent_module_getclasses (void)
 {
 	genders_t gh;
-	char **attrs, **vals;
+	char **attrs = NULL, **vals = NULL;
 	int i, nattrs;
-	int maxattrs;
+	int maxattrs, maxattrlen, maxvallen;
 	int rc = -1;
 
 	char *host = getenv ("GENDERS_HOSTNAME");
 	char *genders_file = getenv ("GENDERS_FILE");
+	char *shared_image = getenv ("GENDERS_SHARED_IMAGE");
 
 	/*
 	 *  Return silently if genders file does not exist. This
@@ -51,25 +77,39 @@ int cfagent_module_getclasses (void)
 	if ((gh = genders_handle_create()) == NULL)
 		return (-1);
 
+	/*
+	 *  Every cfagent run needs only the local node's classes.  Rather
+	 *   than parse the whole cluster database each run, attach the
+	 *   shared image of it, which the first run builds and later runs
+	 *   reuse until the genders file changes.  Set
+	 *   GENDERS_SHARED_IMAGE=0 to parse the file every run.
+	 */
+	if (!shared_image || strcmp (shared_image, "0"))
+		genders_set_flags (gh, GENDERS_FLAG_SHARED_IMAGE);
+
 	if (genders_load_data (gh, genders_file) < 0) {
 		fprintf (stderr, "genders: Failed to read genders file: %s\n",
 				genders_errormsg (gh));
-		return (-1);
+		goto out1;
 	}
 
-	if (genders_attrlist_create (gh, &attrs) < 0) {
-		fprintf (stderr, "genders: Failed to malloc attrlist: %s\n",
+	if ((maxattrs = genders_getmaxattrs (gh)) < 0
+	    || (maxattrlen = genders_getmaxattrlen (gh)) < 0
+	    || (maxvallen = genders_getmaxvallen (gh)) < 0) {
+		fprintf (stderr, "genders: Failed to get list sizes: %s\n",
 				genders_errormsg (gh));
 		goto out1;
 	}
-	if (genders_vallist_create (gh, &vals) < 0) {
-		fprintf (stderr, "genders: Failed to malloc vallist: %s\n",
-				genders_errormsg (gh));
+
+	if (!(attrs = strlist_create (maxattrs, maxattrlen + 1))) {
+		fprintf (stderr, "genders: Failed to malloc attrlist\n");
+		goto out1;
+	}
+	if (!(vals = strlist_create (maxattrs, maxvallen + 1))) {
+		fprintf (stderr, "genders: Failed to malloc vallist\n");
 		goto out2;
 	}
 
-	maxattrs = genders_getmaxattrs (gh);
-
 	if ((nattrs = genders_getattr (gh, attrs, vals, maxattrs, host)) < 0) {
 		fprintf (stderr, "genders: Failed to get all node attributes: %s\n",
 				genders_errormsg (gh));
@@ -88,9 +128,9 @@ int cfagent_module_getclasses (void)
 	}
 
 out3:
-	genders_attrlist_destroy (gh, attrs);
+	free (vals);
 out2:
-	genders_vallist_destroy (gh, vals);
+	free (attrs);
 out1:
 	genders_handle_destroy (gh);
 	return (rc);
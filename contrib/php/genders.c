@@ -33,18 +33,38 @@
 #include "ext/standard/info.h"
 #include "php_genders.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #include <genders.h>
 
+ZEND_DECLARE_MODULE_GLOBALS(genders)
+
+/* persistent handles, kept in EG(persistent_list) across requests */
 static int le_genders;
 
+typedef struct {
+  genders_t ghandle;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  time_t mtime;
+} php_genders_handle;
+
 zend_function_entry genders_functions[] = {
 	PHP_FE(genders_getnumattrs,	NULL)
 	PHP_FE(genders_getattr,		NULL)
 	PHP_FE(genders_getattr_all,	NULL)
 	PHP_FE(genders_getnodes,	NULL)
+	PHP_FE(genders_query,		NULL)
+	PHP_FE(genders_query_attrvals,	NULL)
 	{NULL, NULL, NULL}
 };
 
+PHP_INI_BEGIN()
+	STD_PHP_INI_BOOLEAN("genders.persistent", "1", PHP_INI_ALL, OnUpdateBool, persistent, zend_genders_globals, genders_globals)
+PHP_INI_END()
+
 
 zend_module_entry genders_module_entry = {
 	STANDARD_MODULE_HEADER,
@@ -64,13 +84,30 @@ zend_module_entry genders_module_entry = {
 ZEND_GET_MODULE(genders)
 #endif
 
+static void php_genders_init_globals(zend_genders_globals *genders_globals)
+{
+	genders_globals->persistent = 1;
+}
+
+static void _php_genders_handle_dtor(zend_rsrc_list_entry *rsrc TSRMLS_DC)
+{
+	php_genders_handle *ph = (php_genders_handle *)rsrc->ptr;
+
+	genders_handle_destroy(ph->ghandle);
+	free(ph);
+}
+
 PHP_MINIT_FUNCTION(genders)
 {
+	ZEND_INIT_MODULE_GLOBALS(genders, php_genders_init_globals, NULL);
+	REGISTER_INI_ENTRIES();
+	le_genders = zend_register_list_destructors_ex(NULL, _php_genders_handle_dtor, "genders persistent handle", module_number);
 	return SUCCESS;
 }
 
 PHP_MSHUTDOWN_FUNCTION(genders)
 {
+	UNREGISTER_INI_ENTRIES();
 	return SUCCESS;
 }
 
@@ -89,30 +126,137 @@ PHP_MINFO_FUNCTION(genders)
 	php_info_print_table_start();
 	php_info_print_table_header(2, "genders support", "enabled");
 	php_info_print_table_end();
+
+	DISPLAY_INI_ENTRIES();
+}
+
+/*
+ * _php_genders_get
+ *
+ * Return a loaded handle for file, or the default genders file if
+ * file is NULL.  With genders.persistent set, the worker keeps one
+ * handle per file across requests, like a pconnect, and reloads it
+ * only when stat() shows the file was replaced or modified.  Returns
+ * NULL with a warning issued on error.  Every handle returned must be
+ * passed to _php_genders_put() with the returned persistent flag.
+ */
+static genders_t _php_genders_get(zval *file, int *persistent TSRMLS_DC)
+{
+  genders_t ghandle = NULL;
+  char *filename = NULL;
+  char *key = NULL;
+  int keylen;
+  struct stat st;
+  zend_rsrc_list_entry *le, new_le;
+  php_genders_handle *ph;
+
+  *persistent = 0;
+
+  if (file && Z_TYPE_P(file) != IS_NULL)
+  {
+    convert_to_string(file);
+    filename = Z_STRVAL_P(file);
+  }
+
+  if (GENDERS_G(persistent)
+      && stat(filename ? filename : GENDERS_DEFAULT_FILE, &st) == 0)
+  {
+    keylen = spprintf(&key, 0, "genders_%s", filename ? filename : GENDERS_DEFAULT_FILE);
+
+    if (zend_hash_find(&EG(persistent_list), key, keylen + 1, (void **)&le) == SUCCESS
+        && Z_TYPE_P(le) == le_genders)
+    {
+      ph = (php_genders_handle *)le->ptr;
+      if (ph->dev == st.st_dev
+          && ph->ino == st.st_ino
+          && ph->size == st.st_size
+          && ph->mtime == st.st_mtime)
+      {
+        efree(key);
+        *persistent = 1;
+        return ph->ghandle;
+      }
+      /* stale, the destructor frees the old handle */
+      zend_hash_del(&EG(persistent_list), key, keylen + 1);
+    }
+  }
+
+  if (!(ghandle = genders_handle_create()))
+  {
+    php_error(E_WARNING, "genders_handle_create failed");
+    goto cleanup;
+  }
+
+  if (genders_load_data(ghandle, filename) < 0)
+  {
+    php_error(E_WARNING, genders_errormsg(ghandle));
+    genders_handle_destroy(ghandle);
+    ghandle = NULL;
+    goto cleanup;
+  }
+
+  /* st was taken before the load, so a file modified while loading
+   * is reloaded by the next request
+   */
+  if (key && (ph = (php_genders_handle *)malloc(sizeof(php_genders_handle))))
+  {
+    ph->ghandle = ghandle;
+    ph->dev = st.st_dev;
+    ph->ino = st.st_ino;
+    ph->size = st.st_size;
+    ph->mtime = st.st_mtime;
+    new_le.type = le_genders;
+    new_le.ptr = ph;
+    if (zend_hash_update(&EG(persistent_list), key, keylen + 1, (void *)&new_le, sizeof(zend_rsrc_list_entry), NULL) == SUCCESS)
+      *persistent = 1;
+    else
+      free(ph);
+  }
+
+ cleanup:
+  if (key)
+    efree(key);
+  return ghandle;
+}
+
+/*
+ * _php_genders_put
+ *
+ * Release a handle returned by _php_genders_get(), destroying it
+ * unless it is a persistent handle.
+ */
+static void _php_genders_put(genders_t ghandle, int persistent)
+{
+  if (ghandle && !persistent)
+    genders_handle_destroy(ghandle);
 }
 
 /* {{{ proto int genders_getnumattrs (string file) */
 PHP_FUNCTION(genders_getnumattrs)
 {
   genders_t ghandle;
-  unsigned long retval;
+  int persistent;
+  int retval;
   zval *file;
 
   if (zend_get_parameters(ht, 1, &file) == SUCCESS)
   {
-    ghandle = genders_handle_create();
-    genders_load_data(ghandle, file->value.str.val);
+    if (!(ghandle = _php_genders_get(file, &persistent TSRMLS_CC)))
+    {
+      RETURN_FALSE;
+    }
 
     retval = genders_getnumattrs(ghandle);
 
     if(retval < 0)
     {
       php_error(E_WARNING, genders_strerror(genders_errnum(ghandle)));
+      _php_genders_put(ghandle, persistent);
       RETURN_FALSE;
     }
 
     RETVAL_LONG(retval);
-    genders_handle_destroy(ghandle);
+    _php_genders_put(ghandle, persistent);
   }
   else
   {
@@ -126,17 +270,20 @@ PHP_FUNCTION(genders_getnumattrs)
 PHP_FUNCTION(genders_getattr)
 {
   genders_t ghandle;
+  int persistent;
   zval *file;
   zval *node;
   zval *ret_type;
-  char **attrlist;
-  char **vallist;
+  char **attrlist = NULL;
+  char **vallist = NULL;
   int len, num, k;
 
   if ( ZEND_NUM_ARGS() == 3 && zend_get_parameters(ht, 3, &file, &node, &ret_type) == SUCCESS)
   {
-    ghandle = genders_handle_create();
-    genders_load_data(ghandle, file->value.str.val);
+    if (!(ghandle = _php_genders_get(file, &persistent TSRMLS_CC)))
+    {
+      RETURN_FALSE;
+    }
 
     len = genders_attrlist_create(ghandle, &attrlist);
     genders_vallist_create(ghandle, &vallist);
@@ -144,15 +291,10 @@ PHP_FUNCTION(genders_getattr)
     num = genders_getattr(ghandle, attrlist, vallist, len, node->value.str.val);
     if(num < 0)
     {
-      if(genders_errnum(ghandle) == GENDERS_ERR_NOTFOUND)
-      {
-        RETURN_FALSE;
-      }
-      else
-      {
+      if(genders_errnum(ghandle) != GENDERS_ERR_NOTFOUND)
         php_error(E_WARNING, genders_strerror(genders_errnum(ghandle)));
-        RETURN_FALSE;
-      }
+      RETVAL_FALSE;
+      goto cleanup;
     }
 
     array_init(return_value);
@@ -172,10 +314,11 @@ PHP_FUNCTION(genders_getattr)
       }
     }
 
+  cleanup:
     genders_attrlist_destroy(ghandle, attrlist);
     genders_vallist_destroy(ghandle, vallist);
 
-    genders_handle_destroy(ghandle);
+    _php_genders_put(ghandle, persistent);
   }
   else
   {
@@ -188,24 +331,29 @@ PHP_FUNCTION(genders_getattr)
 PHP_FUNCTION(genders_getnodes)
 {
   genders_t ghandle;
+  int persistent;
   zval *file;
   zval *attr;
   zval *val;
-  char **nodelist;
+  char **nodelist = NULL;
   int len, num, k;
 
   if ( ZEND_NUM_ARGS() == 3 && zend_get_parameters(ht, 3, &file, &attr, &val) == SUCCESS)
   {
-    ghandle = genders_handle_create();
-    genders_load_data(ghandle, file->value.str.val);
+    if (!(ghandle = _php_genders_get(file, &persistent TSRMLS_CC)))
+    {
+      RETURN_FALSE;
+    }
 
     len = genders_nodelist_create(ghandle, &nodelist);
 
-    num = genders_getnodes(ghandle, nodelist, len, attr->value.str.val, val->value.str.val);
+    num = genders_getnodes(ghandle, nodelist, len, attr->value.str.val,
+                           Z_TYPE_P(val) == IS_NULL ? NULL : val->value.str.val);
     if(num < 0)
     {
       php_error(E_WARNING, genders_strerror(genders_errnum(ghandle)));
-      RETURN_FALSE;
+      RETVAL_FALSE;
+      goto cleanup;
     }
 
     array_init(return_value);
@@ -215,8 +363,9 @@ PHP_FUNCTION(genders_getnodes)
       add_next_index_string(return_value, nodelist[k], 1);
     }
 
+  cleanup:
     genders_nodelist_destroy(ghandle, nodelist);
-    genders_handle_destroy(ghandle);
+    _php_genders_put(ghandle, persistent);
   }
   else
   {
@@ -229,14 +378,17 @@ PHP_FUNCTION(genders_getnodes)
 PHP_FUNCTION(genders_getattr_all)
 {
   genders_t ghandle;
+  int persistent;
   zval *file;
-  char **attrlist;
+  char **attrlist = NULL;
   int len, num, k;
 
   if ( ZEND_NUM_ARGS() == 1 && zend_get_parameters(ht, 1, &file) == SUCCESS)
   {
-    ghandle = genders_handle_create();
-    genders_load_data(ghandle, file->value.str.val);
+    if (!(ghandle = _php_genders_get(file, &persistent TSRMLS_CC)))
+    {
+      RETURN_FALSE;
+    }
 
     len = genders_attrlist_create(ghandle, &attrlist);
 
@@ -244,7 +396,8 @@ PHP_FUNCTION(genders_getattr_all)
     if(num < 0)
     {
       php_error(E_WARNING, genders_strerror(genders_errnum(ghandle)));
-      RETURN_FALSE;
+      RETVAL_FALSE;
+      goto cleanup;
     }
 
     array_init(return_value);
@@ -254,8 +407,131 @@ PHP_FUNCTION(genders_getattr_all)
       add_next_index_string(return_value, attrlist[k], 1);
     }
 
+  cleanup:
     genders_attrlist_destroy(ghandle, attrlist);
-    genders_handle_destroy(ghandle);
+    _php_genders_put(ghandle, persistent);
+  }
+  else
+  {
+    WRONG_PARAM_COUNT;
+  }
+  return;
+}
+
+/* {{{ proto string array genders_query (string file, string query) */
+PHP_FUNCTION(genders_query)
+{
+  genders_t ghandle;
+  int persistent;
+  zval *file;
+  zval *query;
+  char **nodelist = NULL;
+  int len, num, k;
+
+  if ( ZEND_NUM_ARGS() == 2 && zend_get_parameters(ht, 2, &file, &query) == SUCCESS)
+  {
+    if (!(ghandle = _php_genders_get(file, &persistent TSRMLS_CC)))
+    {
+      RETURN_FALSE;
+    }
+
+    len = genders_nodelist_create(ghandle, &nodelist);
+
+    num = genders_query(ghandle, nodelist, len,
+                        Z_TYPE_P(query) == IS_NULL ? NULL : query->value.str.val);
+    if(num < 0)
+    {
+      php_error(E_WARNING, genders_strerror(genders_errnum(ghandle)));
+      RETVAL_FALSE;
+      goto cleanup;
+    }
+
+    array_init(return_value);
+
+    for(k=0;k<num;k++)
+    {
+      add_next_index_string(return_value, nodelist[k], 1);
+    }
+
+  cleanup:
+    genders_nodelist_destroy(ghandle, nodelist);
+    _php_genders_put(ghandle, persistent);
+  }
+  else
+  {
+    WRONG_PARAM_COUNT;
+  }
+  return;
+}
+
+/* {{{ proto array genders_query_attrvals (string file, string query) */
+/* returns node => (attr => val) for every node of the query, NULL for attributes without a value */
+PHP_FUNCTION(genders_query_attrvals)
+{
+  genders_t ghandle;
+  int persistent;
+  zval *file;
+  zval *query;
+  zval *attrvals;
+  char **nodelist = NULL;
+  char **attrlist = NULL;
+  char **vallist = NULL;
+  int nodelen, attrlen, num, i, k;
+
+  if ( ZEND_NUM_ARGS() == 2 && zend_get_parameters(ht, 2, &file, &query) == SUCCESS)
+  {
+    if (!(ghandle = _php_genders_get(file, &persistent TSRMLS_CC)))
+    {
+      RETURN_FALSE;
+    }
+
+    nodelen = genders_nodelist_create(ghandle, &nodelist);
+    attrlen = genders_attrlist_create(ghandle, &attrlist);
+    genders_vallist_create(ghandle, &vallist);
+
+    nodelen = genders_query(ghandle, nodelist, nodelen,
+                            Z_TYPE_P(query) == IS_NULL ? NULL : query->value.str.val);
+    if(nodelen < 0)
+    {
+      php_error(E_WARNING, genders_strerror(genders_errnum(ghandle)));
+      RETVAL_FALSE;
+      goto cleanup;
+    }
+
+    array_init(return_value);
+
+    for(i=0;i<nodelen;i++)
+    {
+      genders_vallist_clear(ghandle, vallist);
+
+      num = genders_getattr(ghandle, attrlist, vallist, attrlen, nodelist[i]);
+      if(num < 0)
+      {
+        php_error(E_WARNING, genders_strerror(genders_errnum(ghandle)));
+        zval_dtor(return_value);
+        RETVAL_FALSE;
+        goto cleanup;
+      }
+
+      MAKE_STD_ZVAL(attrvals);
+      array_init(attrvals);
+
+      for(k=0;k<num;k++)
+      {
+        if(vallist[k][0])
+          add_assoc_string(attrvals, attrlist[k], vallist[k], 1);
+        else
+          add_assoc_null(attrvals, attrlist[k]);
+      }
+
+      add_assoc_zval(return_value, nodelist[i], attrvals);
+    }
+
+  cleanup:
+    genders_nodelist_destroy(ghandle, nodelist);
+    genders_attrlist_destroy(ghandle, attrlist);
+    genders_vallist_destroy(ghandle, vallist);
+    _php_genders_put(ghandle, persistent);
   }
   else
   {
@@ -0,0 +1,39 @@
+<?php
+/*
+ * Micro-benchmark of genders extension calls per second, with each
+ * call loading the genders file (genders.persistent=0) and with the
+ * worker's persistent handle (genders.persistent=1).
+ *
+ * Usage: php genders_bench.php [genders file] [seconds]
+ */
+
+$file = ($argc > 1) ? $argv[1] : NULL;
+$seconds = ($argc > 2) ? $argv[2] : 2;
+
+$nodes = genders_getnodes($file, NULL, NULL);
+if (!$nodes)
+  die("no nodes in genders file\n");
+
+foreach (array("0", "1") as $persistent)
+{
+  ini_set("genders.persistent", $persistent);
+
+  $calls = 0;
+  $start = microtime(TRUE);
+  do
+  {
+    genders_getattr($file, $nodes[$calls % count($nodes)], 0);
+    $calls++;
+  } while (microtime(TRUE) - $start < $seconds);
+  $elapsed = microtime(TRUE) - $start;
+
+  printf("genders.persistent=%s: %d genders_getattr() calls, %.0f calls/second\n",
+         $persistent, $calls, $calls / $elapsed);
+}
+
+ini_set("genders.persistent", "1");
+$start = microtime(TRUE);
+$attrvals = genders_query_attrvals($file, NULL);
+printf("genders_query_attrvals(): %d nodes in %.3f seconds\n",
+       count($attrvals), microtime(TRUE) - $start);
+?>
@@ -50,6 +50,12 @@ PHP_FUNCTION(genders_getnumattrs);
 PHP_FUNCTION(genders_getattr);
 PHP_FUNCTION(genders_getattr_all);
 PHP_FUNCTION(genders_getnodes);
+PHP_FUNCTION(genders_query);
+PHP_FUNCTION(genders_query_attrvals);
+
+ZEND_BEGIN_MODULE_GLOBALS(genders)
+	zend_bool persistent;
+ZEND_END_MODULE_GLOBALS(genders)
 
 #ifdef ZTS
 #define GENDERS_G(v) TSRMG(genders_globals_id, zend_genders_globals *, v)
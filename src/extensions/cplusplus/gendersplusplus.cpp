@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <gendersplusplus.hpp>
+#include <gendersplusplus_db.hpp>
 
 using namespace std;
 using namespace Gendersplusplus;
@@ -99,8 +100,25 @@ void Genders::_throw_exception(int errnum) const
     }
 }
 
+/*
+ * Genders::Table
+ *
+ * The database as read by GendersDB, used by the const functions.  It
+ * is only written while the object is constructed, so any number of
+ * threads may read it.  GendersDB locks the handle for queries and
+ * copies, because every libgenders call sets its errnum and may expand
+ * rules or substitute values into its buffers.
+ */
+struct Genders::Table : public GendersDB
+{
+  explicit Table(genders_t gh) : GendersDB(gh) {}
+  genders_t copy_handle() const { return _copy_handle(); }
+};
+
 void Genders::_constructor(const string filename)
 {
+  genders_t gh;
+
   if (!(gh = genders_handle_create()))
     _throw_exception(GENDERS_ERR_OUTMEM);
   
@@ -110,6 +128,8 @@ void Genders::_constructor(const string filename)
       genders_handle_destroy(gh);
       _throw_exception(errnum);
     }
+
+  table = new Table(gh);
 }
 
 Genders::Genders()
@@ -124,17 +144,16 @@ Genders::Genders(const string filename)
 
 Genders::Genders(const Genders &copy)
 {
-  if (!(gh = genders_copy(copy.gh)))
-    _throw_exception(genders_errnum(copy.gh));
+  table = new Table(copy.table->copy_handle());
 }
 
 const Genders &Genders::operator=(const Genders &right)
 {
   if (&right != this)
     {
-      genders_handle_destroy(this->gh);
-      if (!(this->gh = genders_copy(right.gh)))
-	_throw_exception(genders_errnum(right.gh));
+      Table *t = new Table(right.table->copy_handle());
+      delete this->table;
+      this->table = t;
     }
 
   return *this;
@@ -142,288 +161,132 @@ const Genders &Genders::operator=(const Genders &right)
 
 Genders::~Genders()
 {
-  (void)genders_handle_destroy(gh);
+  delete table;
 }
 
 unsigned int Genders::getnumnodes() const
 {
-  int rv;
-
-  if ((rv = genders_getnumnodes(gh)) < 0)
-    _throw_exception(genders_errnum(gh));
-
-  return rv;
+  return table->getnumnodes();
 }
 
 unsigned int Genders::getnumattrs() const
 {
-  int rv;
-
-  if ((rv = genders_getnumattrs(gh)) < 0)
-    _throw_exception(genders_errnum(gh));
-
-  return rv;
+  return table->getnumattrs();
 }
 
 unsigned int Genders::getmaxattrs() const
 {
-  int rv;
-
-  if ((rv = genders_getmaxattrs(gh)) < 0)
-    _throw_exception(genders_errnum(gh));
-
-  return rv;
+  return table->getmaxattrs();
 }
 
 string Genders::getnodename() const
 {
-  string rv;
-  char *buf = NULL;
-  int maxnodelen;
-
-  if ((maxnodelen = genders_getmaxnodelen(gh)) < 0)
-    _throw_exception(genders_errnum(gh));
-
-  if (!(buf = (char *)malloc(maxnodelen + 1)))
-    _throw_exception(genders_errnum(gh));
-
-  if (genders_getnodename(gh, buf, maxnodelen + 1) < 0)
-    {
-      free(buf);
-      _throw_exception(genders_errnum(gh));
-    }
-
-  rv = buf;
-  free(buf);
-  return rv;
+  return string(table->getnodename());
 }
 
 vector< string > Genders::getnodes(const string attr, const string val) const
 {
   vector<string> rv;
-  char **nodelist = NULL;
-  int nodelist_len;
-  int nodelist_count;
-
-  if ((nodelist_len = genders_nodelist_create(gh, &nodelist)) < 0)
-    _throw_exception(genders_errnum(gh));
-
-  if ((nodelist_count = genders_getnodes(gh,
-					 nodelist,
-					 nodelist_len,
-					 attr.c_str(),
-					 val.c_str())) < 0)
+
+  if (attr.empty())
     {
-      int errnum = genders_errnum(gh);
-      genders_nodelist_destroy(gh, nodelist);
-      _throw_exception(errnum);
+      for (string_view node : table->nodes())
+	rv.push_back(string(node));
+      return rv;
     }
-  
-  for (int i = 0; i < nodelist_count; i++)
-    rv.push_back(nodelist[i]);
-  
-  genders_nodelist_destroy(gh, nodelist);
+
+  for (string_view node : table->getnodes(attr, val))
+    rv.push_back(string(node));
+
   return rv;
 }
 
 vector< pair< string, string > > Genders::getattr(const std::string node) const
 {
   vector< pair< string, string> > rv;
-  char **attrlist = NULL;
-  int attrlist_len;
-  char **vallist = NULL;
-  int vallist_len;
-  int list_count;
 
-  if ((attrlist_len = genders_attrlist_create(gh, &attrlist)) < 0)
-    _throw_exception(genders_errnum(gh));
-
-  if ((vallist_len = genders_vallist_create(gh, &vallist)) < 0)
-    {
-      int errnum = genders_errnum(gh);
-      genders_attrlist_destroy(gh, attrlist);
-      _throw_exception(errnum);
-    }
-
-  if ((list_count = genders_getattr(gh,
-				    attrlist,
-				    vallist,
-				    attrlist_len,
-				    node.c_str())) < 0)
-    {
-      int errnum = genders_errnum(gh);
-      genders_attrlist_destroy(gh, attrlist);
-      genders_vallist_destroy(gh, vallist);
-      _throw_exception(errnum);
-    }
+  if (!table->isnode(node))
+    _throw_exception(GENDERS_ERR_NOTFOUND);
 
-  for (int i = 0; i < list_count; i++)
-    rv.push_back(pair<string, string>(attrlist[i], vallist[i]));
+  for (GendersDB::attrval_t av : table->getattr(node))
+    rv.push_back(pair<string, string>(string(av.first), string(av.second)));
 
-  genders_attrlist_destroy(gh, attrlist);
-  genders_vallist_destroy(gh, vallist);
   return rv;
 }
 
 vector< string > Genders::getattr_all() const
 {
   vector<string> rv;
-  char **attrlist = NULL;
-  int attrlist_len;
-  int attrlist_count;
 
-  if ((attrlist_len = genders_attrlist_create(gh, &attrlist)) < 0)
-    _throw_exception(genders_errnum(gh));
+  for (string_view attr : table->getattr_all())
+    rv.push_back(string(attr));
 
-  if ((attrlist_count = genders_getattr_all(gh,
-					    attrlist,
-					    attrlist_len)) < 0)
-    {
-      int errnum = genders_errnum(gh);
-      genders_attrlist_destroy(gh, attrlist);
-      _throw_exception(errnum);
-    }
-  
-  for (int i = 0; i < attrlist_count; i++)
-    rv.push_back(attrlist[i]);
-
-  genders_attrlist_destroy(gh, attrlist);
   return rv;
 }
 
 bool Genders::testattr(const string attr, string &val, const string node) const
 {
-  char *valbuf = NULL;
-  int maxvallen;
-  int ret;
-  bool rv = false;
-  
-  if ((maxvallen = genders_getmaxvallen(gh)) < 0)
-    _throw_exception(genders_errnum(gh));
-  
-  if (!(valbuf = (char *)malloc(maxvallen + 1)))
-    _throw_exception(genders_errnum(gh));
+  optional< string_view > v;
 
-  memset(valbuf, '\0', maxvallen + 1);
+  if (attr.empty())
+    _throw_exception(GENDERS_ERR_PARAMETERS);
 
-  if ((ret = genders_testattr(gh,
-			      node.c_str(),
-			      attr.c_str(),
-			      valbuf,
-			      maxvallen + 1)) < 0)
-    {
-      free(valbuf);
-      _throw_exception(genders_errnum(gh));
-    }
+  if (!table->isnode(node))
+    _throw_exception(GENDERS_ERR_NOTFOUND);
 
-  if (ret)
+  if (!(v = table->getattrval(attr, node)))
     {
-      rv = true;
-      val = valbuf;
+      val = "";
+      return false;
     }
-  else
-    val = "";
 
-  free(valbuf);
-  return rv;
+  val = string(*v);
+  return true;
 }
 
 bool Genders::testattrval(const string attr, const string val, const string node) const
 {
-  bool rv = false;
-  int ret;
+  if (attr.empty())
+    _throw_exception(GENDERS_ERR_PARAMETERS);
 
-  if ((ret = genders_testattrval(gh,
-				 node.c_str(),
-				 attr.c_str(),
-				 val.c_str())) < 0)
-    _throw_exception(genders_errnum(gh));
-  
-  if (ret)
-    rv = true;
+  if (!table->isnode(node))
+    _throw_exception(GENDERS_ERR_NOTFOUND);
 
-  return rv;
+  return table->testattrval(attr, val, node);
 }
 
 bool Genders::isnode(const string node) const
 {
-  bool rv = false;
-  int ret;
-
-  if ((ret = genders_isnode(gh, node.c_str())) < 0)
-    _throw_exception(genders_errnum(gh));
-
-  if (ret)
-    rv = true;
-
-  return rv;
+  return table->isnode(node);
 }
 
 bool Genders::isattr(const string attr) const
 {
-  bool rv = false;
-  int ret;
-
-  if ((ret = genders_isattr(gh, attr.c_str())) < 0)
-    _throw_exception(genders_errnum(gh));
-
-  if (ret)
-    rv = true;
+  if (attr.empty())
+    _throw_exception(GENDERS_ERR_PARAMETERS);
 
-  return rv;
+  return table->isattr(attr);
 }
 
 bool Genders::isattrval(const string attr, const string val) const
 {
-  bool rv = false;
-  int ret;
-
-  if ((ret = genders_isattrval(gh, attr.c_str(), val.c_str())) < 0)
-    _throw_exception(genders_errnum(gh));
+  if (attr.empty() || val.empty())
+    _throw_exception(GENDERS_ERR_PARAMETERS);
 
-  if (ret)
-    rv = true;
-
-  return rv;
+  return table->isattrval(attr, val);
 }
 
 vector< string > Genders::query(const string query) const
 {
   vector<string> rv;
-  char **nodelist = NULL;
-  int nodelist_len;
-  int nodelist_count;
 
-  if ((nodelist_len = genders_nodelist_create(gh, &nodelist)) < 0)
-    _throw_exception(genders_errnum(gh));
+  for (string_view node : table->query(query))
+    rv.push_back(string(node));
 
-  if ((nodelist_count = genders_query(gh,
-				      nodelist,
-				      nodelist_len,
-				      query.c_str())) < 0)
-    {
-      int errnum = genders_errnum(gh);
-      genders_nodelist_destroy(gh, nodelist);
-      _throw_exception(errnum);
-    }
-  
-  for (int i = 0; i < nodelist_count; i++)
-    rv.push_back(nodelist[i]);
-  
-  genders_nodelist_destroy(gh, nodelist);
   return rv;
 }
 
 bool Genders::testquery(const std::string query, const std::string node)
 {
-  bool rv = false;
-  int ret;
-
-  if ((ret = genders_testquery(gh, node.c_str(), query.c_str())) < 0)
-    _throw_exception(genders_errnum(gh));
-
-  if (ret)
-    rv = true;
-
-  return rv;
+  return table->testquery(query, node);
 }
@@ -106,6 +106,9 @@ public:
  * - Use of STL instead of genders specific data structures
  * - Functions may take empty strings instead of NULL pointers for
  *   defaults.
+ * - Const functions may be called concurrently on the same object.
+ *   They read a copy of the database taken when it was loaded,
+ *   except query(), which serializes on the library's query parser.
  *
  */
 class Genders
@@ -133,7 +136,8 @@ public:
 private:
   void _constructor(const std::string filename);
   void _throw_exception(int errnum) const;
-  genders_t gh;
+  struct Table;
+  Table *table;
 };
 
 } // Gendersplusplus
@@ -0,0 +1,172 @@
+/*****************************************************************************\
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+/*
+ * Compare lookups through the Genders class against GendersDB.
+ *
+ * Usage: gendersplusplus_bench <genders file> [iterations [maxthreads]]
+ *
+ * Build with "make gendersplusplus_bench".  Each lookup is run on
+ * every node of the database, iterations times.  Last, testattr() is
+ * run from 1, 2, 4, ... threads sharing one Genders object, up to
+ * maxthreads, by default the number of CPUs.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gendersplusplus.hpp"
+#include "gendersplusplus_db.hpp"
+
+using namespace std;
+using namespace Gendersplusplus;
+
+static size_t sink;
+
+template< typename F >
+static void
+bench(const char *name, size_t ops, F f)
+{
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  f();
+  chrono::duration< double, nano > d = chrono::steady_clock::now() - start;
+  cout << name << ": " << d.count() / ops << " ns/op" << endl;
+}
+
+static void
+bench_threads(const Genders &g,
+              const vector< string > &nodes,
+              const string &attr,
+              int iterations,
+              unsigned int maxthreads)
+{
+  for (unsigned int nthreads = 1; nthreads <= maxthreads; nthreads *= 2)
+    {
+      vector< thread > threads;
+      vector< size_t > found(nthreads);
+      chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+      for (unsigned int t = 0; t < nthreads; t++)
+        threads.push_back(thread([&, t]() {
+            string val;
+            for (int i = 0; i < iterations; i++)
+              for (const string &n : nodes)
+                found[t] += g.testattr(attr, val, n);
+          }));
+      for (thread &t : threads)
+        t.join();
+
+      chrono::duration< double > d = chrono::steady_clock::now() - start;
+      double ops = (double)nodes.size() * iterations * nthreads;
+      cout << "Genders::testattr, " << nthreads << " threads: "
+           << ops / d.count() / 1e6 << " Mops/s" << endl;
+      for (size_t f : found)
+        sink += f;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+  if (argc < 2)
+    {
+      cerr << "Usage: " << argv[0] << " <genders file> [iterations [maxthreads]]" << endl;
+      exit(1);
+    }
+
+  string file = argv[1];
+  int iterations = argc > 2 ? atoi(argv[2]) : 10;
+  unsigned int maxthreads = argc > 3 ? atoi(argv[3]) : thread::hardware_concurrency();
+
+  try
+    {
+      Genders g(file);
+      GendersDB db(file);
+      vector< string > nodes = g.getnodes();
+      vector< string > attrs = g.getattr_all();
+      string attr = attrs.empty() ? "" : attrs[0];
+      size_t ops = nodes.size() * iterations;
+
+      cout << nodes.size() << " nodes, " << attrs.size() << " attrs, "
+           << iterations << " iterations" << endl;
+
+      bench("Genders::getattr", ops, [&]() {
+          for (int i = 0; i < iterations; i++)
+            for (const string &n : nodes)
+              sink += g.getattr(n).size();
+        });
+      bench("GendersDB::getattr", ops, [&]() {
+          for (int i = 0; i < iterations; i++)
+            for (const string &n : nodes)
+              sink += db.getattr(n).size();
+        });
+
+      bench("Genders::testattr", ops, [&]() {
+          string val;
+          for (int i = 0; i < iterations; i++)
+            for (const string &n : nodes)
+              sink += g.testattr(attr, val, n);
+        });
+      bench("GendersDB::getattrval", ops, [&]() {
+          for (int i = 0; i < iterations; i++)
+            for (const string &n : nodes)
+              sink += db.getattrval(attr, n).has_value();
+        });
+
+      bench("Genders::isnode", ops, [&]() {
+          for (int i = 0; i < iterations; i++)
+            for (const string &n : nodes)
+              sink += g.isnode(n);
+        });
+      bench("GendersDB::isnode", ops, [&]() {
+          for (int i = 0; i < iterations; i++)
+            for (const string &n : nodes)
+              sink += db.isnode(n);
+        });
+
+      /* one call lists every node, report per node listed */
+      bench("Genders::getnodes", ops, [&]() {
+          for (int i = 0; i < iterations; i++)
+            sink += g.getnodes(attr).size();
+        });
+      bench("GendersDB::getnodes", ops, [&]() {
+          for (int i = 0; i < iterations; i++)
+            for (string_view n : db.getnodes(attr))
+              sink += n.size();
+        });
+
+      bench_threads(g, nodes, attr, iterations, max(maxthreads, 1u));
+    }
+  catch (GendersException &e)
+    {
+      cerr << argv[0] << ": " << e.errormsg() << endl;
+      exit(1);
+    }
+
+  return sink == 0;
+}
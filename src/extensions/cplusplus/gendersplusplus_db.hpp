@@ -0,0 +1,724 @@
+/*****************************************************************************\
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+#ifndef _GENDERSPLUSPLUS_DB_HPP
+#define _GENDERSPLUSPLUS_DB_HPP
+
+#if __cplusplus < 201703L
+#error "gendersplusplus_db.hpp requires C++17"
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <gendersplusplus.hpp>
+
+namespace Gendersplusplus
+{
+
+/*
+ * GendersDB
+ *
+ * C++17 interface to a genders database.  It is header only, so it
+ * does not depend on the standard the library was built with.
+ * Differences from the Genders class:
+ *
+ * - Arguments are std::string_view, an empty view selects the default
+ *   (the default genders file or the local node).
+ * - The database is read into an immutable table when constructed.
+ *   Lookups return std::string_view and ranges that point into it,
+ *   and do not allocate.  Views and ranges stay valid as long as the
+ *   GendersDB they came from, including after it is moved: they
+ *   point into its heap allocated tables, never at the object.
+ * - A GendersDB is movable but not copyable.
+ * - Const functions may be called from several threads at once.
+ *   query() and testquery() use the handle, whose error number is
+ *   per handle, so they take a lock of the GendersDB's own.  The
+ *   query itself is serialized by libgenders.
+ * - Only loading, and query() and testquery() on an invalid query,
+ *   throw.  Lookups of unknown nodes or attributes return empty
+ *   results.
+ */
+class GendersDB
+{
+public:
+  typedef std::pair< std::string_view, std::string_view > attrval_t;
+
+private:
+  struct str_t
+  {
+    uint32_t off;
+    uint32_t len;
+  };
+
+  struct pair_t
+  {
+    uint32_t id;
+    str_t val;
+  };
+
+  static std::string_view _view(const char *strings, str_t s)
+  {
+    return std::string_view(strings + s.off, s.len);
+  }
+
+public:
+  /*
+   * NodeRange
+   *
+   * Nodes having an attribute, and optionally a value.
+   */
+  class NodeRange
+  {
+  public:
+    class iterator
+    {
+    public:
+      iterator(const char *strings,
+               const str_t *nodenames,
+               const pair_t *p,
+               const pair_t *end,
+               std::string_view val)
+        : _strings(strings), _nodenames(nodenames), _p(p), _end(end), _val(val) { _skip(); }
+      std::string_view operator*() const { return _view(_strings, _nodenames[_p->id]); }
+      iterator &operator++() { ++_p; _skip(); return *this; }
+      bool operator==(const iterator &o) const { return _p == o._p; }
+      bool operator!=(const iterator &o) const { return _p != o._p; }
+    private:
+      void _skip()
+      {
+        if (_val.empty())
+          return;
+        while (_p != _end && _view(_strings, _p->val) != _val)
+          ++_p;
+      }
+      const char *_strings;
+      const str_t *_nodenames;
+      const pair_t *_p;
+      const pair_t *_end;
+      std::string_view _val;
+    };
+
+    NodeRange(const char *strings,
+              const str_t *nodenames,
+              const pair_t *begin,
+              const pair_t *end,
+              std::string_view val)
+      : _strings(strings), _nodenames(nodenames), _begin(begin), _end(end), _val(val) {}
+    iterator begin() const { return iterator(_strings, _nodenames, _begin, _end, _val); }
+    iterator end() const { return iterator(_strings, _nodenames, _end, _end, _val); }
+    bool empty() const { return begin() == end(); }
+  private:
+    const char *_strings;
+    const str_t *_nodenames;
+    const pair_t *_begin;
+    const pair_t *_end;
+    std::string_view _val;
+  };
+
+  /*
+   * AttrvalRange
+   *
+   * Attributes and values of a node.  Attributes without a value have
+   * an empty value.
+   */
+  class AttrvalRange
+  {
+  public:
+    class iterator
+    {
+    public:
+      iterator(const char *strings, const str_t *attrnames, const pair_t *p)
+        : _strings(strings), _attrnames(attrnames), _p(p) {}
+      attrval_t operator*() const
+      {
+        return attrval_t(_view(_strings, _attrnames[_p->id]), _view(_strings, _p->val));
+      }
+      iterator &operator++() { ++_p; return *this; }
+      bool operator==(const iterator &o) const { return _p == o._p; }
+      bool operator!=(const iterator &o) const { return _p != o._p; }
+    private:
+      const char *_strings;
+      const str_t *_attrnames;
+      const pair_t *_p;
+    };
+
+    AttrvalRange(const char *strings,
+                 const str_t *attrnames,
+                 const pair_t *begin,
+                 const pair_t *end)
+      : _strings(strings), _attrnames(attrnames), _begin(begin), _end(end) {}
+    iterator begin() const { return iterator(_strings, _attrnames, _begin); }
+    iterator end() const { return iterator(_strings, _attrnames, _end); }
+    size_t size() const { return _end - _begin; }
+    bool empty() const { return _begin == _end; }
+  private:
+    const char *_strings;
+    const str_t *_attrnames;
+    const pair_t *_begin;
+    const pair_t *_end;
+  };
+
+  /*
+   * NameRange
+   *
+   * All nodes or all attributes.
+   */
+  class NameRange
+  {
+  public:
+    class iterator
+    {
+    public:
+      iterator(const char *strings, const str_t *p) : _strings(strings), _p(p) {}
+      std::string_view operator*() const
+      {
+        return std::string_view(_strings + _p->off, _p->len);
+      }
+      iterator &operator++() { ++_p; return *this; }
+      bool operator==(const iterator &o) const { return _p == o._p; }
+      bool operator!=(const iterator &o) const { return _p != o._p; }
+    private:
+      const char *_strings;
+      const str_t *_p;
+    };
+
+    NameRange(const char *strings, const str_t *begin, const str_t *end)
+      : _strings(strings), _begin(begin), _end(end) {}
+    iterator begin() const { return iterator(_strings, _begin); }
+    iterator end() const { return iterator(_strings, _end); }
+    size_t size() const { return _end - _begin; }
+    std::string_view operator[](size_t i) const
+    {
+      return std::string_view(_strings + _begin[i].off, _begin[i].len);
+    }
+  private:
+    const char *_strings;
+    const str_t *_begin;
+    const str_t *_end;
+  };
+
+  explicit GendersDB(std::string_view filename = std::string_view())
+    : GendersDB(_open(filename))
+  {
+  }
+
+  GendersDB(const GendersDB &) = delete;
+  GendersDB &operator=(const GendersDB &) = delete;
+
+  GendersDB(GendersDB &&other) noexcept
+    : _gh(other._gh),
+      _lock(std::move(other._lock)),
+      _strings(std::move(other._strings)),
+      _nodenames(std::move(other._nodenames)),
+      _attrnames(std::move(other._attrnames)),
+      _nodes(std::move(other._nodes)),
+      _node_pairs(std::move(other._node_pairs)),
+      _attrs(std::move(other._attrs)),
+      _attr_pairs(std::move(other._attr_pairs)),
+      _node_index(std::move(other._node_index)),
+      _attr_index(std::move(other._attr_index)),
+      _nodename(other._nodename),
+      _local(other._local),
+      _maxattrs(other._maxattrs),
+      _maxnodelen(other._maxnodelen)
+  {
+    other._gh = NULL;
+  }
+
+  GendersDB &operator=(GendersDB &&other) noexcept
+  {
+    if (&other != this)
+      {
+        genders_handle_destroy(_gh);
+        _gh = other._gh;
+        other._gh = NULL;
+        _lock = std::move(other._lock);
+        _strings = std::move(other._strings);
+        _nodenames = std::move(other._nodenames);
+        _attrnames = std::move(other._attrnames);
+        _nodes = std::move(other._nodes);
+        _node_pairs = std::move(other._node_pairs);
+        _attrs = std::move(other._attrs);
+        _attr_pairs = std::move(other._attr_pairs);
+        _node_index = std::move(other._node_index);
+        _attr_index = std::move(other._attr_index);
+        _nodename = other._nodename;
+        _local = other._local;
+        _maxattrs = other._maxattrs;
+        _maxnodelen = other._maxnodelen;
+      }
+    return *this;
+  }
+
+  ~GendersDB()
+  {
+    if (_gh)
+      genders_handle_destroy(_gh);
+  }
+
+  size_t getnumnodes() const noexcept { return _nodenames.size(); }
+  size_t getnumattrs() const noexcept { return _attrnames.size(); }
+  size_t getmaxattrs() const noexcept { return _maxattrs; }
+
+  /* the local node's shortened hostname */
+  std::string_view getnodename() const noexcept { return _str(_nodename); }
+
+  NameRange nodes() const noexcept
+  {
+    return NameRange(_strings.get(), _nodenames.data(), _nodenames.data() + _nodenames.size());
+  }
+
+  NameRange getattr_all() const noexcept
+  {
+    return NameRange(_strings.get(), _attrnames.data(), _attrnames.data() + _attrnames.size());
+  }
+
+  NodeRange getnodes(std::string_view attr, std::string_view val = std::string_view()) const
+  {
+    uint32_t id;
+
+    if (!_find(_attr_index, attr, id))
+      return NodeRange(_strings.get(), _nodenames.data(), NULL, NULL, val);
+
+    return NodeRange(_strings.get(),
+                     _nodenames.data(),
+                     _attr_pairs.data() + _attrs[id],
+                     _attr_pairs.data() + _attrs[id + 1],
+                     val);
+  }
+
+  AttrvalRange getattr(std::string_view node = std::string_view()) const
+  {
+    uint32_t id;
+
+    if (!_find_node(node, id))
+      return AttrvalRange(_strings.get(), _attrnames.data(), NULL, NULL);
+
+    return AttrvalRange(_strings.get(),
+                        _attrnames.data(),
+                        _node_pairs.data() + _nodes[id],
+                        _node_pairs.data() + _nodes[id + 1]);
+  }
+
+  /*
+   * Returns the value of attr on node, an empty view if attr has no
+   * value, or no value if node does not have attr.
+   */
+  std::optional< std::string_view > getattrval(std::string_view attr,
+                                               std::string_view node = std::string_view()) const
+  {
+    const pair_t *p;
+
+    if (!(p = _find_pair(attr, node)))
+      return std::nullopt;
+
+    return _str(p->val);
+  }
+
+  bool testattr(std::string_view attr, std::string_view node = std::string_view()) const
+  {
+    return _find_pair(attr, node) != NULL;
+  }
+
+  bool testattrval(std::string_view attr,
+                   std::string_view val,
+                   std::string_view node = std::string_view()) const
+  {
+    const pair_t *p;
+
+    if (!(p = _find_pair(attr, node)))
+      return false;
+
+    return val.empty() || _str(p->val) == val;
+  }
+
+  bool isnode(std::string_view node = std::string_view()) const
+  {
+    uint32_t id;
+
+    return _find_node(node, id);
+  }
+
+  bool isattr(std::string_view attr) const
+  {
+    uint32_t id;
+
+    return _find(_attr_index, attr, id);
+  }
+
+  bool isattrval(std::string_view attr, std::string_view val) const
+  {
+    return !getnodes(attr, val).empty();
+  }
+
+  /*
+   * Returns the nodes matching query, all nodes if query is empty.
+   * Throws GendersExceptionSyntax if the query is invalid.
+   */
+  std::vector< std::string_view > query(std::string_view query = std::string_view()) const
+  {
+    std::vector< std::string_view > rv;
+    std::string q(query);
+    int count;
+    uint32_t id;
+
+    if (q.empty())
+      {
+        rv.reserve(_nodenames.size());
+        for (size_t i = 0; i < _nodenames.size(); i++)
+          rv.push_back(_node(i));
+        return rv;
+      }
+
+    /* the node buffers are not taken from genders_nodelist_create(),
+     * so the handle is only used for the query itself
+     */
+    std::vector< char > buf(_nodenames.size() * (_maxnodelen + 1));
+    std::vector< char * > nodelist(_nodenames.size());
+    for (size_t i = 0; i < nodelist.size(); i++)
+      nodelist[i] = buf.data() + i * (_maxnodelen + 1);
+
+    {
+      std::lock_guard< std::mutex > lock(*_lock);
+
+      if ((count = genders_query(_gh, nodelist.data(), nodelist.size(), q.c_str())) < 0)
+        _throw_exception(genders_errnum(_gh));
+    }
+
+    rv.reserve(count);
+    for (int i = 0; i < count; i++)
+      {
+        if (_find(_node_index, nodelist[i], id))
+          rv.push_back(_node(id));
+      }
+
+    return rv;
+  }
+
+  bool testquery(std::string_view query, std::string_view node = std::string_view()) const
+  {
+    std::string q(query);
+    int ret;
+
+    std::string n(node.empty() ? getnodename() : node);
+    std::lock_guard< std::mutex > lock(*_lock);
+
+    if ((ret = genders_testquery(_gh, n.c_str(), q.c_str())) < 0)
+      _throw_exception(genders_errnum(_gh));
+
+    return ret;
+  }
+
+protected:
+  /*
+   * Takes over gh, a handle a database was loaded into.  gh is
+   * destroyed if reading the table throws.
+   */
+  explicit GendersDB(genders_t gh) : _gh(gh)
+  {
+    try
+      {
+        _load();
+      }
+    catch (...)
+      {
+        genders_handle_destroy(_gh);
+        throw;
+      }
+  }
+
+  /*
+   * Returns a copy of the handle, for a GendersDB of the same
+   * database.
+   */
+  genders_t _copy_handle() const
+  {
+    std::lock_guard< std::mutex > lock(*_lock);
+    genders_t gh;
+
+    if (!(gh = genders_copy(_gh)))
+      _throw_exception(genders_errnum(_gh));
+    return gh;
+  }
+
+  static void _throw_exception(int errnum)
+  {
+    switch (errnum)
+      {
+      case GENDERS_ERR_OPEN:
+        throw GendersExceptionOpen();
+      case GENDERS_ERR_READ:
+        throw GendersExceptionRead();
+      case GENDERS_ERR_PARSE:
+        throw GendersExceptionParse();
+      case GENDERS_ERR_NOTFOUND:
+        throw GendersExceptionNotfound();
+      case GENDERS_ERR_SYNTAX:
+        throw GendersExceptionSyntax();
+      case GENDERS_ERR_OUTMEM:
+        throw std::bad_alloc();
+      default:
+        throw GendersExceptionInternal();
+      }
+  }
+
+private:
+  static genders_t _open(std::string_view filename)
+  {
+    std::string file(filename);
+    genders_t gh;
+
+    if (!(gh = genders_handle_create()))
+      throw std::bad_alloc();
+
+    if (genders_load_data(gh, file.empty() ? NULL : file.c_str()) < 0)
+      {
+        int errnum = genders_errnum(gh);
+        genders_handle_destroy(gh);
+        _throw_exception(errnum);
+      }
+    return gh;
+  }
+
+  std::string_view _str(str_t s) const { return _view(_strings.get(), s); }
+
+  std::string_view _node(uint32_t id) const { return _str(_nodenames[id]); }
+
+  static bool _find(const std::unordered_map< std::string_view, uint32_t > &index,
+                    std::string_view key,
+                    uint32_t &id)
+  {
+    std::unordered_map< std::string_view, uint32_t >::const_iterator it;
+
+    if ((it = index.find(key)) == index.end())
+      return false;
+    id = it->second;
+    return true;
+  }
+
+  bool _find_node(std::string_view node, uint32_t &id) const
+  {
+    if (node.empty())
+      {
+        id = _local;
+        return _local != UINT32_MAX;
+      }
+    return _find(_node_index, node, id);
+  }
+
+  const pair_t *_find_pair(std::string_view attr, std::string_view node) const
+  {
+    uint32_t nodeid, attrid;
+    const pair_t *p, *end;
+
+    if (!_find_node(node, nodeid) || !_find(_attr_index, attr, attrid))
+      return NULL;
+
+    /* a node has at most maxattrs attributes, a scan is cheapest */
+    end = _node_pairs.data() + _nodes[nodeid + 1];
+    for (p = _node_pairs.data() + _nodes[nodeid]; p != end; p++)
+      {
+        if (p->id == attrid)
+          return p;
+      }
+    return NULL;
+  }
+
+  /*
+   * _load
+   *
+   * Read every node's attributes and values out of the handle.  The
+   * strings are interned into one block, so the tables hold offsets
+   * into it and moving the object leaves views valid.
+   */
+  void _load()
+  {
+    std::string strings;
+    std::unordered_map< std::string, str_t > interned;
+    char **nodelist = NULL, **attrlist = NULL, **vallist = NULL;
+    int nodelen, attrlen, numnodes, numattrs;
+    std::string nodename;
+
+    auto intern = [&](const char *s) -> str_t {
+      std::unordered_map< std::string, str_t >::iterator it;
+      str_t str;
+
+      if ((it = interned.find(s)) != interned.end())
+        return it->second;
+      str.off = strings.size();
+      str.len = strlen(s);
+      strings.append(s, str.len + 1);
+      interned.emplace(s, str);
+      return str;
+    };
+
+    auto cleanup = [&]() {
+      genders_nodelist_destroy(_gh, nodelist);
+      genders_attrlist_destroy(_gh, attrlist);
+      genders_vallist_destroy(_gh, vallist);
+    };
+
+    try
+      {
+        if ((nodelen = genders_nodelist_create(_gh, &nodelist)) < 0
+            || (attrlen = genders_attrlist_create(_gh, &attrlist)) < 0
+            || genders_vallist_create(_gh, &vallist) < 0
+            || (numattrs = genders_getattr_all(_gh, attrlist, attrlen)) < 0
+            || (_maxattrs = genders_getmaxattrs(_gh)) < 0
+            || (_maxnodelen = genders_getmaxnodelen(_gh)) < 0)
+          _throw_exception(genders_errnum(_gh));
+
+        std::unordered_map< std::string, uint32_t > attrids;
+        for (int i = 0; i < numattrs; i++)
+          {
+            _attrnames.push_back(intern(attrlist[i]));
+            attrids.emplace(attrlist[i], i);
+          }
+
+        if ((numnodes = genders_getnodes(_gh, nodelist, nodelen, NULL, NULL)) < 0)
+          _throw_exception(genders_errnum(_gh));
+
+        std::unordered_map< std::string, uint32_t > nodeids;
+        _nodes.reserve(numnodes + 1);
+        for (int i = 0; i < numnodes; i++)
+          {
+            int count;
+
+            _nodenames.push_back(intern(nodelist[i]));
+            nodeids.emplace(nodelist[i], i);
+            _nodes.push_back(_node_pairs.size());
+
+            if (genders_vallist_clear(_gh, vallist) < 0
+                || (count = genders_getattr(_gh, attrlist, vallist, attrlen, nodelist[i])) < 0)
+              _throw_exception(genders_errnum(_gh));
+
+            for (int j = 0; j < count; j++)
+              {
+                pair_t p;
+
+                p.id = attrids[attrlist[j]];
+                p.val = intern(vallist[j]);
+                _node_pairs.push_back(p);
+              }
+          }
+        _nodes.push_back(_node_pairs.size());
+
+        /* nodes of each attribute, in the order libgenders lists
+         * them, which need not be node order
+         */
+        _attrs.reserve(numattrs + 1);
+        _attr_pairs.reserve(_node_pairs.size());
+        for (int i = 0; i < numattrs; i++)
+          {
+            int count;
+
+            _attrs.push_back(_attr_pairs.size());
+
+            if ((count = genders_getnodes(_gh,
+                                          nodelist,
+                                          nodelen,
+                                          strings.c_str() + _attrnames[i].off,
+                                          NULL)) < 0)
+              _throw_exception(genders_errnum(_gh));
+
+            for (int j = 0; j < count; j++)
+              {
+                pair_t p;
+
+                p.id = nodeids[nodelist[j]];
+                for (uint32_t k = _nodes[p.id]; k < _nodes[p.id + 1]; k++)
+                  {
+                    if (_node_pairs[k].id == (uint32_t)i)
+                      p.val = _node_pairs[k].val;
+                  }
+                _attr_pairs.push_back(p);
+              }
+          }
+        _attrs.push_back(_attr_pairs.size());
+
+        /* the local node need not be in the database */
+        std::vector< char > buf(_NODENAMELEN);
+        while (genders_getnodename(_gh, buf.data(), buf.size()) < 0)
+          {
+            if (genders_errnum(_gh) != GENDERS_ERR_OVERFLOW)
+              _throw_exception(genders_errnum(_gh));
+            buf.resize(buf.size() * 2);
+          }
+        _nodename = intern(buf.data());
+      }
+    catch (...)
+      {
+        cleanup();
+        throw;
+      }
+    cleanup();
+
+    _strings.reset(new char[strings.size() + 1]);
+    memcpy(_strings.get(), strings.data(), strings.size());
+
+    _node_index.reserve(_nodenames.size());
+    for (size_t i = 0; i < _nodenames.size(); i++)
+      _node_index.emplace(_str(_nodenames[i]), i);
+    _attr_index.reserve(_attrnames.size());
+    for (size_t i = 0; i < _attrnames.size(); i++)
+      _attr_index.emplace(_str(_attrnames[i]), i);
+
+    if (!_find(_node_index, _str(_nodename), _local))
+      _local = UINT32_MAX;
+  }
+
+  enum { _NODENAMELEN = 256 };
+
+  genders_t _gh = NULL;
+  /* a pointer, so that a GendersDB can be moved */
+  std::unique_ptr< std::mutex > _lock = std::make_unique< std::mutex >();
+  std::unique_ptr< char[] > _strings;
+  std::vector< str_t > _nodenames;
+  std::vector< str_t > _attrnames;
+  /* pairs of node i are _node_pairs[_nodes[i], _nodes[i + 1]) */
+  std::vector< uint32_t > _nodes;
+  std::vector< pair_t > _node_pairs;
+  /* nodes of attr i are _attr_pairs[_attrs[i], _attrs[i + 1]) */
+  std::vector< uint32_t > _attrs;
+  std::vector< pair_t > _attr_pairs;
+  std::unordered_map< std::string_view, uint32_t > _node_index;
+  std::unordered_map< std::string_view, uint32_t > _attr_index;
+  str_t _nodename = { 0, 0 };
+  uint32_t _local = UINT32_MAX;
+  int _maxattrs = 0;
+  int _maxnodelen = 0;
+};
+
+} // Gendersplusplus
+
+#endif /* _GENDERSPLUSPLUS_DB_HPP */
@@ -0,0 +1,206 @@
+/*****************************************************************************\
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+/*
+ * Check GendersDB lookups against the C library, and that ranges and
+ * views taken from a GendersDB stay valid after it is moved.
+ *
+ * To check for use after free, build with AddressSanitizer:
+ *
+ *   make check CXXFLAGS="-g -O1 -fsanitize=address" LDFLAGS=-fsanitize=address
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gendersplusplus_db.hpp"
+
+using namespace std;
+using namespace Gendersplusplus;
+
+typedef vector< pair< string, string > > attrvals_t;
+
+static int errors;
+
+static void
+check(bool ok, const char *what, const string &arg)
+{
+  if (!ok)
+    {
+      fprintf(stderr, "%s(%s): wrong result\n", what, arg.c_str());
+      errors++;
+    }
+}
+
+static void
+write_database(const char *file)
+{
+  FILE *fp;
+  int i;
+
+  if (!(fp = fopen(file, "w")))
+    {
+      perror(file);
+      exit(1);
+    }
+
+  for (i = 1; i <= 64; i++)
+    fprintf(fp, "node%d compute,rack=r%d,name=%%n-ib\n", i, i / 16);
+  fprintf(fp, "node[1-4] mgmt,role=io\n");
+  fprintf(fp, "login1 role=login\n");
+  fclose(fp);
+}
+
+static vector< string >
+c_getnodes(genders_t gh, const char *attr, const char *val)
+{
+  vector< string > rv;
+  char **nodelist;
+  int len, count;
+
+  len = genders_nodelist_create(gh, &nodelist);
+  count = genders_getnodes(gh, nodelist, len, attr, val);
+  for (int i = 0; i < count; i++)
+    rv.push_back(nodelist[i]);
+  genders_nodelist_destroy(gh, nodelist);
+  return rv;
+}
+
+static attrvals_t
+c_getattr(genders_t gh, const char *node)
+{
+  attrvals_t rv;
+  char **attrlist, **vallist;
+  int len, count;
+
+  len = genders_attrlist_create(gh, &attrlist);
+  genders_vallist_create(gh, &vallist);
+  count = genders_getattr(gh, attrlist, vallist, len, node);
+  for (int i = 0; i < count; i++)
+    rv.push_back(pair< string, string >(attrlist[i], vallist[i]));
+  genders_attrlist_destroy(gh, attrlist);
+  genders_vallist_destroy(gh, vallist);
+  return rv;
+}
+
+static vector< string >
+nodes_of(const GendersDB::NodeRange &r)
+{
+  vector< string > rv;
+
+  for (string_view n : r)
+    rv.push_back(string(n));
+  return rv;
+}
+
+static attrvals_t
+attrvals_of(const GendersDB::AttrvalRange &r)
+{
+  attrvals_t rv;
+
+  for (GendersDB::attrval_t av : r)
+    rv.push_back(pair< string, string >(string(av.first), string(av.second)));
+  return rv;
+}
+
+int
+main(int argc, char **argv)
+{
+  char file[] = "/tmp/gendersplusplus_db_test.XXXXXX";
+  genders_t gh;
+  int fd;
+
+  if ((fd = mkstemp(file)) < 0)
+    {
+      perror("mkstemp");
+      exit(1);
+    }
+  close(fd);
+  write_database(file);
+
+  if (!(gh = genders_handle_create()) || genders_load_data(gh, file) < 0)
+    {
+      fprintf(stderr, "genders: cannot load %s\n", file);
+      exit(1);
+    }
+
+  vector< string > compute = c_getnodes(gh, "compute", NULL);
+  vector< string > io = c_getnodes(gh, "role", "io");
+  attrvals_t node1 = c_getattr(gh, "node1");
+  attrvals_t login1 = c_getattr(gh, "login1");
+
+  try
+    {
+      GendersDB a(file);
+
+      check(nodes_of(a.getnodes("compute")) == compute, "getnodes", "compute");
+      check(nodes_of(a.getnodes("role", "io")) == io, "getnodes", "role=io");
+      check(attrvals_of(a.getattr("node1")) == node1, "getattr", "node1");
+      check(nodes_of(a.getnodes("nosuchattr")).empty(), "getnodes", "nosuchattr");
+
+      /* taken before the moves below, used after them */
+      GendersDB::NodeRange compute_range = a.getnodes("compute");
+      GendersDB::NodeRange io_range = a.getnodes("role", "io");
+      GendersDB::AttrvalRange node1_range = a.getattr("node1");
+      GendersDB::NameRange nodes_range = a.nodes();
+      optional< string_view > name = a.getattrval("name", "node2");
+
+      GendersDB b(std::move(a));
+
+      check(nodes_of(compute_range) == compute, "move getnodes", "compute");
+      check(nodes_of(io_range) == io, "move getnodes", "role=io");
+      check(attrvals_of(node1_range) == node1, "move getattr", "node1");
+      check(nodes_range.size() == b.getnumnodes(), "move nodes", "");
+      check(name && *name == "node2-ib", "move getattrval", "node2");
+
+      GendersDB c(file);
+
+      c = std::move(b);
+
+      check(nodes_of(compute_range) == compute, "move assign getnodes", "compute");
+      check(attrvals_of(node1_range) == node1, "move assign getattr", "node1");
+      check(attrvals_of(c.getattr("login1")) == login1, "move assign getattr", "login1");
+    }
+  catch (GendersException &e)
+    {
+      fprintf(stderr, "%s\n", e.errormsg());
+      errors++;
+    }
+
+  genders_handle_destroy(gh);
+  unlink(file);
+
+  if (errors)
+    {
+      fprintf(stderr, "%d errors\n", errors);
+      exit(1);
+    }
+
+  return 0;
+}
@@ -0,0 +1,270 @@
+/*****************************************************************************\
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+/*
+ * Call the const functions of one Genders object from several threads
+ * and check every result against the C library.
+ *
+ * To check for data races, build with ThreadSanitizer:
+ *
+ *   make check CXXFLAGS="-g -O1 -fsanitize=thread" LDFLAGS=-fsanitize=thread
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "gendersplusplus.hpp"
+
+using namespace std;
+using namespace Gendersplusplus;
+
+#define NUMTHREADS  8
+#define ITERATIONS  20
+
+static const char *queries[] = {
+  "compute",
+  "rack=r1||mgmt",
+  "compute&&~role=io",
+  "~compute",
+  NULL,
+};
+
+static Genders *g;
+static vector< string > nodes;
+static vector< string > attrs;
+
+/* expected results, from the C library */
+static vector< vector< pair< string, string > > > node_attrvals;
+static vector< vector< string > > attr_nodes;
+static vector< vector< string > > query_nodes;
+
+static int errors;
+static pthread_mutex_t errors_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+fail(const char *what, const string &arg)
+{
+  pthread_mutex_lock(&errors_mutex);
+  fprintf(stderr, "%s(%s): wrong result\n", what, arg.c_str());
+  errors++;
+  pthread_mutex_unlock(&errors_mutex);
+}
+
+/*
+ * Nodes are listed out of order for some attributes, and the "name"
+ * values are substituted per node.
+ */
+static void
+write_database(const char *file)
+{
+  FILE *fp;
+  int i;
+
+  if (!(fp = fopen(file, "w")))
+    {
+      perror(file);
+      exit(1);
+    }
+
+  for (i = 1; i <= 256; i++)
+    fprintf(fp, "node%d compute,rack=r%d,name=%%n-ib\n", i, i / 32);
+  fprintf(fp, "node[1-4] mgmt,role=io\n");
+  for (i = 256; i >= 200; i--)
+    fprintf(fp, "node%d role=io\n", i);
+  fprintf(fp, "login1 role=login,name=%%n\n");
+  fclose(fp);
+}
+
+static void
+load_expected(const char *file)
+{
+  genders_t gh;
+  char **nodelist, **attrlist, **vallist;
+  int nodelist_len, attrlist_len;
+  int i, j, count;
+
+  if (!(gh = genders_handle_create())
+      || genders_load_data(gh, file) < 0
+      || (nodelist_len = genders_nodelist_create(gh, &nodelist)) < 0
+      || (attrlist_len = genders_attrlist_create(gh, &attrlist)) < 0
+      || genders_vallist_create(gh, &vallist) < 0)
+    {
+      fprintf(stderr, "genders: cannot load %s\n", file);
+      exit(1);
+    }
+
+  count = genders_getnodes(gh, nodelist, nodelist_len, NULL, NULL);
+  for (i = 0; i < count; i++)
+    nodes.push_back(nodelist[i]);
+
+  count = genders_getattr_all(gh, attrlist, attrlist_len);
+  for (i = 0; i < count; i++)
+    attrs.push_back(attrlist[i]);
+
+  for (i = 0; i < (int)nodes.size(); i++)
+    {
+      vector< pair< string, string > > avs;
+
+      genders_vallist_clear(gh, vallist);
+      count = genders_getattr(gh, attrlist, vallist, attrlist_len, nodes[i].c_str());
+      for (j = 0; j < count; j++)
+        avs.push_back(pair< string, string >(attrlist[j], vallist[j]));
+      node_attrvals.push_back(avs);
+    }
+
+  for (i = 0; i < (int)attrs.size(); i++)
+    {
+      vector< string > l;
+
+      count = genders_getnodes(gh, nodelist, nodelist_len, attrs[i].c_str(), NULL);
+      for (j = 0; j < count; j++)
+        l.push_back(nodelist[j]);
+      attr_nodes.push_back(l);
+    }
+
+  for (i = 0; queries[i]; i++)
+    {
+      vector< string > l;
+
+      count = genders_query(gh, nodelist, nodelist_len, queries[i]);
+      for (j = 0; j < count; j++)
+        l.push_back(nodelist[j]);
+      query_nodes.push_back(l);
+    }
+
+  genders_nodelist_destroy(gh, nodelist);
+  genders_attrlist_destroy(gh, attrlist);
+  genders_vallist_destroy(gh, vallist);
+  genders_handle_destroy(gh);
+}
+
+static void *
+reader(void *arg)
+{
+  int t = *(int *)arg;
+  int i, j, k;
+
+  for (k = 0; k < ITERATIONS; k++)
+    {
+      for (i = 0; i < (int)nodes.size(); i++)
+        {
+          const string &node = nodes[(i + t * 37) % nodes.size()];
+          const vector< pair< string, string > > &avs = node_attrvals[(i + t * 37) % nodes.size()];
+          string val;
+
+          if (!g->isnode(node))
+            fail("isnode", node);
+          if (g->getattr(node) != avs)
+            fail("getattr", node);
+          for (j = 0; j < (int)avs.size(); j++)
+            {
+              if (!g->testattr(avs[j].first, val, node) || val != avs[j].second)
+                fail("testattr", node);
+              if (!g->testattrval(avs[j].first, avs[j].second, node))
+                fail("testattrval", node);
+            }
+          if (g->testattr("nosuchattr", val, node))
+            fail("testattr", node);
+        }
+
+      for (i = 0; i < (int)attrs.size(); i++)
+        {
+          if (g->getnodes(attrs[i]) != attr_nodes[i])
+            fail("getnodes", attrs[i]);
+        }
+
+      for (i = 0; queries[i]; i++)
+        {
+          if (g->query(queries[i]) != query_nodes[i])
+            fail("query", queries[i]);
+        }
+
+      if (g->getnumnodes() != nodes.size()
+          || g->getnumattrs() != attrs.size()
+          || g->getnodes() != nodes
+          || g->getattr_all() != attrs)
+        fail("getnumnodes", "");
+    }
+
+  return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+  char file[] = "/tmp/gendersplusplus_thread_test.XXXXXX";
+  pthread_t threads[NUMTHREADS];
+  int ids[NUMTHREADS];
+  int fd, i;
+
+  if ((fd = mkstemp(file)) < 0)
+    {
+      perror("mkstemp");
+      exit(1);
+    }
+  close(fd);
+
+  write_database(file);
+  load_expected(file);
+
+  try
+    {
+      g = new Genders(file);
+
+      for (i = 0; i < NUMTHREADS; i++)
+        {
+          ids[i] = i;
+          if (pthread_create(&threads[i], NULL, reader, &ids[i]))
+            {
+              perror("pthread_create");
+              exit(1);
+            }
+        }
+
+      for (i = 0; i < NUMTHREADS; i++)
+        pthread_join(threads[i], NULL);
+
+      delete g;
+    }
+  catch (GendersException &e)
+    {
+      fprintf(stderr, "%s\n", e.errormsg());
+      errors++;
+    }
+
+  unlink(file);
+
+  if (errors)
+    {
+      fprintf(stderr, "%d errors\n", errors);
+      exit(1);
+    }
+
+  return 0;
+}
@@ -280,6 +280,22 @@ class GendersTest
 		System.out.println("unexpected exception: " + e);
 	    }
 
+	    try {
+		GendersPacked packed;
+
+		packed = gh.query_nodes_packed("mgmt||login");
+		for (int i = 0; i < packed.size(); i++)
+		    System.out.println("Query packed mgmt||login: " + packed.node(i));
+
+		packed = gh.getattrvals_packed("mgmt");
+		for (int i = 0; i < packed.size(); i++)
+		    System.out.println("Getattrvals packed mgmt: " + packed.node(i)
+				       + " " + packed.attr(i) + "=" + packed.val(i));
+	    }
+	    catch (Exception e) {
+		System.out.println("unexpected exception: " + e);
+	    }
+
 	    try {
 		gh.getattr("foobarnode");
 	    }
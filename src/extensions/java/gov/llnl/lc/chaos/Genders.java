@@ -199,6 +199,32 @@ public class Genders
      */ 
     public native String[] query(String query) throws GendersException;
 
+    private native byte[] query_packed(String query, boolean withattrs) throws GendersException;
+
+    /**
+     * Returns nodes specified via the specified query, like query(),
+     * but packed into a single array that is decoded as nodes are
+     * read.  If the query is null, all nodes are returned.
+     *
+     * @throws GendersException on error
+     */ 
+    public GendersPacked query_nodes_packed(String query) throws GendersException
+    {
+	return new GendersPacked(query_packed(query, false));
+    }
+
+    /**
+     * Returns every (node, attribute, value) triple of the nodes
+     * specified via the specified query in one call.  If the query is
+     * null, the triples of all nodes are returned.
+     *
+     * @throws GendersException on error
+     */ 
+    public GendersPacked getattrvals_packed(String query) throws GendersException
+    {
+	return new GendersPacked(query_packed(query, true));
+    }
+
     /**
      * Test if the current node meets the conditions of the specified query.
      *
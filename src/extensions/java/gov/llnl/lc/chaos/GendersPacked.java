@@ -0,0 +1,112 @@
+/*****************************************************************************\
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+package gov.llnl.lc.chaos;
+
+import java.nio.ByteBuffer;
+import java.nio.charset.Charset;
+
+/**
+ * Results of a bulk genders call, packed into a single byte array by
+ * the native library.  Each row holds one node name, or a node,
+ * attribute, and value triple.  Strings are decoded from the packed
+ * UTF-8 only when first requested.
+ */
+public class GendersPacked
+{
+    private static final Charset UTF8 = Charset.forName("UTF-8");
+    private static final int HEADER_LEN = 8;
+
+    private final ByteBuffer buf;
+    private final int count;
+    private final int width;
+    private final int blob;
+    private final String[] strings;
+
+    GendersPacked(byte[] packed)
+    {
+	buf = ByteBuffer.wrap(packed);
+	count = buf.getInt(0);
+	width = buf.getInt(4);
+	blob = HEADER_LEN + count * width * 4;
+	strings = new String[count * width];
+    }
+
+    private String decode(int index)
+    {
+	int offset = buf.getInt(HEADER_LEN + index * 4);
+	int start, end;
+
+	if (offset < 0)
+	    return null;
+
+	if (strings[index] != null)
+	    return strings[index];
+
+	start = blob + offset;
+	for (end = start; buf.get(end) != 0; end++)
+	    ;
+	strings[index] = new String(buf.array(), start, end - start, UTF8);
+	return strings[index];
+    }
+
+    /**
+     * Returns the number of rows
+     */
+    public int size()
+    {
+	return count;
+    }
+
+    /**
+     * Returns the node of the specified row
+     */
+    public String node(int i)
+    {
+	if (i < 0 || i >= count)
+	    throw new IndexOutOfBoundsException("row " + i);
+	return decode(i * width);
+    }
+
+    /**
+     * Returns the attribute of the specified row, or null if rows
+     * hold only nodes
+     */
+    public String attr(int i)
+    {
+	if (i < 0 || i >= count)
+	    throw new IndexOutOfBoundsException("row " + i);
+	return (width > 1) ? decode(i * width + 1) : null;
+    }
+
+    /**
+     * Returns the value of the specified row, or null if the
+     * attribute has no value or rows hold only nodes
+     */
+    public String val(int i)
+    {
+	if (i < 0 || i >= count)
+	    throw new IndexOutOfBoundsException("row " + i);
+	return (width > 2) ? decode(i * width + 2) : null;
+    }
+}
@@ -9,6 +9,30 @@
 
 #include "Gendersjni.h"
 
+/*
+ * gh_addr_fid
+ *
+ * Field IDs stay valid while the class is loaded, so the handle field
+ * is looked up once rather than on every call.
+ */
+static jfieldID gh_addr_fid = NULL;
+
+static int
+_get_gh_addr_fid (JNIEnv *env, jobject obj)
+{
+  jclass genders_cls;
+
+  if (gh_addr_fid)
+    return (0);
+
+  genders_cls = (*env)->GetObjectClass (env, obj);
+
+  gh_addr_fid = (*env)->GetFieldID (env, genders_cls, "gh_addr", "J");
+
+  (*env)->DeleteLocalRef (env, genders_cls);
+  return (gh_addr_fid ? 0 : -1);
+}
+
 static void
 _throw_exception (JNIEnv *env, jobject obj, int errnum)
 {
@@ -72,8 +96,6 @@ static int
 _constructor (JNIEnv *env, jobject obj, const char *filename)
 {
   genders_t handle;
-  jclass genders_cls = NULL;
-  jfieldID gh_addr_fid;
   jint rv = -1;
 
   if (!(handle = genders_handle_create ()))
@@ -89,9 +111,7 @@ _constructor (JNIEnv *env, jobject obj, const char *filename)
       goto cleanup;
     }
 
-  genders_cls = (*env)->GetObjectClass (env, obj);
-
-  if (!(gh_addr_fid = (*env)->GetFieldID (env, genders_cls, "gh_addr", "J")))
+  if (_get_gh_addr_fid (env, obj) < 0)
     {
       genders_handle_destroy (handle);
       goto cleanup;
@@ -130,14 +150,10 @@ Java_gov_llnl_lc_chaos_Genders_genders_1constructor (JNIEnv *env, jobject obj, j
 static int
 _get_handle (JNIEnv *env, jobject obj, genders_t *handle)
 {
-  jclass genders_cls;
-  jfieldID gh_addr_fid;
   jlong jgh_addr_addr;
   int rv = -1;
 
-  genders_cls = (*env)->GetObjectClass (env, obj);
-
-  if (!(gh_addr_fid = (*env)->GetFieldID (env, genders_cls, "gh_addr", "J")))
+  if (_get_gh_addr_fid (env, obj) < 0)
     goto cleanup;
   
   jgh_addr_addr = (*env)->GetLongField (env, obj, gh_addr_fid);
@@ -926,6 +942,280 @@ Java_gov_llnl_lc_chaos_Genders_query (JNIEnv *env, jobject obj, jstring query)
   return (rv);
 }
 
+/*
+ * struct packbuf
+ *
+ * Packed results handed to Java in one byte array: a header of the
+ * row count and number of strings per row, an offset table of
+ * count * width big endian ints into a blob of NUL terminated UTF-8
+ * strings, and the blob itself.  An offset of -1 is a missing value.
+ */
+struct packbuf
+{
+  int *offsets;
+  int offsetslen;
+  int offsetssize;
+  char *blob;
+  int bloblen;
+  int blobsize;
+};
+
+#define PACKBUF_HEADER_LEN 8
+
+static int
+_pack_offset (struct packbuf *pb, int offset)
+{
+  if (pb->offsetslen == pb->offsetssize)
+    {
+      int size = pb->offsetssize ? pb->offsetssize * 2 : 1024;
+      int *tmp;
+
+      if (!(tmp = (int *)realloc (pb->offsets, size * sizeof (int))))
+        return (-1);
+      pb->offsets = tmp;
+      pb->offsetssize = size;
+    }
+  pb->offsets[pb->offsetslen++] = offset;
+  return (0);
+}
+
+/* returns offset of str in the blob, -1 on error */
+static int
+_pack_string (struct packbuf *pb, const char *str)
+{
+  int len = strlen (str) + 1;
+  int offset = pb->bloblen;
+
+  if (pb->bloblen + len > pb->blobsize)
+    {
+      int size = pb->blobsize ? pb->blobsize : 4096;
+      char *tmp;
+
+      while (pb->bloblen + len > size)
+        size *= 2;
+      if (!(tmp = (char *)realloc (pb->blob, size)))
+        return (-1);
+      pb->blob = tmp;
+      pb->blobsize = size;
+    }
+  memcpy (pb->blob + pb->bloblen, str, len);
+  pb->bloblen += len;
+  return (offset);
+}
+
+static void
+_pack_int (jbyte *buf, int val)
+{
+  buf[0] = (val >> 24) & 0xff;
+  buf[1] = (val >> 16) & 0xff;
+  buf[2] = (val >> 8) & 0xff;
+  buf[3] = val & 0xff;
+}
+
+static jbyteArray
+_pack_array (JNIEnv *env, jobject obj, struct packbuf *pb, int width)
+{
+  jbyteArray jarray = NULL;
+  jbyte *buf = NULL;
+  int len;
+  int i;
+
+  len = PACKBUF_HEADER_LEN + pb->offsetslen * 4 + pb->bloblen;
+
+  if (!(buf = (jbyte *)malloc (len)))
+    {
+      _throw_exception (env, obj, GENDERS_ERR_INTERNAL);
+      goto cleanup;
+    }
+
+  _pack_int (buf, pb->offsetslen / width);
+  _pack_int (buf + 4, width);
+  for (i = 0; i < pb->offsetslen; i++)
+    _pack_int (buf + PACKBUF_HEADER_LEN + i * 4, pb->offsets[i]);
+  memcpy (buf + PACKBUF_HEADER_LEN + pb->offsetslen * 4, pb->blob, pb->bloblen);
+
+  if (!(jarray = (*env)->NewByteArray (env, len)))
+    goto cleanup;
+
+  (*env)->SetByteArrayRegion (env, jarray, 0, len, buf);
+
+ cleanup:
+  free (buf);
+  return (jarray);
+}
+
+struct packattr
+{
+  char *attr;
+  int offset;
+};
+
+static int
+_packattr_cmp (const void *a, const void *b)
+{
+  return (strcmp (((struct packattr *)a)->attr, ((struct packattr *)b)->attr));
+}
+
+static jbyteArray
+_query_packed (JNIEnv *env, jobject obj, const char *query, int withattrs)
+{
+  genders_t handle = NULL;
+  struct packbuf pb;
+  char **nodelist = NULL;
+  char **attrlist = NULL;
+  char **vallist = NULL;
+  char **attrs = NULL;
+  struct packattr *packattrs = NULL;
+  int nodelistlen, attrlistlen = 0, attrslen = 0;
+  int nodeslen;
+  jbyteArray rv = NULL;
+  int i, j;
+
+  memset (&pb, '\0', sizeof (struct packbuf));
+
+  if (_get_handle (env, obj, &handle) < 0)
+    goto cleanup;
+
+  if ((nodelistlen = genders_nodelist_create (handle, &nodelist)) < 0)
+    {
+      _throw_exception (env, obj, genders_errnum (handle));
+      goto cleanup;
+    }
+
+  if ((nodeslen = genders_query (handle, nodelist, nodelistlen, query)) < 0)
+    {
+      _throw_exception (env, obj, genders_errnum (handle));
+      goto cleanup;
+    }
+
+  if (withattrs)
+    {
+      if ((attrlistlen = genders_attrlist_create (handle, &attrlist)) < 0
+          || genders_vallist_create (handle, &vallist) < 0
+          || genders_attrlist_create (handle, &attrs) < 0
+          || (attrslen = genders_getattr_all (handle, attrs, attrlistlen)) < 0)
+        {
+          _throw_exception (env, obj, genders_errnum (handle));
+          goto cleanup;
+        }
+
+      /* every attribute name is stored once in the blob */
+      if (!(packattrs = (struct packattr *)malloc ((attrslen + 1) * sizeof (struct packattr))))
+        {
+          _throw_exception (env, obj, GENDERS_ERR_INTERNAL);
+          goto cleanup;
+        }
+
+      for (i = 0; i < attrslen; i++)
+        {
+          packattrs[i].attr = attrs[i];
+          if ((packattrs[i].offset = _pack_string (&pb, attrs[i])) < 0)
+            {
+              _throw_exception (env, obj, GENDERS_ERR_INTERNAL);
+              goto cleanup;
+            }
+        }
+
+      qsort (packattrs, attrslen, sizeof (struct packattr), _packattr_cmp);
+    }
+
+  for (i = 0; i < nodeslen; i++)
+    {
+      int nodeoffset;
+      int attrlen;
+
+      if ((nodeoffset = _pack_string (&pb, nodelist[i])) < 0)
+        {
+          _throw_exception (env, obj, GENDERS_ERR_INTERNAL);
+          goto cleanup;
+        }
+
+      if (!withattrs)
+        {
+          if (_pack_offset (&pb, nodeoffset) < 0)
+            {
+              _throw_exception (env, obj, GENDERS_ERR_INTERNAL);
+              goto cleanup;
+            }
+          continue;
+        }
+
+      if (genders_vallist_clear (handle, vallist) < 0
+          || (attrlen = genders_getattr (handle,
+                                         attrlist,
+                                         vallist,
+                                         attrlistlen,
+                                         nodelist[i])) < 0)
+        {
+          _throw_exception (env, obj, genders_errnum (handle));
+          goto cleanup;
+        }
+
+      for (j = 0; j < attrlen; j++)
+        {
+          struct packattr key, *pa;
+          int valoffset = -1;
+
+          key.attr = attrlist[j];
+          if (!(pa = bsearch (&key,
+                              packattrs,
+                              attrslen,
+                              sizeof (struct packattr),
+                              _packattr_cmp)))
+            {
+              _throw_exception (env, obj, GENDERS_ERR_INTERNAL);
+              goto cleanup;
+            }
+
+          if (strlen (vallist[j])
+              && (valoffset = _pack_string (&pb, vallist[j])) < 0)
+            {
+              _throw_exception (env, obj, GENDERS_ERR_INTERNAL);
+              goto cleanup;
+            }
+
+          if (_pack_offset (&pb, nodeoffset) < 0
+              || _pack_offset (&pb, pa->offset) < 0
+              || _pack_offset (&pb, valoffset) < 0)
+            {
+              _throw_exception (env, obj, GENDERS_ERR_INTERNAL);
+              goto cleanup;
+            }
+        }
+    }
+
+  rv = _pack_array (env, obj, &pb, withattrs ? 3 : 1);
+ cleanup:
+  free (pb.offsets);
+  free (pb.blob);
+  free (packattrs);
+  genders_nodelist_destroy (handle, nodelist);
+  genders_attrlist_destroy (handle, attrlist);
+  genders_vallist_destroy (handle, vallist);
+  genders_attrlist_destroy (handle, attrs);
+  return (rv);
+}
+
+JNIEXPORT jbyteArray JNICALL
+Java_gov_llnl_lc_chaos_Genders_query_1packed (JNIEnv *env, jobject obj, jstring query, jboolean withattrs)
+{
+  const jbyte *queryutf = NULL;
+  jbyteArray rv = NULL;
+
+  if (query)
+    {
+      if (!(queryutf = (*env)->GetStringUTFChars(env, query, NULL)))
+	goto cleanup;
+    }
+
+  rv = _query_packed (env, obj, queryutf, withattrs == JNI_TRUE);
+
+ cleanup:
+  if (query && queryutf)
+    (*env)->ReleaseStringUTFChars(env, query, queryutf);
+  return (rv);
+}
+
 static jboolean
 _testquery (JNIEnv *env, jobject obj, const char *node, const char *query)
 {
@@ -1004,19 +1294,12 @@ JNIEXPORT void JNICALL
 Java_gov_llnl_lc_chaos_Genders_cleanup (JNIEnv *env, jobject obj)
 {
   genders_t handle;
-  jclass genders_cls;
-  jfieldID gh_addr_fid;
 
   if (_get_handle (env, obj, &handle) < 0)
     goto cleanup;
 
   genders_handle_destroy (handle);
 
-  genders_cls = (*env)->GetObjectClass (env, obj);
-
-  if (!(gh_addr_fid = (*env)->GetFieldID (env, genders_cls, "gh_addr", "J")))
-    goto cleanup;
-
   (*env)->SetLongField (env, obj, gh_addr_fid, 0);
 
  cleanup:
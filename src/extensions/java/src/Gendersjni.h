@@ -175,6 +175,14 @@ JNIEXPORT jboolean JNICALL Java_gov_llnl_lc_chaos_Genders_isattrval
 JNIEXPORT jobjectArray JNICALL Java_gov_llnl_lc_chaos_Genders_query
   (JNIEnv *, jobject, jstring);
 
+/*
+ * Class:     gov_llnl_lc_chaos_Genders
+ * Method:    query_packed
+ * Signature: (Ljava/lang/String;Z)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_gov_llnl_lc_chaos_Genders_query_1packed
+  (JNIEnv *, jobject, jstring, jboolean);
+
 /*
  * Class:     gov_llnl_lc_chaos_Genders
  * Method:    testquery
@@ -38,6 +38,55 @@
 
 #include <genders.h>
 
+/*
+ * _strlist_create
+ *
+ * Allocate a list of n strings of len bytes each in one block, to
+ * pass to libgenders in place of genders_nodelist_create() and
+ * friends, which allocate each string separately.  Free with free().
+ */
+static char **
+_strlist_create(int n, int len)
+{
+    char **list;
+    char *buf;
+    int i;
+
+    if (n < 1)
+        n = 1;
+
+    if (!(list = (char **)malloc(n * (sizeof(char *) + len))))
+        return NULL;
+
+    buf = (char *)(list + n);
+    memset(buf, '\0', n * len);
+    for (i = 0; i < n; i++)
+        list[i] = buf + i * len;
+    return list;
+}
+
+/*
+ * _nodelist_create
+ *
+ * Create a list large enough for every node with _strlist_create().
+ * Returns the list length, or -1 and sets the handle's errnum.
+ */
+static int
+_nodelist_create(genders_t handle, char ***nlist)
+{
+    int numnodes, maxnodelen;
+
+    if ((numnodes = genders_getnumnodes(handle)) < 0
+        || (maxnodelen = genders_getmaxnodelen(handle)) < 0)
+        return -1;
+
+    if (!(*nlist = _strlist_create(numnodes, maxnodelen + 1))) {
+        genders_set_errnum(handle, GENDERS_ERR_OUTMEM);
+        return -1;
+    }
+    return numnodes;
+}
+
 MODULE = Libgenders             PACKAGE = Libgenders            
 
 PROTOTYPES: ENABLE
@@ -178,6 +227,38 @@ GENDERS_DEFAULT_FILE (sv=&PL_sv_undef)
     OUTPUT:
         RETVAL    
 
+int
+GENDERS_FLAG_DEFAULT (sv=&PL_sv_undef)
+    SV *sv    
+    CODE:
+        RETVAL = GENDERS_FLAG_DEFAULT;
+    OUTPUT:
+        RETVAL    
+
+int
+GENDERS_FLAG_RAW_VALUES (sv=&PL_sv_undef)
+    SV *sv    
+    CODE:
+        RETVAL = GENDERS_FLAG_RAW_VALUES;
+    OUTPUT:
+        RETVAL    
+
+int
+GENDERS_FLAG_LAZY_NODES (sv=&PL_sv_undef)
+    SV *sv    
+    CODE:
+        RETVAL = GENDERS_FLAG_LAZY_NODES;
+    OUTPUT:
+        RETVAL    
+
+int
+GENDERS_FLAG_SHARED_IMAGE (sv=&PL_sv_undef)
+    SV *sv    
+    CODE:
+        RETVAL = GENDERS_FLAG_SHARED_IMAGE;
+    OUTPUT:
+        RETVAL    
+
 void
 DESTROY(handle)
     genders_t handle    
@@ -201,6 +282,27 @@ genders_load_data(handle, filename=NULL)
         OUTPUT:
                 RETVAL
 
+int
+genders_set_flags(handle, flags)
+        genders_t handle
+        unsigned int flags
+        CODE:
+                RETVAL = genders_set_flags(handle, flags);
+        OUTPUT:
+                RETVAL
+
+SV *
+genders_get_flags(handle)
+        genders_t handle
+        PREINIT:
+                unsigned int flags;
+        CODE:
+                if (genders_get_flags(handle, &flags) < 0)
+                    XSRETURN_UNDEF;
+                RETVAL = newSVuv(flags);
+        OUTPUT:
+                RETVAL
+
 int
 genders_errnum(handle)
     genders_t handle
@@ -280,37 +382,34 @@ genders_getnodename(handle)
     OUTPUT:
         RETVAL
 
-AV *
+SV *
 genders_getnodes(handle, attr=NULL, val=NULL) 
     genders_t handle
     char *attr
     char *val
     PREINIT:
-        int len, num, errnum, i;
+        int len, num, i;
         char **nlist = NULL; 
+        AV *nodes;
     CODE:
-        if ((len = genders_nodelist_create(handle, &nlist)) < 0) 
+        if ((len = _nodelist_create(handle, &nlist)) < 0) 
             goto handle_error;
 
         if ((num = genders_getnodes(handle, nlist, len, attr, val)) < 0)
             goto handle_error;
 
-        RETVAL = newAV();
+        nodes = newAV();
+        av_extend(nodes, num);
         for (i = 0; i < num; i++)
-            av_push(RETVAL, newSVpv(nlist[i], 0));
+            av_push(nodes, newSVpv(nlist[i], 0));
         
-        if (genders_nodelist_destroy(handle, nlist) < 0)
-            goto handle_error;
-
+        free(nlist);
+        RETVAL = newRV_noinc((SV *)nodes);
         goto the_end;
 
         handle_error:
 
-            errnum = genders_errnum(handle);
-
-            (void)genders_nodelist_destroy(handle, nlist);
-
-            genders_set_errnum(handle, errnum);
+            free(nlist);
 
             XSRETURN_UNDEF;
 
@@ -507,42 +606,105 @@ genders_index_attrvals(handle, attr)
     OUTPUT:
         RETVAL    
 
-AV *
+SV *
 genders_query(handle, query=NULL)
     genders_t handle
     char *query
     PREINIT:
-        int len, num, errnum, i;
+        int len, num, i;
         char **nlist = NULL; 
+        AV *nodes;
     CODE:
-        if ((len = genders_nodelist_create(handle, &nlist)) < 0) 
+        if ((len = _nodelist_create(handle, &nlist)) < 0) 
             goto handle_error;
 
         if ((num = genders_query(handle, nlist, len, query)) < 0)
             goto handle_error;
 
-        RETVAL = newAV();
+        nodes = newAV();
+        av_extend(nodes, num);
         for (i = 0; i < num; i++)
-            av_push(RETVAL, newSVpv(nlist[i], 0));
+            av_push(nodes, newSVpv(nlist[i], 0));
         
-        if (genders_nodelist_destroy(handle, nlist) < 0)
-            goto handle_error;
-
+        free(nlist);
+        RETVAL = newRV_noinc((SV *)nodes);
         goto the_end;
 
         handle_error:
 
-            errnum = genders_errnum(handle);
+            free(nlist);
 
-            (void)genders_nodelist_destroy(handle, nlist);
+            XSRETURN_UNDEF;
 
-            genders_set_errnum(handle, errnum);
+        the_end:
+    OUTPUT:
+        RETVAL    
+
+SV *
+genders_getattrvals_all(handle)
+    genders_t handle
+    PREINIT:
+        int numnodes, maxattrs, maxattrlen, maxvallen;
+        int num, count = 0, i, j;
+        char **nlist = NULL;
+        char **alist = NULL;
+        char **vlist = NULL;
+        HV *nodes;
+        HV *attrvals;
+    CODE:
+        if ((numnodes = _nodelist_create(handle, &nlist)) < 0)
+            goto handle_error;
+
+        if ((maxattrs = genders_getmaxattrs(handle)) < 0
+            || (maxattrlen = genders_getmaxattrlen(handle)) < 0
+            || (maxvallen = genders_getmaxvallen(handle)) < 0)
+            goto handle_error;
+
+        if (!(alist = _strlist_create(maxattrs, maxattrlen + 1))
+            || !(vlist = _strlist_create(maxattrs, maxvallen + 1))) {
+            genders_set_errnum(handle, GENDERS_ERR_OUTMEM);
+            goto handle_error;
+        }
+
+        if ((num = genders_getnodes(handle, nlist, numnodes, NULL, NULL)) < 0)
+            goto handle_error;
+
+        nodes = (HV *)sv_2mortal((SV *)newHV());
+        hv_ksplit(nodes, num);
+        for (i = 0; i < num; i++) {
+            /* genders_getattr() does not write the values of
+             * attributes without one
+             */
+            for (j = 0; j < count; j++)
+                vlist[j][0] = '\0';
+
+            if ((count = genders_getattr(handle, alist, vlist, maxattrs, nlist[i])) < 0)
+                goto handle_error;
+
+            attrvals = newHV();
+            hv_ksplit(attrvals, count);
+            for (j = 0; j < count; j++)
+                (void)hv_store(attrvals, alist[j], strlen(alist[j]), newSVpv(vlist[j], 0), 0);
+            (void)hv_store(nodes, nlist[i], strlen(nlist[i]), newRV_noinc((SV *)attrvals), 0);
+        }
+
+        free(nlist);
+        free(alist);
+        free(vlist);
+        RETVAL = newRV_inc((SV *)nodes);
+        goto the_end;
+
+        handle_error:
+
+            free(nlist);
+            free(alist);
+            free(vlist);
 
             XSRETURN_UNDEF;
 
         the_end:
     OUTPUT:
-        RETVAL    
+        RETVAL
 
 int
 genders_testquery(handle, query, node=NULL)
@@ -0,0 +1,76 @@
+#############################################################################
+#  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+#  Copyright (C) 2001-2007 The Regents of the University of California.
+#  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+#  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+#  UCRL-CODE-2003-004.
+#
+#  This file is part of Genders, a cluster configuration database.
+#  For details, see <http://www.llnl.gov/linux/genders/>.
+#
+#  Genders is free software; you can redistribute it and/or modify it under
+#  the terms of the GNU General Public License as published by the Free
+#  Software Foundation; either version 2 of the License, or (at your option)
+#  any later version.
+#
+#  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+#  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+#  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+#  details.
+#
+#  You should have received a copy of the GNU General Public License along
+#  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+#############################################################################
+#
+# Run by "make test".  Loads a genders file privately and with
+# GENDERS_FLAG_SHARED_IMAGE, and checks both answer the same.
+
+use strict;
+use Test::More tests => 10;
+use File::Temp qw(tempfile);
+
+use Libgenders;
+
+my ($fh, $file) = tempfile("genders_test.XXXXXX", TMPDIR => 1, UNLINK => 1);
+for my $i (1 .. 32) {
+    printf $fh "node%d compute,rack=r%d\n", $i, $i / 8;
+}
+print $fh "node[1-2] mgmt\n";
+close($fh);
+
+my $shm = "/dev/shm";
+my %before = map { $_ => 1 } glob("$shm/genders.*");
+
+my $private = Libgenders->genders_handle_create();
+ok($private->genders_load_data($file) == 0, "load privately");
+is($private->genders_get_flags(), Libgenders::GENDERS_FLAG_DEFAULT,
+   "default flags");
+
+my $shared = Libgenders->genders_handle_create();
+ok($shared->genders_set_flags(Libgenders::GENDERS_FLAG_SHARED_IMAGE) == 0,
+   "set shared image flag");
+is($shared->genders_get_flags(), Libgenders::GENDERS_FLAG_SHARED_IMAGE,
+   "get shared image flag");
+ok($shared->genders_load_data($file) == 0, "load shared image");
+
+SKIP: {
+    skip "no $shm", 1 unless -d $shm;
+    my @images = grep { !$before{$_} } glob("$shm/genders.*");
+    ok(@images == 1, "shared image created");
+    unlink(@images);
+}
+
+is_deeply([$shared->genders_getnodes()], [$private->genders_getnodes()],
+          "same nodes");
+is_deeply([$shared->genders_query("rack=r1||mgmt")],
+          [$private->genders_query("rack=r1||mgmt")],
+          "same query result");
+my $nodes = $private->genders_getnodes();
+is_deeply([map { $shared->genders_getattr($_) } @$nodes],
+          [map { $private->genders_getattr($_) } @$nodes],
+          "same attributes and values");
+
+my $handle = Libgenders->genders_handle_create();
+ok($handle->genders_set_flags(0x100) < 0
+   && $handle->genders_errnum() == Libgenders::GENDERS_ERR_PARAMETERS,
+   "invalid flags rejected");
@@ -29,6 +29,11 @@ import exceptions
 import sys
 import libgenders
 
+GENDERS_FLAG_DEFAULT = libgenders.GENDERS_FLAG_DEFAULT
+GENDERS_FLAG_RAW_VALUES = libgenders.GENDERS_FLAG_RAW_VALUES
+GENDERS_FLAG_LAZY_NODES = libgenders.GENDERS_FLAG_LAZY_NODES
+GENDERS_FLAG_SHARED_IMAGE = libgenders.GENDERS_FLAG_SHARED_IMAGE
+
 class Genders_Err:
     """
     Genders Error Exception Base Class
@@ -101,14 +106,16 @@ class Genders:
             return Genders_Err_Internal()
         else:
             return Genders_Err()
-    def __init__(self, filename=None):
+    def __init__(self, filename=None, flags=GENDERS_FLAG_DEFAULT):
         """
         Creates a Genders object and load genders data from the
         specified file.  If the genders file is not specified, the
-        default genders file will be used.       
+        default genders file will be used.  flags are GENDERS_FLAG_*
+        values or'ed together, e.g. GENDERS_FLAG_SHARED_IMAGE.
         """
         self.__lgh = libgenders.Libgenders()
         try:
+            self.__lgh.set_flags(flags)
             self.__lgh.load_data(filename)
         except SystemError:
             raise Genders.__find_exception(self)
@@ -128,44 +135,36 @@ class Genders:
         listed in the genders file are returned.       
         """
         try:
-            str = self.__lgh.getnodes(attr, val)
+            return self.__lgh.getnodes(attr, val)
         except SystemError:
             raise Genders.__find_exception(self)
-
-        if str:
-            rv = str.split(',')
-        else:
-            rv = [];
-        return rv
     def getattr(self, node=None):
         """
         Returns a list of attributes for the specified node.  If the
         node is not specified, the local node's attributes returned.
         """
         try:
-            str = self.__lgh.getattr(node)
+            return self.__lgh.getattr(node)
         except SystemError:
             raise Genders.__find_exception(self)
-           
-        if str:
-            rv = str.split(',')
-        else:
-            rv = []
-        return rv
     def getattr_all(self):
         """
         Returns a list of all attributes listed in the genders file.
         """
         try:
-            str = self.__lgh.getattr_all()
+            return self.__lgh.getattr_all()
+        except SystemError:
+            raise Genders.__find_exception(self)
+    def getattr_many(self, nodes):
+        """
+        Returns a dictionary mapping each of the specified nodes to a
+        dictionary of its attributes and values.  Attributes without
+        a value map to None.
+        """
+        try:
+            return self.__lgh.getattr_many(nodes)
         except SystemError:
             raise Genders.__find_exception(self)
-            
-        if str:
-            rv = str.split(',')
-        else:
-            rv = []
-        return rv
     def getattrval(self, attr, node=None):
         """
         Returns the value of the specified attribute for the specified
@@ -240,15 +239,9 @@ class Genders:
         specified, all nodes listed in the genders file are returned.  
         """
         try:
-            str = self.__lgh.query(query)
+            return self.__lgh.query(query)
         except SystemError:
             raise Genders.__find_exception(self)
-
-        if str:
-            rv = str.split(',')
-        else:
-            rv = [];
-        return rv
     def testquery(self, query, node=None):
         """
         Returns 1 if the specified node meets the conditions of the
@@ -279,6 +272,7 @@ if __name__ == '__main__':
         print "unexpected exception:", sys.exc_info()[0], sys.exc_info()[1], sys.exc_info[2]
 
     print "getattr_all:", gh.getattr_all()
+    print "getattr_many:", gh.getattr_many(gh.getnodes("mgmt"))
     print "isnode <blank>:", gh.isnode()
     print "isnode foo:", gh.isnode("foo")
     print "isattr foo:", gh.isattr("foo")
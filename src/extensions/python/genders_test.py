@@ -0,0 +1,72 @@
+#############################################################################
+#  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+#  Copyright (C) 2001-2007 The Regents of the University of California.
+#  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+#  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+#  UCRL-CODE-2003-004.
+#
+#  This file is part of Genders, a cluster configuration database.
+#  For details, see <http://www.llnl.gov/linux/genders/>.
+#
+#  Genders is free software; you can redistribute it and/or modify it under
+#  the terms of the GNU General Public License as published by the Free
+#  Software Foundation; either version 2 of the License, or (at your option)
+#  any later version.
+#
+#  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+#  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+#  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+#  details.
+#
+#  You should have received a copy of the GNU General Public License along
+#  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+#############################################################################
+#
+# Run by "make test".  Loads a genders file privately and with
+# GENDERS_FLAG_SHARED_IMAGE, and checks both answer the same.
+
+import glob
+import os
+import sys
+import tempfile
+import unittest
+
+import genders
+import libgenders
+
+class GendersFlagsTest(unittest.TestCase):
+    def setUp(self):
+        fd, self.file = tempfile.mkstemp(prefix="genders_test.")
+        f = os.fdopen(fd, "w")
+        for i in range(1, 33):
+            f.write("node%d compute,rack=r%d\n" % (i, i / 8))
+        f.write("node[1-2] mgmt\n")
+        f.close()
+    def tearDown(self):
+        os.unlink(self.file)
+    def test_flags(self):
+        lgh = libgenders.Libgenders()
+        self.assertEqual(lgh.get_flags(), libgenders.GENDERS_FLAG_DEFAULT)
+        lgh.set_flags(libgenders.GENDERS_FLAG_SHARED_IMAGE)
+        self.assertEqual(lgh.get_flags(), libgenders.GENDERS_FLAG_SHARED_IMAGE)
+    def test_invalid_flags(self):
+        self.assertRaises(genders.Genders_Err, genders.Genders,
+                          self.file, 0x100)
+    def test_shared_image(self):
+        before = set(glob.glob("/dev/shm/genders.*"))
+        private = genders.Genders(self.file)
+        shared = genders.Genders(self.file, genders.GENDERS_FLAG_SHARED_IMAGE)
+        if os.path.isdir("/dev/shm"):
+            images = set(glob.glob("/dev/shm/genders.*")) - before
+            for image in images:
+                os.unlink(image)
+            self.assertEqual(len(images), 1)
+        self.assertEqual(shared.getnodes(), private.getnodes())
+        self.assertEqual(shared.query("rack=r1||mgmt"),
+                         private.query("rack=r1||mgmt"))
+        self.assertEqual(shared.getattr_all(), private.getattr_all())
+        for node in private.getnodes():
+            self.assertEqual(shared.getattr(node), private.getattr(node))
+
+if __name__ == '__main__':
+    unittest.main()
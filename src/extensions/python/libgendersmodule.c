@@ -39,10 +39,12 @@
 
 #include <Python.h>
 #include <structmember.h>
+#include <pythread.h>
 
 typedef struct {
   PyObject_HEAD
   genders_t gh;
+  PyThread_type_lock lock;
   int genders_err_open;
   int genders_err_read;
   int genders_err_parse;
@@ -55,6 +57,8 @@ static void
 Libgenders_dealloc(Libgenders* self)
 {
   genders_handle_destroy(self->gh);
+  if (self->lock)
+    PyThread_free_lock(self->lock);
   self->ob_type->tp_free((PyObject*)self);
 }
 
@@ -70,6 +74,12 @@ Libgenders_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
       return NULL;
     }
 
+    if (!(self->lock = PyThread_allocate_lock())) {
+      Py_DECREF(self);
+      PyErr_NoMemory();
+      return NULL;
+    }
+
     self->genders_err_open = GENDERS_ERR_OPEN;
     self->genders_err_read = GENDERS_ERR_READ;
     self->genders_err_parse = GENDERS_ERR_PARSE;
@@ -108,6 +118,23 @@ _genders_exception_check(Libgenders *self)
     PyErr_NoMemory();
 }
 
+/*
+ * _lock
+ *
+ * Serialize use of the handle.  load_data and query run with the GIL
+ * released, so another thread may be using the handle.  Only wait
+ * without the GIL, so the thread holding the lock can finish.
+ */
+static void
+_lock(PyThread_type_lock lock)
+{
+  if (!PyThread_acquire_lock(lock, NOWAIT_LOCK)) {
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(lock, WAIT_LOCK);
+    Py_END_ALLOW_THREADS
+  }
+}
+
 static PyObject *
 Libgenders_load_data(Libgenders *self, PyObject *args)
 {
@@ -116,9 +143,14 @@ Libgenders_load_data(Libgenders *self, PyObject *args)
   PyObject *rv = NULL;
 
   if (!PyArg_ParseTuple(args, "|z", &filename))
-    goto cleanup;
+    return NULL;
 
-  if ((ret = genders_load_data(self->gh, filename)) < 0) {
+  Py_BEGIN_ALLOW_THREADS
+  PyThread_acquire_lock(self->lock, WAIT_LOCK);
+  ret = genders_load_data(self->gh, filename);
+  Py_END_ALLOW_THREADS
+
+  if (ret < 0) {
     _genders_exception_check(self);
     goto cleanup;
   }
@@ -127,16 +159,64 @@ Libgenders_load_data(Libgenders *self, PyObject *args)
     goto cleanup;
   
  cleanup:
+  PyThread_release_lock(self->lock);
   return rv; 
 }
 
+static PyObject *
+Libgenders_set_flags(Libgenders *self, PyObject *args)
+{
+  unsigned int flags;
+  PyObject *rv = NULL;
+
+  if (!PyArg_ParseTuple(args, "I", &flags))
+    return NULL;
+
+  _lock(self->lock);
+
+  if (genders_set_flags(self->gh, flags) < 0) {
+    _genders_exception_check(self);
+    goto cleanup;
+  }
+
+  if (!(rv = Py_BuildValue("i", 0)))
+    goto cleanup;
+
+ cleanup:
+  PyThread_release_lock(self->lock);
+  return rv;
+}
+
+static PyObject *
+Libgenders_get_flags(Libgenders *self)
+{
+  unsigned int flags;
+  PyObject *rv = NULL;
+
+  _lock(self->lock);
+
+  if (genders_get_flags(self->gh, &flags) < 0) {
+    _genders_exception_check(self);
+    goto cleanup;
+  }
+
+  if (!(rv = Py_BuildValue("I", flags)))
+    goto cleanup;
+
+ cleanup:
+  PyThread_release_lock(self->lock);
+  return rv;
+}
+
 static PyObject *
 Libgenders_errnum(Libgenders *self)
 {
   PyObject *rv = NULL;
   int errnum;
 
+  _lock(self->lock);
   errnum = genders_errnum(self->gh);
+  PyThread_release_lock(self->lock);
 
   if (!(rv = Py_BuildValue("i", errnum)))
     return NULL;
@@ -169,12 +249,15 @@ Libgenders_errormsg(Libgenders *self)
   char *str;
   PyObject *rv = NULL;
 
+  _lock(self->lock);
+
   str = genders_errormsg(self->gh);
 
   if (!(rv = Py_BuildValue("s", str)))
     goto cleanup;
 
  cleanup:
+  PyThread_release_lock(self->lock);
   return rv;
 }
 
@@ -184,6 +267,8 @@ Libgenders_getnumnodes(Libgenders *self)
   int numnodes;
   PyObject *rv = NULL;
 
+  _lock(self->lock);
+
   if ((numnodes = genders_getnumnodes(self->gh)) < 0) {
     _genders_exception_check(self);
     goto cleanup;
@@ -193,6 +278,7 @@ Libgenders_getnumnodes(Libgenders *self)
     goto cleanup;
 
  cleanup:
+  PyThread_release_lock(self->lock);
   return rv;
 }
 
@@ -202,6 +288,8 @@ Libgenders_getnumattrs(Libgenders *self)
   int numattrs;
   PyObject *rv = NULL;
 
+  _lock(self->lock);
+
   if ((numattrs = genders_getnumattrs(self->gh)) < 0) {
     _genders_exception_check(self);
     goto cleanup;
@@ -211,47 +299,29 @@ Libgenders_getnumattrs(Libgenders *self)
     goto cleanup;
 
  cleanup:
+  PyThread_release_lock(self->lock);
   return rv;
 }
 
 static PyObject *
-_build_comma_separated_string(int maxitemlen, char **itemlist, int itemlistlen)
+_build_list(char **itemlist, int itemlistlen)
 {
-  char *stringbuf = NULL;
-  unsigned int stringbuflen;
   PyObject *rv = NULL;
+  PyObject *item;
   int i;
 
-  /* achu: As far as I can tell, there is no (present) way to
-   * (reasonbly and easily) return a Python list instead of a single
-   * object.  If there is a way, I can't find it and/or it's advanced Python stuff.
-   *
-   * Until I learn of a way, I'll return a giant comma separated
-   * string.  It's the job of an upper level library to deal with the
-   * string and convert it to something more useful like a list.
-   */
-
-  /* +1 to deal with commas */
-  stringbuflen = itemlistlen * (maxitemlen + 1);
-
-  if (!(stringbuf = (char *)malloc(stringbuflen))) {
-    PyErr_NoMemory();
-    goto cleanup;
-  }
-
-  memset(stringbuf, '\0', stringbuflen);
+  if (!(rv = PyList_New(itemlistlen)))
+    return NULL;
 
   for (i = 0; i < itemlistlen; i++) {
-    strcat(stringbuf, itemlist[i]);
-    if (i != (itemlistlen - 1))
-      strcat(stringbuf, ",");
+    if (!(item = PyString_FromString(itemlist[i]))) {
+      Py_DECREF(rv);
+      return NULL;
+    }
+    /* steals the reference */
+    PyList_SET_ITEM(rv, i, item);
   }
 
-  if (!(rv = Py_BuildValue("s", stringbuf)))
-    goto cleanup;
-  
- cleanup:
-  free(stringbuf);
   return rv;
 }
 
@@ -267,7 +337,9 @@ Libgenders_getnodes(Libgenders *self, PyObject *args)
   int errnum;
 
   if (!PyArg_ParseTuple(args, "|zz", &attr, &val))
-    goto cleanup;
+    return NULL;
+
+  _lock(self->lock);
 
   if ((nodelistlen = genders_nodelist_create(self->gh, &nodelist)) < 0) {
     _genders_exception_check(self);
@@ -279,28 +351,14 @@ Libgenders_getnodes(Libgenders *self, PyObject *args)
     goto cleanup;
   }
 
-  if (nodelen) {
-    int maxnodelen;
-
-    if ((maxnodelen = genders_getmaxnodelen(self->gh)) < 0) {
-      _genders_exception_check(self);
-      goto cleanup;
-    }
-
-    if (!(rv = _build_comma_separated_string(maxnodelen,
-					     nodelist,
-					     nodelen)))
-      goto cleanup;
-  }
-  else {
-    if (!(rv = Py_BuildValue("z", NULL)))
-      goto cleanup;
-  }
+  if (!(rv = _build_list(nodelist, nodelen)))
+    goto cleanup;
   
  cleanup:
   errnum = genders_errnum(self->gh);
   genders_nodelist_destroy(self->gh, nodelist);
   genders_set_errnum(self->gh, errnum);
+  PyThread_release_lock(self->lock);
   return rv; 
 }
 
@@ -315,7 +373,9 @@ Libgenders_getattr(Libgenders *self, PyObject *args)
   int errnum;
 
   if (!PyArg_ParseTuple(args, "|z", &node))
-    goto cleanup;
+    return NULL;
+
+  _lock(self->lock);
 
   if ((attrlistlen = genders_attrlist_create(self->gh, &attrlist)) < 0) {
     _genders_exception_check(self);
@@ -331,28 +391,14 @@ Libgenders_getattr(Libgenders *self, PyObject *args)
     goto cleanup;
   }
 
-  if (attrlen) {
-    int maxattrlen;
-
-    if ((maxattrlen = genders_getmaxattrlen(self->gh)) < 0) {
-      _genders_exception_check(self);
-      goto cleanup;
-    }
-
-    if (!(rv = _build_comma_separated_string(maxattrlen,
-					     attrlist,
-					     attrlen)))
-      goto cleanup;
-  }
-  else {
-    if (!(rv = Py_BuildValue("z", NULL)))
-      goto cleanup;
-  }
+  if (!(rv = _build_list(attrlist, attrlen)))
+    goto cleanup;
   
  cleanup:
   errnum = genders_errnum(self->gh);
   genders_attrlist_destroy(self->gh, attrlist);
   genders_set_errnum(self->gh, errnum);
+  PyThread_release_lock(self->lock);
   return rv; 
 }
 
@@ -365,6 +411,8 @@ Libgenders_getattr_all(Libgenders *self)
   PyObject *rv = NULL;
   int errnum;
 
+  _lock(self->lock);
+
   if ((attrlistlen = genders_attrlist_create(self->gh, &attrlist)) < 0) {
     _genders_exception_check(self);
     goto cleanup;
@@ -377,29 +425,114 @@ Libgenders_getattr_all(Libgenders *self)
     goto cleanup;
   }
 
-  if (attrlen) {
-    int maxattrlen;
+  if (!(rv = _build_list(attrlist, attrlen)))
+    goto cleanup;
+  
+ cleanup:
+  errnum = genders_errnum(self->gh);
+  genders_attrlist_destroy(self->gh, attrlist);
+  genders_set_errnum(self->gh, errnum);
+  PyThread_release_lock(self->lock);
+  return rv; 
+}
+
+static PyObject *
+Libgenders_getattr_many(Libgenders *self, PyObject *args)
+{
+  PyObject *nodes = NULL;
+  PyObject *seq = NULL;
+  PyObject *attrdict = NULL;
+  PyObject *val;
+  char **attrlist = NULL;
+  char **vallist = NULL;
+  int attrlistlen;
+  int attrlen;
+  PyObject *rv = NULL;
+  int errnum;
+  int i, j;
+
+  if (!PyArg_ParseTuple(args, "O", &nodes))
+    return NULL;
+
+  if (!(seq = PySequence_Fast(nodes, "nodes must be a sequence")))
+    return NULL;
+
+  _lock(self->lock);
+
+  if ((attrlistlen = genders_attrlist_create(self->gh, &attrlist)) < 0) {
+    _genders_exception_check(self);
+    goto cleanup;
+  }
+
+  if (genders_vallist_create(self->gh, &vallist) < 0) {
+    _genders_exception_check(self);
+    goto cleanup;
+  }
+
+  if (!(rv = PyDict_New()))
+    goto cleanup;
+
+  /* one attribute and value list is reused for every node */
+  for (i = 0; i < PySequence_Fast_GET_SIZE(seq); i++) {
+    PyObject *node = PySequence_Fast_GET_ITEM(seq, i);
+    char *nodestr;
+
+    if (!(nodestr = PyString_AsString(node)))
+      goto cleanup_rv;
 
-    if ((maxattrlen = genders_getmaxattrlen(self->gh)) < 0) {
+    if (genders_vallist_clear(self->gh, vallist) < 0) {
       _genders_exception_check(self);
-      goto cleanup;
+      goto cleanup_rv;
     }
 
-    if (!(rv = _build_comma_separated_string(maxattrlen,
-					     attrlist,
-					     attrlen)))
-      goto cleanup;
-  }
-  else {
-    if (!(rv = Py_BuildValue("z", NULL)))
-      goto cleanup;
+    if ((attrlen = genders_getattr(self->gh,
+                                   attrlist,
+                                   vallist,
+                                   attrlistlen,
+                                   nodestr)) < 0) {
+      _genders_exception_check(self);
+      goto cleanup_rv;
+    }
+
+    if (!(attrdict = PyDict_New()))
+      goto cleanup_rv;
+
+    for (j = 0; j < attrlen; j++) {
+      if (strlen(vallist[j]))
+        val = PyString_FromString(vallist[j]);
+      else {
+        Py_INCREF(Py_None);
+        val = Py_None;
+      }
+      if (!val)
+        goto cleanup_rv;
+      if (PyDict_SetItemString(attrdict, attrlist[j], val) < 0) {
+        Py_DECREF(val);
+        goto cleanup_rv;
+      }
+      Py_DECREF(val);
+    }
+
+    if (PyDict_SetItem(rv, node, attrdict) < 0)
+      goto cleanup_rv;
+    Py_DECREF(attrdict);
+    attrdict = NULL;
   }
-  
+
+  goto cleanup;
+
+ cleanup_rv:
+  Py_XDECREF(attrdict);
+  Py_DECREF(rv);
+  rv = NULL;
  cleanup:
   errnum = genders_errnum(self->gh);
   genders_attrlist_destroy(self->gh, attrlist);
+  genders_vallist_destroy(self->gh, vallist);
   genders_set_errnum(self->gh, errnum);
-  return rv; 
+  PyThread_release_lock(self->lock);
+  Py_DECREF(seq);
+  return rv;
 }
 
 static PyObject *
@@ -409,6 +542,8 @@ Libgenders_getnodename(Libgenders* self)
   int maxnodelen;
   PyObject *rv = NULL;
 
+  _lock(self->lock);
+
   if ((maxnodelen = genders_getmaxnodelen(self->gh)) < 0) {
     _genders_exception_check(self);
     goto cleanup;
@@ -431,6 +566,7 @@ Libgenders_getnodename(Libgenders* self)
 
  cleanup:
   free(nodenamebuf);
+  PyThread_release_lock(self->lock);
   return rv;
 }
 
@@ -445,7 +581,9 @@ Libgenders_getattrval(Libgenders *self, PyObject *args)
   PyObject *rv = NULL;
 
   if (!PyArg_ParseTuple(args, "s|z", &attr, &node))
-    goto cleanup;
+    return NULL;
+
+  _lock(self->lock);
 
   if ((maxvallen = genders_getmaxvallen(self->gh)) < 0) {
     _genders_exception_check(self);
@@ -475,6 +613,7 @@ Libgenders_getattrval(Libgenders *self, PyObject *args)
   
  cleanup:
   free(valbuf);
+  PyThread_release_lock(self->lock);
   return rv; 
 }
 
@@ -487,7 +626,9 @@ Libgenders_testattr(Libgenders *self, PyObject *args)
   PyObject *rv = NULL;
 
   if (!PyArg_ParseTuple(args, "s|z", &attr, &node))
-    goto cleanup;
+    return NULL;
+
+  _lock(self->lock);
 
   if ((ret = genders_testattr(self->gh, node, attr, NULL, 0)) < 0) {
     _genders_exception_check(self);
@@ -498,6 +639,7 @@ Libgenders_testattr(Libgenders *self, PyObject *args)
     goto cleanup;
 
  cleanup:
+  PyThread_release_lock(self->lock);
   return rv;
 }
 
@@ -511,7 +653,9 @@ Libgenders_testattrval(Libgenders *self, PyObject *args)
   PyObject *rv = NULL;
 
   if (!PyArg_ParseTuple(args, "ss|z", &attr, &val, &node))
-    goto cleanup;
+    return NULL;
+
+  _lock(self->lock);
 
   if ((ret = genders_testattrval(self->gh, node, attr, val)) < 0) {
     _genders_exception_check(self);
@@ -522,6 +666,7 @@ Libgenders_testattrval(Libgenders *self, PyObject *args)
     goto cleanup;
   
  cleanup:
+  PyThread_release_lock(self->lock);
   return rv;
 }
 
@@ -533,7 +678,9 @@ Libgenders_isnode(Libgenders *self, PyObject *args)
   PyObject *rv = NULL;
 
   if (!PyArg_ParseTuple(args, "|z", &node))
-    goto cleanup;
+    return NULL;
+
+  _lock(self->lock);
 
   if ((ret = genders_isnode(self->gh, node)) < 0) {
     _genders_exception_check(self);
@@ -544,6 +691,7 @@ Libgenders_isnode(Libgenders *self, PyObject *args)
     goto cleanup;
 
  cleanup:
+  PyThread_release_lock(self->lock);
   return rv;
 }
 
@@ -555,7 +703,9 @@ Libgenders_isattr(Libgenders *self, PyObject *args)
   PyObject *rv = NULL;
 
   if (!PyArg_ParseTuple(args, "s", &attr))
-    goto cleanup;
+    return NULL;
+
+  _lock(self->lock);
 
   if ((ret = genders_isattr(self->gh, attr)) < 0) {
     _genders_exception_check(self);
@@ -566,6 +716,7 @@ Libgenders_isattr(Libgenders *self, PyObject *args)
     goto cleanup;
 
  cleanup:
+  PyThread_release_lock(self->lock);
   return rv;
 }
 
@@ -578,7 +729,9 @@ Libgenders_isattrval(Libgenders *self, PyObject *args)
   PyObject *rv = NULL;
 
   if (!PyArg_ParseTuple(args, "ss", &attr, &val))
-    goto cleanup;
+    return NULL;
+
+  _lock(self->lock);
 
   if ((ret = genders_isattrval(self->gh, attr, val)) < 0) {
     _genders_exception_check(self);
@@ -589,6 +742,7 @@ Libgenders_isattrval(Libgenders *self, PyObject *args)
     goto cleanup;
 
  cleanup:
+  PyThread_release_lock(self->lock);
   return rv;
 }
 
@@ -600,7 +754,9 @@ Libgenders_index_attrvals(Libgenders *self, PyObject *args)
   PyObject *rv = NULL;
 
   if (!PyArg_ParseTuple(args, "s", &attr))
-    goto cleanup;
+    return NULL;
+
+  _lock(self->lock);
 
   if ((ret = genders_index_attrvals(self->gh, attr)) < 0) {
     _genders_exception_check(self);
@@ -611,6 +767,7 @@ Libgenders_index_attrvals(Libgenders *self, PyObject *args)
     goto cleanup;
 
  cleanup:
+  PyThread_release_lock(self->lock);
   return rv;
 }
 
@@ -625,40 +782,32 @@ Libgenders_query(Libgenders *self, PyObject *args)
   int errnum;
 
   if (!PyArg_ParseTuple(args, "|z", &query))
-    goto cleanup;
+    return NULL;
+
+  _lock(self->lock);
 
   if ((nodelistlen = genders_nodelist_create(self->gh, &nodelist)) < 0) {
     _genders_exception_check(self);
     goto cleanup;
   }
 
-  if ((nodelen = genders_query(self->gh, nodelist, nodelistlen, query)) < 0) {
+  Py_BEGIN_ALLOW_THREADS
+  nodelen = genders_query(self->gh, nodelist, nodelistlen, query);
+  Py_END_ALLOW_THREADS
+
+  if (nodelen < 0) {
     _genders_exception_check(self);
     goto cleanup;
   }
 
-  if (nodelen) {
-    int maxnodelen;
-    
-    if ((maxnodelen = genders_getmaxnodelen(self->gh)) < 0) {
-      _genders_exception_check(self);
-      goto cleanup;
-    }
-
-    if (!(rv = _build_comma_separated_string(maxnodelen,
-					     nodelist,
-					     nodelen)))
-      goto cleanup;
-  }
-  else {
-    if (!(rv = Py_BuildValue("z", NULL)))
-      goto cleanup;
-  }
+  if (!(rv = _build_list(nodelist, nodelen)))
+    goto cleanup;
   
  cleanup:
   errnum = genders_errnum(self->gh);
   genders_nodelist_destroy(self->gh, nodelist);
   genders_set_errnum(self->gh, errnum);
+  PyThread_release_lock(self->lock);
   return rv; 
 }
 
@@ -671,9 +820,12 @@ Libgenders_testquery(Libgenders *self, PyObject *args)
   PyObject *rv = NULL;
 
   if (!PyArg_ParseTuple(args, "s|z", &query, &node))
-    goto cleanup;
+    return NULL;
+
+  _lock(self->lock);
+  ret = genders_testquery(self->gh, node, query);
 
-  if ((ret = genders_testquery(self->gh, node, query)) < 0) {
+  if (ret < 0) {
     _genders_exception_check(self);
     goto cleanup;
   }
@@ -682,6 +834,7 @@ Libgenders_testquery(Libgenders *self, PyObject *args)
     goto cleanup;
 
  cleanup:
+  PyThread_release_lock(self->lock);
   return rv;
 }
 
@@ -692,6 +845,18 @@ static PyMethodDef Libgenders_methods[] = {
     METH_VARARGS,
     "Opens, reads, and parses the genders file specified.  If a file is not specified, the default genders file is parsed."
   },
+  {
+    "set_flags",
+    (PyCFunction)Libgenders_set_flags,
+    METH_VARARGS,
+    "Sets the GENDERS_FLAG_* flags used when the genders file is loaded.  Must be called before load_data."
+  },
+  {
+    "get_flags",
+    (PyCFunction)Libgenders_get_flags,
+    METH_NOARGS,
+    "Returns the GENDERS_FLAG_* flags currently set."
+  },
   {
     "errnum",
     (PyCFunction)Libgenders_errnum,
@@ -732,19 +897,25 @@ static PyMethodDef Libgenders_methods[] = {
     "getnodes",
     (PyCFunction)Libgenders_getnodes,
     METH_VARARGS,
-    "Returns a comma separated string of nodes with the specified attribute and value.  If a value is not specified, only the attribute is considered.  If the attribute is not specified, all nodes listed in the genders file are returned."
+    "Returns a list of nodes with the specified attribute and value.  If a value is not specified, only the attribute is considered.  If the attribute is not specified, all nodes listed in the genders file are returned."
   },
   {
     "getattr",
     (PyCFunction)Libgenders_getattr,
     METH_VARARGS,
-    "Returns a comma separated string of attributes for the specified node. If the node is not specified, the local node's attributes returned."
+    "Returns a list of attributes for the specified node. If the node is not specified, the local node's attributes returned."
   },
   {
     "getattr_all",
     (PyCFunction)Libgenders_getattr_all,
     METH_NOARGS,
-    "Returns a comma separated string of all attributes in the genders file."
+    "Returns a list of all attributes in the genders file."
+  },
+  {
+    "getattr_many",
+    (PyCFunction)Libgenders_getattr_many,
+    METH_VARARGS,
+    "Returns a dictionary mapping each of the specified nodes to a dictionary of its attributes and values.  Attributes without a value map to None."
   },
   {
     "getattrval",
@@ -791,7 +962,7 @@ static PyMethodDef Libgenders_methods[] = {
     "query",
     (PyCFunction)Libgenders_query,
     METH_VARARGS,
-    "Returns a comma separated string of nodes specified by a genders query.  A genders query is based on the union, intersection, set difference, or complement between genders attributes and values.  Union is represented by two pipe symbols ('||'), intersection by two ampersand symbols ('&&'), difference by two minus symbols ('--'), and complement by a tilde ('~') Operations are performed from left to right.  Parentheses may be used to change the order of operations.  For example, the following query would retrieve all nodes other than management or login nodes:\"all-(mgmt+login)\".  If the query is not specified, all nodes listed in the genders file are returned."
+    "Returns a list of nodes specified by a genders query.  A genders query is based on the union, intersection, set difference, or complement between genders attributes and values.  Union is represented by two pipe symbols ('||'), intersection by two ampersand symbols ('&&'), difference by two minus symbols ('--'), and complement by a tilde ('~') Operations are performed from left to right.  Parentheses may be used to change the order of operations.  For example, the following query would retrieve all nodes other than management or login nodes:\"all-(mgmt+login)\".  If the query is not specified, all nodes listed in the genders file are returned."
   },
   {
     "testquery",
@@ -865,4 +1036,9 @@ initlibgenders(void)
 
   Py_INCREF(&LibgendersType);
   PyModule_AddObject(m, "Libgenders", (PyObject *)&LibgendersType);
+
+  PyModule_AddIntConstant(m, "GENDERS_FLAG_DEFAULT", GENDERS_FLAG_DEFAULT);
+  PyModule_AddIntConstant(m, "GENDERS_FLAG_RAW_VALUES", GENDERS_FLAG_RAW_VALUES);
+  PyModule_AddIntConstant(m, "GENDERS_FLAG_LAZY_NODES", GENDERS_FLAG_LAZY_NODES);
+  PyModule_AddIntConstant(m, "GENDERS_FLAG_SHARED_IMAGE", GENDERS_FLAG_SHARED_IMAGE);
 }
@@ -29,7 +29,7 @@
 #  if HAVE_STRING_H
 #    include <string.h>
 #  endif
-#  if HAVE_PTHREAD_H
+#  if WITH_PTHREADS
 #    include <pthread.h>
 #  endif
 #else                /* !HAVE_CONFIG_H */
@@ -109,8 +109,11 @@
 #define MAXHOSTNAMELEN    64
 #endif
 
-/* max size of internal hostrange buffer */
-#define MAXHOSTRANGELEN 1024
+/* min number of ranges in a hostlist before hostlist_find() indexes it */
+#define HOSTLIST_INDEX_MIN_RANGES 16
+
+/* size of the buffer batching output of the hostlist print functions */
+#define HOSTLIST_WRITE_BUFLEN 4096
 
 /* ----[ Internal Data Structures ]---- */
 
@@ -169,6 +172,34 @@ struct hostlist {
     /* list of iterators */
     struct hostlist_iterator *ilist;
 
+    /* sorted index of hr[] for hostlist_find(), NULL until built */
+    struct hostlist_index *index;
+
+    /* calls to hostlist_find() since hl was last changed */
+    int nfinds;
+
+};
+
+/* A range in a hostlist index, and the position of its first host
+ * in the hostlist */
+struct hostlist_index_entry {
+    hostrange_t hr;
+    int offset;
+};
+
+/* The hostlist index type: the ranges of a hostlist, those with a
+ * numeric suffix first, sorted by prefix and lo, then the singlehost
+ * ranges, sorted by name.  Equal entries are kept in hostlist order. */
+struct hostlist_index {
+    /* number of entries, and of entries with a numeric suffix */
+    int n;
+    int nranged;
+
+    /* true if ranges of the same prefix overlap, the index can only
+     * find the first of them by position if they don't */
+    int overlap;
+
+    struct hostlist_index_entry *e;
 };
 
 
@@ -209,6 +240,7 @@ static int    _width_equiv(unsigned long, int *, unsigned long, int *);
 
 static int           host_prefix_end(const char *);
 static hostname_t    hostname_create(const char *);
+static int           hostname_parse(hostname_t, const char *, char *, size_t);
 static void          hostname_destroy(hostname_t);
 static int           hostname_suffix_is_valid(hostname_t);
 static int           hostname_suffix_width(hostname_t);
@@ -230,8 +262,6 @@ static char *        hostrange_shift(hostrange_t);
 static int           hostrange_join(hostrange_t, hostrange_t);
 static hostrange_t   hostrange_intersect(hostrange_t, hostrange_t);
 static int           hostrange_hn_within(hostrange_t, hostname_t);
-static size_t        hostrange_to_string(hostrange_t hr, size_t, char *, char *);
-static size_t        hostrange_numstr(hostrange_t, size_t, char *);
 
 static hostlist_t  hostlist_new(void);
 static hostlist_t _hostlist_create_bracketed(const char *, char *, char *);
@@ -248,6 +278,20 @@ static hostlist_t _hostlist_create(const char *, char *, char *);
 static void        hostlist_shift_iterators(hostlist_t, int, int, int);
 static int        _attempt_range_join(hostlist_t, int);
 static int        _is_bracket_needed(hostlist_t, int);
+static char *     _bracketed_list_strdup(hostlist_t, int);
+
+static int        hostlist_is_uniq(hostlist_t);
+static int        hostlist_append_range(hostlist_t, hostrange_t,
+                                        unsigned long, unsigned long);
+static hostlist_t hostlist_merge(hostlist_t, hostlist_t, int);
+static hostlist_t hostlist_merge_hosts(hostlist_t, hostlist_t, int);
+static hostlist_t hostlist_set_op(hostlist_t, hostlist_t, int);
+static hostset_t  hostset_wrap(hostlist_t);
+
+static struct hostlist_index * hostlist_index_create(hostlist_t);
+static void                    hostlist_index_clear(hostlist_t);
+static int                     hostlist_index_find(struct hostlist_index *,
+                                                   hostname_t);
 
 static hostlist_iterator_t hostlist_iterator_new(void);
 static void               _iterator_advance(hostlist_iterator_t);
@@ -533,6 +577,46 @@ static hostname_t hostname_create(const char *hostname)
     return hn;
 }
 
+/* parse a hostname into the caller's hostname object hn, without
+ * allocating memory.  The prefix is copied to buf of size len if it
+ * is followed by a valid suffix, otherwise it points to hostname.
+ *
+ * Returns 0, or -1 if the prefix does not fit in buf.
+ */
+static int hostname_parse(hostname_t hn, const char *hostname,
+                          char *buf, size_t len)
+{
+    char *p = NULL;
+    unsigned long num;
+    int idx;
+
+    assert(hostname != NULL);
+
+    idx = host_prefix_end(hostname);
+
+    hn->hostname = (char *) hostname;
+    hn->prefix = (char *) hostname;
+    hn->suffix = NULL;
+    hn->num = 0;
+
+    if (idx == (int) strlen(hostname) - 1)
+        return 0;
+
+    num = strtoul(hostname + idx + 1, &p, 10);
+
+    if ((*p == '\0') && (num <= MAX_HOST_SUFFIX)) {
+        if (idx + 2 > len)
+            return -1;
+        memcpy(buf, hostname, idx + 1);
+        buf[idx + 1] = '\0';
+        hn->prefix = buf;
+        hn->suffix = (char *) hostname + idx + 1;
+        hn->num = num;
+    }
+
+    return 0;
+}
+
 /* free a hostname object
  */
 static void hostname_destroy(hostname_t hn)
@@ -711,9 +795,12 @@ static int hostrange_cmp(hostrange_t h1, hostrange_t h2)
     assert(h1 != NULL);
     assert(h2 != NULL);
 
-    if ((retval = hostrange_prefix_cmp(h1, h2)) == 0)
-        retval = hostrange_width_combine(h1, h2) ?
-            h1->lo - h2->lo : h1->width - h2->width;
+    if ((retval = hostrange_prefix_cmp(h1, h2)) == 0) {
+        if (!hostrange_width_combine(h1, h2))
+            retval = h1->width - h2->width;
+        else if (h1->lo != h2->lo)
+            retval = (h1->lo < h2->lo) ? -1 : 1;
+    }
 
     return retval;
 }
@@ -951,72 +1038,6 @@ static int hostrange_hn_within(hostrange_t hr, hostname_t hn)
 }
 
 
-/* copy a string representation of the hostrange hr into buffer buf,
- * writing at most n chars including NUL termination
- */
-static size_t
-hostrange_to_string(hostrange_t hr, size_t n, char *buf, char *separator)
-{
-    unsigned long i;
-    int truncated = 0;
-    int len = 0;
-    char sep = separator == NULL ? ',' : separator[0];
-
-    if (n == 0)
-        return 0;
-
-    if (hr->singlehost)
-        return snprintf(buf, n, "%s", hr->prefix);
-
-    for (i = hr->lo; i <= hr->hi; i++) {
-        size_t m = (n - len) <= n ? n - len : 0; /* check for < 0 */
-        int ret = snprintf(buf + len, m, "%s%0*lu",
-                   hr->prefix, hr->width, i);
-        if (ret < 0 || ret >= m) {
-            len = n;
-            truncated = 1;
-            break;
-        }
-        len+=ret;
-        buf[len++] = sep;
-    }
-
-    if (truncated) {
-        buf[n-1] = '\0';
-        return -1;
-    } else {
-        /* back up over final separator */
-        buf[--len] = '\0';
-        return len;
-    }
-}
-
-/* Place the string representation of the numeric part of hostrange into buf
- * writing at most n chars including NUL termination.
- */
-static size_t hostrange_numstr(hostrange_t hr, size_t n, char *buf)
-{
-    int len = 0;
-
-    assert(buf != NULL);
-
-    if (hr->singlehost || n == 0)
-        return 0;
-
-    len = snprintf(buf, n, "%0*lu", hr->width, hr->lo);
-
-    if ((len >= 0) && (len < n) && (hr->lo < hr->hi)) {
-        int len2 = snprintf(buf+len, n-len, "-%0*lu", hr->width, hr->hi);
-        if (len2 < 0) 
-            len = -1;
-        else
-            len += len2;
-    }
-
-    return len;
-}
-
-
 /* ----[ hostlist functions ]---- */
 
 /* Create a new hostlist object. 
@@ -1044,6 +1065,8 @@ static hostlist_t hostlist_new(void)
     new->nranges = 0;
     new->nhosts = 0;
     new->ilist = NULL;
+    new->index = NULL;
+    new->nfinds = 0;
     return new;
 
   fail2:
@@ -1100,6 +1123,7 @@ static int hostlist_push_range(hostlist_t hl, hostrange_t hr)
 
     assert(hr != NULL);
     LOCK_HOSTLIST(hl);
+    hostlist_index_clear(hl);
 
     tail = (hl->nranges > 0) ? hl->hr[hl->nranges-1] : hl->hr[0];
 
@@ -1161,6 +1185,8 @@ static int hostlist_insert_range(hostlist_t hl, hostrange_t hr, int n)
     if (hl->size == hl->nranges && !hostlist_expand(hl))
         return 0;
 
+    hostlist_index_clear(hl);
+
     /* copy new hostrange into slot "n" in array */
     tmp = hl->hr[n];
     hl->hr[n] = hostrange_copy(hr);
@@ -1194,6 +1220,8 @@ static void hostlist_delete_range(hostlist_t hl, int n)
     assert(hl->magic == HOSTLIST_MAGIC);
     assert(n < hl->nranges && n >= 0);
 
+    hostlist_index_clear(hl);
+
     old = hl->hr[n];
     for (i = n; i < hl->nranges - 1; i++)
         hl->hr[i] = hl->hr[i + 1];
@@ -1561,6 +1589,7 @@ void hostlist_destroy(hostlist_t hl)
     for (i = 0; i < hl->nranges; i++)
         hostrange_destroy(hl->hr[i]);
     free(hl->hr);
+    hostlist_index_clear(hl);
     assert(hl->magic = 0x1);
     UNLOCK_HOSTLIST(hl);
     mutex_destroy(&hl->mutex);
@@ -1632,6 +1661,7 @@ char *hostlist_pop(hostlist_t hl)
     char *host = NULL;
 
     LOCK_HOSTLIST(hl);
+    hostlist_index_clear(hl);
     if (hl->nhosts > 0) {
         hostrange_t hr = hl->hr[hl->nranges - 1];
         host = hostrange_pop(hr);
@@ -1671,6 +1701,7 @@ char *hostlist_shift(hostlist_t hl)
     char *host = NULL;
 
     LOCK_HOSTLIST(hl);
+    hostlist_index_clear(hl);
 
     if (hl->nhosts > 0) {
         hostrange_t hr = hl->hr[0];
@@ -1694,7 +1725,7 @@ char *hostlist_shift(hostlist_t hl)
 char *hostlist_pop_range(hostlist_t hl)
 {
     int i;
-    char buf[MAXHOSTRANGELEN + 1];
+    char *buf;
     hostlist_t hltmp;
     hostrange_t tail;
 
@@ -1703,6 +1734,7 @@ char *hostlist_pop_range(hostlist_t hl)
         UNLOCK_HOSTLIST(hl);
         return NULL;
     }
+    hostlist_index_clear(hl);
 
     i = hl->nranges - 2;
     tail = hl->hr[hl->nranges - 1];
@@ -1718,16 +1750,16 @@ char *hostlist_pop_range(hostlist_t hl)
     hl->nranges -= hltmp->nranges;
 
     UNLOCK_HOSTLIST(hl);
-    hostlist_ranged_string(hltmp, MAXHOSTRANGELEN, buf);
+    buf = _bracketed_list_strdup(hltmp, 0);
     hostlist_destroy(hltmp);
-    return strdup(buf);
+    return buf;
 }
 
 
 char *hostlist_shift_range(hostlist_t hl)
 {
     int i;
-    char buf[1024];
+    char *buf;
     hostlist_t hltmp = hostlist_new();
     if (!hltmp)
         return NULL;
@@ -1739,6 +1771,7 @@ char *hostlist_shift_range(hostlist_t hl)
         UNLOCK_HOSTLIST(hl);
         return NULL;
     }
+    hostlist_index_clear(hl);
 
     i = 0;
     do {
@@ -1759,10 +1792,10 @@ char *hostlist_shift_range(hostlist_t hl)
 
     UNLOCK_HOSTLIST(hl);
 
-    hostlist_ranged_string(hltmp, 1024, buf);
+    buf = _bracketed_list_strdup(hltmp, 0);
     hostlist_destroy(hltmp);
 
-    return strdup(buf);
+    return buf;
 }
 
 /* XXX: Note: efficiency improvements needed */
@@ -1836,6 +1869,7 @@ int hostlist_delete_nth(hostlist_t hl, int n)
 
     LOCK_HOSTLIST(hl);
     assert(n >= 0 && n <= hl->nhosts);
+    hostlist_index_clear(hl);
 
     count = 0;
 
@@ -1876,18 +1910,169 @@ int hostlist_count(hostlist_t hl)
     return retval;
 }
 
+/* compare hostlist index entries, ranges with a numeric suffix by
+ * prefix and lo, then position in the hostlist */
+static int _index_cmp_ranged(const void *p1, const void *p2)
+{
+    const struct hostlist_index_entry *e1 = p1;
+    const struct hostlist_index_entry *e2 = p2;
+    int retval;
+
+    if ((retval = strcmp(e1->hr->prefix, e2->hr->prefix)))
+        return retval;
+    if (e1->hr->lo != e2->hr->lo)
+        return e1->hr->lo < e2->hr->lo ? -1 : 1;
+    return e1->offset - e2->offset;
+}
+
+/* compare hostlist index entries, singlehost ranges by name, then
+ * position in the hostlist */
+static int _index_cmp_single(const void *p1, const void *p2)
+{
+    const struct hostlist_index_entry *e1 = p1;
+    const struct hostlist_index_entry *e2 = p2;
+    int retval;
+
+    if ((retval = strcmp(e1->hr->prefix, e2->hr->prefix)))
+        return retval;
+    return e1->offset - e2->offset;
+}
+
+/* create a sorted index of the ranges in hostlist hl
+ *
+ * Returns NULL if malloc fails.
+ * Assumes that the hostlist hl is locked by caller
+ */
+static struct hostlist_index * hostlist_index_create(hostlist_t hl)
+{
+    struct hostlist_index *idx;
+    int i, r, s, offset;
+
+    if (!(idx = (struct hostlist_index *) malloc(sizeof(*idx))))
+        return NULL;
+    if (!(idx->e = malloc(hl->nranges * sizeof(*idx->e)))) {
+        free(idx);
+        return NULL;
+    }
+
+    idx->n = hl->nranges;
+    idx->nranged = 0;
+    idx->overlap = 0;
+    for (i = 0; i < hl->nranges; i++) {
+        if (!hl->hr[i]->singlehost)
+            idx->nranged++;
+    }
+
+    for (i = 0, r = 0, s = idx->nranged, offset = 0; i < hl->nranges; i++) {
+        struct hostlist_index_entry *e;
+
+        e = hl->hr[i]->singlehost ? &idx->e[s++] : &idx->e[r++];
+        e->hr = hl->hr[i];
+        e->offset = offset;
+        offset += hostrange_count(hl->hr[i]);
+    }
+
+    qsort(idx->e, idx->nranged, sizeof(*idx->e), &_index_cmp_ranged);
+    qsort(idx->e + idx->nranged, idx->n - idx->nranged, sizeof(*idx->e),
+          &_index_cmp_single);
+
+    for (i = 1; i < idx->nranged; i++) {
+        if (strcmp(idx->e[i - 1].hr->prefix, idx->e[i].hr->prefix) == 0
+            && idx->e[i].hr->lo <= idx->e[i - 1].hr->hi)
+            idx->overlap = 1;
+    }
+
+    return idx;
+}
+
+/* free the index of hostlist hl, whenever hl is changed
+ * Assumes that the hostlist hl is locked by caller
+ */
+static void hostlist_index_clear(hostlist_t hl)
+{
+    hl->nfinds = 0;
+    if (hl->index) {
+        free(hl->index->e);
+        free(hl->index);
+        hl->index = NULL;
+    }
+}
+
+/* return the position of the first host matching hn in the hostlist
+ * indexed by idx, -1 if not found.  The ranges of each prefix in idx
+ * must not overlap.
+ */
+static int hostlist_index_find(struct hostlist_index *idx, hostname_t hn)
+{
+    struct hostlist_index_entry *e;
+    int lo, hi, mid, pos, ret = -1;
+
+    /* first singlehost range named hn */
+    lo = idx->nranged;
+    hi = idx->n;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (strcmp(idx->e[mid].hr->prefix, hn->hostname) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < idx->n && strcmp(idx->e[lo].hr->prefix, hn->hostname) == 0)
+        ret = idx->e[lo].offset;
+
+    if (!hostname_suffix_is_valid(hn))
+        return ret;
+
+    /* last range of hn's prefix starting at or below hn's suffix */
+    lo = 0;
+    hi = idx->nranged;
+    while (lo < hi) {
+        int c;
+
+        mid = lo + (hi - lo) / 2;
+        c = strcmp(idx->e[mid].hr->prefix, hn->prefix);
+        if (c < 0 || (c == 0 && idx->e[mid].hr->lo <= hn->num))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0 && hostrange_hn_within((e = &idx->e[lo - 1])->hr, hn)) {
+        pos = e->offset + hn->num - e->hr->lo;
+        if (ret < 0 || pos < ret)
+            ret = pos;
+    }
+
+    return ret;
+}
+
 int hostlist_find(hostlist_t hl, const char *hostname)
 {
+    struct hostname_components hnbuf;
+    char prefix[MAXHOSTNAMELEN + 1];
     int i, count, ret = -1;
-    hostname_t hn;
+    hostname_t hn = &hnbuf;
 
     if (!hostname)
         return -1;
 
-    hn = hostname_create(hostname);
+    /* parse on the stack, unless the prefix does not fit */
+    if (hostname_parse(hn, hostname, prefix, sizeof(prefix)) < 0)
+        hn = hostname_create(hostname);
 
     LOCK_HOSTLIST(hl);
 
+    /* index on the second find since hl was changed, so that finds
+     * alternating with changes, as in hostlist_delete(), don't build
+     * an index each time */
+    if (!hl->index && hl->nranges >= HOSTLIST_INDEX_MIN_RANGES
+        && ++hl->nfinds > 1)
+        hl->index = hostlist_index_create(hl);
+
+    if (hl->index && !hl->index->overlap) {
+        ret = hostlist_index_find(hl->index, hn);
+        goto done;
+    }
+
     for (i = 0, count = 0; i < hl->nranges; i++) {
         if (hostrange_hn_within(hl->hr[i], hn)) {
             if (hostname_suffix_is_valid(hn) && !hl->hr[i]->singlehost)
@@ -1901,7 +2086,8 @@ int hostlist_find(hostlist_t hl, const char *hostname)
 
   done:
     UNLOCK_HOSTLIST(hl);
-    hostname_destroy(hn);
+    if (hn != &hnbuf)
+        hostname_destroy(hn);
     return ret;
 }
 
@@ -1927,6 +2113,7 @@ void hostlist_sort(hostlist_t hl)
     }
 
     qsort(hl->hr, hl->nranges, sizeof(hostrange_t), &_cmp);
+    hostlist_index_clear(hl);
 
     /* reset all iterators */
     for (i = hl->ilist; i; i = i->next)
@@ -1947,6 +2134,7 @@ static void hostlist_collapse(hostlist_t hl)
     int i;
 
     LOCK_HOSTLIST(hl);
+    hostlist_index_clear(hl);
     for (i = hl->nranges - 1; i > 0; i--) {
         hostrange_t hprev = hl->hr[i - 1];
         hostrange_t hnext = hl->hr[i];
@@ -1970,6 +2158,7 @@ static void hostlist_coalesce(hostlist_t hl)
     hostrange_t new;
 
     LOCK_HOSTLIST(hl);
+    hostlist_index_clear(hl);
 
     for (i = hl->nranges - 1; i > 0; i--) {
 
@@ -2043,6 +2232,7 @@ void hostlist_uniq(hostlist_t hl)
         return;
     }
     qsort(hl->hr, hl->nranges, sizeof(hostrange_t), &_cmp);
+    hostlist_index_clear(hl);
 
     while (i < hl->nranges) {
         if (_attempt_range_join(hl, i) < 0) /* No range join occurred */
@@ -2057,31 +2247,101 @@ void hostlist_uniq(hostlist_t hl)
 }
 
 
-ssize_t hostlist_deranged_string(hostlist_t hl, size_t n, char *buf)
+/* output state of the hostlist print functions: output is collected
+ * in buf and handed to fn a buffer at a time, or only counted if fn
+ * is NULL
+ */
+struct hostlist_writer {
+    hostlist_write_f fn;
+    void *arg;
+    size_t len;                 /* bytes output so far            */
+    size_t n;                   /* bytes waiting in buf           */
+    int error;                  /* set once fn has returned < 0   */
+    char buf[HOSTLIST_WRITE_BUFLEN];
+};
+
+/* string output of the hostlist print functions: at most n - 1
+ * bytes are copied to buf
+ */
+struct hostlist_string {
+    char *buf;
+    size_t n;
+    size_t len;
+};
+
+static void _writer_init(struct hostlist_writer *w, hostlist_write_f fn,
+                         void *arg)
 {
-    int i;
-    int len = 0;
-    int truncated = 0;
+    w->fn = fn;
+    w->arg = arg;
+    w->len = 0;
+    w->n = 0;
+    w->error = 0;
+}
 
-    LOCK_HOSTLIST(hl);
-    for (i = 0; i < hl->nranges; i++) {
-        size_t m = (n - len) <= n ? n - len : 0;
-        int ret = hostrange_to_string(hl->hr[i], m, buf + len, ",");
-        if (ret < 0 || ret > m) {
-            len = n;
-            truncated = 1;
-            break;
-        }
-        len+=ret;
-        buf[len++] = ',';
+static void _writer_flush(struct hostlist_writer *w)
+{
+    if (w->n > 0 && !w->error && w->fn(w->arg, w->buf, w->n) < 0)
+        w->error = 1;
+    w->n = 0;
+}
+
+static void _writer_write(struct hostlist_writer *w, const char *s,
+                          size_t len)
+{
+    w->len += len;
+    if (!w->fn)
+        return;
+
+    while (len > 0 && !w->error) {
+        size_t m = HOSTLIST_WRITE_BUFLEN - w->n;
+        if (m > len)
+            m = len;
+        memcpy(w->buf + w->n, s, m);
+        w->n += m;
+        s += m;
+        len -= m;
+        if (w->n == HOSTLIST_WRITE_BUFLEN)
+            _writer_flush(w);
     }
-    UNLOCK_HOSTLIST(hl);
+}
+
+static void _writer_putc(struct hostlist_writer *w, char c)
+{
+    _writer_write(w, &c, 1);
+}
 
-    buf[len > 0 ? --len : 0] = '\0';
-    if (len == n)
-        truncated = 1;
+/* write num zero padded to width digits, as "%0*lu" would */
+static void _writer_number(struct hostlist_writer *w, int width,
+                           unsigned long num)
+{
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%lu", num);
 
-    return truncated ? -1 : len;
+    while (width-- > len)
+        _writer_putc(w, '0');
+    _writer_write(w, buf, len);
+}
+
+/* write the hostnames of hr, separated by sep */
+static void _write_range_hosts(hostrange_t hr, const char *sep,
+                               struct hostlist_writer *w)
+{
+    size_t plen = strlen(hr->prefix);
+    size_t slen = strlen(sep);
+    unsigned long i;
+
+    if (hr->singlehost) {
+        _writer_write(w, hr->prefix, plen);
+        return;
+    }
+
+    for (i = hr->lo; i <= hr->hi && !w->error; i++) {
+        if (i > hr->lo)
+            _writer_write(w, sep, slen);
+        _writer_write(w, hr->prefix, plen);
+        _writer_number(w, hr->width, i);
+    }
 }
 
 /* return true if a bracket is needed for the range at i in hostlist hl */
@@ -2093,82 +2353,153 @@ static int _is_bracket_needed(hostlist_t hl, int i)
 }
 
 /* write the next bracketed hostlist, i.e. prefix[n-m,k,...]
- * into buf, writing at most n chars including the terminating '\0'
  *
- * leaves start pointing to one past last range object in bracketed list,
- * and returns the number of bytes written into buf.
+ * leaves start pointing to one past last range object in bracketed list.
  *
  * Assumes hostlist is locked.
  */
-static int
-_get_bracketed_list(hostlist_t hl, int *start, const size_t n, char *buf)
+static void
+_write_bracketed_list(hostlist_t hl, int *start, struct hostlist_writer *w)
 {
     hostrange_t *hr = hl->hr;
     int i = *start;
-    int m, len = 0;
     int bracket_needed = _is_bracket_needed(hl, i);
 
-    len = snprintf(buf, n, "%s", hr[i]->prefix);
-
-    if ((len < 0) || (len > n))
-        return n; /* truncated, buffer filled */
-
-    if (bracket_needed && len < n && len >= 0)
-        buf[len++] = '[';
+    _writer_write(w, hr[i]->prefix, strlen(hr[i]->prefix));
+    if (bracket_needed)
+        _writer_putc(w, '[');
 
     do {
-        m = (n - len) <= n ? n - len : 0;
-        len += hostrange_numstr(hr[i], m, buf + len);
-        if (len >= n)
-            break;
-        if (bracket_needed) /* Only need commas inside brackets */
-            buf[len++] = ',';
+        /* Only need commas inside brackets */
+        if (i > *start)
+            _writer_putc(w, ',');
+        if (!hr[i]->singlehost) {
+            _writer_number(w, hr[i]->width, hr[i]->lo);
+            if (hr[i]->lo < hr[i]->hi) {
+                _writer_putc(w, '-');
+                _writer_number(w, hr[i]->width, hr[i]->hi);
+            }
+        }
     } while (++i < hl->nranges && hostrange_within_range(hr[i], hr[i-1]));
 
-    if (bracket_needed && len < n && len > 0) {
+    if (bracket_needed)
+        _writer_putc(w, ']');
 
-        /* Add trailing bracket (change trailing "," from above to "]" */
-        buf[len - 1] = ']';
+    *start = i;
+}
 
-        /* NUL terminate for safety, but do not add terminator to len */
-        buf[len]   = '\0';
+/* write hl ranged, or deranged with the hostnames separated by sep if
+ * sep is not NULL.  Returns the length of the output, or -1 if
+ * w->fn failed.
+ */
+static ssize_t
+_hostlist_write(hostlist_t hl, const char *sep, struct hostlist_writer *w)
+{
+    int i = 0;
 
-    } else if (len >= n) {
-        if (n > 0)
-            buf[n-1] = '\0';
+    LOCK_HOSTLIST(hl);
+    while (i < hl->nranges && !w->error) {
+        if (i > 0)
+            _writer_write(w, sep ? sep : ",", sep ? strlen(sep) : 1);
+        if (sep)
+            _write_range_hosts(hl->hr[i++], sep, w);
+        else
+            _write_bracketed_list(hl, &i, w);
+    }
+    UNLOCK_HOSTLIST(hl);
 
-    } else {
-        /* If len is > 0, NUL terminate (but do not add to len) */
-        buf[len > 0 ? len : 0] = '\0';
+    if (w->fn)
+        _writer_flush(w);
+    return w->error ? -1 : w->len;
+}
+
+static int _string_write(void *arg, const char *buf, size_t len)
+{
+    struct hostlist_string *s = arg;
+
+    if (s->len + len >= s->n) {
+        memcpy(s->buf + s->len, buf, s->n - 1 - s->len);
+        s->len = s->n - 1;
+        return -1;
     }
+    memcpy(s->buf + s->len, buf, len);
+    s->len += len;
+    return 0;
+}
 
-    *start = i;
+/* copy hl into buf as _hostlist_write() would write it, writing at most
+ * n chars including NUL termination.  Returns the length written, or -1
+ * if truncation occurred.
+ */
+static ssize_t
+_hostlist_string(hostlist_t hl, const char *sep, size_t n, char *buf)
+{
+    struct hostlist_writer w;
+    struct hostlist_string s;
+    ssize_t len;
+
+    if (n == 0)
+        return -1;
+
+    s.buf = buf;
+    s.n = n;
+    s.len = 0;
+    _writer_init(&w, _string_write, &s);
+    len = _hostlist_write(hl, sep, &w);
+    buf[s.len] = '\0';
     return len;
 }
 
+/* return the bracketed hostlist starting at range start of hl as a
+ * new string, or NULL if out of memory.  Assumes hostlist is locked.
+ */
+static char *_bracketed_list_strdup(hostlist_t hl, int start)
+{
+    struct hostlist_writer w;
+    struct hostlist_string s;
+    int i = start;
+
+    _writer_init(&w, NULL, NULL);
+    _write_bracketed_list(hl, &i, &w);
+
+    s.n = w.len + 1;
+    s.len = 0;
+    if (!(s.buf = malloc(s.n)))
+        return NULL;
+
+    i = start;
+    _writer_init(&w, _string_write, &s);
+    _write_bracketed_list(hl, &i, &w);
+    _writer_flush(&w);
+    s.buf[s.len] = '\0';
+    return s.buf;
+}
+
+ssize_t hostlist_deranged_string(hostlist_t hl, size_t n, char *buf)
+{
+    return _hostlist_string(hl, ",", n, buf);
+}
+
 ssize_t hostlist_ranged_string(hostlist_t hl, size_t n, char *buf)
 {
-    int i = 0;
-    int len = 0;
-    int truncated = 0;
+    return _hostlist_string(hl, NULL, n, buf);
+}
 
-    LOCK_HOSTLIST(hl);
-    while (i < hl->nranges && len < n) {
-        len += _get_bracketed_list(hl, &i, n - len, buf + len);
-        if ((len > 0) && (len < n) && (i < hl->nranges))
-            buf[len++] = ',';
-    }
-    UNLOCK_HOSTLIST(hl);
+ssize_t hostlist_ranged_write(hostlist_t hl, hostlist_write_f fn, void *arg)
+{
+    struct hostlist_writer w;
 
-    /* NUL terminate */
-    if (len >= n) {
-        truncated = 1;
-        if (n > 0)
-            buf[n-1] = '\0';
-    } else
-        buf[len > 0 ? len : 0] = '\0';
+    _writer_init(&w, fn, arg);
+    return _hostlist_write(hl, NULL, &w);
+}
 
-    return truncated ? -1 : len;
+ssize_t hostlist_deranged_write(hostlist_t hl, const char *sep,
+                                hostlist_write_f fn, void *arg)
+{
+    struct hostlist_writer w;
+
+    _writer_init(&w, fn, arg);
+    return _hostlist_write(hl, sep ? sep : ",", &w);
 }
 
 /* ----[ hostlist iterator functions ]---- */
@@ -2246,7 +2577,8 @@ static void _iterator_advance(hostlist_iterator_t i)
         return;
     if (++(i->depth) > (i->hr->hi - i->hr->lo)) {
         i->depth = 0;
-        i->hr = i->hl->hr[++i->idx];
+        /* hr[] may be full, don't read past its last range */
+        i->hr = ++i->idx < i->hl->nranges ? i->hl->hr[i->idx] : NULL;
     }
 }
 
@@ -2267,7 +2599,7 @@ static void _iterator_advance_range(hostlist_iterator_t i)
     if (++i->depth > 0) {
         while (++j < nr && hostrange_within_range(i->hr, hr[j])) {;}
         i->idx = j;
-        i->hr = i->hl->hr[i->idx];
+        i->hr = j < nr ? i->hl->hr[j] : NULL;
         i->depth = 0;
     }
 }
@@ -2304,10 +2636,34 @@ char *hostlist_next(hostlist_iterator_t i)
     return (buf);
 }
 
+int hostlist_next_host(hostlist_iterator_t i, char *buf, size_t n)
+{
+    int len;
+    assert(i != NULL);
+    assert(i->magic == HOSTLIST_MAGIC);
+    LOCK_HOSTLIST(i->hl);
+    _iterator_advance(i);
+
+    if (i->idx > i->hl->nranges - 1) {
+        UNLOCK_HOSTLIST(i->hl);
+        if (n > 0)
+            buf[0] = '\0';
+        return 0;
+    }
+
+    if (i->hr->singlehost)
+        len = snprintf(buf, n, "%s", i->hr->prefix);
+    else
+        len = snprintf(buf, n, "%s%0*lu", i->hr->prefix, i->hr->width,
+                       i->hr->lo + i->depth);
+
+    UNLOCK_HOSTLIST(i->hl);
+    return len;
+}
+
 char *hostlist_next_range(hostlist_iterator_t i)
 {
-    char buf[MAXHOSTRANGELEN + 1];
-    int j;
+    char *buf;
 
     assert(i != NULL);
     assert(i->magic == HOSTLIST_MAGIC);
@@ -2320,12 +2676,11 @@ char *hostlist_next_range(hostlist_iterator_t i)
         return NULL;
     }
 
-    j = i->idx;
-    _get_bracketed_list(i->hl, &j, MAXHOSTRANGELEN, buf);
+    buf = _bracketed_list_strdup(i->hl, i->idx);
 
     UNLOCK_HOSTLIST(i->hl);
 
-    return strdup(buf);
+    return buf;
 }
 
 int hostlist_remove(hostlist_iterator_t i)
@@ -2334,6 +2689,7 @@ int hostlist_remove(hostlist_iterator_t i)
     assert(i != NULL);
     assert(i->magic == HOSTLIST_MAGIC);
     LOCK_HOSTLIST(i->hl);
+    hostlist_index_clear(i->hl);
     new = hostrange_delete_host(i->hr, i->hr->lo + i->depth);
     if (new) {
         hostlist_insert_range(i->hl, new, i->idx + 1);
@@ -2413,6 +2769,8 @@ static int hostset_insert_range(hostset_t set, hostrange_t hr)
     if (hl->size == hl->nranges && !hostlist_expand(hl))
         return 0;
 
+    hostlist_index_clear(hl);
+
     nhosts = hostrange_count(hr);
 
     for (i = 0; i < hl->nranges; i++) {
@@ -2559,13 +2917,377 @@ ssize_t hostset_deranged_string(hostset_t set, size_t n, char *buf)
     return hostlist_deranged_string(set->hl, n, buf);
 }
 
-#if TEST_MAIN 
+ssize_t hostset_ranged_write(hostset_t set, hostlist_write_f fn, void *arg)
+{
+    return hostlist_ranged_write(set->hl, fn, arg);
+}
+
+ssize_t hostset_deranged_write(hostset_t set, const char *sep,
+                               hostlist_write_f fn, void *arg)
+{
+    return hostlist_deranged_write(set->hl, sep, fn, arg);
+}
+
+/* ----[ hostlist set operations ]---- */
+
+#define HOSTLIST_UNION      0
+#define HOSTLIST_INTERSECT  1
+#define HOSTLIST_DIFFERENCE 2
+
+/* return true if the ranges of hl are sorted, do not overlap, and
+ * all ranges of each prefix have compatible widths, as after
+ * hostlist_uniq() on all but mixed width hostlists
+ * Assumes that the hostlist hl is locked by caller
+ */
+static int hostlist_is_uniq(hostlist_t hl)
+{
+    int i;
+
+    for (i = 1; i < hl->nranges; i++) {
+        hostrange_t prev = hl->hr[i - 1];
+        hostrange_t hr = hl->hr[i];
+        int cmp = hostrange_prefix_cmp(prev, hr);
+
+        if (cmp > 0)
+            return 0;
+        if (cmp < 0)
+            continue;
+        if (prev->singlehost || !hostrange_width_combine(prev, hr)
+            || prev->hi >= hr->lo)
+            return 0;
+    }
+    return 1;
+}
+
+/* append hosts lo through hi of range hr to hostlist hl, joining them
+ * to the last range of hl if they overlap or follow it.  Hosts must
+ * be appended in hostlist_uniq() order.
+ *
+ * Returns 0 if malloc fails, 1 otherwise.
+ * Assumes that the hostlist hl is locked by caller
+ */
+static int hostlist_append_range(hostlist_t hl, hostrange_t hr,
+                                 unsigned long lo, unsigned long hi)
+{
+    hostrange_t tail = hl->nranges > 0 ? hl->hr[hl->nranges - 1] : NULL;
+    hostrange_t new;
+
+    if (tail && !hr->singlehost && !tail->singlehost
+        && hostrange_prefix_cmp(tail, hr) == 0
+        && lo <= tail->hi + 1
+        && hostrange_width_combine(tail, hr)) {
+        if (hi > tail->hi) {
+            hl->nhosts += hi - tail->hi;
+            tail->hi = hi;
+        }
+        return 1;
+    }
+
+    if (hl->size == hl->nranges && !hostlist_expand(hl))
+        return 0;
+
+    if (hr->singlehost)
+        new = hostrange_create_single(hr->prefix);
+    else
+        new = hostrange_create(hr->prefix, lo, hi, hr->width);
+    if (!new)
+        return 0;
+
+    hl->hr[hl->nranges++] = new;
+    hl->nhosts += hostrange_count(new);
+    return 1;
+}
+
+/* merge the ranges of hl1 and hl2, which must satisfy
+ * hostlist_is_uniq(), into a new hostlist holding the union,
+ * intersection, or difference of the two, in time linear in their
+ * number of ranges.
+ *
+ * Returns NULL if malloc fails, or with errno set to EINVAL if ranges
+ * of one prefix in hl1 and hl2 have incompatible widths.
+ * Assumes that both hostlists are locked by caller
+ */
+static hostlist_t hostlist_merge(hostlist_t hl1, hostlist_t hl2, int op)
+{
+    hostlist_t new;
+    hostrange_t a, b;
+    unsigned long lo;
+    int i = 0, j = 0;
+
+    if (!(new = hostlist_new()))
+        return NULL;
+
+    /* a is hl1->hr[i], of which hosts lo and up are left */
+    a = hl1->nranges > 0 ? hl1->hr[0] : NULL;
+    lo = a ? a->lo : 0;
+
+    while (a || j < hl2->nranges) {
+        int cmp;
+
+        b = j < hl2->nranges ? hl2->hr[j] : NULL;
+
+        /* order a and b, a missing range is last */
+        if (!b)
+            cmp = -1;
+        else if (!a)
+            cmp = 1;
+        else if ((cmp = hostrange_prefix_cmp(a, b)) == 0
+                 && !a->singlehost) {
+            if (!hostrange_width_combine(a, b)) {
+                hostlist_destroy(new);
+                errno = EINVAL;
+                return NULL;
+            }
+            if (a->hi < b->lo)
+                cmp = -1;
+            else if (b->hi < lo)
+                cmp = 1;
+        }
+
+        if (cmp < 0) {
+            /* hosts of a before b */
+            if (op != HOSTLIST_INTERSECT
+                && !hostlist_append_range(new, a, lo, a->hi))
+                goto error;
+        } else if (cmp > 0) {
+            /* hosts of b before a */
+            if (op == HOSTLIST_UNION
+                && !hostlist_append_range(new, b, b->lo, b->hi))
+                goto error;
+            j++;
+            continue;
+        } else if (a->singlehost) {
+            /* the same singlehost */
+            if (op != HOSTLIST_DIFFERENCE
+                && !hostlist_append_range(new, a, lo, a->hi))
+                goto error;
+            j++;
+        } else {
+            /* a and b overlap, handle hosts up to the first to end */
+            unsigned long hi = a->hi < b->hi ? a->hi : b->hi;
+
+            if (op == HOSTLIST_UNION) {
+                if (!hostlist_append_range(new, a, lo < b->lo ? lo : b->lo, hi))
+                    goto error;
+            } else if (op == HOSTLIST_INTERSECT) {
+                if (!hostlist_append_range(new, a, lo > b->lo ? lo : b->lo, hi))
+                    goto error;
+            } else if (lo < b->lo) {
+                if (!hostlist_append_range(new, a, lo, b->lo - 1))
+                    goto error;
+            }
+
+            if (b->hi <= a->hi)
+                j++;
+            if (b->hi < a->hi) {
+                lo = b->hi + 1;
+                continue;
+            }
+            if (op == HOSTLIST_UNION && b->hi > a->hi) {
+                /* the rest of b is appended as a range of its own */
+                if (!hostlist_append_range(new, b, a->hi + 1, b->hi))
+                    goto error;
+                j++;
+            }
+        }
+
+        /* done with a */
+        a = ++i < hl1->nranges ? hl1->hr[i] : NULL;
+        lo = a ? a->lo : 0;
+    }
+
+    return new;
+
+  error:
+    hostlist_destroy(new);
+    return NULL;
+}
+
+/* compute the union, intersection, or difference of hl1 and hl2
+ * host by host, for hostlists hostlist_merge() cannot handle
+ */
+static hostlist_t hostlist_merge_hosts(hostlist_t hl1, hostlist_t hl2, int op)
+{
+    hostlist_t new;
+    hostlist_iterator_t i;
+    char *host;
+
+    if (op == HOSTLIST_UNION) {
+        if (!(new = hostlist_copy(hl1)))
+            return NULL;
+        hostlist_push_list(new, hl2);
+        hostlist_uniq(new);
+        return new;
+    }
+
+    if (!(new = hostlist_create(NULL)))
+        return NULL;
+    if (!(i = hostlist_iterator_create(hl1))) {
+        hostlist_destroy(new);
+        return NULL;
+    }
+    while ((host = hostlist_next(i))) {
+        if ((hostlist_find(hl2, host) >= 0) == (op == HOSTLIST_INTERSECT))
+            hostlist_push_host(new, host);
+        free(host);
+    }
+    hostlist_iterator_destroy(i);
+    hostlist_uniq(new);
+    return new;
+}
+
+/* compute the union, intersection, or difference of hl1 and hl2, as
+ * a new sorted hostlist without duplicates
+ */
+static hostlist_t hostlist_set_op(hostlist_t hl1, hostlist_t hl2, int op)
+{
+    hostlist_t new, uniq1 = NULL, uniq2 = NULL;
+    hostlist_t first, second;
+
+    if (hl1 == NULL || hl2 == NULL)
+        seterrno_ret(EINVAL, NULL);
+
+    /* lock in a fixed order, a hostlist may be given twice */
+    first = hl1 < hl2 ? hl1 : hl2;
+    second = hl1 < hl2 ? hl2 : hl1;
+    LOCK_HOSTLIST(first);
+    if (second != first)
+        LOCK_HOSTLIST(second);
+
+    if (hostlist_is_uniq(hl1) && hostlist_is_uniq(hl2))
+        new = hostlist_merge(hl1, hl2, op);
+    else {
+        new = NULL;
+        errno = EINVAL;
+    }
+
+    if (second != first)
+        UNLOCK_HOSTLIST(second);
+    UNLOCK_HOSTLIST(first);
+
+    if (new || errno != EINVAL)
+        return new;
+
+    /* sort and uniq copies of unsorted hostlists, and merge those */
+    if (!(uniq1 = hostlist_copy(hl1)) || !(uniq2 = hostlist_copy(hl2)))
+        goto done;
+    hostlist_uniq(uniq1);
+    hostlist_uniq(uniq2);
+
+    new = NULL;
+    errno = EINVAL;
+    if (hostlist_is_uniq(uniq1) && hostlist_is_uniq(uniq2))
+        new = hostlist_merge(uniq1, uniq2, op);
+
+    /* mixed widths within a prefix, where the order of hosts after
+     * hostlist_uniq() depends on the order they were pushed in */
+    if (!new && errno == EINVAL)
+        new = hostlist_merge_hosts(hl1, hl2, op);
+
+  done:
+    hostlist_destroy(uniq1);
+    hostlist_destroy(uniq2);
+    return new;
+}
+
+hostlist_t hostlist_union(hostlist_t hl1, hostlist_t hl2)
+{
+    return hostlist_set_op(hl1, hl2, HOSTLIST_UNION);
+}
+
+hostlist_t hostlist_intersect(hostlist_t hl1, hostlist_t hl2)
+{
+    return hostlist_set_op(hl1, hl2, HOSTLIST_INTERSECT);
+}
+
+hostlist_t hostlist_difference(hostlist_t hl1, hostlist_t hl2)
+{
+    return hostlist_set_op(hl1, hl2, HOSTLIST_DIFFERENCE);
+}
+
+/* wrap the result of a hostlist set operation in a new hostset */
+static hostset_t hostset_wrap(hostlist_t hl)
+{
+    hostset_t new;
+
+    if (!hl)
+        return NULL;
+    if (!(new = (hostset_t) malloc(sizeof(*new)))) {
+        hostlist_destroy(hl);
+        out_of_memory("hostset_wrap");
+    }
+    new->hl = hl;
+    return new;
+}
+
+hostset_t hostset_union(hostset_t set1, hostset_t set2)
+{
+    if (set1 == NULL || set2 == NULL)
+        seterrno_ret(EINVAL, NULL);
+    return hostset_wrap(hostlist_union(set1->hl, set2->hl));
+}
+
+hostset_t hostset_intersect(hostset_t set1, hostset_t set2)
+{
+    if (set1 == NULL || set2 == NULL)
+        seterrno_ret(EINVAL, NULL);
+    return hostset_wrap(hostlist_intersect(set1->hl, set2->hl));
+}
+
+hostset_t hostset_difference(hostset_t set1, hostset_t set2)
+{
+    if (set1 == NULL || set2 == NULL)
+        seterrno_ret(EINVAL, NULL);
+    return hostset_wrap(hostlist_difference(set1->hl, set2->hl));
+}
 
 int hostlist_nranges(hostlist_t hl)
 {
-    return hl->nranges;
+    int retval;
+    LOCK_HOSTLIST(hl);
+    retval = hl->nranges;
+    UNLOCK_HOSTLIST(hl);
+    return retval;
+}
+
+int hostlist_nth_range(hostlist_t hl, int n, char **prefix,
+                       unsigned long *lo, unsigned long *hi, int *width)
+{
+    hostrange_t hr;
+    int retval;
+
+    LOCK_HOSTLIST(hl);
+    if (n < 0 || n >= hl->nranges) {
+        UNLOCK_HOSTLIST(hl);
+        return -1;
+    }
+    hr = hl->hr[n];
+    *prefix = hr->prefix;
+    *lo = hr->singlehost ? 0 : hr->lo;
+    *hi = hr->singlehost ? 0 : hr->hi;
+    *width = hr->singlehost ? 0 : hr->width;
+    retval = hr->singlehost ? 0 : 1;
+    UNLOCK_HOSTLIST(hl);
+    return retval;
+}
+
+int hostlist_push_numbered(hostlist_t hl, const char *prefix,
+                           unsigned long lo, unsigned long hi, int width)
+{
+    hostrange_t hr;
+    int retval;
+
+    if (lo > hi)
+        seterrno_ret(EINVAL, -1);
+    if (!(hr = hostrange_create((char *) prefix, lo, hi, width)))
+        return -1;
+    retval = hostlist_push_range(hl, hr);
+    hostrange_destroy(hr);
+    return retval;
 }
 
+#if TEST_MAIN 
+
 int hostset_nranges(hostset_t set)
 {
     return set->hl->nranges;
@@ -262,6 +262,24 @@ void hostlist_sort(hostlist_t hl);
  */
 void hostlist_uniq(hostlist_t hl);
 
+/* hostlist_union():
+ * hostlist_intersect():
+ * hostlist_difference():
+ *
+ * Create a new hostlist of the hosts in hl1 or hl2, in both hl1 and
+ * hl2, or in hl1 but not hl2, sorted and without duplicates as by
+ * hostlist_uniq().
+ *
+ * If hl1 and hl2 are sorted without duplicates, as after
+ * hostlist_uniq(), these take time linear in their number of ranges,
+ * independent of their number of hosts.
+ *
+ * Returns NULL on failure.
+ */
+hostlist_t hostlist_union(hostlist_t hl1, hostlist_t hl2);
+hostlist_t hostlist_intersect(hostlist_t hl1, hostlist_t hl2);
+hostlist_t hostlist_difference(hostlist_t hl1, hostlist_t hl2);
+
 
 /* ----[ hostlist print functions ]---- */
 
@@ -291,6 +309,36 @@ ssize_t hostset_ranged_string(hostset_t hs, size_t n, char *buf);
 ssize_t hostlist_deranged_string(hostlist_t hl, size_t n, char *buf);
 ssize_t hostset_deranged_string(hostset_t hs, size_t n, char *buf);
 
+/* hostlist_write_f:
+ *
+ * Receives the next len bytes of output of a hostlist write function
+ * in buf, which is not NUL terminated.  Returns < 0 to stop the write.
+ * It is called with the hostlist locked, and must not use it.
+ */
+typedef int (*hostlist_write_f)(void *arg, const char *buf, size_t len);
+
+/* hostlist_ranged_write():
+ *
+ * Pass the string hostlist_ranged_string() would write for hl to fn,
+ * a buffer at a time, so output of any size is written in constant
+ * memory.  Returns the length of the string, or -1 if fn returned < 0.
+ *
+ * If fn is NULL, nothing is written, and the exact length of the
+ * string is returned: a buffer of one more byte will hold it.
+ */
+ssize_t hostlist_ranged_write(hostlist_t hl, hostlist_write_f fn, void *arg);
+ssize_t hostset_ranged_write(hostset_t hs, hostlist_write_f fn, void *arg);
+
+/* hostlist_deranged_write():
+ *
+ * As hostlist_ranged_write(), for every hostname of hl separated by
+ * sep, or by "," if sep is NULL.
+ */
+ssize_t hostlist_deranged_write(hostlist_t hl, const char *sep,
+                                hostlist_write_f fn, void *arg);
+ssize_t hostset_deranged_write(hostset_t hs, const char *sep,
+                               hostlist_write_f fn, void *arg);
+
 
 /* ----[ hostlist utility functions ]---- */
 
@@ -302,6 +350,33 @@ ssize_t hostset_deranged_string(hostset_t hs, size_t n, char *buf);
 int hostlist_nranges(hostlist_t hl);
 
 
+/* hostlist_nth_range():
+ *
+ * Store the prefix, first and last numeric suffix, and zero-padding
+ * width of the nth range of hostlist hl in prefix, lo, hi, and width.
+ * prefix points into hl and is only valid until hl is modified.
+ *
+ * Returns 1 for a range of hosts with a numeric suffix, 0 for a
+ * single host without one (lo, hi, and width are then 0), or -1 if
+ * there is no nth range.
+ */
+int hostlist_nth_range(hostlist_t hl, int n, char **prefix,
+                       unsigned long *lo, unsigned long *hi, int *width);
+
+
+/* hostlist_push_numbered():
+ *
+ * Push the hosts prefix followed by each number from lo to hi, zero
+ * padded to width digits, onto hostlist hl, without parsing their
+ * names.  The range is joined to the last range of hl if it follows
+ * it.  The inverse of hostlist_nth_range().
+ *
+ * Returns the number of hosts in hl, or -1 on failure.
+ */
+int hostlist_push_numbered(hostlist_t hl, const char *prefix,
+                           unsigned long lo, unsigned long hi, int width);
+
+
 /* ----[ hostlist iterator functions ]---- */
 
 /* hostlist_iterator_create():
@@ -339,6 +414,15 @@ void hostlist_iterator_reset(hostlist_iterator_t i);
  */ 
 char * hostlist_next(hostlist_iterator_t i);
 
+/* hostlist_next_host():
+ *
+ * As hostlist_next(), but writes the next hostname into buf, writing
+ * at most n chars including the terminating NUL, so that nothing is
+ * allocated per host.  Returns the length of the hostname, which was
+ * truncated if it is n or more, or 0 at the end of the list.
+ */
+int hostlist_next_host(hostlist_iterator_t i, char *buf, size_t n);
+
 
 /* hostlist_next_range():
  *
@@ -413,5 +497,19 @@ char * hostset_shift_range(hostset_t set);
  */
 int hostset_count(hostset_t set);
 
+/* hostset_union():
+ * hostset_intersect():
+ * hostset_difference():
+ *
+ * Create a new hostset of the hosts in set1 or set2, in both set1 and
+ * set2, or in set1 but not set2, in time linear in the number of
+ * ranges of set1 and set2.  See hostlist_union().
+ *
+ * Returns NULL on failure.
+ */
+hostset_t hostset_union(hostset_t set1, hostset_t set2);
+hostset_t hostset_intersect(hostset_t set1, hostset_t set2);
+hostset_t hostset_difference(hostset_t set1, hostset_t set2);
+
 
 #endif /* !_HOSTLIST_H */
@@ -0,0 +1,264 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+/*
+ * Time hostlist operations on hostlists of many ranges.
+ *
+ * Usage: hostlist_bench [ranges [iterations [sethosts]]]
+ *
+ * Build with "make hostlist_bench".  The hostlist holds the given
+ * number of ranges of three hosts each, spread over four prefixes,
+ * with a gap after every range.  Every host, and every gap, is looked
+ * up iterations times.
+ *
+ * Then the union, intersection and difference of two hostlists of
+ * sethosts hosts each, in ranges of 1 to 64 hosts, are computed
+ * iterations times, by the hostlist set operations and host by host.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hostlist.h"
+
+static const char *prefixes[] = { "ib", "node", "pn", "x" };
+
+#define NUMPREFIXES (sizeof(prefixes) / sizeof(prefixes[0]))
+
+static double
+_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+_report(const char *name, double start, long ops)
+{
+  printf("%-20s %10.1f ns/op\n", name, (_now() - start) * 1e9 / ops);
+}
+
+/*
+ * _random_set
+ *
+ * Create a sorted hostlist of 'hosts' hosts, in ranges of 1 to 64
+ * hosts with gaps of 1 to 64 hosts between them.
+ */
+static hostlist_t
+_random_set(int hosts)
+{
+  hostlist_t hl;
+  char buf[64];
+  int n = 0, lo = 0, len;
+
+  if (!(hl = hostlist_create(NULL)))
+    {
+      perror("hostlist_create");
+      exit(1);
+    }
+
+  while (n < hosts)
+    {
+      lo += 1 + rand() % 64;
+      len = 1 + rand() % 64;
+      if (len > hosts - n)
+        len = hosts - n;
+      snprintf(buf, sizeof(buf), "node[%d-%d]", lo, lo + len - 1);
+      hostlist_push(hl, buf);
+      lo += len;
+      n += len;
+    }
+
+  hostlist_uniq(hl);
+  return hl;
+}
+
+/*
+ * _set_op_hosts
+ *
+ * Compute a set operation host by host, by pushing both hostlists
+ * for a union, or looking up every host of hl1 in hl2.
+ */
+static hostlist_t
+_set_op_hosts(hostlist_t hl1, hostlist_t hl2, int keep)
+{
+  hostlist_t hl = hostlist_create(NULL);
+  hostlist_iterator_t itr;
+  char *host;
+
+  if (keep < 0)
+    {
+      hostlist_push_list(hl, hl1);
+      hostlist_push_list(hl, hl2);
+    }
+  else
+    {
+      itr = hostlist_iterator_create(hl1);
+      while ((host = hostlist_next(itr)))
+        {
+          if ((hostlist_find(hl2, host) >= 0) == keep)
+            hostlist_push_host(hl, host);
+          free(host);
+        }
+      hostlist_iterator_destroy(itr);
+    }
+
+  hostlist_uniq(hl);
+  return hl;
+}
+
+static void
+_bench_set_ops(int hosts, int iterations)
+{
+  static const char *names[] = { "union", "intersect", "difference" };
+  hostlist_t hl1 = _random_set(hosts);
+  hostlist_t hl2 = _random_set(hosts);
+  char name[64];
+  int op, j;
+  double start;
+
+  printf("%d and %d hosts, %d and %d ranges\n",
+         hostlist_count(hl1), hostlist_count(hl2),
+         hostlist_nranges(hl1), hostlist_nranges(hl2));
+
+  for (op = 0; op < 3; op++)
+    {
+      hostlist_t fast = NULL, slow = NULL;
+
+      start = _now();
+      for (j = 0; j < iterations; j++)
+        {
+          hostlist_destroy(fast);
+          if (op == 0)
+            fast = hostlist_union(hl1, hl2);
+          else if (op == 1)
+            fast = hostlist_intersect(hl1, hl2);
+          else
+            fast = hostlist_difference(hl1, hl2);
+        }
+      _report(names[op], start, iterations);
+
+      start = _now();
+      for (j = 0; j < iterations; j++)
+        {
+          hostlist_destroy(slow);
+          slow = _set_op_hosts(hl1, hl2, op == 0 ? -1 : op == 1);
+        }
+      snprintf(name, sizeof(name), "%s by host", names[op]);
+      _report(name, start, iterations);
+
+      if (!fast
+          || hostlist_count(fast) != hostlist_count(slow)
+          || hostlist_nranges(fast) != hostlist_nranges(slow))
+        {
+          fprintf(stderr, "hostlist_%s: wrong result\n", names[op]);
+          exit(1);
+        }
+      hostlist_destroy(fast);
+      hostlist_destroy(slow);
+    }
+
+  hostlist_destroy(hl1);
+  hostlist_destroy(hl2);
+}
+
+int
+main(int argc, char **argv)
+{
+  hostlist_t hl;
+  char host[64];
+  int ranges, iterations, sethosts, i, j, found;
+  long ops;
+  double start;
+
+  ranges = argc > 1 ? atoi(argv[1]) : 4096;
+  iterations = argc > 2 ? atoi(argv[2]) : 10;
+  sethosts = argc > 3 ? atoi(argv[3]) : 100000;
+
+  if (!(hl = hostlist_create(NULL)))
+    {
+      perror("hostlist_create");
+      exit(1);
+    }
+
+  /* range i is prefix[i % NUMPREFIXES][4i-4i+2], 4i+3 is a gap */
+  for (i = 0; i < ranges; i++)
+    {
+      snprintf(host, sizeof(host), "%s[%d-%d]",
+               prefixes[i % NUMPREFIXES], 4 * i, 4 * i + 2);
+      hostlist_push(hl, host);
+    }
+
+  printf("%d ranges, %d hosts, %d iterations\n",
+         hostlist_nranges(hl), hostlist_count(hl), iterations);
+
+  ops = (long)ranges * 3 * iterations;
+  found = 0;
+  start = _now();
+  for (j = 0; j < iterations; j++)
+    for (i = 0; i < ranges * 3; i++)
+      {
+        snprintf(host, sizeof(host), "%s%d",
+                 prefixes[(i / 3) % NUMPREFIXES], 4 * (i / 3) + i % 3);
+        found += hostlist_find(hl, host) == i;
+      }
+  _report("find", start, ops);
+  if (found != ops)
+    {
+      fprintf(stderr, "hostlist_find: wrong position\n");
+      exit(1);
+    }
+
+  ops = (long)ranges * iterations;
+  found = 0;
+  start = _now();
+  for (j = 0; j < iterations; j++)
+    for (i = 0; i < ranges; i++)
+      {
+        snprintf(host, sizeof(host), "%s%d",
+                 prefixes[i % NUMPREFIXES], 4 * i + 3);
+        found += hostlist_find(hl, host) < 0;
+      }
+  _report("find missing", start, ops);
+  if (found != ops)
+    {
+      fprintf(stderr, "hostlist_find: found missing host\n");
+      exit(1);
+    }
+
+  hostlist_destroy(hl);
+
+  _bench_set_ops(sethosts, iterations);
+  exit(0);
+}
@@ -0,0 +1,391 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+/*
+ * Check hostlist and hostset set operations against computing them
+ * host by host, and the hostlist print and iterator functions against
+ * each other, on random hostlists.  Also check that hostlist_nth_range()
+ * and hostlist_push_numbered() rebuild a hostlist.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hostlist.h"
+
+#define TESTS      2000
+#define MAXRANGES  40
+
+#define OP_UNION      0
+#define OP_INTERSECT  1
+#define OP_DIFFERENCE 2
+
+static const char *opnames[] = { "union", "intersect", "difference" };
+
+/* few prefixes and suffixes, so that hostlists overlap */
+static const char *prefixes[] = { "a", "node", "node-ib", "x" };
+
+#define NUMPREFIXES (sizeof(prefixes) / sizeof(prefixes[0]))
+
+static int errors;
+
+/* output collected by _append */
+struct output {
+  char buf[65536];
+  size_t len;
+};
+
+/*
+ * Push random hosts onto 'hl': ranges, zero padded ranges of one
+ * prefix, and hosts without a numeric suffix.  If 'mixed', the padded
+ * prefix also gets hosts without padding.
+ */
+static void
+random_hostlist(hostlist_t hl, int mixed)
+{
+  char buf[64];
+  int i, n, lo;
+
+  n = rand() % MAXRANGES;
+  for (i = 0; i < n; i++)
+    {
+      const char *prefix = prefixes[rand() % NUMPREFIXES];
+
+      lo = rand() % 100;
+      switch (rand() % 8)
+        {
+        case 0:
+          snprintf(buf, sizeof(buf), "login%d", rand() % 3);
+          buf[5] = 'a' + buf[5] - '0';
+          break;
+        case 1:
+          snprintf(buf, sizeof(buf), "%s%d", prefix, lo);
+          break;
+        case 2:
+          snprintf(buf, sizeof(buf), "pn[%03d-%03d]", lo, lo + rand() % 20);
+          break;
+        case 3:
+          if (mixed)
+            {
+              snprintf(buf, sizeof(buf), "pn%d", lo);
+              break;
+            }
+          /* fall through */
+        default:
+          snprintf(buf, sizeof(buf), "%s[%d-%d]", prefix, lo, lo + rand() % 20);
+          break;
+        }
+      hostlist_push(hl, buf);
+    }
+}
+
+/*
+ * Compute a set operation host by host.
+ */
+static hostlist_t
+naive(hostlist_t hl1, hostlist_t hl2, int op)
+{
+  hostlist_t hl = hostlist_create(NULL);
+  hostlist_iterator_t itr;
+  char *host;
+
+  if (op == OP_UNION)
+    {
+      hostlist_push_list(hl, hl1);
+      hostlist_push_list(hl, hl2);
+    }
+  else
+    {
+      itr = hostlist_iterator_create(hl1);
+      while ((host = hostlist_next(itr)))
+        {
+          if ((hostlist_find(hl2, host) >= 0) == (op == OP_INTERSECT))
+            hostlist_push_host(hl, host);
+          free(host);
+        }
+      hostlist_iterator_destroy(itr);
+    }
+
+  hostlist_uniq(hl);
+  return hl;
+}
+
+static void
+compare(const char *what, int op, hostlist_t expected, hostlist_t result,
+        hostlist_t hl1, hostlist_t hl2)
+{
+  static char buf1[65536], buf2[65536], in1[65536], in2[65536];
+
+  if (!result)
+    {
+      fprintf(stderr, "%s_%s: failed\n", what, opnames[op]);
+      errors++;
+      return;
+    }
+
+  hostlist_deranged_string(expected, sizeof(buf1), buf1);
+  hostlist_deranged_string(result, sizeof(buf2), buf2);
+  if (strcmp(buf1, buf2))
+    {
+      hostlist_ranged_string(hl1, sizeof(in1), in1);
+      hostlist_ranged_string(hl2, sizeof(in2), in2);
+      fprintf(stderr, "%s_%s(%s, %s):\n  expected %s\n  result   %s\n",
+              what, opnames[op], in1, in2, buf1, buf2);
+      errors++;
+    }
+}
+
+static int
+_append(void *arg, const char *buf, size_t len)
+{
+  struct output *out = arg;
+
+  if (out->len + len >= sizeof(out->buf))
+    return -1;
+  memcpy(out->buf + out->len, buf, len);
+  out->len += len;
+  out->buf[out->len] = '\0';
+  return 0;
+}
+
+/*
+ * Check that the write functions output what the string functions
+ * do, that their length without a writer is exact, and that one
+ * byte less of buffer is reported as truncation.
+ */
+static void
+check_print(hostlist_t hl)
+{
+  static struct output out;
+  static char buf[65536];
+  int deranged;
+
+  for (deranged = 0; deranged <= 1; deranged++)
+    {
+      ssize_t len, wlen, nlen, tlen;
+
+      out.len = 0;
+      out.buf[0] = '\0';
+      if (deranged)
+        {
+          len = hostlist_deranged_string(hl, sizeof(buf), buf);
+          wlen = hostlist_deranged_write(hl, NULL, _append, &out);
+          nlen = hostlist_deranged_write(hl, NULL, NULL, NULL);
+          tlen = len > 0 ? hostlist_deranged_string(hl, len, buf) : -1;
+        }
+      else
+        {
+          len = hostlist_ranged_string(hl, sizeof(buf), buf);
+          wlen = hostlist_ranged_write(hl, _append, &out);
+          nlen = hostlist_ranged_write(hl, NULL, NULL);
+          tlen = len > 0 ? hostlist_ranged_string(hl, len, buf) : -1;
+        }
+
+      if (len < 0 || wlen != len || nlen != len || tlen != -1
+          || (len > 0 && strncmp(out.buf, buf, len - 1))
+          || strlen(out.buf) != (size_t)len)
+        {
+          fprintf(stderr, "hostlist_%sranged_write(%s): "
+                  "length %zd, write %zd, count %zd, truncated %zd\n",
+                  deranged ? "de" : "", out.buf, len, wlen, nlen, tlen);
+          errors++;
+        }
+    }
+}
+
+/*
+ * Check that hostlist_next_host() yields what hostlist_next() does,
+ * into a buffer just large enough, or truncated into a short one.
+ */
+static void
+check_next(hostlist_t hl)
+{
+  hostlist_iterator_t itr1 = hostlist_iterator_create(hl);
+  hostlist_iterator_t itr2 = hostlist_iterator_create(hl);
+  char buf[256], *host;
+  int len;
+
+  while ((host = hostlist_next(itr1)))
+    {
+      size_t n = strlen(host) + (rand() % 2);
+
+      len = hostlist_next_host(itr2, buf, n);
+      if (len != (int)strlen(host)
+          || (len < n ? strcmp(buf, host) : strncmp(buf, host, n - 1)))
+        {
+          fprintf(stderr, "hostlist_next_host(%zu): %d %s, expected %s\n",
+                  n, len, buf, host);
+          errors++;
+        }
+      free(host);
+    }
+
+  if (hostlist_next_host(itr2, buf, sizeof(buf)) != 0)
+    {
+      fprintf(stderr, "hostlist_next_host: %s past the end\n", buf);
+      errors++;
+    }
+
+  hostlist_iterator_destroy(itr1);
+  hostlist_iterator_destroy(itr2);
+}
+
+/*
+ * Check that pushing the ranges of 'hl' from hostlist_nth_range()
+ * with hostlist_push_numbered() rebuilds 'hl'.
+ */
+static void
+check_ranges(hostlist_t hl)
+{
+  static char buf1[65536], buf2[65536];
+  hostlist_t copy = hostlist_create(NULL);
+  unsigned long lo, hi;
+  char *prefix;
+  int i, width, rv;
+
+  for (i = 0; (rv = hostlist_nth_range(hl, i, &prefix, &lo, &hi, &width)) >= 0; i++)
+    {
+      if (rv)
+        hostlist_push_numbered(copy, prefix, lo, hi, width);
+      else
+        hostlist_push_host(copy, prefix);
+    }
+
+  hostlist_ranged_string(hl, sizeof(buf1), buf1);
+  hostlist_ranged_string(copy, sizeof(buf2), buf2);
+  if (strcmp(buf1, buf2) || hostlist_count(copy) != hostlist_count(hl))
+    {
+      fprintf(stderr, "hostlist_push_numbered: %s, expected %s\n", buf2, buf1);
+      errors++;
+    }
+
+  if (hostlist_push_numbered(copy, "x", 2, 1, 0) != -1)
+    {
+      fprintf(stderr, "hostlist_push_numbered: empty range pushed\n");
+      errors++;
+    }
+
+  hostlist_destroy(copy);
+}
+
+int
+main(int argc, char **argv)
+{
+  int t, op;
+
+  srand(argc > 1 ? atoi(argv[1]) : 1);
+
+  for (t = 0; t < TESTS; t++)
+    {
+      hostlist_t hl1 = hostlist_create(NULL);
+      hostlist_t hl2 = hostlist_create(NULL);
+      hostlist_t sethl1, sethl2;
+      char buf[65536];
+      hostset_t set1, set2;
+
+      /* mixed padding in one of the hostlists, now and then */
+      random_hostlist(hl1, t % 10 == 0);
+      random_hostlist(hl2, t % 10 == 1);
+
+      /* half unsorted, half sorted */
+      if (t % 2)
+        {
+          hostlist_uniq(hl1);
+          hostlist_uniq(hl2);
+        }
+
+      check_print(hl1);
+      check_next(hl2);
+      check_ranges(hl1);
+
+      /* the hosts of each set, in the set's order */
+      hostlist_ranged_string(hl1, sizeof(buf), buf);
+      set1 = hostset_create(buf);
+      hostset_ranged_string(set1, sizeof(buf), buf);
+      sethl1 = hostlist_create(buf);
+      hostlist_ranged_string(hl2, sizeof(buf), buf);
+      set2 = hostset_create(buf);
+      hostset_ranged_string(set2, sizeof(buf), buf);
+      sethl2 = hostlist_create(buf);
+
+      for (op = OP_UNION; op <= OP_DIFFERENCE; op++)
+        {
+          hostlist_t expected = naive(hl1, hl2, op);
+          hostlist_t result;
+          hostset_t set;
+
+          if (op == OP_UNION)
+            result = hostlist_union(hl1, hl2);
+          else if (op == OP_INTERSECT)
+            result = hostlist_intersect(hl1, hl2);
+          else
+            result = hostlist_difference(hl1, hl2);
+          compare("hostlist", op, expected, result, hl1, hl2);
+          hostlist_destroy(result);
+          hostlist_destroy(expected);
+
+          expected = naive(sethl1, sethl2, op);
+          if (op == OP_UNION)
+            set = hostset_union(set1, set2);
+          else if (op == OP_INTERSECT)
+            set = hostset_intersect(set1, set2);
+          else
+            set = hostset_difference(set1, set2);
+          if (!set)
+            compare("hostset", op, expected, NULL, sethl1, sethl2);
+          else
+            {
+              hostset_ranged_string(set, sizeof(buf), buf);
+              result = hostlist_create(buf);
+              compare("hostset", op, expected, result, sethl1, sethl2);
+              hostlist_destroy(result);
+              hostset_destroy(set);
+            }
+
+          hostlist_destroy(expected);
+        }
+
+      hostset_destroy(set1);
+      hostset_destroy(set2);
+      hostlist_destroy(sethl1);
+      hostlist_destroy(sethl2);
+      hostlist_destroy(hl1);
+      hostlist_destroy(hl2);
+    }
+
+  if (errors)
+    {
+      fprintf(stderr, "%d errors\n", errors);
+      exit(1);
+    }
+
+  exit(0);
+}
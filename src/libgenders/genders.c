@@ -41,7 +41,10 @@
 #include "genders.h"
 #include "genders_api.h"
 #include "genders_constants.h"
+#include "genders_image.h"
+#include "genders_order.h"
 #include "genders_parsing.h"
+#include "genders_refresh.h"
 #include "genders_util.h"
 #include "hash.h"
 #include "list.h"
@@ -95,13 +98,35 @@ _initialize_handle_info(genders_t handle)
   handle->attr_index = NULL;
   handle->attr_index_size = 0;
   handle->attrval_index = NULL;
-  handle->attrval_index_attr = NULL;
+  handle->attrval_sets = NULL;
+  handle->attrval_numeric = NULL;
+  handle->attrval_dict = NULL;
 
   /* Don't initialize the nodeslist, attrvalslist, or attrslist, they
    * should not be re-initialized on a load_data error.
    */
 }
 
+/*
+ * _genders_attrval_index_clear
+ *
+ * Drop the indexes of values, they are rebuilt on first use.
+ */
+static void
+_genders_attrval_index_clear(genders_t handle)
+{
+  __hash_destroy(handle->attrval_index);
+  __hash_destroy(handle->attrval_sets);
+  __hash_destroy(handle->attrval_numeric);
+  __hash_destroy(handle->attrval_dict);
+  __list_destroy(handle->attrval_buflist);
+  handle->attrval_index = NULL;
+  handle->attrval_sets = NULL;
+  handle->attrval_numeric = NULL;
+  handle->attrval_dict = NULL;
+  handle->attrval_buflist = NULL;
+}
+
 genders_t 
 genders_handle_create(void) 
 {
@@ -116,6 +141,12 @@ genders_handle_create(void)
   handle->attrvalslist = NULL;
   handle->attrslist = NULL;
   handle->attrval_buflist = NULL;
+  handle->ruleslist = NULL;
+  handle->refresh = NULL;
+  handle->image = NULL;
+  handle->order = NULL;
+  handle->nodeprefixes = NULL;
+  handle->nodeprefixes_size = 0;
   
   __list_create(handle->nodeslist, _genders_list_free_genders_node);
   __list_create(handle->attrvalslist, _genders_list_free_attrvallist);
@@ -151,9 +182,12 @@ genders_handle_destroy(genders_t handle)
   free(handle->valbuf);
   __hash_destroy(handle->node_index);
   __hash_destroy(handle->attr_index);
-  __hash_destroy(handle->attrval_index);
-  free(handle->attrval_index_attr);
-  __list_destroy(handle->attrval_buflist);
+  _genders_attrval_index_clear(handle);
+  __list_destroy(handle->ruleslist);
+  _genders_refresh_destroy(handle->refresh);
+  _genders_image_destroy(handle->image);
+  _genders_order_destroy(handle->order);
+  _genders_nodeprefixes_destroy(handle->nodeprefixes);
 
   /* "clean" handle */
   _initialize_handle_info(handle);
@@ -170,16 +204,25 @@ int
 genders_load_data(genders_t handle, const char *filename) 
 {
   char *temp;
+  int rv;
 
   if (_genders_unloaded_handle_error_check(handle) < 0)
     goto cleanup;
+
+  if (handle->flags & GENDERS_FLAG_SHARED_IMAGE)
+    {
+      if ((rv = _genders_image_load(handle, filename)) < 0)
+        goto cleanup;
+      if (rv)
+        goto loaded;
+    }
   
   handle->node_index_size = GENDERS_NODE_INDEX_INIT_SIZE;
   
   __hash_create(handle->node_index,
                 handle->node_index_size,
-                (hash_key_f)hash_key_string,
-                (hash_cmp_f)strcmp, 
+                (hash_key_f)_genders_node_key,
+                (hash_cmp_f)_genders_node_cmp,
                 NULL);
   
   handle->attr_index_size = GENDERS_ATTR_INDEX_INIT_SIZE;
@@ -190,6 +233,9 @@ genders_load_data(genders_t handle, const char *filename)
                 (hash_cmp_f)strcmp, 
                 (hash_del_f)list_destroy);
 
+  if (handle->flags & GENDERS_FLAG_LAZY_NODES)
+    __list_create(handle->ruleslist, _genders_list_free_genders_rule);
+
   if (_genders_open_and_parse(handle, 
 			      filename, 
 			      &handle->numattrs,
@@ -204,12 +250,35 @@ genders_load_data(genders_t handle, const char *filename)
                               &(handle->node_index_size),
                               &(handle->attr_index),
                               &(handle->attr_index_size),
+                              handle->ruleslist,
 			      0, 
 			      NULL) < 0)
     goto cleanup;
 
-  handle->numnodes = list_count(handle->nodeslist);
+  if (handle->ruleslist)
+    {
+      int numrules = list_count(handle->ruleslist);
+
+      if (_genders_check_rules(handle, 
+                               &handle->numnodes, 
+                               &handle->maxattrs) < 0)
+        goto cleanup;
+
+      /* Searching the rules costs time in the number of rules for
+       * every node tested, so they are only worth keeping if they
+       * are few or each lists many nodes.
+       */
+      if (numrules > GENDERS_RULES_MAX_SEARCH
+          && handle->numnodes < numrules * GENDERS_RULES_MIN_NODES)
+        {
+          if (_genders_expand_rules(handle) < 0)
+            goto cleanup;
+        }
+    }
+  else
+    handle->numnodes = list_count(handle->nodeslist);
 
+ loaded:
   if (gethostname(handle->nodename, GENDERS_MAXHOSTNAMELEN+1) < 0) 
     {
       handle->errnum = GENDERS_ERR_INTERNAL;
@@ -245,6 +314,12 @@ cleanup:
       list_delete_all(handle->attrslist, _genders_list_is_all, ""); 
       __hash_destroy(handle->node_index);
       __hash_destroy(handle->attr_index);
+      __list_destroy(handle->ruleslist);
+      handle->ruleslist = NULL;
+      _genders_image_destroy(handle->image);
+      handle->image = NULL;
+      _genders_nodeprefixes_destroy(handle->nodeprefixes);
+      handle->nodeprefixes = NULL;
       _initialize_handle_info(handle);
     }
   return -1;
@@ -308,7 +383,9 @@ int
 genders_set_flags(genders_t handle, unsigned int flags)
 {
   unsigned int mask = (GENDERS_FLAG_DEFAULT
-		       | GENDERS_FLAG_RAW_VALUES);
+		       | GENDERS_FLAG_RAW_VALUES
+		       | GENDERS_FLAG_LAZY_NODES
+		       | GENDERS_FLAG_SHARED_IMAGE);
 
   if (_genders_handle_error_check(handle) < 0)
     return -1;
@@ -319,6 +396,10 @@ genders_set_flags(genders_t handle, unsigned int flags)
       return -1;
     }
 
+  /* values were indexed with or without %n substituted */
+  if ((flags ^ handle->flags) & GENDERS_FLAG_RAW_VALUES)
+    _genders_attrval_index_clear(handle);
+
   handle->flags = flags;
   handle->errnum = GENDERS_ERR_SUCCESS;
   return 0;
@@ -617,12 +698,324 @@ genders_getnodename(genders_t handle, char *node, int len)
   return 0;
 }
 
+/* 
+ * _genders_getnodes_rules
+ *
+ * Find the nodes with attr or attr=val in the rules of a lazily
+ * loaded handle.  Rules are kept in the order their lines were
+ * loaded, so nodes are found in the same order as in attr_index.  If
+ * 'exists' is set, only determine if any node is found.
+ *
+ * Returns number of nodes on success, -1 on error
+ */
+static int
+_genders_getnodes_rules(genders_t handle, 
+                        char *nodes[], 
+                        int len, 
+                        const char *attr, 
+                        const char *val,
+                        int exists)
+{
+  ListIterator itr = NULL;
+  hostlist_iterator_t hlitr = NULL;
+  genders_rule_t r;
+  char node[GENDERS_MAXHOSTNAMELEN + 1];
+  int index = 0, rv = -1;
+
+  __list_iterator_create(itr, handle->ruleslist);
+  while ((r = list_next(itr)))
+    {
+      genders_attrval_t av;
+
+      if (!r->avc
+          || !(av = list_find_first(r->avc->attrvals, 
+                                    _genders_list_is_attr_in_attrvals, 
+                                    (char *)attr)))
+        continue;
+
+      /* Without substitution, every node of the rule has the same value */
+      if (val 
+          && (!av->val 
+              || (!av->val_contains_subst && strcmp(av->val, val))))
+        continue;
+
+      /* rule hostnames were checked against GENDERS_MAXHOSTNAMELEN */
+      __hostlist_iterator_create(hlitr, r->nodes);
+      while (hostlist_next_host(hlitr, node, sizeof(node)) > 0)
+        {
+          if (val && av->val_contains_subst)
+            {
+              struct genders_node n;
+              char *valptr;
+
+              n.name = node;
+              if (_genders_get_valptr(handle, &n, av, &valptr, NULL) < 0)
+                goto cleanup;
+
+              if (strcmp(valptr, val))
+                continue;
+            }
+
+          if (exists)
+            {
+              index = 1;
+              goto out;
+            }
+
+          if (_genders_put_in_array(handle, node, nodes, index++, len) < 0)
+            goto cleanup;
+        }
+      hostlist_iterator_destroy(hlitr);
+      hlitr = NULL;
+    }
+
+ out:
+  rv = index;
+ cleanup:
+  __list_iterator_destroy(itr);
+  __hostlist_iterator_destroy(hlitr);
+  return rv;
+}
+
+/*
+ * _attrval_set_key
+ *
+ * Hash a List of nodes by the nodes it holds, for attrval_sets
+ */
+static unsigned int
+_attrval_set_key(const void *key)
+{
+  ListIterator itr;
+  genders_node_t n;
+  unsigned int h = list_count((List)key);
+
+  /* Without an iterator equal Lists may hash differently, which only
+   * loses their sharing.
+   */
+  if (!(itr = list_iterator_create((List)key)))
+    return h;
+  while ((n = list_next(itr)))
+    h = h * 31 + (unsigned int)((unsigned long)n >> 4);
+  list_iterator_destroy(itr);
+  return h;
+}
+
+/*
+ * _attrval_set_cmp
+ *
+ * Compare two Lists of nodes for attrval_sets, returns 0 if they hold
+ * the same nodes in the same order.
+ */
+static int
+_attrval_set_cmp(const void *key1, const void *key2)
+{
+  ListIterator itr1 = NULL, itr2 = NULL;
+  void *n1, *n2;
+  int rv = 1;
+
+  if (list_count((List)key1) != list_count((List)key2))
+    return 1;
+
+  if (!(itr1 = list_iterator_create((List)key1))
+      || !(itr2 = list_iterator_create((List)key2)))
+    goto cleanup;
+
+  while ((n1 = list_next(itr1)) && (n2 = list_next(itr2)))
+    {
+      if (n1 != n2)
+        goto cleanup;
+    }
+  rv = 0;
+ cleanup:
+  if (itr1)
+    list_iterator_destroy(itr1);
+  if (itr2)
+    list_iterator_destroy(itr2);
+  return rv;
+}
+
+struct _attrval_share_arg {
+  hash_t index;
+  hash_t sets;
+};
+
+/*
+ * _attrval_share
+ *
+ * Move a value's List of nodes into an attribute's index, replacing it
+ * by an equal List already in attrval_sets, if there is one.  Returns
+ * 1 if the List was moved, 0 if it is left to the caller.
+ */
+static int
+_attrval_share(void *data, const void *key, void *arg)
+{
+  struct _attrval_share_arg *a = arg;
+  List l = data;
+  List set;
+
+  if ((set = hash_find(a->sets, l)))
+    {
+      if (!hash_insert(a->index, key, set))
+        return 0;
+      list_destroy(l);
+      return 1;
+    }
+
+  if (!hash_insert(a->index, key, l))
+    return 0;
+  if (!hash_insert(a->sets, l, l))
+    {
+      hash_remove(a->index, key);
+      return 0;
+    }
+  return 1;
+}
+
+/*
+ * _genders_attrval_index
+ *
+ * Find attr's index in attrval_index, building it on first use.  The
+ * index maps every value of attr to the List of nodes with that
+ * value, in attr_index order.  Nodes listing attr without a value are
+ * not indexed.  Lists are kept in attrval_sets, and shared by every
+ * attr and value selecting the same nodes.
+ *
+ * Must not be called with a shared image or unexpanded rules.
+ *
+ * Returns 0 and the index in 'index', or NULL if no node has attr.
+ * Returns -1 on error.
+ */
+static int
+_genders_attrval_index(genders_t handle, const char *attr, hash_t *index)
+{
+  ListIterator itr = NULL;
+  List attrnodes, l, newl = NULL;
+  hash_t vals = NULL, valindex = NULL;
+  struct _attrval_share_arg arg;
+  genders_node_t n;
+  char *valbuf = NULL;
+  char *attrkey;
+  int count;
+
+  *index = NULL;
+
+  if (!handle->numattrs
+      || !(attrnodes = hash_find(handle->attr_index, attr)))
+    return 0;
+
+  if (handle->attrval_index
+      && (*index = hash_find(handle->attrval_index, attr)))
+    return 0;
+
+  if (!handle->attrval_index)
+    __hash_create(handle->attrval_index,
+                  handle->numattrs,
+                  (hash_key_f)hash_key_string,
+                  (hash_cmp_f)strcmp,
+                  (hash_del_f)hash_destroy);
+
+  /* Lists are held here, attrval_index only points to them */
+  if (!handle->attrval_sets)
+    __hash_create(handle->attrval_sets,
+                  handle->numnodes,
+                  _attrval_set_key,
+                  _attrval_set_cmp,
+                  (hash_del_f)list_destroy);
+
+  /* Create a List to store buffers for later freeing */
+  if (!handle->attrval_buflist)
+    __list_create(handle->attrval_buflist, free);
+
+  /* Every node may have its own value, so size for that while
+   * collecting the values, then size the index for the values found.
+   */
+  __hash_create(vals,
+                list_count(attrnodes),
+                (hash_key_f)hash_key_string,
+                (hash_cmp_f)strcmp,
+                (hash_del_f)list_destroy);
+
+  __list_iterator_create(itr, attrnodes);
+  while ((n = list_next(itr)))
+    {
+      int subst_occurred = 0;
+      genders_attrval_t av;
+      char *valptr;
+
+      if (_genders_find_attrval(handle, n, attr, NULL, &av) < 0)
+        goto cleanup;
+
+      if (!av || !av->val)
+        continue;
+
+      if (_genders_get_valptr(handle, n, av, &valptr, &subst_occurred) < 0)
+        goto cleanup;
+
+      if (!(l = hash_find(vals, valptr)))
+        {
+          __list_create(newl, NULL);
+
+          /* If a substitution occurred, we cannot use the av->val
+           * pointer as the key, b/c the key contains some nonsense
+           * characters (i.e. %n).  So we have to copy this buffer and
+           * store it somewhere to be freed later.
+           */
+          if (subst_occurred)
+            {
+              __xstrdup(valbuf, valptr);
+              __list_append(handle->attrval_buflist, valbuf);
+              valptr = valbuf;
+              valbuf = NULL;
+            }
+
+          __hash_insert(vals, valptr, newl);
+          l = newl;
+          newl = NULL;
+        }
+
+      __list_append(l, n);
+    }
+
+  count = hash_count(vals);
+  __hash_create(valindex,
+                count ? count : 1,
+                (hash_key_f)hash_key_string,
+                (hash_cmp_f)strcmp,
+                NULL);
+
+  arg.index = valindex;
+  arg.sets = handle->attrval_sets;
+  if (hash_remove_if(vals, _attrval_share, &arg) != count)
+    {
+      handle->errnum = GENDERS_ERR_OUTMEM;
+      goto cleanup;
+    }
+
+  __xstrdup(valbuf, attr);
+  __list_append(handle->attrval_buflist, valbuf);
+  attrkey = valbuf;
+  valbuf = NULL;
+
+  __hash_insert(handle->attrval_index, attrkey, valindex);
+  *index = valindex;
+  valindex = NULL;
+
+ cleanup:
+  __list_iterator_destroy(itr);
+  __list_destroy(newl);
+  __hash_destroy(vals);
+  __hash_destroy(valindex);
+  free(valbuf);
+  return *index ? 0 : -1;
+}
+
 int 
 genders_getnodes(genders_t handle, char *nodes[], int len, 
                  const char *attr, const char *val) 
 {
   ListIterator itr = NULL;
   genders_node_t n;
+  char namebuf[GENDERS_MAXHOSTNAMELEN + 1];
   int index = 0, rv = -1;
 
   if (_genders_loaded_handle_error_check(handle) < 0)
@@ -640,15 +1033,16 @@ genders_getnodes(genders_t handle, char *nodes[], int len,
   if (val && !strlen(val))
     val = NULL;
 
-  if (handle->attrval_index 
-      && attr
-      && val
-      && !strcmp(handle->attrval_index_attr, attr)) 
+  if (attr && val && !handle->image && !handle->ruleslist)
     {
       /* Case A: Use attrval_index to find nodes */
+      hash_t valindex;
       List l;
-      
-      if (!(l = hash_find(handle->attrval_index, val))) 
+
+      if (_genders_attrval_index(handle, attr, &valindex) < 0)
+        goto cleanup;
+
+      if (!valindex || !(l = hash_find(valindex, val)))
 	{
 	  /* No attributes with this value */
 	  handle->errnum = GENDERS_ERR_SUCCESS;
@@ -658,13 +1052,29 @@ genders_getnodes(genders_t handle, char *nodes[], int len,
       __list_iterator_create(itr, l);
       while ((n = list_next(itr))) 
 	{
-	  if (_genders_put_in_array(handle, n->name, nodes, index++, len) < 0)
+	  if (_genders_put_in_array(handle, 
+                                    (char *)_genders_node_name(n, namebuf), 
+                                    nodes, 
+                                    index++, 
+                                    len) < 0)
 	    goto cleanup;
 	}
     }
+  else if (handle->image)
+    {
+      /* Nodes are in a shared image */
+      if ((index = _genders_image_getnodes(handle, nodes, len, attr, val, 0)) < 0)
+        goto cleanup;
+    }
+  else if (attr && handle->ruleslist)
+    {
+      /* Case B: nodes not yet expanded, so search the rules */
+      if ((index = _genders_getnodes_rules(handle, nodes, len, attr, val, 0)) < 0)
+        goto cleanup;
+    }
   else if (attr) 
     {
-      /* Case B: atleast the attr was input, so use attr_index */
+      /* Case C: atleast the attr was input, so use attr_index */
       List l;
       
       if (!handle->numattrs)
@@ -690,17 +1100,28 @@ genders_getnodes(genders_t handle, char *nodes[], int len,
 	  if (_genders_find_attrval(handle, n, attr, val, &av) < 0)
 	    goto cleanup;
 	  
-	  if (av && _genders_put_in_array(handle, n->name, nodes, index++, len) < 0)
+	  if (av && _genders_put_in_array(handle, 
+                                          (char *)_genders_node_name(n, namebuf), 
+                                          nodes, 
+                                          index++, 
+                                          len) < 0)
 	    goto cleanup;
 	}
     }
   else 
     {
-      /* Case C: get every node */
+      /* Case D: get every node */
+      if (_genders_expand_rules(handle) < 0)
+        goto cleanup;
+
       __list_iterator_create(itr, handle->nodeslist);
       while ((n = list_next(itr))) 
 	{
-	  if (_genders_put_in_array(handle, n->name, nodes, index++, len) < 0)
+	  if (_genders_put_in_array(handle, 
+                                    (char *)_genders_node_name(n, namebuf), 
+                                    nodes, 
+                                    index++, 
+                                    len) < 0)
 	    goto cleanup;
 	}
     }
@@ -712,6 +1133,50 @@ genders_getnodes(genders_t handle, char *nodes[], int len,
   return rv;
 }
 
+/* 
+ * _genders_put_attrvals
+ *
+ * Put the attributes of an attrvals container, and their values for
+ * node 'n', in the attrs and vals arrays starting at *index.
+ *
+ * Returns 0 on success, -1 on error
+ */
+static int
+_genders_put_attrvals(genders_t handle,
+                      genders_node_t n,
+                      genders_attrvals_container_t avc,
+                      char *attrs[],
+                      char *vals[],
+                      int len,
+                      int *index)
+{
+  ListIterator attrvals_itr = NULL;
+  genders_attrval_t av;
+  int rv = -1;
+      
+  __list_iterator_create(attrvals_itr, avc->attrvals);
+  while ((av = list_next(attrvals_itr))) 
+    {
+      if (_genders_put_in_array(handle, av->attr, attrs, *index, len) < 0)
+        goto cleanup;
+      
+      if (vals && av->val) 
+        {
+          char *valptr;
+          if (_genders_get_valptr(handle, n, av, &valptr, NULL) < 0)
+            goto cleanup;
+          if (_genders_put_in_array(handle, valptr, vals, *index, len) < 0)
+            goto cleanup;
+        }
+      (*index)++;
+    }
+
+  rv = 0;
+ cleanup:
+  __list_iterator_destroy(attrvals_itr);
+  return rv;
+}
+
 int 
 genders_getattr(genders_t handle, 
 		char *attrs[], 
@@ -720,7 +1185,6 @@ genders_getattr(genders_t handle,
 		const char *node) 
 {
   ListIterator attrlist_itr = NULL;
-  ListIterator attrvals_itr = NULL;
   genders_attrvals_container_t avc;
   genders_node_t n;
   int index = 0, rv = -1;
@@ -743,42 +1207,67 @@ genders_getattr(genders_t handle,
       return -1;
     }
 
-  if (!(n = hash_find(handle->node_index, node))) 
+  if (handle->image)
     {
-      handle->errnum = GENDERS_ERR_NOTFOUND;
-      return -1;
+      if ((index = _genders_image_getattr(handle, attrs, vals, len, node)) < 0)
+        goto cleanup;
     }
+  else if (handle->ruleslist)
+    {
+      struct genders_node rulesn;
+      genders_rule_t r;
+
+      /* nodes not yet expanded, so search the rules */
+      if ((rv = _genders_rules_isnode(handle, node)) <= 0)
+        {
+          if (!rv)
+            handle->errnum = GENDERS_ERR_NOTFOUND;
+          return -1;
+        }
+      rv = -1;
 
-  __list_iterator_create(attrlist_itr, n->attrlist);
-  while ((avc = list_next(attrlist_itr))) 
+      rulesn.name = (char *)node;
+      __list_iterator_create(attrlist_itr, handle->ruleslist);
+      while ((r = list_next(attrlist_itr)))
+        {
+          if (r->avc 
+              && hostlist_find(r->nodes, node) >= 0
+              && _genders_put_attrvals(handle, 
+                                       &rulesn, 
+                                       r->avc, 
+                                       attrs, 
+                                       vals, 
+                                       len, 
+                                       &index) < 0)
+            goto cleanup;
+        }
+    }
+  else
     {
-      genders_attrval_t av;
-      
-      __list_iterator_create(attrvals_itr, avc->attrvals);
-      while ((av = list_next(attrvals_itr))) 
-	{
-	  if (_genders_put_in_array(handle, av->attr, attrs, index, len) < 0)
-	    goto cleanup;
-      
-	  if (vals && av->val) 
-	    {
-	      char *valptr;
-	      if (_genders_get_valptr(handle, n, av, &valptr, NULL) < 0)
-		goto cleanup;
-	      if (_genders_put_in_array(handle, valptr, vals, index, len) < 0)
-		goto cleanup;
-	    }
-	  index++;
-	}
-      __list_iterator_destroy(attrvals_itr);
+      if (!(n = _genders_find_node(handle->node_index, node))) 
+        {
+          handle->errnum = GENDERS_ERR_NOTFOUND;
+          return -1;
+        }
+
+      __list_iterator_create(attrlist_itr, n->attrlist);
+      while ((avc = list_next(attrlist_itr))) 
+        {
+          if (_genders_put_attrvals(handle, 
+                                    n, 
+                                    avc, 
+                                    attrs, 
+                                    vals, 
+                                    len, 
+                                    &index) < 0)
+            goto cleanup;
+        }
     }
-  attrvals_itr = NULL;
   
   rv = index;
   handle->errnum = GENDERS_ERR_SUCCESS;
  cleanup:
   __list_iterator_destroy(attrlist_itr);
-  __list_iterator_destroy(attrvals_itr);
   return rv;  
 }
 
@@ -804,11 +1293,19 @@ genders_getattr_all(genders_t handle, char *attrs[], int len)
       goto cleanup;
     }
 
-  __list_iterator_create(attrslist_itr, handle->attrslist);
-  while ((attr = list_next(attrslist_itr))) 
+  if (handle->image)
     {
-      if (_genders_put_in_array(handle, attr, attrs, index++, len) < 0)
-	goto cleanup;
+      if ((index = _genders_image_getattr_all(handle, attrs, len)) < 0)
+        goto cleanup;
+    }
+  else
+    {
+      __list_iterator_create(attrslist_itr, handle->attrslist);
+      while ((attr = list_next(attrslist_itr))) 
+        {
+          if (_genders_put_in_array(handle, attr, attrs, index++, len) < 0)
+            goto cleanup;
+        }
     }
 
   rv = index;
@@ -825,6 +1322,7 @@ genders_testattr(genders_t handle,
                  char *val, 
 		 int len) 
 {
+  struct genders_node rulesn;
   genders_node_t n;
   genders_attrval_t av;
 
@@ -848,14 +1346,46 @@ genders_testattr(genders_t handle,
       return -1;
     }
 
-  if (!(n = hash_find(handle->node_index, node))) 
+  if (handle->image)
     {
-      handle->errnum = GENDERS_ERR_NOTFOUND;
-      return -1;
+      if (!_genders_image_isnode(handle, node))
+        {
+          handle->errnum = GENDERS_ERR_NOTFOUND;
+          return -1;
+        }
+
+      rulesn.name = (char *)node;
+      n = &rulesn;
+      if (_genders_image_find_attrval(handle, node, attr, NULL, &av) < 0)
+        return -1;
+    }
+  else if (handle->ruleslist)
+    {
+      int rv;
+
+      if ((rv = _genders_rules_isnode(handle, node)) <= 0)
+        {
+          if (!rv)
+            handle->errnum = GENDERS_ERR_NOTFOUND;
+          return -1;
+        }
+
+      rulesn.name = (char *)node;
+      n = &rulesn;
+      if (_genders_rules_find_attrval(handle, node, attr, NULL, &av) < 0)
+        return -1;
     }
+  else
+    {
+      if (!(n = _genders_find_node(handle->node_index, node))) 
+        {
+          handle->errnum = GENDERS_ERR_NOTFOUND;
+          return -1;
+        }
 
-  if (_genders_find_attrval(handle, n, attr, NULL, &av) < 0)
-    return -1;
+      if (_genders_find_attrval(handle, n, attr, NULL, &av) < 0)
+        return -1;
+    }
 
   if (av) 
     {
@@ -912,14 +1442,42 @@ genders_testattrval(genders_t handle,
       return -1;
     }
 
-  if (!(n = hash_find(handle->node_index, node))) 
+  if (handle->image)
     {
-      handle->errnum = GENDERS_ERR_NOTFOUND;
-      return -1;
+      if (!_genders_image_isnode(handle, node))
+        {
+          handle->errnum = GENDERS_ERR_NOTFOUND;
+          return -1;
+        }
+
+      if (_genders_image_find_attrval(handle, node, attr, val, &av) < 0)
+        return -1;
     }
+  else if (handle->ruleslist)
+    {
+      int rv;
 
-  if (_genders_find_attrval(handle, n, attr, val, &av) < 0)
-    return -1;
+      if ((rv = _genders_rules_isnode(handle, node)) <= 0)
+        {
+          if (!rv)
+            handle->errnum = GENDERS_ERR_NOTFOUND;
+          return -1;
+        }
+
+      if (_genders_rules_find_attrval(handle, node, attr, val, &av) < 0)
+        return -1;
+    }
+  else
+    {
+      if (!(n = _genders_find_node(handle->node_index, node))) 
+        {
+          handle->errnum = GENDERS_ERR_NOTFOUND;
+          return -1;
+        }
+
+      if (_genders_find_attrval(handle, n, attr, val, &av) < 0)
+        return -1;
+    }
   
   handle->errnum = GENDERS_ERR_SUCCESS;
   return ((av) ? 1 : 0);
@@ -943,7 +1501,23 @@ genders_isnode(genders_t handle, const char *node)
       return 0;
     }
 
-  n = hash_find(handle->node_index, node);
+  if (handle->image)
+    {
+      handle->errnum = GENDERS_ERR_SUCCESS;
+      return _genders_image_isnode(handle, node);
+    }
+
+  if (handle->ruleslist)
+    {
+      int rv;
+
+      if ((rv = _genders_rules_isnode(handle, node)) < 0)
+        return -1;
+      handle->errnum = GENDERS_ERR_SUCCESS;
+      return rv;
+    }
+
+  n = _genders_find_node(handle->node_index, node);
   handle->errnum = GENDERS_ERR_SUCCESS;
   return ((n) ? 1 : 0);
 }
@@ -969,6 +1543,12 @@ genders_isattr(genders_t handle, const char *attr)
       return 0;
     }
 
+  if (handle->image)
+    {
+      handle->errnum = GENDERS_ERR_SUCCESS;
+      return _genders_image_isattr(handle, attr);
+    }
+
   ptr = hash_find(handle->attr_index, attr);
   handle->errnum = GENDERS_ERR_SUCCESS;
   return ((ptr) ? 1 : 0);
@@ -977,9 +1557,7 @@ genders_isattr(genders_t handle, const char *attr)
 int 
 genders_isattrval(genders_t handle, const char *attr, const char *val) 
 {
-  ListIterator nodeslist_itr = NULL;
-  genders_node_t n;
-  genders_attrval_t av;
+  hash_t valindex;
   int rv = -1;
 
   if (_genders_loaded_handle_error_check(handle) < 0)
@@ -994,59 +1572,50 @@ genders_isattrval(genders_t handle, const char *attr, const char *val)
       goto cleanup;
     }
   
-  if (handle->attrval_index 
-      && !strcmp(handle->attrval_index_attr, attr)) 
+  if (!handle->numattrs)
+    goto out;
+
+  if (handle->image)
     {
-      if (!hash_find(handle->attrval_index, val))
-	rv = 0;
-      else
-	rv = 1;
-      
+      if ((rv = _genders_image_getnodes(handle, NULL, 0, attr, val, 1)) < 0)
+        goto cleanup;
       handle->errnum = GENDERS_ERR_SUCCESS;
-      return rv;
+      goto cleanup;
     }
-  else 
-    {
-      List l;
 
-      if (!handle->numattrs)
-        goto out;
+  if (!hash_find(handle->attr_index, attr))
+    goto out;
+
+  if (handle->ruleslist)
+    {
+      /* nodes not yet expanded, so search the rules */
+      if ((rv = _genders_getnodes_rules(handle, NULL, 0, attr, val, 1)) < 0)
+        goto cleanup;
+      handle->errnum = GENDERS_ERR_SUCCESS;
+      goto cleanup;
+    }
 
-      if (!(l = hash_find(handle->attr_index, attr)))
-        goto out;
+  if (_genders_attrval_index(handle, attr, &valindex) < 0)
+    goto cleanup;
 
-      __list_iterator_create(nodeslist_itr, l);
-      while ((n = list_next(nodeslist_itr))) 
-	{
-	  if (_genders_find_attrval(handle, n, attr, val, &av) < 0) 
-	    goto cleanup;
-	  if (av) 
-	    {
-	      rv = 1;
-	      handle->errnum = GENDERS_ERR_SUCCESS;
-	      goto cleanup;
-	    }
-	}
+  if (valindex && hash_find(valindex, val))
+    {
+      rv = 1;
+      handle->errnum = GENDERS_ERR_SUCCESS;
+      goto cleanup;
     }
 
  out:
   rv = 0;
   handle->errnum = GENDERS_ERR_SUCCESS;
  cleanup:
-  __list_iterator_destroy(nodeslist_itr);
   return rv;
 }
 
-int
+int 
 genders_index_attrvals(genders_t handle, const char *attr)
 {
-  ListIterator nodeslist_itr = NULL;
-  List l = NULL;
-  List attrval_buflist = NULL;
-  genders_node_t n;
-  char *valbuf = NULL;
-  hash_t attrval_index = NULL;
-  char *attrval_index_attr = NULL;
+  hash_t valindex;
   int rv;
 
   if (_genders_loaded_handle_error_check(handle) < 0)
@@ -1055,119 +1624,38 @@ genders_index_attrvals(genders_t handle, const char *attr)
   if (!attr || !strlen(attr))
     {
       handle->errnum = GENDERS_ERR_PARAMETERS;
-      goto cleanup;
+      return -1;
     }
 
   /* check if attr is legit */
 
   if ((rv = genders_isattr(handle, attr)) < 0)
-    goto cleanup;
+    return -1;
 
   if (!rv) 
     {
       handle->errnum = GENDERS_ERR_NOTFOUND;
-      goto cleanup;
-    }
-
-  /* check if index already created */
-  if (handle->attrval_index && !strcmp(handle->attrval_index_attr, attr)) 
-    {
-      handle->errnum = GENDERS_ERR_SUCCESS;
-      return 0;
+      return -1;
     }
 
-  /* Nothing to index if there are no nodes */
-  if (!handle->numnodes)
+  /* Nothing to index if there are no nodes, and a shared image
+   * needs no index, its attributes already list their nodes.
+   */
+  if (!handle->numnodes || handle->image)
     {
       handle->errnum = GENDERS_ERR_SUCCESS;
       return 0;
     }
 
-  /* Max possible hash size is number of nodes, so pick upper boundary */
-  __hash_create(attrval_index, 
-                handle->numnodes, 
-                (hash_key_f)hash_key_string,
-                (hash_cmp_f)strcmp, 
-                (hash_del_f)list_destroy);
-
-  /* Create a List to store buffers for later freeing */
-  __list_create(attrval_buflist, free);
-
-  __list_iterator_create(nodeslist_itr, handle->nodeslist);
-  while ((n = list_next(nodeslist_itr))) 
-    {
-      int subst_occurred = 0;
-      genders_attrval_t av;
-      
-      if (_genders_find_attrval(handle, n, attr, NULL, &av) < 0)
-	goto cleanup;
-
-      if (av) 
-	{
-	  char *valptr;
-	  
-	  if (av->val) 
-	    {
-	      if (_genders_get_valptr(handle, 
-				      n, 
-				      av, 
-				      &valptr, 
-				      &subst_occurred) < 0)
-		goto cleanup;
-	    }
-	  else
-	    valptr = GENDERS_NOVALUE;
-
-	  if (!(l = hash_find(attrval_index, valptr))) 
-	    {
-	      __list_create(l, NULL);
-	      
-	      /* If a substitution occurred, we cannot use the av->val
-	       * pointer as the key, b/c the key contains some nonsense
-	       * characters (i.e. %n).  So we have to copy this buffer and
-	       * store it somewhere to be freed later.
-	       */
-	      if (subst_occurred) 
-		{
-		  __xstrdup(valbuf, valptr);
-		  __list_append(attrval_buflist, valbuf);
-		  valptr = valbuf;
-		  valbuf = NULL;
-		}
-	      
-	      __hash_insert(attrval_index, valptr, l);
-	    }
-      
-	  __list_append(l, n);
-	  l = NULL;
-	}
-    }
-
-  __xstrdup(attrval_index_attr, attr);
-
-  /* Delete/free previous index */
-  __hash_destroy(handle->attrval_index);
-  free(handle->attrval_index_attr);
-  __list_destroy(handle->attrval_buflist);
-  handle->attrval_index = NULL;
-  handle->attrval_index_attr = NULL;
+  if (_genders_expand_rules(handle) < 0)
+    return -1;
 
-  handle->attrval_index = attrval_index;
-  handle->attrval_index_attr = attrval_index_attr;
-  handle->attrval_buflist = attrval_buflist;
+  /* Indexes are otherwise built on first use, build this one now */
+  if (_genders_attrval_index(handle, attr, &valindex) < 0)
+    return -1;
 
-  __list_iterator_destroy(nodeslist_itr);
   handle->errnum = GENDERS_ERR_SUCCESS;
   return 0;
-  
- cleanup:
-  __list_iterator_destroy(nodeslist_itr);
-  __list_destroy(l);
-  __hash_destroy(attrval_index);
-  __list_destroy(attrval_buflist);
-  free(attrval_index_attr);
-  free(valbuf);
-  return -1;
 }
 
 int 
@@ -1198,8 +1686,8 @@ genders_parse(genders_t handle, const char *filename, FILE *stream)
   __list_create(debugattrslist, free);
   __hash_create(debugnode_index,
                 debugnode_index_size,
-                (hash_key_f)hash_key_string,
-                (hash_cmp_f)strcmp, 
+                (hash_key_f)_genders_node_key,
+                (hash_cmp_f)_genders_node_cmp,
                 NULL);
   __hash_create(debugattr_index,
                 debugattr_index_size,
@@ -1221,6 +1709,7 @@ genders_parse(genders_t handle, const char *filename, FILE *stream)
                                           &(debugnode_index_size),
                                           &(debugattr_index),
                                           &(debugattr_index_size),
+                                          NULL,
 					  1, 
 					  stream)) < 0)
     goto cleanup;
@@ -1257,13 +1746,20 @@ _genders_copy_nodeslist(genders_t handle, genders_t handlecopy)
   ListIterator itr = NULL;
   genders_node_t n = NULL;
   genders_node_t newn = NULL;
+  char namebuf[GENDERS_MAXHOSTNAMELEN + 1];
   int rv = -1;
 
   __list_iterator_create(itr, handle->nodeslist);
   while ((n = list_next(itr)))
     {
       __xmalloc(newn, genders_node_t, sizeof(struct genders_node));
-      __xstrdup(newn->name, n->name);
+      if (_genders_node_set_name(handlecopy, 
+                                 newn, 
+                                 _genders_node_name(n, namebuf)) < 0)
+        {
+          handle->errnum = handlecopy->errnum;
+          goto cleanup;
+        }
       __list_create(newn->attrlist, NULL);
       newn->attrcount = n->attrcount;
       newn->attrlist_index_size = n->attrlist_index_size;
@@ -1308,7 +1804,7 @@ static int _genders_copy_fill_node_index(genders_t handle, genders_t handlecopy)
 
   __list_iterator_create(itr, handlecopy->nodeslist);
   while ((n = list_next(itr)))
-    __hash_insert(handlecopy->node_index, n->name, n);
+    __hash_insert(handlecopy->node_index, n, n);
   
   rv = 0;
  cleanup:
@@ -1510,7 +2006,7 @@ _genders_copy_fill_node(genders_t handle,
 
 	  __hash_insert(nodecopy->attrlist_index,
 			av->attr,
-			tmpavc);
+			av);
 	  
 	  if (!(l = hash_find(handlecopy->attr_index, av->attr)))
 	    {
@@ -1550,7 +2046,7 @@ _genders_copy_fill_node_data(genders_t handle, genders_t handlecopy)
     {
       genders_node_t nodehandle;
 
-      if (!(nodehandle = hash_find(handle->node_index, nodecopy->name)))
+      if (!(nodehandle = hash_find(handle->node_index, nodecopy)))
 	{
 	  /* Shouldn't be possible to error here */
 	  handle->errnum = GENDERS_ERR_INTERNAL;
@@ -1578,6 +2074,9 @@ genders_copy(genders_t handle)
   if (_genders_loaded_handle_error_check(handle) < 0)
     return NULL;
 
+  if (_genders_expand_rules(handle) < 0)
+    return NULL;
+
   if (!(handlecopy = genders_handle_create()))
     {
       handle->errnum = GENDERS_ERR_OUTMEM;
@@ -1594,6 +2093,15 @@ genders_copy(genders_t handle)
   handlecopy->maxvallen = handle->maxvallen;
 
   memcpy(handlecopy->nodename, handle->nodename, GENDERS_MAXHOSTNAMELEN+1);
+
+  if (handle->image)
+    {
+      if (_genders_image_copy(handle, handlecopy) < 0)
+        goto cleanup;
+      __xmalloc(handlecopy->valbuf, char *, handlecopy->maxvallen + 1);
+      handle->errnum = GENDERS_ERR_SUCCESS;
+      return handlecopy;
+    }
   
   if (_genders_copy_nodeslist(handle, handlecopy) < 0)
     goto cleanup;
@@ -1602,8 +2110,8 @@ genders_copy(genders_t handle)
 
   __hash_create(handlecopy->node_index,
                 handlecopy->node_index_size,
-                (hash_key_f)hash_key_string,
-                (hash_cmp_f)strcmp,
+                (hash_key_f)_genders_node_key,
+                (hash_cmp_f)_genders_node_cmp,
                 NULL);
 
   if (_genders_copy_fill_node_index(handle, handlecopy) < 0)
@@ -1632,17 +2140,9 @@ genders_copy(genders_t handle)
   /* Create a buffer for value substitutions */
   __xmalloc(handlecopy->valbuf, char *, handlecopy->maxvallen + 1);
 
-  /* attrval_index, attrval_index_attr, and attrval_buflist
-   * set/re-created by genders_index_attrvals
+  /* attrval_index, attrval_sets, attrval_numeric, attrval_dict,
+   * attrval_buflist, and the node order are rebuilt on first use
    */
-  if (handle->attrval_index)
-    {
-      if (genders_index_attrvals(handlecopy, handle->attrval_index_attr) < 0)
-	{
-	  handle->errnum = GENDERS_ERR_INTERNAL;
-	  goto cleanup;
-	}
-    }
 
   handle->errnum = GENDERS_ERR_SUCCESS;
   return handlecopy;
@@ -43,21 +43,35 @@
 
 #define GENDERS_ATTRLIST_INDEX_INIT_SIZE 128
 
+#define GENDERS_NODEPREFIXES_INIT_SIZE   64
+
+#define GENDERS_NODENUM_MAXWIDTH         9
+
 /* 
  * struct genders_node
  *
  * stores node name and a list of pointers to attrval lists containing
  * the attributes and values of this node.  The pointers point to
  * lists stored within the attrvalslist parameter of the genders
- * handle.  The attrlist_index is hash that enables faster lookups
- * into the attrlist.
+ * handle.  The attrlist_index is hash that maps each of the node's
+ * attributes to its attrval.
+ *
+ * A name ending in a number of at most GENDERS_NODENUM_MAXWIDTH
+ * digits is not stored, name is NULL and the name is the prefix
+ * followed by num, zero padded to width digits.  Prefixes are shared
+ * by every node of the handle with that prefix, see
+ * _genders_node_name().
  */
 struct genders_node {
   char *name;
+  char *prefix;
+  unsigned int num;
+  int width;
   List attrlist;
   int attrcount;
   hash_t attrlist_index;
   int attrlist_index_size;
+  int ordinal;                  /* position in the handle's node order */
 };
 typedef struct genders_node *genders_node_t;
 
@@ -86,6 +100,20 @@ struct genders_attrvals_container {
 };
 typedef struct genders_attrvals_container *genders_attrvals_container_t;
 
+/*
+ * struct genders_rule
+ *
+ * stores one line of the genders database as the hostlist of its
+ * nodes and its attrvals container (NULL if the line lists no
+ * attributes).  Used in place of per-node data when the database is
+ * loaded with GENDERS_FLAG_LAZY_NODES.
+ */
+struct genders_rule {
+  hostlist_t nodes;
+  genders_attrvals_container_t avc;
+};
+typedef struct genders_rule *genders_rule_t;
+
 /* 
  * struct genders
  * 
@@ -113,18 +141,18 @@ typedef struct genders_attrvals_container *genders_attrvals_container_t;
  * nodeslist = node1 -> node2 -> node3 -> \0
  *    node1.name = nodename1, node1.attrlist = listptr1 -> listptr2 -> \0
  *    node1.attrlist_index = hash table with
- *          KEY(attr1): listptr1
- *          KEY(attr2): listptr1
- *          KEY(attr3): listptr2
- *          KEY(attr4): listptr2
+ *          KEY(attrname1): attr1
+ *          KEY(attrname2): attr2
+ *          KEY(attrname3): attr3
+ *          KEY(attrname4): attr4
  *    node2.name = nodename2, node2.attrlist = listptr1 -> listptr3 -> \0
  *    node2.attrlist_index = hash table with
- *          KEY(attr1): listptr1
- *          KEY(attr2): listptr1
- *          KEY(attr5): listptr3
+ *          KEY(attrname1): attr1
+ *          KEY(attrname2): attr2
+ *          KEY(attrname5): attr5
  *    node3.name = nodename3, node3.attrlist = listptr4 -> \0
  *    node3.attrlist_index = hash table with
- *          KEY(attr6): listptr4
+ *          KEY(attrname6): attr6
  * attrvalslist = listptr1 -> listptr2 -> listptr3 -> listptr4 -> \0
  *    listptr1 = attr1 -> attr2 -> \0
  *    listptr2 = attr3 -> attr4 -> \0
@@ -140,10 +168,10 @@ typedef struct genders_attrvals_container *genders_attrvals_container_t;
  *             attrname5 -> attrname6 -> \0
  * valbuf -> buffer of length 5 (maxvallen + 1) 
  *
- * node_index = hash table with
- *              KEY(nodename1): node1
- *              KEY(nodename2): node2
- *              KEY(nodename3): node3
+ * node_index = hash table, searched by name with _genders_find_node(), with
+ *              KEY(node1): node1
+ *              KEY(node2): node2
+ *              KEY(node3): node3
  *
  * attr_index = hash table with
  *              KEY(attrname1): node1 -> node2
@@ -152,6 +180,26 @@ typedef struct genders_attrvals_container *genders_attrvals_container_t;
  *              KEY(attrname4): node1
  *              KEY(attrname5): node2
  *              KEY(attrname6): node3 
+ *
+ * If loaded with GENDERS_FLAG_LAZY_NODES, nodeslist and node_index
+ * are initially empty, the attr_index lists are empty, and instead
+ *
+ * ruleslist = rule1 -> rule2 -> rule3 -> rule4 -> \0
+ *    rule1.nodes = nodename[1-2], rule1.avc = listptr1
+ *    rule2.nodes = nodename1, rule2.avc = listptr2
+ *    rule3.nodes = nodename2, rule3.avc = listptr3
+ *    rule4.nodes = nodename3, rule4.avc = listptr4
+ *
+ * The rules are expanded into the per-node data above, and ruleslist
+ * set to NULL, the first time a function needs it.
+ *
+ * If loaded with GENDERS_FLAG_SHARED_IMAGE and a shared image could
+ * be attached, the lists and indexes are empty and every function
+ * reads the image instead.
+ *
+ * The first query of an expanded handle numbers the nodes in sorted
+ * hostlist order, storing each node's ordinal in the node, so query
+ * results can be built in that order without sorting them.
  */
 struct genders {
   int magic;                                /* magic number */ 
@@ -171,11 +219,19 @@ struct genders {
   char *valbuf;                             /* Buffer for value substitution */
   hash_t node_index;                        /* Index table for quicker node access */
   int node_index_size;                      /* Index size for node_index */
+  hash_t nodeprefixes;                      /* Prefixes of numbered node names */
+  int nodeprefixes_size;                    /* Index size for nodeprefixes */
   hash_t attr_index;                        /* Index table for quicker search times */
   int attr_index_size;                      /* Index size for attr_index */
-  hash_t attrval_index;                     /* Index table for quicker search times */
-  char *attrval_index_attr;                 /* Current indexed attr in attrval_index */
+  hash_t attrval_index;                     /* Per attr index of values to Lists of nodes */
+  hash_t attrval_sets;                      /* Distinct Lists of nodes in attrval_index */
+  hash_t attrval_numeric;                   /* Per attr numeric values, sorted */
+  hash_t attrval_dict;                      /* Per attr distinct values, sorted */
   List attrval_buflist;                     /* List to store val buffers to be free */
+  List ruleslist;                           /* List of genders_rule, if not expanded */
+  struct genders_refresh *refresh;          /* Snapshots from genders_refresh_start */
+  struct genders_image *image;              /* Shared image, if attached */
+  struct genders_order *order;              /* Node ordinals, built on first use */
 };
 
 #endif /* _GENDERS_API_H */
@@ -31,6 +31,28 @@
 
 #define GENDERS_BUFLEN            65536
 
+/* Rules of a GENDERS_FLAG_LAZY_NODES load are expanded right away
+ * if there are more than GENDERS_RULES_MAX_SEARCH of them, listing
+ * fewer than GENDERS_RULES_MIN_NODES nodes each on average.
+ */
+#define GENDERS_RULES_MAX_SEARCH  256
+#define GENDERS_RULES_MIN_NODES   16
+
+/* Milliseconds between checks of a refreshed database without inotify */
+#define GENDERS_REFRESH_POLL_INTERVAL 1000
+
+#define GENDERS_REFRESH_EVENT_BUFLEN  4096
+
+/* Shared images from GENDERS_FLAG_SHARED_IMAGE */
+#define GENDERS_IMAGE_MAGIC       0x67656e64
+#define GENDERS_IMAGE_VERSION     1
+#define GENDERS_IMAGE_NAMELEN     64
+#define GENDERS_IMAGE_BUFLEN      65536
+#define GENDERS_IMAGE_MAXSIZE     0x40000000
+
+/* Seconds before an image that is still being built is assumed dead */
+#define GENDERS_IMAGE_BUILD_TIMEOUT 10
+
 /* Impossible to have a genders value with spaces */
 #define GENDERS_NOVALUE           "  NOVAL  "   
 
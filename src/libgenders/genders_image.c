@@ -0,0 +1,1114 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#if STDC_HEADERS
+#include <string.h>
+#endif /* STDC_HEADERS */
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#endif /* HAVE_FCNTL_H */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <errno.h>
+
+#include "genders.h"
+#include "genders_api.h"
+#include "genders_constants.h"
+#include "genders_image.h"
+#include "genders_util.h"
+
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif /* PATH_MAX */
+
+/*
+ * Shared image layout
+ *
+ * An image is a genders database laid out in one block of memory
+ * that contains no pointers, only offsets from its start, so it can
+ * be mapped at any address by any number of processes.  It is the
+ * header, followed by
+ *
+ * nodes     - entry per node, in nodeslist order.  'list' is the
+ *             offset of the node's attrval ids, in attrlist order.
+ * attrs     - entry per attribute, in attrslist order.  'list' is the
+ *             offset of the attribute's node/attrval pairs, in
+ *             attr_index order.
+ * attrvals  - attrval per attrval of the database
+ * nodetable - open addressed hash table of node id + 1, 0 if empty
+ * attrtable - open addressed hash table of attr id + 1, 0 if empty
+ *
+ * followed by the lists and a table of unique strings.  The image
+ * ends with a '\0', so no string can run past its end.
+ *
+ * An image is keyed by the device, inode, size, and times of the
+ * database it was built from, so an image of an older version of the
+ * file is never used.  'magic' is written last, an image with a zero
+ * magic is still being built.
+ */
+struct genders_image_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;
+  uint32_t numnodes;
+  uint32_t numattrs;
+  uint32_t numattrvals;
+  uint32_t maxattrs;
+  uint32_t maxnodelen;
+  uint32_t maxattrlen;
+  uint32_t maxvallen;
+  uint32_t nodes;
+  uint32_t attrs;
+  uint32_t attrvals;
+  uint32_t nodetable;
+  uint32_t nodetablesize;
+  uint32_t attrtable;
+  uint32_t attrtablesize;
+  uint64_t dev;
+  uint64_t ino;
+  uint64_t filesize;
+  uint64_t mtime;
+  uint64_t ctime;
+  uint32_t mtime_nsec;
+  uint32_t ctime_nsec;
+};
+
+struct genders_image_entry {
+  uint32_t name;
+  uint32_t list;
+  uint32_t count;
+};
+
+struct genders_image_attrval {
+  uint32_t attr;
+  uint32_t val;                 /* 0 if no value */
+  uint32_t val_contains_subst;
+};
+
+struct genders_image_pair {
+  uint32_t node;
+  uint32_t attrval;
+};
+
+/*
+ * struct genders_image
+ *
+ * A handle's mapping of an image.  'av' is returned by
+ * _genders_image_find_attrval(), as the image holds no struct
+ * genders_attrval to point to.
+ */
+struct genders_image {
+  int fd;
+  char *base;
+  size_t size;
+  struct genders_image_header *hdr;
+  struct genders_attrval av;
+};
+
+/*
+ * struct genders_image_buf
+ *
+ * Growing buffer an image is built in
+ */
+struct genders_image_buf {
+  char *data;
+  unsigned int len;
+  unsigned int size;
+};
+
+#define _IMG(base, off, type)   ((type *)((char *)(base) + (off)))
+#define _IMG_STR(image, off)    _IMG((image)->base, (off), char)
+#define _IMG_NODES(image)       _IMG((image)->base, (image)->hdr->nodes, struct genders_image_entry)
+#define _IMG_ATTRS(image)       _IMG((image)->base, (image)->hdr->attrs, struct genders_image_entry)
+#define _IMG_ATTRVALS(image)    _IMG((image)->base, (image)->hdr->attrvals, struct genders_image_attrval)
+
+#if HAVE_SHM_OPEN
+
+/* 
+ * _image_ptr_key
+ *
+ * hash_key_f for pointers
+ */
+static unsigned int
+_image_ptr_key(const void *key)
+{
+  return (unsigned int)((uintptr_t)key >> 3);
+}
+
+/* 
+ * _image_ptr_cmp
+ *
+ * hash_cmp_f for pointers
+ */
+static int
+_image_ptr_cmp(const void *key1, const void *key2)
+{
+  return (key1 != key2);
+}
+
+/* 
+ * _image_alloc
+ *
+ * Allocate 'len' zeroed bytes, rounded up for alignment, at the end
+ * of the image being built.
+ *
+ * Returns offset on success, -1 on error
+ */
+static int
+_image_alloc(genders_t handle, struct genders_image_buf *b, unsigned int len)
+{
+  unsigned int off;
+
+  len = (len + 7) & ~7U;
+  if (len > GENDERS_IMAGE_MAXSIZE - b->len)
+    {
+      handle->errnum = GENDERS_ERR_OVERFLOW;
+      return -1;
+    }
+
+  if (b->len + len > b->size)
+    {
+      unsigned int size = b->size ? b->size : GENDERS_IMAGE_BUFLEN;
+      char *data;
+
+      while (size < b->len + len)
+        size *= 2;
+
+      if (!(data = (char *)realloc(b->data, size)))
+        {
+          handle->errnum = GENDERS_ERR_OUTMEM;
+          return -1;
+        }
+      memset(data + b->size, '\0', size - b->size);
+      b->data = data;
+      b->size = size;
+    }
+
+  off = b->len;
+  b->len += len;
+  return off;
+}
+
+/* 
+ * _image_string
+ *
+ * Add a string to the image's string table, unless it is already
+ * there.
+ *
+ * Returns offset on success, -1 on error
+ */
+static int
+_image_string(genders_t handle, 
+              struct genders_image_buf *b, 
+              hash_t strings, 
+              char *str)
+{
+  void *data;
+  int off;
+
+  if ((data = hash_find(strings, str)))
+    return (int)(uintptr_t)data;
+
+  if ((off = _image_alloc(handle, b, strlen(str) + 1)) < 0)
+    return -1;
+  strcpy(b->data + off, str);
+
+  if (!hash_insert(strings, str, (void *)(uintptr_t)off))
+    {
+      handle->errnum = GENDERS_ERR_INTERNAL;
+      return -1;
+    }
+  return off;
+}
+
+/* 
+ * _image_tablesize
+ *
+ * Returns the size of a hash table for 'num' entries, a power of two
+ * at least twice 'num' so no lookup probes far.
+ */
+static unsigned int
+_image_tablesize(unsigned int num)
+{
+  unsigned int size = 2;
+
+  while (size < 2 * num)
+    size *= 2;
+  return size;
+}
+
+/* 
+ * _image_table_insert
+ *
+ * Insert entry 'id' named 'str' in a hash table of the image being
+ * built.
+ */
+static void
+_image_table_insert(struct genders_image_buf *b, 
+                    unsigned int table,
+                    unsigned int size,
+                    const char *str,
+                    unsigned int id)
+{
+  uint32_t *slots = _IMG(b->data, table, uint32_t);
+  unsigned int i = hash_key_string(str) & (size - 1);
+
+  while (slots[i])
+    i = (i + 1) & (size - 1);
+  slots[i] = id + 1;
+}
+
+/* 
+ * _image_serialize
+ *
+ * Lay out the database loaded in 'h' as an image keyed by 'st'.
+ *
+ * Returns 0 on success, -1 on error
+ */
+static int
+_image_serialize(genders_t handle, 
+                 genders_t h, 
+                 struct stat *st, 
+                 struct genders_image_buf *b)
+{
+  ListIterator itr = NULL, avcitr = NULL, avitr = NULL;
+  hash_t strings = NULL, attrids = NULL, avids = NULL, nodeids = NULL;
+  struct genders_image_header *hdr;
+  unsigned int numnodes, numattrs, numattrvals = 0;
+  unsigned int nodetablesize, attrtablesize;
+  int nodes, attrs, attrvals, nodetable, attrtable;
+  genders_attrvals_container_t avc;
+  genders_attrval_t av;
+  genders_node_t n;
+  List l;
+  char *attr;
+  char namebuf[GENDERS_MAXHOSTNAMELEN + 1];
+  unsigned int i;
+  int off, rv = -1;
+
+  numnodes = list_count(h->nodeslist);
+  numattrs = list_count(h->attrslist);
+
+  __list_iterator_create(itr, h->attrvalslist);
+  while ((avc = list_next(itr)))
+    numattrvals += list_count(avc->attrvals);
+  list_iterator_destroy(itr);
+  itr = NULL;
+
+  __hash_create(strings, 
+                numnodes + numattrs + numattrvals + 1,
+                (hash_key_f)hash_key_string,
+                (hash_cmp_f)strcmp,
+                NULL);
+  __hash_create(attrids,
+                numattrs + 1,
+                (hash_key_f)hash_key_string,
+                (hash_cmp_f)strcmp,
+                NULL);
+  __hash_create(avids, numattrvals + 1, _image_ptr_key, _image_ptr_cmp, NULL);
+  __hash_create(nodeids, numnodes + 1, _image_ptr_key, _image_ptr_cmp, NULL);
+
+  nodetablesize = _image_tablesize(numnodes);
+  attrtablesize = _image_tablesize(numattrs);
+
+  if (_image_alloc(handle, b, sizeof(struct genders_image_header)) < 0
+      || (nodes = _image_alloc(handle, b, numnodes * sizeof(struct genders_image_entry))) < 0
+      || (attrs = _image_alloc(handle, b, numattrs * sizeof(struct genders_image_entry))) < 0
+      || (attrvals = _image_alloc(handle, b, numattrvals * sizeof(struct genders_image_attrval))) < 0
+      || (nodetable = _image_alloc(handle, b, nodetablesize * sizeof(uint32_t))) < 0
+      || (attrtable = _image_alloc(handle, b, attrtablesize * sizeof(uint32_t))) < 0)
+    goto cleanup;
+
+  i = 0;
+  __list_iterator_create(itr, h->attrslist);
+  while ((attr = list_next(itr)))
+    {
+      if ((off = _image_string(handle, b, strings, attr)) < 0)
+        goto cleanup;
+      _IMG(b->data, attrs, struct genders_image_entry)[i].name = off;
+      _image_table_insert(b, attrtable, attrtablesize, attr, i);
+      __hash_insert(attrids, attr, (void *)(uintptr_t)(i + 1));
+      i++;
+    }
+  list_iterator_destroy(itr);
+  itr = NULL;
+
+  i = 0;
+  __list_iterator_create(itr, h->attrvalslist);
+  while ((avc = list_next(itr)))
+    {
+      __list_iterator_create(avitr, avc->attrvals);
+      while ((av = list_next(avitr)))
+        {
+          struct genders_image_attrval *iav;
+          void *id;
+          int val = 0;
+
+          if (!(id = hash_find(attrids, av->attr)))
+            {
+              handle->errnum = GENDERS_ERR_INTERNAL;
+              goto cleanup;
+            }
+
+          if (av->val && (val = _image_string(handle, b, strings, av->val)) < 0)
+            goto cleanup;
+
+          iav = &_IMG(b->data, attrvals, struct genders_image_attrval)[i];
+          iav->attr = (uintptr_t)id - 1;
+          iav->val = val;
+          iav->val_contains_subst = av->val_contains_subst;
+          __hash_insert(avids, av, (void *)(uintptr_t)(i + 1));
+          i++;
+        }
+      list_iterator_destroy(avitr);
+      avitr = NULL;
+    }
+  list_iterator_destroy(itr);
+  itr = NULL;
+
+  i = 0;
+  __list_iterator_create(itr, h->nodeslist);
+  while ((n = list_next(itr)))
+    {
+      struct genders_image_entry *e;
+      unsigned int count = 0;
+      int name, list;
+
+      /* the string table keeps its keys, so only a stored name can
+       * be shared through it
+       */
+      if (n->name)
+        name = _image_string(handle, b, strings, n->name);
+      else if ((name = _image_alloc(handle, 
+                                    b, 
+                                    strlen(_genders_node_name(n, namebuf)) + 1)) >= 0)
+        strcpy(b->data + name, namebuf);
+      if (name < 0)
+        goto cleanup;
+
+      __list_iterator_create(avcitr, n->attrlist);
+      while ((avc = list_next(avcitr)))
+        count += list_count(avc->attrvals);
+      list_iterator_reset(avcitr);
+
+      if ((list = _image_alloc(handle, b, count * sizeof(uint32_t))) < 0)
+        goto cleanup;
+
+      e = &_IMG(b->data, nodes, struct genders_image_entry)[i];
+      e->name = name;
+      e->list = list;
+      e->count = 0;
+      while ((avc = list_next(avcitr)))
+        {
+          __list_iterator_create(avitr, avc->attrvals);
+          while ((av = list_next(avitr)))
+            _IMG(b->data, list, uint32_t)[e->count++] 
+              = (uintptr_t)hash_find(avids, av) - 1;
+          list_iterator_destroy(avitr);
+          avitr = NULL;
+        }
+      list_iterator_destroy(avcitr);
+      avcitr = NULL;
+
+      _image_table_insert(b, nodetable, nodetablesize, b->data + name, i);
+      __hash_insert(nodeids, n, (void *)(uintptr_t)(i + 1));
+      i++;
+    }
+  list_iterator_destroy(itr);
+  itr = NULL;
+
+  for (i = 0; i < numattrs; i++)
+    {
+      struct genders_image_entry *a = &_IMG(b->data, attrs, struct genders_image_entry)[i];
+      int list;
+
+      if (!(l = hash_find(h->attr_index, b->data + a->name)))
+        continue;
+
+      if ((list = _image_alloc(handle, b, list_count(l) * sizeof(struct genders_image_pair))) < 0)
+        goto cleanup;
+
+      a = &_IMG(b->data, attrs, struct genders_image_entry)[i];
+      a->list = list;
+      __list_iterator_create(itr, l);
+      while ((n = list_next(itr)))
+        {
+          struct genders_image_entry *e;
+          struct genders_image_pair *p;
+          uint32_t *ids;
+          unsigned int j;
+
+          p = &_IMG(b->data, list, struct genders_image_pair)[a->count++];
+          p->node = (uintptr_t)hash_find(nodeids, n) - 1;
+          e = &_IMG(b->data, nodes, struct genders_image_entry)[p->node];
+          ids = _IMG(b->data, e->list, uint32_t);
+          for (j = 0; j < e->count; j++)
+            {
+              if (_IMG(b->data, attrvals, struct genders_image_attrval)[ids[j]].attr == i)
+                {
+                  p->attrval = ids[j];
+                  break;
+                }
+            }
+        }
+      list_iterator_destroy(itr);
+      itr = NULL;
+    }
+
+  /* terminate the last string, see above */
+  if (_image_alloc(handle, b, 1) < 0)
+    goto cleanup;
+
+  hdr = _IMG(b->data, 0, struct genders_image_header);
+  hdr->magic = 0;
+  hdr->version = GENDERS_IMAGE_VERSION;
+  hdr->size = b->len;
+  hdr->numnodes = numnodes;
+  hdr->numattrs = numattrs;
+  hdr->numattrvals = numattrvals;
+  hdr->maxattrs = h->maxattrs;
+  hdr->maxnodelen = h->maxnodelen;
+  hdr->maxattrlen = h->maxattrlen;
+  hdr->maxvallen = h->maxvallen;
+  hdr->nodes = nodes;
+  hdr->attrs = attrs;
+  hdr->attrvals = attrvals;
+  hdr->nodetable = nodetable;
+  hdr->nodetablesize = nodetablesize;
+  hdr->attrtable = attrtable;
+  hdr->attrtablesize = attrtablesize;
+  hdr->dev = st->st_dev;
+  hdr->ino = st->st_ino;
+  hdr->filesize = st->st_size;
+  hdr->mtime = st->st_mtime;
+  hdr->ctime = st->st_ctime;
+  hdr->mtime_nsec = GENDERS_MTIME_NSEC(st);
+  hdr->ctime_nsec = GENDERS_CTIME_NSEC(st);
+  rv = 0;
+
+ cleanup:
+  __list_iterator_destroy(itr);
+  __list_iterator_destroy(avcitr);
+  __list_iterator_destroy(avitr);
+  __hash_destroy(strings);
+  __hash_destroy(attrids);
+  __hash_destroy(avids);
+  __hash_destroy(nodeids);
+  return rv;
+}
+
+/* 
+ * _image_valid
+ *
+ * Check that every section of an image of 'size' bytes lies within
+ * it.
+ *
+ * Returns 1 if valid, 0 if not
+ */
+static int
+_image_valid(struct genders_image_header *hdr, size_t size)
+{
+  if (hdr->size != size
+      || (uint64_t)hdr->nodes + (uint64_t)hdr->numnodes * sizeof(struct genders_image_entry) > size
+      || (uint64_t)hdr->attrs + (uint64_t)hdr->numattrs * sizeof(struct genders_image_entry) > size
+      || (uint64_t)hdr->attrvals + (uint64_t)hdr->numattrvals * sizeof(struct genders_image_attrval) > size
+      || !hdr->nodetablesize
+      || (hdr->nodetablesize & (hdr->nodetablesize - 1))
+      || (uint64_t)hdr->nodetable + (uint64_t)hdr->nodetablesize * sizeof(uint32_t) > size
+      || !hdr->attrtablesize
+      || (hdr->attrtablesize & (hdr->attrtablesize - 1))
+      || (uint64_t)hdr->attrtable + (uint64_t)hdr->attrtablesize * sizeof(uint32_t) > size
+      || ((char *)hdr)[size - 1] != '\0')
+    return 0;
+  return 1;
+}
+
+/* 
+ * _image_attach
+ *
+ * Map the image open on 'fd', if it is an image of the database
+ * described by 'st'.
+ *
+ * Returns 1 if attached, 0 if the image is still being built, -1 if
+ * the image is stale or unusable
+ */
+static int
+_image_attach(genders_t handle, int fd, struct stat *st)
+{
+  struct genders_image_header *hdr;
+  struct genders_image *image;
+  struct stat shmst;
+  void *base;
+
+  if (fstat(fd, &shmst) < 0)
+    return 0;
+
+  /* only trust an image written by our own user */
+  if (shmst.st_uid != geteuid() 
+      || (shmst.st_mode & (S_IWGRP | S_IWOTH)))
+    return 0;
+
+  if (shmst.st_size < sizeof(struct genders_image_header)
+      || shmst.st_size > GENDERS_IMAGE_MAXSIZE)
+    goto incomplete;
+
+  if ((base = mmap(NULL, 
+                   shmst.st_size, 
+                   PROT_READ, 
+                   MAP_SHARED, 
+                   fd, 
+                   0)) == MAP_FAILED)
+    return 0;
+
+  hdr = (struct genders_image_header *)base;
+  if (!hdr->magic)
+    {
+      munmap(base, shmst.st_size);
+      goto incomplete;
+    }
+
+  if (hdr->magic != GENDERS_IMAGE_MAGIC
+      || hdr->version != GENDERS_IMAGE_VERSION
+      || hdr->dev != (uint64_t)st->st_dev
+      || hdr->ino != (uint64_t)st->st_ino
+      || hdr->filesize != (uint64_t)st->st_size
+      || hdr->mtime != (uint64_t)st->st_mtime
+      || hdr->ctime != (uint64_t)st->st_ctime
+      || hdr->mtime_nsec != (uint32_t)GENDERS_MTIME_NSEC(st)
+      || hdr->ctime_nsec != (uint32_t)GENDERS_CTIME_NSEC(st)
+      || !_image_valid(hdr, shmst.st_size))
+    {
+      munmap(base, shmst.st_size);
+      return -1;
+    }
+
+  if (!(image = (struct genders_image *)malloc(sizeof(struct genders_image))))
+    {
+      munmap(base, shmst.st_size);
+      return 0;
+    }
+  memset(image, '\0', sizeof(struct genders_image));
+  image->fd = fd;
+  image->base = (char *)base;
+  image->size = shmst.st_size;
+  image->hdr = hdr;
+
+  handle->image = image;
+  handle->numnodes = hdr->numnodes;
+  handle->numattrs = hdr->numattrs;
+  handle->maxattrs = hdr->maxattrs;
+  handle->maxnodelen = hdr->maxnodelen;
+  handle->maxattrlen = hdr->maxattrlen;
+  handle->maxvallen = hdr->maxvallen;
+  return 1;
+
+ incomplete:
+  /* the builder may have died, don't wait on it forever */
+  if (time(NULL) - shmst.st_mtime > GENDERS_IMAGE_BUILD_TIMEOUT)
+    return -1;
+  return 0;
+}
+
+/* 
+ * _image_build
+ *
+ * Parse the database and publish its image under 'name'.
+ *
+ * Returns 1 if built and attached, 0 if another process is building
+ * the image or it cannot be built, -1 on error
+ */
+static int
+_image_build(genders_t handle, 
+             const char *filename, 
+             struct stat *st,
+             const char *name)
+{
+  struct genders_image_buf b;
+  genders_t h = NULL;
+  uint32_t magic = GENDERS_IMAGE_MAGIC;
+  unsigned int written = 0;
+  int fd, rv = -1;
+
+  memset(&b, '\0', sizeof(struct genders_image_buf));
+
+  /* O_EXCL, so only one process builds an image */
+  if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
+    return 0;
+
+  if (!(h = genders_handle_create()))
+    {
+      handle->errnum = GENDERS_ERR_OUTMEM;
+      goto cleanup;
+    }
+
+  if (genders_load_data(h, filename) < 0)
+    {
+      handle->errnum = genders_errnum(h);
+      goto cleanup;
+    }
+
+  if (_image_serialize(handle, h, st, &b) < 0)
+    goto cleanup;
+
+  if (ftruncate(fd, b.len) < 0)
+    goto unusable;
+
+  while (written < b.len)
+    {
+      ssize_t n;
+
+      if ((n = pwrite(fd, b.data + written, b.len - written, written)) < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          goto unusable;
+        }
+      written += n;
+    }
+
+  if (pwrite(fd, &magic, sizeof(magic), 0) != sizeof(magic))
+    goto unusable;
+
+  if ((rv = _image_attach(handle, fd, st)) <= 0)
+    goto unusable;
+  fd = -1;
+
+ cleanup:
+  if (rv < 0 && fd >= 0)
+    shm_unlink(name);
+  if (fd >= 0)
+    close(fd);
+  if (h)
+    genders_handle_destroy(h);
+  free(b.data);
+  return rv;
+
+ unusable:
+  /* e.g. out of space in /dev/shm, load privately */
+  shm_unlink(name);
+  rv = 0;
+  goto cleanup;
+}
+
+int
+_genders_image_load(genders_t handle, const char *filename)
+{
+  char path[PATH_MAX + 1];
+  char name[GENDERS_IMAGE_NAMELEN];
+  struct stat st;
+  int i, fd, rv;
+
+  if (!filename)
+    filename = GENDERS_DEFAULT_FILE;
+
+  /* a private load reports any error opening the file */
+  if (stat(filename, &st) < 0 || !realpath(filename, path))
+    return 0;
+
+  snprintf(name, 
+           GENDERS_IMAGE_NAMELEN, 
+           "/genders.%u.%08x", 
+           (unsigned int)geteuid(), 
+           hash_key_string(path));
+
+  /* Once for an existing image, once more if another process built
+   * the image at the same time as us.
+   */
+  for (i = 0; i < 2; i++)
+    {
+      if ((fd = shm_open(name, O_RDONLY, 0)) >= 0)
+        {
+          if ((rv = _image_attach(handle, fd, &st)) > 0)
+            return 1;
+          close(fd);
+          if (!rv)
+            return 0;
+
+          /* Stale.  If two processes race here, one may unlink the
+           * other's new image, which only costs a rebuild.
+           */
+          shm_unlink(name);
+        }
+      else if (errno != ENOENT)
+        return 0;
+
+      if ((rv = _image_build(handle, filename, &st, name)))
+        return rv;
+    }
+  return 0;
+}
+
+int
+_genders_image_copy(genders_t handle, genders_t handlecopy)
+{
+  struct genders_image *image = NULL;
+  void *base;
+
+  __xmalloc(image, struct genders_image *, sizeof(struct genders_image));
+  image->fd = -1;
+
+  if ((image->fd = dup(handle->image->fd)) < 0
+      || (base = mmap(NULL, 
+                      handle->image->size, 
+                      PROT_READ, 
+                      MAP_SHARED, 
+                      image->fd, 
+                      0)) == MAP_FAILED)
+    {
+      handle->errnum = GENDERS_ERR_INTERNAL;
+      goto cleanup;
+    }
+
+  image->base = (char *)base;
+  image->size = handle->image->size;
+  image->hdr = (struct genders_image_header *)base;
+  handlecopy->image = image;
+  return 0;
+
+ cleanup:
+  if (image && image->fd >= 0)
+    close(image->fd);
+  free(image);
+  return -1;
+}
+
+void
+_genders_image_destroy(struct genders_image *image)
+{
+  if (!image)
+    return;
+
+  munmap(image->base, image->size);
+  close(image->fd);
+  free(image);
+}
+
+#else  /* !HAVE_SHM_OPEN */
+
+int
+_genders_image_load(genders_t handle, const char *filename)
+{
+  return 0;
+}
+
+int
+_genders_image_copy(genders_t handle, genders_t handlecopy)
+{
+  handle->errnum = GENDERS_ERR_INTERNAL;
+  return -1;
+}
+
+void
+_genders_image_destroy(struct genders_image *image)
+{
+}
+
+#endif /* !HAVE_SHM_OPEN */
+
+/* 
+ * _image_lookup
+ *
+ * Find the entry named 'str' in a hash table of the image.
+ *
+ * Returns id on success, -1 if not found
+ */
+static int
+_image_lookup(struct genders_image *image, 
+              uint32_t table, 
+              uint32_t size, 
+              struct genders_image_entry *entries,
+              const char *str)
+{
+  uint32_t *slots = _IMG(image->base, table, uint32_t);
+  unsigned int i = hash_key_string(str) & (size - 1);
+
+  while (slots[i])
+    {
+      if (!strcmp(_IMG_STR(image, entries[slots[i] - 1].name), str))
+        return slots[i] - 1;
+      i = (i + 1) & (size - 1);
+    }
+  return -1;
+}
+
+#define _image_find_node(image, node) \
+        _image_lookup((image), \
+                      (image)->hdr->nodetable, \
+                      (image)->hdr->nodetablesize, \
+                      _IMG_NODES(image), \
+                      (node))
+
+#define _image_find_attr(image, attr) \
+        _image_lookup((image), \
+                      (image)->hdr->attrtable, \
+                      (image)->hdr->attrtablesize, \
+                      _IMG_ATTRS(image), \
+                      (attr))
+
+/* 
+ * _image_attrval
+ *
+ * Point the image's av buffer at attrval 'id'.
+ *
+ * Returns pointer to the av buffer
+ */
+static genders_attrval_t
+_image_attrval(struct genders_image *image, uint32_t id)
+{
+  struct genders_image_attrval *iav = &_IMG_ATTRVALS(image)[id];
+
+  image->av.attr = _IMG_STR(image, _IMG_ATTRS(image)[iav->attr].name);
+  image->av.val = iav->val ? _IMG_STR(image, iav->val) : NULL;
+  image->av.val_contains_subst = iav->val_contains_subst;
+  return &image->av;
+}
+
+/* 
+ * _image_val_matches
+ *
+ * Determine if 'av' of the node named 'node' has value 'val'.
+ *
+ * Returns 1 if it does, 0 if not, -1 on error
+ */
+static int
+_image_val_matches(genders_t handle, 
+                   char *node,
+                   genders_attrval_t av, 
+                   const char *val)
+{
+  struct genders_node n;
+  char *valptr;
+
+  if (!av->val)
+    return 0;
+
+  n.name = node;
+  if (_genders_get_valptr(handle, &n, av, &valptr, NULL) < 0)
+    return -1;
+  return !strcmp(valptr, val);
+}
+
+int
+_genders_image_isnode(genders_t handle, const char *node)
+{
+  return (_image_find_node(handle->image, node) >= 0);
+}
+
+int
+_genders_image_isattr(genders_t handle, const char *attr)
+{
+  return (_image_find_attr(handle->image, attr) >= 0);
+}
+
+int
+_genders_image_attr_count(genders_t handle, const char *attr)
+{
+  int a;
+
+  if ((a = _image_find_attr(handle->image, attr)) < 0)
+    return 0;
+  return _IMG_ATTRS(handle->image)[a].count;
+}
+
+char *
+_genders_image_nodename(genders_t handle, int i)
+{
+  return _IMG_STR(handle->image, _IMG_NODES(handle->image)[i].name);
+}
+
+int
+_genders_image_find_attrval(genders_t handle,
+                            const char *node,
+                            const char *attr,
+                            const char *val,
+                            genders_attrval_t *avptr)
+{
+  struct genders_image *image = handle->image;
+  struct genders_image_entry *e;
+  genders_attrval_t av;
+  uint32_t *ids;
+  unsigned int j;
+  int i, a, rv;
+
+  *avptr = NULL;
+
+  if ((i = _image_find_node(image, node)) < 0
+      || (a = _image_find_attr(image, attr)) < 0)
+    return 0;
+
+  e = &_IMG_NODES(image)[i];
+  ids = _IMG(image->base, e->list, uint32_t);
+  for (j = 0; j < e->count; j++)
+    {
+      if (_IMG_ATTRVALS(image)[ids[j]].attr != a)
+        continue;
+
+      av = _image_attrval(image, ids[j]);
+      if (val)
+        {
+          if ((rv = _image_val_matches(handle, 
+                                       _IMG_STR(image, e->name), 
+                                       av, 
+                                       val)) <= 0)
+            return rv;
+        }
+      *avptr = av;
+      break;
+    }
+  return 0;
+}
+
+int
+_genders_image_getnodes(genders_t handle,
+                        char *nodes[],
+                        int len,
+                        const char *attr,
+                        const char *val,
+                        int exists)
+{
+  struct genders_image *image = handle->image;
+  struct genders_image_entry *a;
+  struct genders_image_pair *p;
+  unsigned int j;
+  int id, index = 0, rv;
+
+  if (!attr)
+    {
+      for (j = 0; j < image->hdr->numnodes; j++)
+        {
+          if (_genders_put_in_array(handle, 
+                                    _genders_image_nodename(handle, j), 
+                                    nodes, 
+                                    index++, 
+                                    len) < 0)
+            return -1;
+        }
+      return index;
+    }
+
+  if ((id = _image_find_attr(image, attr)) < 0)
+    return 0;
+
+  a = &_IMG_ATTRS(image)[id];
+  p = _IMG(image->base, a->list, struct genders_image_pair);
+  for (j = 0; j < a->count; j++)
+    {
+      char *node = _genders_image_nodename(handle, p[j].node);
+
+      if (val
+          && (rv = _image_val_matches(handle, 
+                                      node,
+                                      _image_attrval(image, p[j].attrval),
+                                      val)) <= 0)
+        {
+          if (rv < 0)
+            return -1;
+          continue;
+        }
+
+      if (exists)
+        return 1;
+
+      if (_genders_put_in_array(handle, node, nodes, index++, len) < 0)
+        return -1;
+    }
+  return index;
+}
+
+int
+_genders_image_getattr(genders_t handle,
+                       char *attrs[],
+                       char *vals[],
+                       int len,
+                       const char *node)
+{
+  struct genders_image *image = handle->image;
+  struct genders_image_entry *e;
+  struct genders_node n;
+  uint32_t *ids;
+  unsigned int j;
+  int i, index = 0;
+
+  if ((i = _image_find_node(image, node)) < 0)
+    {
+      handle->errnum = GENDERS_ERR_NOTFOUND;
+      return -1;
+    }
+
+  e = &_IMG_NODES(image)[i];
+  n.name = _IMG_STR(image, e->name);
+  ids = _IMG(image->base, e->list, uint32_t);
+  for (j = 0; j < e->count; j++)
+    {
+      genders_attrval_t av = _image_attrval(image, ids[j]);
+
+      if (_genders_put_in_array(handle, av->attr, attrs, index, len) < 0)
+        return -1;
+
+      if (vals && av->val) 
+        {
+          char *valptr;
+          if (_genders_get_valptr(handle, &n, av, &valptr, NULL) < 0)
+            return -1;
+          if (_genders_put_in_array(handle, valptr, vals, index, len) < 0)
+            return -1;
+        }
+      index++;
+    }
+  return index;
+}
+
+int
+_genders_image_getattr_all(genders_t handle, char *attrs[], int len)
+{
+  struct genders_image *image = handle->image;
+  unsigned int j;
+  int index = 0;
+
+  for (j = 0; j < image->hdr->numattrs; j++)
+    {
+      if (_genders_put_in_array(handle, 
+                                _IMG_STR(image, _IMG_ATTRS(image)[j].name), 
+                                attrs, 
+                                index++, 
+                                len) < 0)
+        return -1;
+    }
+  return index;
+}
@@ -0,0 +1,145 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+#ifndef _GENDERS_IMAGE_H
+#define _GENDERS_IMAGE_H 1
+
+#include "genders.h"
+#include "genders_api.h"
+
+struct genders_image;
+
+/*
+ * _genders_image_load
+ *
+ * Attach the handle to the shared image of a database, building the
+ * image first if there is none or it is stale.  On success the
+ * handle's counts are set from the image.
+ *
+ * Returns 1 if attached, 0 if the database should be loaded privately
+ * instead, -1 on error
+ */
+int _genders_image_load(genders_t handle, const char *filename);
+
+/*
+ * _genders_image_copy
+ *
+ * Attach 'handlecopy' to the image of 'handle'.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int _genders_image_copy(genders_t handle, genders_t handlecopy);
+
+/*
+ * _genders_image_destroy
+ *
+ * Detach from an image.
+ */
+void _genders_image_destroy(struct genders_image *image);
+
+/*
+ * _genders_image_isnode
+ *
+ * Returns 1 if node is in the image, 0 if not
+ */
+int _genders_image_isnode(genders_t handle, const char *node);
+
+/*
+ * _genders_image_isattr
+ *
+ * Returns 1 if attr is in the image, 0 if not
+ */
+int _genders_image_isattr(genders_t handle, const char *attr);
+
+/*
+ * _genders_image_attr_count
+ *
+ * Returns number of nodes with attr in the image
+ */
+int _genders_image_attr_count(genders_t handle, const char *attr);
+
+/*
+ * _genders_image_nodename
+ *
+ * Returns name of the node with index 'i' in the image
+ */
+char *_genders_image_nodename(genders_t handle, int i);
+
+/*
+ * _genders_image_find_attrval
+ *
+ * Find the attrval of attr, or attr=val if val is non-NULL, for the
+ * node named 'node' in the image.  *avptr points to a buffer in the
+ * image's state, valid until the next call.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int _genders_image_find_attrval(genders_t handle,
+                                const char *node,
+                                const char *attr,
+                                const char *val,
+                                genders_attrval_t *avptr);
+
+/*
+ * _genders_image_getnodes
+ *
+ * Find the nodes with attr, or attr=val if val is non-NULL, or every
+ * node if attr is NULL, in the same order as a private load.  If
+ * 'exists' is set, only determine if any node is found.
+ *
+ * Returns number of nodes on success, -1 on error
+ */
+int _genders_image_getnodes(genders_t handle,
+                            char *nodes[],
+                            int len,
+                            const char *attr,
+                            const char *val,
+                            int exists);
+
+/*
+ * _genders_image_getattr
+ *
+ * Get the attributes, and values if vals is non-NULL, of a node in
+ * the image.
+ *
+ * Returns number of attributes on success, -1 on error
+ */
+int _genders_image_getattr(genders_t handle,
+                           char *attrs[],
+                           char *vals[],
+                           int len,
+                           const char *node);
+
+/*
+ * _genders_image_getattr_all
+ *
+ * Get every attribute in the image.
+ *
+ * Returns number of attributes on success, -1 on error
+ */
+int _genders_image_getattr_all(genders_t handle, char *attrs[], int len);
+
+#endif /* _GENDERS_IMAGE_H */
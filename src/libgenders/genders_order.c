@@ -0,0 +1,506 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#if STDC_HEADERS
+#include <string.h>
+#endif /* STDC_HEADERS */
+#include <errno.h>
+
+#include "genders.h"
+#include "genders_api.h"
+#include "genders_constants.h"
+#include "genders_order.h"
+#include "genders_util.h"
+
+/*
+ * struct genders_prefix
+ *
+ * The nodes named 'name', or 'name' followed by a numeric suffix.
+ * The numbered nodes have the ordinals 'first' through 'first +
+ * count - 1', in suffix order.  'width' is the width of every
+ * suffix if any is zero padded, otherwise suffixes are not padded
+ * and 'width' is unused.
+ */
+struct genders_prefix {
+  char *name;
+  int single;                   /* ordinal of node 'name', or -1 */
+  int first;
+  int count;
+  unsigned long lo;
+  unsigned long hi;
+  int width;
+  int padded;
+};
+
+/*
+ * struct genders_order
+ *
+ * Node ordinals, numbering the nodes in the order hostlist_uniq()
+ * sorts them: by prefix, a node without a suffix first, then by
+ * suffix.  'prefix' and 'suffix' map an ordinal back to its prefix
+ * and suffix, and each node's ordinal is stored in the node.
+ *
+ * 'usable' is 0 if the node names could not be numbered, because a
+ * prefix mixes zero padded suffixes with suffixes of other widths,
+ * which hostlist_uniq() does not sort by suffix alone.
+ */
+struct genders_order {
+  int usable;
+  int numnodes;
+  struct genders_prefix *prefixes;
+  int numprefixes;
+  hash_t prefix_index;
+  int *prefix;
+  unsigned long *suffix;
+};
+
+/*
+ * _suffix_digits
+ *
+ * Returns the number of digits of 'n', unpadded.
+ */
+static int
+_suffix_digits(unsigned long n)
+{
+  int digits = 1;
+
+  while (n /= 10)
+    digits++;
+  return digits;
+}
+
+/*
+ * _order_number
+ *
+ * Map the ordinals of the handle's nodes to their prefix and suffix,
+ * in the order of the ranges of 'hl', the uniq'ed hostlist of all
+ * nodes.
+ *
+ * Returns 1 if mapped, 0 if the nodes cannot be numbered, -1 on
+ * error
+ */
+static int
+_order_number(genders_t handle, struct genders_order *order, hostlist_t hl)
+{
+  int nranges, i, rv, ord = 0;
+
+  nranges = hostlist_nranges(hl);
+
+  __xmalloc(order->prefixes, 
+            struct genders_prefix *, 
+            sizeof(struct genders_prefix) * nranges);
+  __hash_create(order->prefix_index,
+                nranges,
+                (hash_key_f)hash_key_string,
+                (hash_cmp_f)strcmp,
+                NULL);
+
+  for (i = 0; i < nranges; i++)
+    {
+      struct genders_prefix *p;
+      unsigned long lo, hi, s;
+      char *prefix;
+      int width, padded;
+
+      if ((rv = hostlist_nth_range(hl, i, &prefix, &lo, &hi, &width)) < 0)
+        {
+          handle->errnum = GENDERS_ERR_INTERNAL;
+          goto cleanup;
+        }
+
+      if (!(p = hash_find(order->prefix_index, prefix)))
+        {
+          p = &order->prefixes[order->numprefixes++];
+          __xstrdup(p->name, prefix);
+          p->single = -1;
+          __hash_insert(order->prefix_index, p->name, p);
+        }
+
+      if (!rv)
+        {
+          if (p->single >= 0 || p->count)
+            return 0;
+          p->single = ord;
+          order->prefix[ord] = p - order->prefixes;
+          order->suffix[ord++] = 0;
+          continue;
+        }
+
+      padded = width > _suffix_digits(lo);
+      if (!p->count)
+        {
+          p->first = ord;
+          p->lo = lo;
+          p->width = width;
+        }
+      else if (order->prefix[ord - 1] != p - order->prefixes
+               || lo <= p->hi
+               || (width != p->width && (padded || p->padded)))
+        return 0;
+
+      /* hi may be ULONG_MAX, so test before incrementing */
+      s = lo;
+      do
+        {
+          order->prefix[ord] = p - order->prefixes;
+          order->suffix[ord++] = s;
+        }
+      while (s++ < hi);
+
+      p->padded |= padded;
+      p->hi = hi;
+      p->count += hi - lo + 1;
+    }
+
+  return 1;
+
+ cleanup:
+  return -1;
+}
+
+/*
+ * _order_get
+ *
+ * Get the node ordinals of a handle, numbering the nodes on first
+ * use.
+ *
+ * Returns 0 and the ordinals in 'orderp', -1 on error
+ */
+static int
+_order_get(genders_t handle, struct genders_order **orderp)
+{
+  struct genders_order *order = NULL;
+  hostlist_t hl = NULL;
+  ListIterator itr = NULL;
+  unsigned char *numbered = NULL;
+  genders_node_t n;
+  char namebuf[GENDERS_MAXHOSTNAMELEN + 1];
+  int rv;
+
+  if (handle->order)
+    {
+      *orderp = handle->order;
+      return 0;
+    }
+
+  __xmalloc(order, struct genders_order *, sizeof(struct genders_order));
+  order->numnodes = handle->numnodes;
+
+  __hostlist_create(hl, NULL);
+  __list_iterator_create(itr, handle->nodeslist);
+  while ((n = list_next(itr)))
+    {
+      if (hostlist_push_host(hl, _genders_node_name(n, namebuf)) <= 0)
+        {
+          handle->errnum = GENDERS_ERR_OUTMEM;
+          goto cleanup;
+        }
+    }
+  hostlist_uniq(hl);
+
+  if (hostlist_count(hl) == handle->numnodes && handle->numnodes)
+    {
+      __xmalloc(order->prefix, int *, sizeof(int) * handle->numnodes);
+      __xmalloc(order->suffix, 
+                unsigned long *, 
+                sizeof(unsigned long) * handle->numnodes);
+      if ((rv = _order_number(handle, order, hl)) < 0)
+        goto cleanup;
+      order->usable = rv;
+    }
+
+  /* A node's ordinal is its position in the hostlist, every
+   * position must be found exactly once.
+   */
+  if (order->usable)
+    {
+      __xmalloc(numbered, unsigned char *, handle->numnodes);
+      list_iterator_reset(itr);
+      while ((n = list_next(itr)))
+        {
+          int ord = hostlist_find(hl, _genders_node_name(n, namebuf));
+
+          if (ord < 0 || ord >= handle->numnodes || numbered[ord])
+            {
+              order->usable = 0;
+              break;
+            }
+          numbered[ord] = 1;
+          n->ordinal = ord;
+        }
+    }
+
+  /* Unusable ordinals are kept, so the nodes are numbered once */
+  if (!order->usable)
+    {
+      _genders_order_destroy(order);
+      order = NULL;
+      __xmalloc(order, struct genders_order *, sizeof(struct genders_order));
+    }
+
+  __list_iterator_destroy(itr);
+  hostlist_destroy(hl);
+  free(numbered);
+  handle->order = order;
+  *orderp = order;
+  return 0;
+
+ cleanup:
+  __list_iterator_destroy(itr);
+  __hostlist_destroy(hl);
+  free(numbered);
+  _genders_order_destroy(order);
+  return -1;
+}
+
+/*
+ * _order_lookup
+ *
+ * Returns the ordinal of the node numbered 's' in prefix 'p', or -1
+ * if there is none.
+ */
+static int
+_order_lookup(struct genders_order *order, 
+              struct genders_prefix *p, 
+              unsigned long s)
+{
+  int lo, hi, mid;
+
+  if (!p->count || s < p->lo || s > p->hi)
+    return -1;
+
+  if (p->hi - p->lo + 1 == (unsigned long)p->count)
+    return p->first + (s - p->lo);
+
+  lo = p->first;
+  hi = p->first + p->count;
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (order->suffix[mid] < s)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return (lo < p->first + p->count && order->suffix[lo] == s) ? lo : -1;
+}
+
+/*
+ * _order_push
+ *
+ * Push the nodes whose mark is 'want' onto 'hl', in ordinal order,
+ * pushing each run of consecutive suffixes as one range.
+ *
+ * Returns 0 on success, -1 on error
+ */
+static int
+_order_push(genders_t handle, 
+            struct genders_order *order,
+            unsigned char *marks,
+            unsigned char want,
+            hostlist_t hl)
+{
+  int ord = 0;
+
+  while (ord < order->numnodes)
+    {
+      struct genders_prefix *p;
+      int start, width;
+
+      if (marks[ord] != want)
+        {
+          ord++;
+          continue;
+        }
+
+      p = &order->prefixes[order->prefix[ord]];
+      if (ord == p->single)
+        {
+          if (hostlist_push_host(hl, p->name) <= 0)
+            goto cleanup;
+          ord++;
+          continue;
+        }
+
+      start = ord++;
+      while (ord < p->first + p->count
+             && marks[ord] == want
+             && order->suffix[ord] == order->suffix[ord - 1] + 1)
+        ord++;
+
+      width = p->padded ? p->width : _suffix_digits(order->suffix[start]);
+      if (hostlist_push_numbered(hl,
+                                 p->name,
+                                 order->suffix[start],
+                                 order->suffix[ord - 1],
+                                 width) < 0)
+        goto cleanup;
+    }
+
+  return 0;
+
+ cleanup:
+  handle->errnum = GENDERS_ERR_OUTMEM;
+  return -1;
+}
+
+int
+_genders_order_hostlist(genders_t handle, 
+                        List *lists, 
+                        int numlists, 
+                        hostlist_t *hl)
+{
+  struct genders_order *order;
+  unsigned char *marks = NULL;
+  ListIterator itr = NULL;
+  genders_node_t n;
+  hostlist_t h = NULL;
+  int i;
+
+  *hl = NULL;
+
+  if (_order_get(handle, &order) < 0)
+    return -1;
+
+  if (!order->usable)
+    return 0;
+
+  __xmalloc(marks, unsigned char *, order->numnodes);
+  for (i = 0; i < numlists; i++)
+    {
+      __list_iterator_create(itr, lists[i]);
+      while ((n = list_next(itr)))
+        marks[n->ordinal] = 1;
+      list_iterator_destroy(itr);
+      itr = NULL;
+    }
+
+  __hostlist_create(h, NULL);
+  if (_order_push(handle, order, marks, 1, h) < 0)
+    goto cleanup;
+
+  free(marks);
+  *hl = h;
+  return 0;
+
+ cleanup:
+  __list_iterator_destroy(itr);
+  __hostlist_destroy(h);
+  free(marks);
+  return -1;
+}
+
+int
+_genders_order_complement(genders_t handle, hostlist_t h, hostlist_t *hl)
+{
+  struct genders_order *order;
+  unsigned char *marks = NULL;
+  hostlist_t ch = NULL;
+  int nranges, i;
+
+  *hl = NULL;
+
+  if (_order_get(handle, &order) < 0)
+    return -1;
+
+  if (!order->usable)
+    return 0;
+
+  __xmalloc(marks, unsigned char *, order->numnodes);
+
+  /* Every node of 'h' should be numbered, if one is not, leave the
+   * complement to the caller.
+   */
+  nranges = hostlist_nranges(h);
+  for (i = 0; i < nranges; i++)
+    {
+      struct genders_prefix *p;
+      unsigned long lo, hi, s;
+      char *prefix;
+      int width, rv, ord;
+
+      if ((rv = hostlist_nth_range(h, i, &prefix, &lo, &hi, &width)) < 0
+          || !(p = hash_find(order->prefix_index, prefix)))
+        goto out;
+
+      if (!rv)
+        {
+          if (p->single < 0)
+            goto out;
+          marks[p->single] = 1;
+          continue;
+        }
+
+      if (p->padded ? width != p->width : width > _suffix_digits(lo))
+        goto out;
+
+      s = lo;
+      do
+        {
+          if ((ord = _order_lookup(order, p, s)) < 0)
+            goto out;
+          marks[ord] = 1;
+        }
+      while (s++ < hi);
+    }
+
+  __hostlist_create(ch, NULL);
+  if (_order_push(handle, order, marks, 0, ch) < 0)
+    goto cleanup;
+
+  *hl = ch;
+ out:
+  free(marks);
+  return 0;
+
+ cleanup:
+  __hostlist_destroy(ch);
+  free(marks);
+  return -1;
+}
+
+void
+_genders_order_destroy(struct genders_order *order)
+{
+  int i;
+
+  if (!order)
+    return;
+
+  for (i = 0; i < order->numprefixes; i++)
+    free(order->prefixes[i].name);
+  free(order->prefixes);
+  __hash_destroy(order->prefix_index);
+  free(order->prefix);
+  free(order->suffix);
+  free(order);
+}
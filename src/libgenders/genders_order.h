@@ -0,0 +1,69 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+#ifndef _GENDERS_ORDER_H
+#define _GENDERS_ORDER_H 1
+
+#include "genders.h"
+#include "hostlist.h"
+#include "list.h"
+
+struct genders_order;
+
+/*
+ * _genders_order_hostlist
+ *
+ * Create a hostlist of the nodes in the 'numlists' Lists 'lists',
+ * built in one pass over the node ordinals without sorting.  It holds
+ * the same ranges, in the same order, as pushing the nodes and
+ * calling hostlist_uniq().
+ *
+ * Must not be called with a shared image or unexpanded rules.
+ *
+ * Returns 0 and the hostlist in 'hl', or 0 and NULL if node names
+ * mix zero padded and other suffix widths, in which case the caller
+ * must sort the nodes itself.  Returns -1 on error.
+ */
+int _genders_order_hostlist(genders_t handle, 
+                            List *lists, 
+                            int numlists, 
+                            hostlist_t *hl);
+
+/*
+ * _genders_order_complement
+ *
+ * As _genders_order_hostlist(), for the nodes not in hostlist 'h'.
+ */
+int _genders_order_complement(genders_t handle, hostlist_t h, hostlist_t *hl);
+
+/*
+ * _genders_order_destroy
+ *
+ * Destroy the node ordinals of a handle.
+ */
+void _genders_order_destroy(struct genders_order *order);
+
+#endif /* _GENDERS_ORDER_H */
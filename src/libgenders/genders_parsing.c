@@ -35,6 +35,7 @@
 #include <string.h>
 #endif /* STDC_HEADERS */
 #include <errno.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #if HAVE_FCNTL_H
@@ -95,11 +96,12 @@ _insert_node(genders_t handle,
   genders_node_t n = NULL;
 
   /* must create node if node doesn't exist */ 
-  if (!(n = hash_find((*node_index), nodename)))
+  if (!(n = _genders_find_node((*node_index), nodename)))
     {
       /* insert into nodelist */
       __xmalloc(n, genders_node_t, sizeof(struct genders_node));
-      __xstrdup(n->name, nodename);
+      if (_genders_node_set_name(handle, n, nodename) < 0)
+        goto cleanup;
       __list_create(n->attrlist, NULL);
       n->attrcount = 0;
       n->attrlist_index_size = GENDERS_ATTRLIST_INDEX_INIT_SIZE;
@@ -115,11 +117,15 @@ _insert_node(genders_t handle,
 
       if (hash_count((*node_index)) > ((*node_index_size) * 2))
         {
-          if (_genders_rehash(handle, node_index, node_index_size) < 0)
+          if (_genders_rehash(handle, 
+                              node_index, 
+                              node_index_size,
+                              _genders_node_key,
+                              _genders_node_cmp) < 0)
             goto cleanup;
         }
 
-      __hash_insert((*node_index), n->name, n);
+      __hash_insert((*node_index), n, n);
     }
   return n;
   
@@ -128,6 +134,7 @@ _insert_node(genders_t handle,
     {
       __list_destroy(n->attrlist);
       __hash_destroy(n->attrlist_index);
+      free(n->name);
       free(n);
     }
   return NULL;
@@ -199,7 +206,11 @@ _insert_attr(genders_t handle,
 
   if (hash_count((*attr_index)) > ((*attr_index_size) * 2))
     {
-      if (_genders_rehash(handle, attr_index, attr_index_size) < 0)
+      if (_genders_rehash(handle, 
+                          attr_index, 
+                          attr_index_size,
+                          (hash_key_f)hash_key_string,
+                          (hash_cmp_f)strcmp) < 0)
         goto cleanup;
     }
 
@@ -234,6 +245,7 @@ _attr_node_processsing(genders_t handle,
   ListIterator attrvals_itr = NULL;
   List tmpattrlist = NULL;
   genders_attrval_t av = NULL;
+  char namebuf[GENDERS_MAXHOSTNAMELEN + 1];
   int rv = -1;
 
   __list_create(tmpattrlist, NULL);
@@ -254,7 +266,7 @@ _attr_node_processsing(genders_t handle,
 	  if (line_num > 0) 
 	    {
 	      fprintf(stream, "Line %d: duplicate attribute \"%s\" listed for node \"%s\"\n",
-		      line_num, av->attr, n->name);
+		      line_num, av->attr, _genders_node_name(n, namebuf));
 	      rv = 1;
 	    }
 	  handle->errnum = GENDERS_ERR_PARSE;
@@ -278,7 +290,7 @@ _attr_node_processsing(genders_t handle,
 	  if (line_num > 0) 
 	    {
 	      fprintf(stream, "Line %d: duplicate attribute \"%s\" listed for node \"%s\"\n",
-		      line_num, av->attr, n->name);
+		      line_num, av->attr, _genders_node_name(n, namebuf));
 	      rv = 1;
 	    }
 	  handle->errnum = GENDERS_ERR_PARSE;
@@ -303,13 +315,17 @@ _attr_node_processsing(genders_t handle,
       /* add attr to attrlist_index */
       if (hash_count(n->attrlist_index) > (n->attrlist_index_size * 2))
         {
-          if (_genders_rehash(handle, &(n->attrlist_index), &(n->attrlist_index_size)) < 0)
+          if (_genders_rehash(handle, 
+                              &(n->attrlist_index), 
+                              &(n->attrlist_index_size),
+                              (hash_key_f)hash_key_string,
+                              (hash_cmp_f)strcmp) < 0)
             goto cleanup;
         }
       
       __hash_insert(n->attrlist_index,
                     av->attr,
-                    avc);
+                    av);
     }
   
   rv = 0;
@@ -319,6 +335,127 @@ _attr_node_processsing(genders_t handle,
   return rv;
 }
 
+/* 
+ * _parse_nodes
+ *
+ * Insert the nodes of a genders file line, and the attributes listed
+ * for them, into the nodeslist and indexes.
+ *
+ * Returns -1 on error, 1 if there was a parse error, 0 if no errors
+ */
+static int
+_parse_nodes(genders_t handle,
+             int *maxattrs,
+             int *maxnodelen,
+             int *line_maxnodelen,
+             List nodeslist,
+             hash_t *node_index,
+             int *node_index_size,
+             hash_t *attr_index,
+             hostlist_t hl,
+             genders_attrvals_container_t avc,
+             int line_num,
+             FILE *stream)
+{
+  hostlist_iterator_t hlitr = NULL;
+  char node[GENDERS_MAXHOSTNAMELEN + 1];
+  int nodelen;
+  int rv = -1;
+
+  __hostlist_iterator_create(hlitr, hl);
+
+  /* node names are formatted into node, _insert_node() copies them */
+  while ((nodelen = hostlist_next_host(hlitr, node, sizeof(node))) > 0) 
+    {
+      genders_node_t n;
+
+      if (nodelen > GENDERS_MAXHOSTNAMELEN) 
+	{
+	  if (line_num > 0) 
+	    {
+	      fprintf(stream, "Line %d: hostname too long\n", line_num);
+	      rv = 1;
+	    }
+	  handle->errnum = GENDERS_ERR_PARSE;
+	  goto cleanup;
+	}
+  
+      if (!(n = _insert_node(handle,
+                             nodeslist,
+                             node_index,
+                             node_index_size,
+                             node)))
+	goto cleanup;
+      
+      if (avc) 
+	{
+	  if ((rv = _attr_node_processsing(handle,
+                                           n,
+                                           avc,
+                                           attr_index,
+                                           line_num,
+                                           stream)) != 0)
+	    goto cleanup;
+
+          __list_append(n->attrlist, avc);
+	  n->attrcount += list_count(avc->attrvals);
+	}
+      
+      if (!line_num) 
+	{
+	  (*maxattrs) = GENDERS_MAX(n->attrcount, (*maxattrs));
+	  (*maxnodelen) = GENDERS_MAX(nodelen, (*maxnodelen));
+	  (*line_maxnodelen) = GENDERS_MAX(nodelen, (*line_maxnodelen));
+	}
+    }
+
+  rv = 0;
+ cleanup:
+  __hostlist_iterator_destroy(hlitr);
+  return rv;
+}
+
+/* 
+ * _numdigits
+ *
+ * Returns the number of decimal digits in num
+ */
+static int
+_numdigits(unsigned long num)
+{
+  int digits = 1;
+
+  while (num /= 10)
+    digits++;
+  return digits;
+}
+
+/* 
+ * _hostlist_maxlen
+ *
+ * Returns the length of the longest hostname in a hostlist
+ */
+static int
+_hostlist_maxlen(hostlist_t hl)
+{
+  int i, nranges, maxlen = 0;
+
+  nranges = hostlist_nranges(hl);
+  for (i = 0; i < nranges; i++)
+    {
+      unsigned long lo, hi;
+      char *prefix;
+      int width, len;
+
+      if (hostlist_nth_range(hl, i, &prefix, &lo, &hi, &width) > 0)
+        len = strlen(prefix) + GENDERS_MAX(width, _numdigits(hi));
+      else
+        len = strlen(prefix);
+      maxlen = GENDERS_MAX(len, maxlen);
+    }
+  return maxlen;
+}
+
 #ifndef HAVE_STRSEP
 /* 
  * strsep for those systems that do not define it.
@@ -375,7 +512,8 @@ strsep (char **stringp, const char *delim)
  * _parse_line
  *
  * parse a genders file line
- * - If line_num == 0, parse and store genders data
+ * - If line_num == 0, parse and store genders data, as a rule in
+ *   ruleslist if it is not NULL
  * - If line_num > 0, debug genders file
  *
  * Returns -1 on error, 1 if there was a parse error, 0 if no errors
@@ -398,16 +536,17 @@ _parse_line(genders_t handle,
             int *node_index_size,
             hash_t *attr_index,
             int *attr_index_size,
+            List ruleslist,
             char *line, 
 	    int line_num, 
 	    FILE *stream, 
 	    int *parsed_nodes)
 {
-  char *temp, *nodenames, *node = NULL;
+  char *temp, *nodenames;
   int max_n_subst_vallen = 0, line_maxnodelen = 0, rv = -1;
   genders_attrvals_container_t avc = NULL;
+  genders_rule_t r = NULL;
   hostlist_t hl = NULL;
-  hostlist_iterator_t hlitr = NULL;
 
   /* "remove" comments */
   if ((temp = strchr(line, '#'))) 
@@ -577,54 +716,35 @@ _parse_line(genders_t handle,
       goto cleanup;
     }
 
-  __hostlist_iterator_create(hlitr, hl);
-
-  while ((node = hostlist_next(hlitr))) 
+  if (ruleslist && !line_num)
     {
-      genders_node_t n;
-
-      if (strlen(node) > GENDERS_MAXHOSTNAMELEN) 
+      /* Keep the line as a rule, its nodes are checked against
+       * each other by _genders_check_rules()
+       */
+      if ((line_maxnodelen = _hostlist_maxlen(hl)) > GENDERS_MAXHOSTNAMELEN)
 	{
-	  if (line_num > 0) 
-	    {
-	      fprintf(stream, "Line %d: hostname too long\n", line_num);
-	      rv = 1;
-	    }
 	  handle->errnum = GENDERS_ERR_PARSE;
 	  goto cleanup;
 	}
-  
-      if (!(n = _insert_node(handle,
-                             nodeslist,
-                             node_index,
-                             node_index_size,
-                             node)))
-	goto cleanup;
-      
-      if (avc) 
-	{
-	  if ((rv = _attr_node_processsing(handle,
-                                           n,
-                                           avc,
-                                           attr_index,
-                                           line_num,
-                                           stream)) != 0)
-	    goto cleanup;
+      (*maxnodelen) = GENDERS_MAX(line_maxnodelen, (*maxnodelen));
 
-          __list_append(n->attrlist, avc);
-	  n->attrcount += list_count(avc->attrvals);
-	}
-      
-      if (!line_num) 
-	{
-	  (*maxattrs) = GENDERS_MAX(n->attrcount, (*maxattrs));
-	  (*maxnodelen) = GENDERS_MAX(strlen(node), (*maxnodelen));
-	  line_maxnodelen = GENDERS_MAX(strlen(node), line_maxnodelen);
-	}
-      
-      free(node);
+      __xmalloc(r, genders_rule_t, sizeof(struct genders_rule));
+      r->nodes = hl;
+      r->avc = avc;
     }
-  node = NULL;
+  else if ((rv = _parse_nodes(handle,
+                              maxattrs,
+                              maxnodelen,
+                              &line_maxnodelen,
+                              nodeslist,
+                              node_index,
+                              node_index_size,
+                              attr_index,
+                              hl,
+                              avc,
+                              line_num,
+                              stream)) != 0)
+    goto cleanup;
   
   /* %n substitution found on this line, update maxvallen */
   if (!line_num && max_n_subst_vallen)
@@ -637,17 +757,23 @@ _parse_line(genders_t handle,
       __list_append(attrvalslist, avc);
       avc = NULL;
     }
+
+  if (r)
+    {
+      __list_append(ruleslist, r);
+      r = NULL;
+      hl = NULL;
+    }
   
   rv = 0;
  cleanup:
-  __hostlist_iterator_destroy(hlitr);
   __hostlist_destroy(hl);
   if (avc)
     {
       __list_destroy(avc->attrvals);
       free(avc);
     }
-  free(node);
+  free(r);
   return rv;
 }
 
@@ -666,6 +792,7 @@ _genders_open_and_parse(genders_t handle,
                         int *node_index_size,
                         hash_t *attr_index,
                         int *attr_index_size,
+                        List ruleslist,
 			int debug,
 			FILE *stream)
 {
@@ -703,6 +830,7 @@ _genders_open_and_parse(genders_t handle,
                                    node_index_size,
                                    attr_index,
                                    attr_index_size,
+                                   ruleslist,
 				   buf, 
 				   (debug) ? line_count : 0, 
 				   stream, 
@@ -759,3 +887,390 @@ _genders_open_and_parse(genders_t handle,
   close(fd);
   return rv;
 }
+
+/*
+ * struct genders_rule_range
+ *
+ * Nodes of a rule named by a prefix of length prefixlen followed by
+ * a numeric suffix from lo through hi, written with exactly width
+ * digits.  Two ranges list a common node if and only if they have
+ * the same prefix and width and their suffixes overlap.  Nodes
+ * without a numeric suffix have a width of -1.
+ */
+struct genders_rule_range {
+  char *prefix;
+  int prefixlen;
+  int width;
+  unsigned long lo;
+  unsigned long hi;
+  int *attrids;
+  int attrcount;
+};
+
+/*
+ * _rule_range_cmp
+ *
+ * qsort comparison function ordering ranges by prefix, width, and
+ * first suffix.
+ */
+static int
+_rule_range_cmp(const void *x, const void *y)
+{
+  const struct genders_rule_range *a = x;
+  const struct genders_rule_range *b = y;
+  int rv;
+
+  if ((rv = memcmp(a->prefix, 
+                   b->prefix, 
+                   GENDERS_MIN(a->prefixlen, b->prefixlen))))
+    return rv;
+  if (a->prefixlen != b->prefixlen)
+    return a->prefixlen - b->prefixlen;
+  if (a->width != b->width)
+    return a->width - b->width;
+  if (a->lo != b->lo)
+    return (a->lo < b->lo) ? -1 : 1;
+  return 0;
+}
+
+/*
+ * _rule_ranges
+ *
+ * Store the ranges of a hostlist in ranges, if it is not NULL, split
+ * so that every range has a single width.  Hosts pushed without a
+ * recognized numeric suffix are split into one if they end in
+ * digits, so they compare equal to the same host listed in a range.
+ *
+ * Returns the number of ranges.
+ */
+static int
+_rule_ranges(hostlist_t hl, 
+             int *attrids, 
+             int attrcount, 
+             struct genders_rule_range *ranges)
+{
+  int i, nranges, count = 0;
+
+  nranges = hostlist_nranges(hl);
+  for (i = 0; i < nranges; i++)
+    {
+      struct genders_rule_range range;
+      unsigned long lo, hi;
+      char *prefix;
+      int width;
+
+      range.attrids = attrids;
+      range.attrcount = attrcount;
+
+      if (hostlist_nth_range(hl, i, &prefix, &lo, &hi, &width) > 0)
+        {
+          range.prefix = prefix;
+          range.prefixlen = strlen(prefix);
+          
+          /* a suffix is written with more digits than the width
+           * once it needs them, so split at every power of ten
+           */
+          while (1)
+            {
+              int d, digits = _numdigits(lo);
+              unsigned long top = 1;
+
+              /* every suffix up to ULONG_MAX has as many digits
+               * as lo if the next power of ten does not fit
+               */
+              for (d = 0; d < digits && top <= ULONG_MAX / 10; d++)
+                top *= 10;
+              top = (d < digits) ? hi : GENDERS_MIN(top - 1, hi);
+              
+              range.width = GENDERS_MAX(width, digits);
+              range.lo = lo;
+              range.hi = top;
+              if (ranges)
+                ranges[count] = range;
+              count++;
+
+              if (top == hi)
+                break;
+              lo = top + 1;
+            }
+        }
+      else
+        {
+          char *end, *suffix;
+
+          range.prefix = prefix;
+          range.prefixlen = strlen(prefix);
+          range.width = -1;
+          range.lo = range.hi = 0;
+
+          suffix = prefix + range.prefixlen;
+          while (suffix > prefix && isdigit(*(suffix - 1)))
+            suffix--;
+
+          if (*suffix != '\0')
+            {
+              unsigned long num;
+
+              errno = 0;
+              num = strtoul(suffix, &end, 10);
+              if (errno != ERANGE)
+                {
+                  range.prefixlen = suffix - prefix;
+                  range.width = strlen(suffix);
+                  range.lo = range.hi = num;
+                }
+            }
+
+          if (ranges)
+            ranges[count] = range;
+          count++;
+        }
+    }
+
+  return count;
+}
+
+int
+_genders_check_rules(genders_t handle, int *numnodes, int *maxattrs)
+{
+  struct genders_rule_range *ranges = NULL;
+  struct genders_rule_range **active = NULL;
+  ListIterator itr = NULL;
+  genders_rule_t r;
+  hash_t attrid_index = NULL;
+  int *ids = NULL, *attrids = NULL, *attrcounts = NULL;
+  int numattrs, nattrids = 0, nranges = 0, count = 0;
+  int i, j, k, rv = -1;
+  char *attr;
+
+  *numnodes = 0;
+  *maxattrs = 0;
+
+  /* number every attribute, so counting them needs no lookups */
+  numattrs = list_count(handle->attrslist);
+  __xmalloc(ids, int *, sizeof(int) * (numattrs + 1));
+  __xmalloc(attrcounts, int *, sizeof(int) * (numattrs + 1));
+  __hash_create(attrid_index,
+                numattrs + 1,
+                (hash_key_f)hash_key_string,
+                (hash_cmp_f)strcmp,
+                NULL);
+
+  __list_iterator_create(itr, handle->attrslist);
+  for (i = 0; (attr = list_next(itr)); i++)
+    {
+      ids[i] = i;
+      __hash_insert(attrid_index, attr, &ids[i]);
+    }
+  __list_iterator_destroy(itr);
+
+  __list_iterator_create(itr, handle->ruleslist);
+  while ((r = list_next(itr)))
+    {
+      if (r->avc)
+        nattrids += list_count(r->avc->attrvals);
+      nranges += _rule_ranges(r->nodes, NULL, 0, NULL);
+    }
+
+  __xmalloc(attrids, int *, sizeof(int) * (nattrids + 1));
+  __xmalloc(ranges, 
+            struct genders_rule_range *, 
+            sizeof(struct genders_rule_range) * (nranges + 1));
+  __xmalloc(active, 
+            struct genders_rule_range **, 
+            sizeof(struct genders_rule_range *) * (nranges + 1));
+
+  list_iterator_reset(itr);
+  nattrids = 0;
+  nranges = 0;
+  while ((r = list_next(itr)))
+    {
+      int attrcount = 0;
+
+      if (r->avc)
+        {
+          ListIterator avitr = NULL;
+          genders_attrval_t av;
+
+          __list_iterator_create(avitr, r->avc->attrvals);
+          while ((av = list_next(avitr)))
+            {
+              int *id;
+
+              if (!(id = hash_find(attrid_index, av->attr)))
+                {
+                  list_iterator_destroy(avitr);
+                  handle->errnum = GENDERS_ERR_INTERNAL;
+                  goto cleanup;
+                }
+              attrids[nattrids + attrcount++] = *id;
+            }
+          list_iterator_destroy(avitr);
+        }
+
+      nranges += _rule_ranges(r->nodes,
+                              &attrids[nattrids],
+                              attrcount,
+                              &ranges[nranges]);
+      nattrids += attrcount;
+    }
+
+  qsort(ranges, nranges, sizeof(struct genders_rule_range), _rule_range_cmp);
+
+  /* Sweep the suffixes of every group of ranges with the same prefix
+   * and width.  The nodes between two consecutive starts or ends of
+   * ranges are listed by the same set of rules, so their attributes
+   * only need to be counted once.
+   */
+  for (i = 0; i < nranges; i = j)
+    {
+      int nactive = 0, attrsum = 0;
+      unsigned long pos, end;
+
+      for (j = i + 1; j < nranges; j++)
+        {
+          if (ranges[j].prefixlen != ranges[i].prefixlen
+              || ranges[j].width != ranges[i].width
+              || memcmp(ranges[j].prefix, 
+                        ranges[i].prefix, 
+                        ranges[i].prefixlen))
+            break;
+        }
+
+      pos = ranges[i].lo;
+      k = i;
+      while (1)
+        {
+          int a, b;
+
+          /* start ranges */
+          for (; k < j && ranges[k].lo == pos; k++)
+            {
+              for (a = 0; a < ranges[k].attrcount; a++)
+                {
+                  /* attribute listed twice for a node */
+                  if (attrcounts[ranges[k].attrids[a]]++)
+                    {
+                      handle->errnum = GENDERS_ERR_PARSE;
+                      goto cleanup;
+                    }
+                }
+              attrsum += ranges[k].attrcount;
+              active[nactive++] = &ranges[k];
+            }
+
+          /* the nodes from pos to end are listed by the same
+           * rules.  Work with the last node rather than the one
+           * after it, a suffix may be as large as ULONG_MAX.
+           */
+          end = (k < j) ? ranges[k].lo - 1 : ULONG_MAX;
+          for (a = 0; a < nactive; a++)
+            end = GENDERS_MIN(active[a]->hi, end);
+
+          if (nactive)
+            {
+              count += end - pos + 1;
+              *maxattrs = GENDERS_MAX(attrsum, *maxattrs);
+            }
+
+          if (end == ULONG_MAX)
+            break;
+          pos = end + 1;
+
+          /* end ranges */
+          for (a = 0, b = 0; a < nactive; a++)
+            {
+              if (active[a]->hi < pos)
+                {
+                  int c;
+
+                  for (c = 0; c < active[a]->attrcount; c++)
+                    attrcounts[active[a]->attrids[c]]--;
+                  attrsum -= active[a]->attrcount;
+                }
+              else
+                active[b++] = active[a];
+            }
+          nactive = b;
+        }
+    }
+
+  *numnodes = count;
+  rv = 0;
+ cleanup:
+  __list_iterator_destroy(itr);
+  __hash_destroy(attrid_index);
+  free(ids);
+  free(attrids);
+  free(attrcounts);
+  free(ranges);
+  free(active);
+  return rv;
+}
+
+/* 
+ * _hash_is_all
+ *
+ * Returns 1
+ */
+static int
+_hash_is_all(void *data, const void *key, void *arg)
+{
+  return 1;
+}
+
+/* 
+ * _hash_clear_list
+ *
+ * Delete every item of the List stored in a hash
+ */
+static int
+_hash_clear_list(void *data, const void *key, void *arg)
+{
+  list_delete_all((List)data, _genders_list_is_all, "");
+  return 0;
+}
+
+int
+_genders_expand_rules(genders_t handle)
+{
+  ListIterator itr = NULL;
+  genders_rule_t r;
+  int maxattrs = 0, maxnodelen = 0, line_maxnodelen = 0;
+
+  if (!handle->ruleslist)
+    return 0;
+
+  __list_iterator_create(itr, handle->ruleslist);
+  while ((r = list_next(itr)))
+    {
+      if (_parse_nodes(handle,
+                       &maxattrs,
+                       &maxnodelen,
+                       &line_maxnodelen,
+                       handle->nodeslist,
+                       &(handle->node_index),
+                       &(handle->node_index_size),
+                       &(handle->attr_index),
+                       r->nodes,
+                       r->avc,
+                       0,
+                       NULL) != 0)
+        goto cleanup;
+    }
+  __list_iterator_destroy(itr);
+
+  __list_destroy(handle->ruleslist);
+  handle->ruleslist = NULL;
+  return 0;
+
+ cleanup:
+  /* Leave the handle as it was loaded, so the rules can still be
+   * used or expanded again later
+   */
+  __list_iterator_destroy(itr);
+  list_delete_all(handle->nodeslist, _genders_list_is_all, "");
+  hash_delete_if(handle->node_index, _hash_is_all, NULL);
+  hash_for_each(handle->attr_index, _hash_clear_list, NULL);
+  return -1;
+}
@@ -38,7 +38,8 @@
  * _genders_open_and_parse
  *
  * Common file open and file parsing function for genders_load_data
- * and genders_parse.
+ * and genders_parse.  If ruleslist is not NULL, lines are stored as
+ * rules in it instead of expanded into nodeslist and node_index.
  *
  * Returns 0 on success, -1 on error
  */
@@ -56,7 +57,29 @@ int _genders_open_and_parse(genders_t handle,
                             int *node_index_size,
                             hash_t *attr_index,
                             int *attr_index_size,
+                            List ruleslist,
 			    int debug,
 			    FILE *stream);
 
+/* 
+ * _genders_check_rules
+ *
+ * Check the rules of a lazily loaded handle for nodes listing an
+ * attribute more than once, and count the nodes and the maximum
+ * number of attributes of any node, without expanding the rules.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int _genders_check_rules(genders_t handle, int *numnodes, int *maxattrs);
+
+/* 
+ * _genders_expand_rules
+ *
+ * Build the per-node data of a lazily loaded handle from its rules,
+ * if not already built.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int _genders_expand_rules(genders_t handle);
+
 #endif /* _GENDERS_PARSING_H */
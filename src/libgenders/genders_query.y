@@ -40,11 +40,21 @@
 #if HAVE_PATHS_H
 #include <paths.h>
 #endif /* HAVE_PATHS_H */
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif /* HAVE_SYS_TIME_H */
+#if WITH_PTHREADS
+#include <pthread.h>
+#endif /* WITH_PTHREADS */
+#include <math.h>
 
 #include "genders.h"
 #include "genders_api.h"
 #include "genders_constants.h"
+#include "genders_image.h"
+#include "genders_order.h"
 #include "genders_util.h"
+#include "genders_values.h"
 
 /* 
  * struct genders_treenode
@@ -56,8 +66,66 @@ struct genders_treenode {
   struct genders_treenode *left;
   struct genders_treenode *right;
   int complement;
+  /* filled in by _genders_makeleaf() */
+  char *val;                    /* value of an attr=val leaf */
+  char *pattern;                /* value of an attr=val leaf with wildcards */
+  int numeric;                  /* leaf compares values as numbers */
+  struct genders_range range;   /* numbers selected by a numeric leaf */
+  char *lo;                     /* range.lo as written, or NULL */
+  char *hi;                     /* range.hi as written, or NULL */
+  /* filled in by _plan_query() */
+  int est;                      /* estimated nodes, before complement */
+  int exact;                    /* est is exact, not an upper bound */
+  int strategy;                 /* GENDERS_PLAN_* */
+  char *rewrite;                /* rewrite applied to this node */
+  /* filled in by genders_query_analyze() */
+  int evaluated;                /* 0 = no, 1 = yes, 2 = probed */
+  int nodes;                    /* nodes in result, or nodes probed */
+  double usec;                  /* evaluation time */
+  struct genders_treenode *made; /* node made before this one */
 };
 
+/*
+ * struct genders_token
+ *
+ * stores a term returned by the lexer
+ */
+struct genders_token {
+  struct genders_token *next;
+  char str[1];
+};
+
+/*
+ * Evaluation strategies chosen by _plan_query()
+ *
+ * LEAF_ATTR - nodes found through attr_index
+ * LEAF_INDEX - nodes found through attrval_index
+ * LEAF_NUMERIC - nodes found through attr's values sorted by number
+ * LEAF_DICT - nodes found through attr's distinct values, sorted
+ * EMPTY - result is known to be empty, nothing is evaluated
+ * SCAN - both operands are evaluated and combined
+ * PROBE - the left operand is evaluated and each of its nodes is
+ * tested against the right operand, a leaf, which is never evaluated
+ */
+#define GENDERS_PLAN_LEAF_ATTR  0
+#define GENDERS_PLAN_LEAF_INDEX 1
+#define GENDERS_PLAN_EMPTY      2
+#define GENDERS_PLAN_SCAN       3
+#define GENDERS_PLAN_PROBE      4
+#define GENDERS_PLAN_LEAF_NUMERIC 5
+#define GENDERS_PLAN_LEAF_DICT  6
+
+static char *genders_plan_strategy_str[] = 
+  {
+    "attr index",
+    "attrval index",
+    "empty",
+    "scan",
+    "probe",
+    "numeric index",
+    "value dictionary",
+  };
+
 /* 
  * genders_query_err
  *
@@ -72,6 +140,39 @@ static int genders_query_err = 0;
  */ 
 static struct genders_treenode *genders_treeroot = NULL;
 
+/*
+ * genders_treenodes, genders_tokens
+ *
+ * Every treenode made and every term lexed while parsing.  The parser
+ * drops terms and subtrees when it finds a syntax error, so they are
+ * freed from here when the query is reset, not through the tree.
+ */
+static struct genders_treenode *genders_treenodes = NULL;
+static struct genders_token *genders_tokens = NULL;
+
+/*
+ * genders_query_analyzing
+ *
+ * Set by genders_query_analyze() to record evaluation statistics in
+ * the tree.
+ */
+static int genders_query_analyzing = 0;
+
+/*
+ * genders_query_mutex
+ *
+ * The parser and the globals above are shared by every handle, so
+ * a query holds the mutex from _parse_query() until it is reset.
+ */
+#if WITH_PTHREADS
+static pthread_mutex_t genders_query_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define _query_lock()   pthread_mutex_lock(&genders_query_mutex)
+#define _query_unlock() pthread_mutex_unlock(&genders_query_mutex)
+#else  /* !WITH_PTHREADS */
+#define _query_lock()
+#define _query_unlock()
+#endif /* !WITH_PTHREADS */
+
 #ifndef _PATH_DEVNULL
 #define _PATH_DEVNULL "/dev/null"
 #endif /* _PATH_DEVNULL */
@@ -117,9 +218,161 @@ _genders_makenode(char *str, void *left, void *right)
   t->left = left;
   t->right = right;
   t->complement = 0;
+  t->val = NULL;
+  t->pattern = NULL;
+  t->numeric = 0;
+  t->range.lo = -HUGE_VAL;
+  t->range.hi = HUGE_VAL;
+  t->range.lo_strict = 0;
+  t->range.hi_strict = 0;
+  t->lo = NULL;
+  t->hi = NULL;
+  t->est = 0;
+  t->exact = 0;
+  t->strategy = GENDERS_PLAN_SCAN;
+  t->rewrite = NULL;
+  t->evaluated = 0;
+  t->nodes = 0;
+  t->usec = 0;
+  t->made = genders_treenodes;
+  genders_treenodes = t;
   return t;
 } 
 
+/*
+ * _cmp_len
+ *
+ * Returns the length of the comparison at 'str', one of "<", "<=",
+ * ">", or ">=", or 0 if there is none.
+ */
+static int
+_cmp_len(const char *str)
+{
+  if (*str != '<' && *str != '>')
+    return 0;
+  return (str[1] == '=') ? 2 : 1;
+}
+
+/* 
+ * _genders_makeleaf
+ *
+ * Make a genders treenode for a term.  An "attr=val" term is split
+ * into its attr and value, which is a pattern if it contains a '*'
+ * or '?' wildcard, and a comparison "attr<hi", "attr>lo", or
+ * "lo<attr<hi", with "<=" and ">=" as well, into its attr and the
+ * range of numbers it selects.  The bounds must be numbers.
+ *
+ * Returns pointer to new node on success, NULL on error
+ */ 
+static struct genders_treenode *
+_genders_makeleaf(char *str)
+{
+  struct genders_treenode *t;
+  char *op, *op2, *attr, *lo = NULL, *hi = NULL, *buf;
+  int len, attrlen, lolen = 0, hilen = 0, hioff, size;
+
+  if (!(t = _genders_makenode(str, NULL, NULL)))
+    return NULL;
+
+  if (!(op = strpbrk(t->str, "<>=")))
+    return t;
+
+  if (*op == '=')
+    {
+      *op = '\0';
+      t->val = op + 1;
+      if (!strlen(t->val))
+        t->val = NULL;
+      else if (strpbrk(t->val, "*?"))
+        {
+          t->pattern = t->val;
+          t->val = NULL;
+        }
+      return t;
+    }
+
+  len = _cmp_len(op);
+  if (!(op2 = strpbrk(op + len, "<>=")))
+    {
+      attr = t->str;
+      attrlen = op - t->str;
+      if (*op == '<')
+        {
+          hi = op + len;
+          hilen = strlen(hi);
+          t->range.hi_strict = (len == 1);
+        }
+      else
+        {
+          lo = op + len;
+          lolen = strlen(lo);
+          t->range.lo_strict = (len == 1);
+        }
+    }
+  else
+    {
+      if (*op != '<' || *op2 != '<')
+        goto syntax;
+      lo = t->str;
+      lolen = op - t->str;
+      t->range.lo_strict = (len == 1);
+      attr = op + len;
+      attrlen = op2 - attr;
+      len = _cmp_len(op2);
+      hi = op2 + len;
+      hilen = strlen(hi);
+      t->range.hi_strict = (len == 1);
+    }
+
+  /* attr, lo, and hi are copied over the term, which is longer as
+   * every comparison is replaced by one '\0'.
+   */
+  hioff = attrlen + 1 + (lo ? lolen + 1 : 0);
+  size = hioff + (hi ? hilen + 1 : 0);
+  if (!(buf = (char *)malloc(size)))
+    {
+      genders_query_err = GENDERS_ERR_OUTMEM;
+      goto cleanup;
+    }
+  memcpy(buf, attr, attrlen);
+  buf[attrlen] = '\0';
+  if (lo)
+    {
+      memcpy(buf + attrlen + 1, lo, lolen);
+      buf[attrlen + 1 + lolen] = '\0';
+    }
+  if (hi)
+    {
+      memcpy(buf + hioff, hi, hilen);
+      buf[hioff + hilen] = '\0';
+    }
+  memcpy(t->str, buf, size);
+  free(buf);
+
+  t->numeric = 1;
+  if (lo)
+    {
+      t->lo = t->str + attrlen + 1;
+      if (!_genders_value_number(t->lo, &t->range.lo))
+        goto syntax;
+    }
+  if (hi)
+    {
+      t->hi = t->str + hioff;
+      if (!_genders_value_number(t->hi, &t->range.hi))
+        goto syntax;
+    }
+  if (!attrlen)
+    goto syntax;
+  return t;
+
+ syntax:
+  genders_query_err = GENDERS_ERR_SYNTAX;
+ cleanup:
+  /* t is freed with the other treenodes */
+  return NULL;
+}
+
 /* 
  * _genders_set_complement_flag
  *
@@ -146,22 +399,53 @@ _genders_set_complement_flag(void *node)
 }
 
 /* 
- * _genders_free_treenode
+ * _genders_free_treenodes
  *
- * Free a genders_treenode
+ * Free every genders_treenode and term of the last parse
  */
 static void
-_genders_free_treenode(struct genders_treenode *t)
+_genders_free_treenodes(void)
 {
-  if (!t)
-    return;
+  while (genders_treenodes)
+    {
+      struct genders_treenode *t = genders_treenodes;
+
+      genders_treenodes = t->made;
+      free(t->str);
+      free(t);
+    }
+
+  while (genders_tokens)
+    {
+      struct genders_token *tok = genders_tokens;
 
-  _genders_free_treenode(t->left);
-  _genders_free_treenode(t->right);
-  free(t->str);
-  free(t);
+      genders_tokens = tok->next;
+      free(tok);
+    }
+}
+
+/*
+ * _genders_query_token
+ *
+ * Copy a term for the lexer, freed by _genders_free_treenodes().
+ *
+ * Returns pointer to copy on success, NULL on error
+ */
+char *
+_genders_query_token(const char *str)
+{
+  struct genders_token *tok;
+  size_t len = strlen(str);
 
-  return;
+  if (!(tok = (struct genders_token *)malloc(sizeof(struct genders_token) + len)))
+    {
+      genders_query_err = GENDERS_ERR_OUTMEM;
+      return NULL;
+    }
+  memcpy(tok->str, str, len + 1);
+  tok->next = genders_tokens;
+  genders_tokens = tok;
+  return tok->str;
 }
 
 /* 
@@ -191,7 +475,8 @@ yywrap()
  * _parse_query
  *
  * Parse the genders query.  Sets up pipes appropriately to work with
- * yacc.
+ * yacc.  Takes the query mutex, which the caller releases after
+ * resetting the parse tree, on success or error.
  * 
  * Returns 0 on success, -1 on error
  */
@@ -201,6 +486,7 @@ _parse_query(genders_t handle, const char *query)
   extern FILE *yyin, *yyout; 
   int fds[2];
 
+  _query_lock();
   genders_query_err = GENDERS_ERR_SUCCESS;
   genders_treeroot = NULL;
 
@@ -258,6 +544,279 @@ _parse_query(genders_t handle, const char *query)
   return 0;
 }
 
+/*
+ * _leaf_compares
+ *
+ * Returns 1 if leaf 't' selects nodes by comparing their values
+ * against a pattern or range, rather than looking up one value.
+ */
+static int
+_leaf_compares(struct genders_treenode *t)
+{
+  return (t->pattern || t->numeric);
+}
+
+/*
+ * _leaf_val_matches
+ *
+ * Returns 1 if value 'val' is selected by leaf 't', 0 if not.  A
+ * leaf without a value, pattern, or comparison selects any value, or
+ * none.
+ */
+static int
+_leaf_val_matches(struct genders_treenode *t, const char *val)
+{
+  double num;
+
+  if (!t->val && !_leaf_compares(t))
+    return 1;
+  if (!val)
+    return 0;
+  if (t->val)
+    return !strcmp(val, t->val);
+  if (t->pattern)
+    return _genders_value_glob(t->pattern, val);
+  return (_genders_value_number(val, &num) 
+          && _genders_range_contains(&t->range, num));
+}
+
+/* 
+ * _find_attrval
+ *
+ * Find the attrval of leaf 't' for node 'n', or for the node named
+ * 'node' if the handle's nodes are in a shared image or have not
+ * been expanded from its rules.
+ *
+ * Return 0 on success, -1 on error
+ */
+static int
+_find_attrval(genders_t handle, 
+              const char *node, 
+              genders_node_t n,
+              struct genders_treenode *t,
+              genders_attrval_t *avptr)
+{
+  struct genders_node namedn;
+  char *valptr;
+  int rv;
+
+  if (handle->image)
+    rv = _genders_image_find_attrval(handle, node, t->str, t->val, avptr);
+  else if (handle->ruleslist)
+    rv = _genders_rules_find_attrval(handle, node, t->str, t->val, avptr);
+  else
+    rv = _genders_find_attrval(handle, n, t->str, t->val, avptr);
+
+  if (rv < 0 || !_leaf_compares(t) || !*avptr)
+    return rv;
+
+  /* A pattern or numeric leaf finds the attr, then compares its value */
+  if (!n)
+    {
+      namedn.name = (char *)node;
+      n = &namedn;
+    }
+  valptr = NULL;
+  if ((*avptr)->val
+      && _genders_get_valptr(handle, n, *avptr, &valptr, NULL) < 0)
+    return -1;
+  if (!_leaf_val_matches(t, valptr))
+    *avptr = NULL;
+  return 0;
+}
+
+/*
+ * _find_named_attrval
+ *
+ * As _find_attrval(), for the node named 'node' only.
+ *
+ * Return 0 on success, -1 on error
+ */
+static int
+_find_named_attrval(genders_t handle, 
+                    const char *node, 
+                    struct genders_treenode *t,
+                    genders_attrval_t *avptr)
+{
+  genders_node_t n = NULL;
+
+  if (!handle->ruleslist
+      && !handle->image
+      && !(n = _genders_find_node(handle->node_index, node)))
+    {
+      handle->errnum = GENDERS_ERR_INTERNAL;
+      return -1;
+    }
+
+  return _find_attrval(handle, node, n, t, avptr);
+}
+
+/* 
+ * _calc_rules_nodes
+ *
+ * Determines the nodes listed by the rules of a lazily loaded handle
+ * with this treenode's attr and value, or by every rule if 't' is
+ * NULL, as the union of the rules' ranges.  Only rules with a "%n"
+ * substitution in the value need their nodes tested one by one.
+ *
+ * Returns hostlist on success, NULL on error
+ */
+static hostlist_t
+_calc_rules_nodes(genders_t handle, struct genders_treenode *t)
+{
+  hostlist_t h = NULL;
+  hostlist_iterator_t hlitr = NULL;
+  ListIterator itr = NULL;
+  genders_rule_t r;
+  char node[GENDERS_MAXHOSTNAMELEN + 1];
+
+  __hostlist_create(h, NULL);
+  __list_iterator_create(itr, handle->ruleslist);
+  while ((r = list_next(itr)))
+    {
+      genders_attrval_t av = NULL;
+
+      if (t)
+        {
+          if (!r->avc
+              || !(av = list_find_first(r->avc->attrvals, 
+                                        _genders_list_is_attr_in_attrvals, 
+                                        t->str)))
+            continue;
+          
+          if ((t->val || _leaf_compares(t)) && !av->val)
+            continue;
+        }
+
+      if (!t || (!t->val && !_leaf_compares(t)) || !av->val_contains_subst)
+        {
+          if (t && !_leaf_val_matches(t, av->val))
+            continue;
+
+          hostlist_push_list(h, r->nodes);
+          continue;
+        }
+
+      __hostlist_iterator_create(hlitr, r->nodes);
+      while (hostlist_next_host(hlitr, node, sizeof(node)) > 0)
+        {
+          struct genders_node n;
+          char *valptr;
+
+          n.name = node;
+          if (_genders_get_valptr(handle, &n, av, &valptr, NULL) < 0)
+            goto cleanup;
+
+          if (_leaf_val_matches(t, valptr))
+            {
+              if (hostlist_push_host(h, node) <= 0) 
+                {
+                  handle->errnum = GENDERS_ERR_INTERNAL;
+                  goto cleanup;
+                }
+            }
+        }
+      hostlist_iterator_destroy(hlitr);
+      hlitr = NULL;
+    }
+
+  hostlist_uniq(h);
+  __list_iterator_destroy(itr);
+  return h;
+
+ cleanup:
+  __list_iterator_destroy(itr);
+  __hostlist_iterator_destroy(hlitr);
+  __hostlist_destroy(h);
+  return NULL;
+}
+
+/*
+ * _calc_attrval_nodes_ordered
+ *
+ * Determines the nodes containing this treenode's attr and value
+ * from attr_index or attrval_index, the nodes whose value matches
+ * the treenode's pattern from attr's distinct values sorted, or the
+ * nodes whose value is in the treenode's range from attr's values
+ * sorted by number, emitted in node order instead of sorted.  Must
+ * not be called with a shared image or unexpanded rules.
+ *
+ * Returns 0 and hostlist in 'hl' on success, 0 and NULL if the
+ * nodes cannot be ordered, -1 on error
+ */
+static int
+_calc_attrval_nodes_ordered(genders_t handle, 
+                            struct genders_treenode *t,
+                            hostlist_t *hl)
+{
+  hash_t valindex;
+  List l = NULL;
+  List *lists = &l, *matched = NULL;
+  int numlists = 1, rv;
+
+  *hl = NULL;
+
+  if (t->pattern)
+    {
+      if ((rv = _genders_values_glob(handle, 
+                                     t->str, 
+                                     t->pattern, 
+                                     1, 
+                                     &matched, 
+                                     &numlists)) < 0)
+        return -1;
+      lists = matched;
+      if (!rv || !numlists)
+        l = NULL;
+      else
+        l = lists[0];
+    }
+  else if (t->numeric)
+    {
+      if ((rv = _genders_values_numeric(handle, 
+                                        t->str, 
+                                        &t->range, 
+                                        1, 
+                                        &lists, 
+                                        &numlists)) < 0)
+        return -1;
+      if (!rv || !numlists)
+        l = NULL;
+      else
+        l = lists[0];
+    }
+  else if (handle->numattrs
+           && (l = hash_find(handle->attr_index, t->str))
+           && t->val
+           && strlen(t->val))
+    {
+      if (genders_index_attrvals(handle, t->str) < 0)
+        return -1;
+
+      if (!handle->attrval_index
+          || !(valindex = hash_find(handle->attrval_index, t->str))
+          || !(l = hash_find(valindex, t->val)))
+        l = NULL;
+    }
+
+  if (!l)
+    {
+      if (!(*hl = hostlist_create(NULL)))
+        {
+          handle->errnum = GENDERS_ERR_OUTMEM;
+          return -1;
+        }
+      return 0;
+    }
+
+  rv = _genders_order_hostlist(handle, lists, numlists, hl);
+  free(matched);
+  if (rv < 0)
+    return -1;
+
+  return 0;
+}
+
 /* 
  * _calc_attrval_nodes
  *
@@ -272,22 +831,38 @@ _calc_attrval_nodes(genders_t handle, struct genders_treenode *t)
   hostlist_t h = NULL;
   char **nodes = NULL;
   int i, len, num;
-  char *attr, *val;
   int errnum_save;
-    
-  attr = t->str; 
-  if ((val = strchr(attr, '=')))
-    *val++ = '\0';
+
+  if (handle->ruleslist)
+    return _calc_rules_nodes(handle, t);
+
+  if (!handle->image)
+    {
+      if (_calc_attrval_nodes_ordered(handle, t, &h) < 0)
+        return NULL;
+      if (h)
+        return h;
+    }
     
   if ((len = genders_nodelist_create(handle, &nodes)) < 0)
     return NULL;
 
-  if ((num = genders_getnodes(handle, nodes, len, attr, val)) < 0)
+  if ((num = genders_getnodes(handle, nodes, len, t->str, t->val)) < 0)
     goto cleanup;
 
   __hostlist_create(h, NULL);
   for (i = 0; i < num; i++) 
     {
+      if (_leaf_compares(t))
+        {
+          genders_attrval_t av;
+
+          if (_find_named_attrval(handle, nodes[i], t, &av) < 0)
+            goto cleanup;
+          if (!av)
+            continue;
+        }
+
       if (!hostlist_push(h, nodes[i])) 
 	{
 	  handle->errnum = GENDERS_ERR_INTERNAL;
@@ -317,36 +892,14 @@ _calc_attrval_nodes(genders_t handle, struct genders_treenode *t)
 static hostlist_t
 _calc_union(genders_t handle, hostlist_t l, hostlist_t r)
 {
-  hostlist_t h = NULL;
-  char buf[GENDERS_BUFLEN];
-  int rv;
-  
-  __hostlist_create(h, NULL);
-  memset(buf, '\0', GENDERS_BUFLEN);
-  if ((rv = hostlist_ranged_string(l, GENDERS_BUFLEN, buf)) < 0) 
-    {
-      handle->errnum = GENDERS_ERR_INTERNAL;
-      goto cleanup;
-    }
-  
-  if (rv > 0)
-    hostlist_push(h, buf);
-  
-  memset(buf, '\0', GENDERS_BUFLEN);
-  if ((rv = hostlist_ranged_string(r, GENDERS_BUFLEN, buf)) < 0) 
+  hostlist_t h;
+
+  if (!(h = hostlist_union(l, r)))
     {
-      handle->errnum = GENDERS_ERR_INTERNAL;
-      goto cleanup;
+      handle->errnum = GENDERS_ERR_OUTMEM;
+      return NULL;
     }
-  
-  if (rv > 0)
-    hostlist_push(h, buf);
-  
-  hostlist_uniq(h);
   return h;
- cleanup:
-  __hostlist_destroy(h);
-  return NULL;
 }
             
 /* 
@@ -359,34 +912,14 @@ _calc_union(genders_t handle, hostlist_t l, hostlist_t r)
 static hostlist_t
 _calc_intersection(genders_t handle, hostlist_t l, hostlist_t r)
 {
-  hostlist_t h = NULL;
-  hostlist_iterator_t itr = NULL;
-  char *node = NULL;
-  
-  __hostlist_create(h, NULL);
-  __hostlist_iterator_create(itr, l);
-  while ((node = hostlist_next(itr))) 
+  hostlist_t h;
+
+  if (!(h = hostlist_intersect(l, r)))
     {
-      if (hostlist_find(r, node) >= 0) 
-	{
-	  if (hostlist_push_host(h, node) <= 0) 
-	    {
-	      handle->errnum = GENDERS_ERR_INTERNAL;
-	      goto cleanup;
-	    }
-	}
-      free(node);
+      handle->errnum = GENDERS_ERR_OUTMEM;
+      return NULL;
     }
-  node = NULL;
-
-  hostlist_uniq(h);
-  __hostlist_iterator_destroy(itr);
   return h;
- cleanup:
-  __hostlist_iterator_destroy(itr);
-  __hostlist_destroy(h);
-  free(node);
-  return NULL;
 }
 
 /* 
@@ -399,36 +932,14 @@ _calc_intersection(genders_t handle, hostlist_t l, hostlist_t r)
 static hostlist_t
 _calc_set_difference(genders_t handle, hostlist_t l, hostlist_t r)
 {
-  hostlist_t h = NULL;
-  hostlist_iterator_t itr = NULL;
-  char *node = NULL;
-    
-  __hostlist_create(h, NULL);
-  __hostlist_iterator_create(itr, l);
-      
-  while ((node = hostlist_next(itr))) 
+  hostlist_t h;
+
+  if (!(h = hostlist_difference(l, r)))
     {
-      if (hostlist_find(r, node) < 0) 
-	{
-	  if (hostlist_push_host(h, node) <= 0) 
-	    {
-	      handle->errnum = GENDERS_ERR_INTERNAL;
-	      goto cleanup;
-	    }
-	}
-      free(node);
+      handle->errnum = GENDERS_ERR_OUTMEM;
+      return NULL;
     }
-  node = NULL;
-
-  hostlist_uniq(h);
-  __hostlist_iterator_destroy(itr);
   return h;
- cleanup:
-  __hostlist_iterator_destroy(itr);
-  __hostlist_destroy(h);
-  free(node);
-  return NULL;
-
 }
 
 /* 
@@ -442,54 +953,379 @@ static hostlist_t
 _calc_complement(genders_t handle, hostlist_t h)
 {
   hostlist_t ch = NULL;
-  char **nodes = NULL;
-  char *node = NULL;
-  int i, len, num;
-  int errnum_save;
-    
-  if ((len = genders_nodelist_create(handle, &nodes)) < 0)
-    return NULL;
+  ListIterator itr = NULL;
+  genders_node_t n;
+  char namebuf[GENDERS_MAXHOSTNAMELEN + 1];
 
-  if ((num = genders_getnodes(handle, nodes, len, NULL, NULL)) < 0) 
-    goto cleanup;
-  
+  if (handle->image)
+    {
+      int i;
+
+      __hostlist_create(ch, NULL);
+      for (i = 0; i < handle->numnodes; i++)
+        {
+          char *node = _genders_image_nodename(handle, i);
+
+          if (hostlist_find(h, node) < 0)
+            {
+              if (hostlist_push_host(ch, node) <= 0) 
+                {
+                  handle->errnum = GENDERS_ERR_INTERNAL;
+                  goto cleanup;
+                }
+            }
+        }
+      hostlist_uniq(ch);
+      return ch;
+    }
+
+  if (handle->ruleslist)
+    {
+      hostlist_t all;
+
+      if (!(all = _calc_rules_nodes(handle, NULL)))
+        return NULL;
+      ch = _calc_set_difference(handle, all, h);
+      hostlist_destroy(all);
+      return ch;
+    }
+
+  if (_genders_order_complement(handle, h, &ch) < 0)
+    return NULL;
+  if (ch)
+    {
+      return ch;
+    }
+    
   __hostlist_create(ch, NULL);
-  for (i = 0; i < num; i++) 
+  __list_iterator_create(itr, handle->nodeslist);
+  while ((n = list_next(itr)))
     {
-      if (hostlist_find(h, nodes[i]) < 0) 
+      if (hostlist_find(h, _genders_node_name(n, namebuf)) < 0) 
 	{
-	  if (hostlist_push_host(ch, nodes[i]) <= 0) 
+	  if (hostlist_push_host(ch, _genders_node_name(n, namebuf)) <= 0) 
 	    {
 	      handle->errnum = GENDERS_ERR_INTERNAL;
 	      goto cleanup;
 	    }
 	}
-      free(node);
     }
-  node = NULL;
 
-  genders_nodelist_destroy(handle, nodes);
+  __list_iterator_destroy(itr);
   hostlist_uniq(ch);
   return ch;
 
  cleanup:
-  errnum_save = handle->errnum;
-  genders_nodelist_destroy(handle, nodes);
-  handle->errnum = errnum_save;
+  __list_iterator_destroy(itr);
   __hostlist_destroy(ch);
-  free(node);
   return NULL;
 }
 
 /* 
- * _calc_query
+ * _calc_probe
+ *
+ * Determine the nodes in 'l' that match (if 'keep' is non-zero) or
+ * do not match (if 'keep' is zero) the leaf 't', by testing each node
+ * of 'l' instead of determining all the nodes of 't'.
+ *
+ * Returns resulting hostlist on success, NULL on error
+ */
+static hostlist_t
+_calc_probe(genders_t handle, 
+            hostlist_t l, 
+            struct genders_treenode *t, 
+            int keep)
+{
+  hostlist_t h = NULL;
+  hostlist_iterator_t itr = NULL;
+  char node[GENDERS_MAXHOSTNAMELEN + 1];
+  int nodelen;
+  
+  __hostlist_create(h, NULL);
+  __hostlist_iterator_create(itr, l);
+  while ((nodelen = hostlist_next_host(itr, node, sizeof(node))) > 0) 
+    {
+      genders_attrval_t av = NULL;
+      int found;
+
+      if (nodelen > GENDERS_MAXHOSTNAMELEN)
+        {
+          handle->errnum = GENDERS_ERR_INTERNAL;
+          goto cleanup;
+        }
+
+      if (_find_named_attrval(handle, node, t, &av) < 0)
+        goto cleanup;
+
+      found = (av != NULL);
+      if (t->complement)
+        found = !found;
+
+      if (found == keep)
+	{
+	  if (hostlist_push_host(h, node) <= 0) 
+	    {
+	      handle->errnum = GENDERS_ERR_INTERNAL;
+	      goto cleanup;
+	    }
+	}
+    }
+
+  hostlist_uniq(h);
+  __hostlist_iterator_destroy(itr);
+  t->evaluated = 2;
+  t->nodes = hostlist_count(l);
+  return h;
+ cleanup:
+  __hostlist_iterator_destroy(itr);
+  __hostlist_destroy(h);
+  return NULL;
+}
+
+/*
+ * _plan_est
+ *
+ * Returns the estimated number of nodes in the result of 't',
+ * including its complement.
+ */
+static int
+_plan_est(genders_t handle, struct genders_treenode *t)
+{
+  if (!t->complement)
+    return t->est;
+  return t->exact ? handle->numnodes - t->est : handle->numnodes;
+}
+
+/*
+ * _plan_swap
+ *
+ * Swap the operands of 't'.
+ */
+static void
+_plan_swap(struct genders_treenode *t)
+{
+  struct genders_treenode *temp;
+
+  temp = t->left;
+  t->left = t->right;
+  t->right = temp;
+}
+
+/*
+ * _plan_rules_count
+ *
+ * Returns the number of nodes with attribute 'attr' in the rules of
+ * a lazily loaded handle.  A node lists an attribute only once, so
+ * the node counts of the rules listing it can be summed.
+ */
+static int
+_plan_rules_count(genders_t handle, const char *attr)
+{
+  ListIterator itr;
+  genders_rule_t r;
+  int count = 0;
+
+  if (!(itr = list_iterator_create(handle->ruleslist)))
+    return handle->numnodes;
+
+  while ((r = list_next(itr)))
+    {
+      if (r->avc && list_find_first(r->avc->attrvals, 
+                                    _genders_list_is_attr_in_attrvals, 
+                                    (char *)attr))
+        count += hostlist_count(r->nodes);
+    }
+  list_iterator_destroy(itr);
+  return count;
+}
+
+/*
+ * _plan_leaf
+ *
+ * Estimate the number of nodes of a leaf from the per-attribute node
+ * counts in attr_index, or from attrval_index if the attribute's
+ * values have been indexed, or from its values sorted by string or
+ * by number if they have been sorted.
+ */
+static void
+_plan_leaf(genders_t handle, struct genders_treenode *t)
+{
+  hash_t valindex;
+  List l, *lists;
+  int numlists, i;
+
+  t->strategy = GENDERS_PLAN_LEAF_ATTR;
+  if (handle->image)
+    {
+      t->est = _genders_image_attr_count(handle, t->str);
+      t->exact = (!t->val && !_leaf_compares(t)) || !t->est;
+    }
+  else if (!handle->numattrs || !(l = hash_find(handle->attr_index, t->str)))
+    {
+      t->est = 0;
+      t->exact = 1;
+    }
+  else if (t->val
+           && handle->attrval_index
+           && (valindex = hash_find(handle->attrval_index, t->str)))
+    {
+      l = hash_find(valindex, t->val);
+      t->est = l ? list_count(l) : 0;
+      t->exact = 1;
+      t->strategy = GENDERS_PLAN_LEAF_INDEX;
+    }
+  else if (t->pattern
+           && !handle->ruleslist
+           && _genders_values_glob(handle, 
+                                   t->str, 
+                                   t->pattern, 
+                                   0, 
+                                   &lists, 
+                                   &numlists) > 0)
+    {
+      t->est = 0;
+      for (i = 0; i < numlists; i++)
+        t->est += list_count(lists[i]);
+      free(lists);
+      t->exact = 1;
+      t->strategy = GENDERS_PLAN_LEAF_DICT;
+    }
+  else if (t->numeric
+           && !handle->ruleslist
+           && _genders_values_numeric(handle, 
+                                      t->str, 
+                                      &t->range, 
+                                      0, 
+                                      &lists, 
+                                      &numlists) > 0)
+    {
+      t->est = 0;
+      for (i = 0; i < numlists; i++)
+        t->est += list_count(lists[i]);
+      t->exact = 1;
+      t->strategy = GENDERS_PLAN_LEAF_NUMERIC;
+    }
+  else
+    {
+      /* with a value, the attr's node count is an upper bound */
+      if (handle->ruleslist)
+        t->est = _plan_rules_count(handle, t->str);
+      else
+        t->est = list_count(l);
+      t->exact = !t->val && !_leaf_compares(t);
+    }
+}
+
+/*
+ * _plan_query
+ *
+ * Estimate the size of every subtree of 't', rewrite operations on
+ * complements into operations that need no complement, order
+ * intersections so the smaller operand is evaluated first, and choose
+ * an evaluation strategy for each operation.
+ */
+static void
+_plan_query(genders_t handle, struct genders_treenode *t)
+{
+  struct genders_treenode *l, *r;
+  int lest, rest;
+
+  if (!t->left && !t->right)
+    {
+      _plan_leaf(handle, t);
+      return;
+    }
+
+  _plan_query(handle, t->left);
+  _plan_query(handle, t->right);
+
+  /* The operator strings are all two characters long, so they are
+   * rewritten in place.
+   */
+  if (!strcmp(t->str, "&&"))
+    {
+      if (t->left->complement && t->right->complement)
+        {
+          t->left->complement = 0;
+          t->right->complement = 0;
+          t->complement = !t->complement;
+          strcpy(t->str, "||");
+          t->rewrite = "~A && ~B -> ~(A || B)";
+        }
+      else if (t->right->complement)
+        {
+          t->right->complement = 0;
+          strcpy(t->str, "--");
+          t->rewrite = "A && ~B -> A -- B";
+        }
+      else if (t->left->complement)
+        {
+          _plan_swap(t);
+          t->right->complement = 0;
+          strcpy(t->str, "--");
+          t->rewrite = "~A && B -> B -- A";
+        }
+    }
+  else if (!strcmp(t->str, "--"))
+    {
+      if (t->right->complement)
+        {
+          t->right->complement = 0;
+          strcpy(t->str, "&&");
+          t->rewrite = "A -- ~B -> A && B";
+        }
+    }
+
+  if (!strcmp(t->str, "&&")
+      && _plan_est(handle, t->left) > _plan_est(handle, t->right))
+    _plan_swap(t);
+
+  l = t->left;
+  r = t->right;
+  lest = _plan_est(handle, l);
+  rest = _plan_est(handle, r);
+
+  /* An estimate of zero is always exact, as estimates are upper
+   * bounds.
+   */
+  if (!strcmp(t->str, "||"))
+    {
+      t->est = GENDERS_MIN(lest + rest, handle->numnodes);
+      t->exact = (!lest || !rest) && l->exact && r->exact;
+    }
+  else if (!strcmp(t->str, "&&"))
+    {
+      t->est = GENDERS_MIN(lest, rest);
+      t->exact = !t->est;
+    }
+  else
+    {
+      t->est = lest;
+      t->exact = !lest || (!rest && l->exact);
+    }
+
+  if (!t->est)
+    t->strategy = GENDERS_PLAN_EMPTY;
+  else if (strcmp(t->str, "||") 
+           && !r->left
+           && !r->right
+           && lest <= rest)
+    t->strategy = GENDERS_PLAN_PROBE;
+  else
+    t->strategy = GENDERS_PLAN_SCAN;
+}
+
+static hostlist_t _calc_query(genders_t handle, struct genders_treenode *t);
+
+/* 
+ * _calc_query_node
  *
  * Determine the nodes for the query rooted at 't'.
  *
  * Returns resulting hostlist on success, NULL on error
  */
 static hostlist_t
-_calc_query(genders_t handle, struct genders_treenode *t)
+_calc_query_node(genders_t handle, struct genders_treenode *t)
 {
   hostlist_t h = NULL;
 
@@ -505,7 +1341,16 @@ _calc_query(genders_t handle, struct genders_treenode *t)
       return NULL;
     }
 
-  if (!t->left && !t->right)
+  if (t->strategy == GENDERS_PLAN_EMPTY 
+      || ((!t->left && !t->right) && !t->est))
+    {
+      if (!(h = hostlist_create(NULL)))
+        {
+          handle->errnum = GENDERS_ERR_OUTMEM;
+          return NULL;
+        }
+    }
+  else if (!t->left && !t->right)
     h = _calc_attrval_nodes(handle, t);
   else {
     hostlist_t l = NULL;
@@ -513,6 +1358,33 @@ _calc_query(genders_t handle, struct genders_treenode *t)
 
     if (!(l = _calc_query(handle, t->left)))
       goto cleanup_calc;
+
+    /* Intersection and set difference with an empty left operand are
+     * empty, so the right operand need not be evaluated.
+     */
+    if (!hostlist_count(l) && strcmp(t->str, "||"))
+      {
+        h = l;
+        l = NULL;
+        goto done_calc;
+      }
+
+    /* Likewise union and set difference with a right operand known
+     * to be empty are the left operand.
+     */
+    if (!_plan_est(handle, t->right) && strcmp(t->str, "&&"))
+      {
+        h = l;
+        l = NULL;
+        goto done_calc;
+      }
+
+    if (t->strategy == GENDERS_PLAN_PROBE)
+      {
+        h = _calc_probe(handle, l, t->right, !strcmp(t->str, "&&"));
+        goto done_calc;
+      }
+
     if (!(r = _calc_query(handle, t->right)))
       goto cleanup_calc;
     
@@ -532,6 +1404,7 @@ _calc_query(genders_t handle, struct genders_treenode *t)
       goto cleanup_calc;
     }
 
+  done_calc:
     if (!h) 
       {
       cleanup_calc:
@@ -539,6 +1412,8 @@ _calc_query(genders_t handle, struct genders_treenode *t)
 	__hostlist_destroy(r);
 	return NULL;
       }
+    __hostlist_destroy(l);
+    __hostlist_destroy(r);
   }
 
   if (t->complement) 
@@ -555,13 +1430,51 @@ _calc_query(genders_t handle, struct genders_treenode *t)
   return h;
 }
 
+/* 
+ * _calc_query
+ *
+ * Determine the nodes for the query rooted at 't', recording
+ * evaluation statistics in 't' if the query is being analyzed.
+ *
+ * Returns resulting hostlist on success, NULL on error
+ */
+static hostlist_t
+_calc_query(genders_t handle, struct genders_treenode *t)
+{
+#if HAVE_SYS_TIME_H
+  struct timeval start, end;
+#endif /* HAVE_SYS_TIME_H */
+  hostlist_t h;
+
+  if (!genders_query_analyzing)
+    return _calc_query_node(handle, t);
+
+#if HAVE_SYS_TIME_H
+  gettimeofday(&start, NULL);
+#endif /* HAVE_SYS_TIME_H */
+
+  h = _calc_query_node(handle, t);
+
+#if HAVE_SYS_TIME_H
+  gettimeofday(&end, NULL);
+  t->usec = (end.tv_sec - start.tv_sec) * 1000000.0 
+    + (end.tv_usec - start.tv_usec);
+#endif /* HAVE_SYS_TIME_H */
+  if (h)
+    {
+      t->evaluated = 1;
+      t->nodes = hostlist_count(h);
+    }
+  return h;
+}
+
 int
 genders_query(genders_t handle, char *nodes[], int len, const char *query)
 {
   hostlist_t h = NULL;
   hostlist_iterator_t itr = NULL;
-  char *node = NULL;
-  int index = 0, rv = -1;
+  char node[GENDERS_MAXHOSTNAMELEN + 1];
+  int nodelen, index = 0, rv = -1;
 
   if (_genders_loaded_handle_error_check(handle) < 0)
     return -1;
@@ -569,7 +1482,7 @@ genders_query(genders_t handle, char *nodes[], int len, const char *query)
   if ((!nodes && len > 0) || len < 0) 
     {
       handle->errnum = GENDERS_ERR_PARAMETERS;
-      goto cleanup;
+      return -1;
     }
 
   /* Special case for NULL or empty string query */
@@ -579,29 +1492,93 @@ genders_query(genders_t handle, char *nodes[], int len, const char *query)
   if (_parse_query(handle, query) < 0)
     goto cleanup;
   
+  _plan_query(handle, genders_treeroot);
+
   if (!(h = _calc_query(handle, genders_treeroot)))
     goto cleanup;
 
   __hostlist_iterator_create(itr, h);
-  while ((node = hostlist_next(itr))) 
+  while ((nodelen = hostlist_next_host(itr, node, sizeof(node))) > 0) 
     {
+      if (nodelen > GENDERS_MAXHOSTNAMELEN)
+        {
+          handle->errnum = GENDERS_ERR_INTERNAL;
+          goto cleanup;
+        }
       if (_genders_put_in_array(handle, node, nodes, index++, len) < 0)
 	goto cleanup;
-      free(node);
     }
-  node = NULL;
 
   rv = index;
   handle->errnum = GENDERS_ERR_SUCCESS;
  cleanup:
   __hostlist_iterator_destroy(itr);
   __hostlist_destroy(h);
-  if (genders_treeroot)
-    _genders_free_treenode(genders_treeroot);
-  free(node);
+  _genders_free_treenodes();
   /* reset */
   genders_treeroot = NULL;
   genders_query_err = 0;
+  _query_unlock();
+  return rv;
+}
+
+/* 
+ * _test_query
+ *
+ * Determine if node 'n', named 'node', is in the result of the
+ * query rooted at 't', without determining the result.
+ *
+ * Returns 1 if it is, 0 if not, -1 on error
+ */
+static int
+_test_query(genders_t handle, 
+            const char *node,
+            genders_node_t n, 
+            struct genders_treenode *t)
+{
+  int rv;
+
+  if (!t->left && !t->right)
+    {
+      genders_attrval_t av;
+
+      if (_find_attrval(handle, node, n, t, &av) < 0)
+        return -1;
+      rv = (av != NULL);
+    }
+  else
+    {
+      if ((rv = _test_query(handle, node, n, t->left)) < 0)
+        return -1;
+
+      if (!strcmp(t->str, "||"))
+        {
+          if (!rv && (rv = _test_query(handle, node, n, t->right)) < 0)
+            return -1;
+        }
+      else if (!strcmp(t->str, "&&"))
+        {
+          if (rv && (rv = _test_query(handle, node, n, t->right)) < 0)
+            return -1;
+        }
+      else if (!strcmp(t->str, "--"))
+        {
+          if (rv)
+            {
+              if ((rv = _test_query(handle, node, n, t->right)) < 0)
+                return -1;
+              rv = !rv;
+            }
+        }
+      else
+        {
+          handle->errnum = GENDERS_ERR_INTERNAL;
+          return -1;
+        }
+    }
+
+  if (t->complement)
+    rv = !rv;
   return rv;
 }
 
@@ -610,12 +1587,8 @@ genders_testquery(genders_t handle,
                   const char *node,
                   const char *query)
 {
-  genders_node_t n;
-  char **nodelist = NULL;
-  int i, len, num;
-  int found = 0;
+  genders_node_t n = NULL;
   int rv = -1;
-  int errnum_save;
 
   if (_genders_loaded_handle_error_check(handle) < 0)
     return -1;
@@ -635,36 +1608,192 @@ genders_testquery(genders_t handle,
       return -1;
     }
   
-  if (!(n = hash_find(handle->node_index, node)))
+  if (handle->image)
+    {
+      if (!_genders_image_isnode(handle, node))
+        {
+          handle->errnum = GENDERS_ERR_NOTFOUND;
+          return -1;
+        }
+    }
+  else if (handle->ruleslist)
+    {
+      if ((rv = _genders_rules_isnode(handle, node)) <= 0)
+        {
+          if (!rv)
+            handle->errnum = GENDERS_ERR_NOTFOUND;
+          return -1;
+        }
+      rv = -1;
+    }
+  else if (!(n = _genders_find_node(handle->node_index, node)))
     {
       handle->errnum = GENDERS_ERR_NOTFOUND;
       return -1;
     }
 
-  if ((len = genders_nodelist_create(handle, &nodelist)) < 0)
-    return -1;
+  if (_parse_query(handle, query) < 0)
+    goto cleanup;
+
+  _plan_query(handle, genders_treeroot);
 
-  if ((num = genders_query(handle, nodelist, len, query)) < 0)
+  if ((rv = _test_query(handle, node, n, genders_treeroot)) < 0)
     goto cleanup;
-  
-  for (i = 0; i < num; i++)
+
+  handle->errnum = GENDERS_ERR_SUCCESS;
+ cleanup:
+  _genders_free_treenodes();
+  /* reset */
+  genders_treeroot = NULL;
+  genders_query_err = 0;
+  _query_unlock();
+  return rv;
+}
+
+/* 
+ * _explain_query
+ *
+ * Output the plan for the query rooted at 't', one node per line.
+ * If 'analyze' is set, also output the statistics recorded by
+ * evaluating it.
+ */
+static void
+_explain_query(genders_t handle, 
+               struct genders_treenode *t, 
+               int depth, 
+               int analyze,
+               FILE *stream)
+{
+  fprintf(stream, "%*s%s", depth * 2, "", t->complement ? "~" : "");
+
+  if (!t->left && !t->right)
     {
-      if (!strcmp(nodelist[i], node))
-        {
-          found++;
-          break;
-        }
+      if (t->lo && t->hi)
+        fprintf(stream, "%s%s", t->lo, t->range.lo_strict ? "<" : "<=");
+      fprintf(stream, "%s", t->str);
+      if (t->val)
+        fprintf(stream, "=%s", t->val);
+      else if (t->pattern)
+        fprintf(stream, "=%s", t->pattern);
+      else if (t->hi)
+        fprintf(stream, "%s%s", t->range.hi_strict ? "<" : "<=", t->hi);
+      else if (t->lo)
+        fprintf(stream, "%s%s", t->range.lo_strict ? ">" : ">=", t->lo);
     }
-  
-  if (found)
-    rv = 1;
+  else if (!strcmp(t->str, "||"))
+    fprintf(stream, "union");
+  else if (!strcmp(t->str, "&&"))
+    fprintf(stream, "intersection");
   else
-    rv = 0;
+    fprintf(stream, "difference");
+
+  fprintf(stream, " (est %s%d, %s", 
+          t->exact ? "" : "<=",
+          _plan_est(handle, t),
+          genders_plan_strategy_str[t->strategy]);
+  if (t->rewrite)
+    fprintf(stream, ", rewrote %s", t->rewrite);
+  fprintf(stream, ")");
+
+  if (analyze)
+    {
+      if (t->evaluated == 1)
+        fprintf(stream, " (nodes %d, %.3f ms)", 
+                t->nodes, 
+                t->usec / 1000.0);
+      else if (t->evaluated == 2)
+        fprintf(stream, " (probed %d nodes)", t->nodes);
+      else
+        fprintf(stream, " (not evaluated)");
+    }
+  fprintf(stream, "\n");
+
+  if (t->left)
+    _explain_query(handle, t->left, depth + 1, analyze, stream);
+  if (t->right)
+    _explain_query(handle, t->right, depth + 1, analyze, stream);
+}
+
+int
+genders_query_explain(genders_t handle, const char *query, FILE *stream)
+{
+  int rv = -1;
+
+  if (_genders_loaded_handle_error_check(handle) < 0)
+    return -1;
+
+  if (!stream)
+    stream = stderr;
+
+  /* Special case for NULL or empty string query */
+  if (!query || !strlen(query))
+    {
+      fprintf(stream, "all (est %d, scan)\n", handle->numnodes);
+      handle->errnum = GENDERS_ERR_SUCCESS;
+      return 0;
+    }
+
+  if (_parse_query(handle, query) < 0)
+    goto cleanup;
+
+  _plan_query(handle, genders_treeroot);
+  _explain_query(handle, genders_treeroot, 0, 0, stream);
+
+  rv = 0;
   handle->errnum = GENDERS_ERR_SUCCESS;
  cleanup:
-  errnum_save = handle->errnum;
-  genders_nodelist_destroy(handle, nodelist);
-  handle->errnum = errnum_save;
+  _genders_free_treenodes();
+  /* reset */
+  genders_treeroot = NULL;
+  genders_query_err = 0;
+  _query_unlock();
+  return rv;
+}
+
+int
+genders_query_analyze(genders_t handle, const char *query, FILE *stream)
+{
+  hostlist_t h = NULL;
+  int rv = -1;
+
+  if (_genders_loaded_handle_error_check(handle) < 0)
+    return -1;
+
+  if (!stream)
+    stream = stderr;
+
+  /* Special case for NULL or empty string query */
+  if (!query || !strlen(query))
+    {
+      fprintf(stream, "all (est %d, scan) (nodes %d)\n", 
+              handle->numnodes,
+              handle->numnodes);
+      handle->errnum = GENDERS_ERR_SUCCESS;
+      return handle->numnodes;
+    }
+
+  if (_parse_query(handle, query) < 0)
+    goto cleanup;
+
+  _plan_query(handle, genders_treeroot);
+
+  genders_query_analyzing = 1;
+  h = _calc_query(handle, genders_treeroot);
+  genders_query_analyzing = 0;
+  if (!h)
+    goto cleanup;
+
+  _explain_query(handle, genders_treeroot, 0, 1, stream);
+
+  rv = hostlist_count(h);
+  handle->errnum = GENDERS_ERR_SUCCESS;
+ cleanup:
+  __hostlist_destroy(h);
+  _genders_free_treenodes();
+  /* reset */
+  genders_treeroot = NULL;
+  genders_query_err = 0;
+  _query_unlock();
   return rv;
 }
 %}
@@ -703,7 +1832,7 @@ query: term {$$ = $1;}
 
 term: ATTRTOK 
            {
-             $$ = _genders_makenode($1, NULL, NULL);
+             $$ = _genders_makeleaf($1);
            }
        | LPARENTOK query RPARENTOK 
            {
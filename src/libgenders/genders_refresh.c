@@ -0,0 +1,647 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#if STDC_HEADERS
+#include <string.h>
+#endif /* STDC_HEADERS */
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#if WITH_PTHREADS
+#include <pthread.h>
+#include <poll.h>
+#endif /* WITH_PTHREADS */
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif /* HAVE_SYS_INOTIFY_H */
+
+#include "genders.h"
+#include "genders_api.h"
+#include "genders_constants.h"
+#include "genders_refresh.h"
+#include "genders_util.h"
+
+/*
+ * struct genders_refresh_copy
+ *
+ * A copy of a snapshot's handle given to one reader at a time.  A
+ * handle is not re-entrant (errnum, valbuf, and the indexes built on
+ * first use), so readers never share one.
+ */
+struct genders_refresh_copy {
+  genders_t handle;
+  int inuse;
+  struct genders_refresh_copy *next;
+};
+
+/*
+ * struct genders_refresh_snapshot
+ *
+ * A loaded genders handle published by genders_refresh_start() or
+ * the watcher.  The handle is only copied, readers are given one of
+ * its 'copies', which are kept for later readers when released.  The
+ * current snapshot holds a reference for being current, and each
+ * reader holds one from genders_refresh_acquire() until
+ * genders_refresh_release().  A replaced snapshot is destroyed when
+ * its last reader releases it.
+ */
+struct genders_refresh_snapshot {
+  genders_t handle;
+  struct genders_refresh_copy *copies;
+  int refcount;
+  struct genders_refresh_snapshot *next;
+};
+
+/*
+ * struct genders_refresh
+ *
+ * Refresh state of a genders handle.  'snapshots' is the current
+ * snapshot followed by the replaced snapshots still held by readers.
+ * Readers hold the mutex only to take or drop a reference and a copy,
+ * so reading never waits for a database to be parsed.  Copying a
+ * handle changes it, so new copies are made under 'copy_mutex'.
+ */
+struct genders_refresh {
+  char *filename;
+  unsigned int flags;
+  struct stat st;
+  struct genders_refresh_snapshot *snapshots;
+#if WITH_PTHREADS
+  pthread_mutex_t mutex;
+  pthread_mutex_t copy_mutex;
+  pthread_t thread;
+  int stopfds[2];
+#endif /* WITH_PTHREADS */
+#if HAVE_SYS_INOTIFY_H
+  int inotifyfd;
+  char *basename;
+#endif /* HAVE_SYS_INOTIFY_H */
+};
+
+#if WITH_PTHREADS
+#define _refresh_lock(r)        pthread_mutex_lock(&(r)->mutex)
+#define _refresh_unlock(r)      pthread_mutex_unlock(&(r)->mutex)
+#define _refresh_copy_lock(r)   pthread_mutex_lock(&(r)->copy_mutex)
+#define _refresh_copy_unlock(r) pthread_mutex_unlock(&(r)->copy_mutex)
+#else  /* !WITH_PTHREADS */
+#define _refresh_lock(r)
+#define _refresh_unlock(r)
+#define _refresh_copy_lock(r)
+#define _refresh_copy_unlock(r)
+#endif /* !WITH_PTHREADS */
+
+/*
+ * _refresh_snapshot_destroy
+ *
+ * Destroy a snapshot and all copies of its handle.
+ */
+static void
+_refresh_snapshot_destroy(struct genders_refresh_snapshot *s)
+{
+  struct genders_refresh_copy *c;
+
+  while ((c = s->copies))
+    {
+      s->copies = c->next;
+      genders_handle_destroy(c->handle);
+      free(c);
+    }
+  genders_handle_destroy(s->handle);
+  free(s);
+}
+
+/*
+ * _refresh_load
+ *
+ * Load a new snapshot of the database.  Stores the error code in
+ * 'errnum' on error.
+ *
+ * Returns handle on success, NULL on error
+ */
+static genders_t
+_refresh_load(struct genders_refresh *r, int *errnum)
+{
+  genders_t handle;
+
+  if (!(handle = genders_handle_create()))
+    {
+      *errnum = GENDERS_ERR_OUTMEM;
+      return NULL;
+    }
+
+  if (genders_set_flags(handle, r->flags) < 0
+      || genders_load_data(handle, r->filename) < 0)
+    {
+      *errnum = genders_errnum(handle);
+      genders_handle_destroy(handle);
+      return NULL;
+    }
+
+  return handle;
+}
+
+/*
+ * _refresh_changed
+ *
+ * Determine if the file has been replaced or modified since it was
+ * last loaded.
+ *
+ * Returns 1 if changed, 0 if not
+ */
+static int
+_refresh_changed(struct genders_refresh *r)
+{
+  struct stat st;
+
+  if (stat(r->filename, &st) < 0)
+    return 0;
+
+  if (st.st_dev == r->st.st_dev
+      && st.st_ino == r->st.st_ino
+      && st.st_size == r->st.st_size
+      && st.st_mtime == r->st.st_mtime
+      && GENDERS_MTIME_NSEC(&st) == GENDERS_MTIME_NSEC(&r->st)
+      && st.st_ctime == r->st.st_ctime
+      && GENDERS_CTIME_NSEC(&st) == GENDERS_CTIME_NSEC(&r->st))
+    return 0;
+
+  r->st = st;
+  return 1;
+}
+
+/*
+ * _refresh_publish
+ *
+ * Make 'handle' the current snapshot.  The replaced snapshot is
+ * destroyed now if no reader holds it, otherwise by its last
+ * release.
+ */
+static void
+_refresh_publish(struct genders_refresh *r, genders_t handle)
+{
+  struct genders_refresh_snapshot *s, *old;
+
+  if (!(s = (struct genders_refresh_snapshot *)malloc(sizeof(*s))))
+    {
+      genders_handle_destroy(handle);
+      return;
+    }
+  s->handle = handle;
+  s->copies = NULL;
+  s->refcount = 1;
+
+  _refresh_lock(r);
+  old = r->snapshots;
+  s->next = old;
+  r->snapshots = s;
+  if (!--old->refcount)
+    s->next = old->next;
+  else
+    old = NULL;
+  _refresh_unlock(r);
+
+  if (old)
+    _refresh_snapshot_destroy(old);
+}
+
+/*
+ * _refresh_reload
+ *
+ * Parse the database and publish it.  A database that fails to load,
+ * such as one caught half written, leaves the current snapshot in
+ * place.
+ */
+static void
+_refresh_reload(struct genders_refresh *r)
+{
+  genders_t handle;
+  int errnum;
+
+  if ((handle = _refresh_load(r, &errnum)))
+    _refresh_publish(r, handle);
+}
+
+#if WITH_PTHREADS
+/*
+ * _refresh_wait
+ *
+ * Wait for the database to change.  With inotify, the directory of
+ * the database is watched, so files renamed over the database are
+ * seen as well as files written in place.  Otherwise the database is
+ * checked with stat every GENDERS_REFRESH_POLL_INTERVAL milliseconds.
+ *
+ * Returns 1 if the database changed, 0 if not, -1 if stopped
+ */
+static int
+_refresh_wait(struct genders_refresh *r)
+{
+  struct pollfd pfds[2];
+  int nfds = 1, timeout = GENDERS_REFRESH_POLL_INTERVAL;
+
+  pfds[0].fd = r->stopfds[0];
+  pfds[0].events = POLLIN;
+#if HAVE_SYS_INOTIFY_H
+  if (r->inotifyfd >= 0)
+    {
+      pfds[1].fd = r->inotifyfd;
+      pfds[1].events = POLLIN;
+      nfds++;
+      timeout = -1;
+    }
+#endif /* HAVE_SYS_INOTIFY_H */
+
+  if (poll(pfds, nfds, timeout) < 0)
+    return (errno == EINTR) ? 0 : -1;
+
+  if (pfds[0].revents)
+    return -1;
+
+#if HAVE_SYS_INOTIFY_H
+  if (nfds > 1)
+    {
+      union {
+        struct inotify_event event;
+        char buf[GENDERS_REFRESH_EVENT_BUFLEN];
+      } events;
+      ssize_t len;
+      char *ptr;
+      int changed = 0;
+
+      if (!pfds[1].revents)
+        return 0;
+
+      if ((len = read(r->inotifyfd, events.buf, sizeof(events.buf))) <= 0)
+        return (len < 0 && errno == EINTR) ? 0 : -1;
+
+      for (ptr = events.buf; ptr < events.buf + len; )
+        {
+          struct inotify_event *e = (struct inotify_event *)ptr;
+
+          if ((e->mask & IN_Q_OVERFLOW)
+              || (e->len && !strcmp(e->name, r->basename)))
+            changed++;
+          ptr += sizeof(struct inotify_event) + e->len;
+        }
+      return changed ? 1 : 0;
+    }
+#endif /* HAVE_SYS_INOTIFY_H */
+
+  return _refresh_changed(r);
+}
+
+/*
+ * _refresh_thread
+ *
+ * Watcher thread, reloads the database each time it changes until
+ * stopped by _genders_refresh_destroy().
+ */
+static void *
+_refresh_thread(void *arg)
+{
+  struct genders_refresh *r = (struct genders_refresh *)arg;
+  int rv;
+
+  while ((rv = _refresh_wait(r)) >= 0)
+    {
+      if (rv)
+        _refresh_reload(r);
+    }
+  return NULL;
+}
+
+/*
+ * _refresh_watch
+ *
+ * Setup an inotify watch on the directory of the database, if
+ * inotify is available.  Falls back to polling on failure.
+ */
+static void
+_refresh_watch(struct genders_refresh *r)
+{
+#if HAVE_SYS_INOTIFY_H
+  char *dir, *ptr;
+
+  if (!(dir = strdup(r->filename)))
+    return;
+
+  if ((ptr = strrchr(dir, '/')))
+    {
+      r->basename = r->filename + (ptr - dir) + 1;
+      if (ptr == dir)
+        ptr++;
+      *ptr = '\0';
+    }
+  else
+    {
+      r->basename = r->filename;
+      strcpy(dir, ".");
+    }
+
+  if ((r->inotifyfd = inotify_init()) >= 0)
+    {
+      if (inotify_add_watch(r->inotifyfd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        {
+          close(r->inotifyfd);
+          r->inotifyfd = -1;
+        }
+    }
+  free(dir);
+#endif /* HAVE_SYS_INOTIFY_H */
+}
+#endif /* WITH_PTHREADS */
+
+int
+genders_refresh_start(genders_t handle, const char *filename)
+{
+  struct genders_refresh *r = NULL;
+  genders_t snapshot = NULL;
+  int errnum;
+
+  if (_genders_unloaded_handle_error_check(handle) < 0)
+    return -1;
+
+  if (!filename)
+    filename = GENDERS_DEFAULT_FILE;
+
+  __xmalloc(r, struct genders_refresh *, sizeof(struct genders_refresh));
+#if WITH_PTHREADS
+  r->stopfds[0] = r->stopfds[1] = -1;
+#endif /* WITH_PTHREADS */
+#if HAVE_SYS_INOTIFY_H
+  r->inotifyfd = -1;
+#endif /* HAVE_SYS_INOTIFY_H */
+  __xstrdup(r->filename, filename);
+  r->flags = handle->flags;
+
+  /* stat before loading, so a change made during the load is
+   * picked up by the next check.
+   */
+  _refresh_changed(r);
+
+  if (!(snapshot = _refresh_load(r, &errnum)))
+    {
+      handle->errnum = errnum;
+      goto cleanup;
+    }
+
+  __xmalloc(r->snapshots,
+            struct genders_refresh_snapshot *,
+            sizeof(struct genders_refresh_snapshot));
+  r->snapshots->handle = snapshot;
+  r->snapshots->copies = NULL;
+  r->snapshots->refcount = 1;
+  snapshot = NULL;
+
+#if WITH_PTHREADS
+  if (pipe(r->stopfds) < 0)
+    {
+      handle->errnum = GENDERS_ERR_INTERNAL;
+      goto cleanup;
+    }
+
+  _refresh_watch(r);
+  pthread_mutex_init(&r->mutex, NULL);
+  pthread_mutex_init(&r->copy_mutex, NULL);
+  if (pthread_create(&r->thread, NULL, _refresh_thread, r))
+    {
+      pthread_mutex_destroy(&r->mutex);
+      pthread_mutex_destroy(&r->copy_mutex);
+      handle->errnum = GENDERS_ERR_INTERNAL;
+      goto cleanup;
+    }
+#endif /* WITH_PTHREADS */
+
+  handle->refresh = r;
+  handle->errnum = GENDERS_ERR_SUCCESS;
+  return 0;
+
+ cleanup:
+  if (r)
+    {
+#if WITH_PTHREADS
+      if (r->stopfds[0] >= 0)
+        {
+          close(r->stopfds[0]);
+          close(r->stopfds[1]);
+        }
+#endif /* WITH_PTHREADS */
+#if HAVE_SYS_INOTIFY_H
+      if (r->inotifyfd >= 0)
+        close(r->inotifyfd);
+#endif /* HAVE_SYS_INOTIFY_H */
+      if (r->snapshots)
+        _refresh_snapshot_destroy(r->snapshots);
+      free(r->filename);
+      free(r);
+    }
+  return -1;
+}
+
+/*
+ * _refresh_snapshot_put
+ *
+ * Drop a reference to a snapshot taken with the refresh mutex held.
+ * Returns the snapshot if it must now be destroyed, NULL if not.
+ */
+static struct genders_refresh_snapshot *
+_refresh_snapshot_put(struct genders_refresh *r,
+                      struct genders_refresh_snapshot *s)
+{
+  struct genders_refresh_snapshot **sp;
+
+  /* only a replaced snapshot can reach zero */
+  if (--s->refcount)
+    return NULL;
+
+  for (sp = &r->snapshots; *sp != s; sp = &(*sp)->next)
+    ;
+  *sp = s->next;
+  return s;
+}
+
+/*
+ * The handle of a refreshed database is shared by every thread, so
+ * genders_refresh_acquire() and genders_refresh_release() do not
+ * store GENDERS_ERR_SUCCESS in it, only error codes.
+ */
+
+genders_t
+genders_refresh_acquire(genders_t handle)
+{
+  struct genders_refresh *r;
+  struct genders_refresh_snapshot *s, *old;
+  struct genders_refresh_copy *c;
+  genders_t copy;
+
+  if (_genders_handle_error_check(handle) < 0)
+    return NULL;
+
+  if (!(r = handle->refresh))
+    {
+      handle->errnum = GENDERS_ERR_NOTLOADED;
+      return NULL;
+    }
+
+#if !WITH_PTHREADS
+  /* Without a watcher thread, check for changes here */
+  if (_refresh_changed(r))
+    _refresh_reload(r);
+#endif /* !WITH_PTHREADS */
+
+  _refresh_lock(r);
+  s = r->snapshots;
+  s->refcount++;
+  for (c = s->copies; c; c = c->next)
+    {
+      if (!c->inuse)
+        {
+          c->inuse = 1;
+          break;
+        }
+    }
+  _refresh_unlock(r);
+
+  if (c)
+    return c->handle;
+
+  /* Every copy is in use, the reference keeps the snapshot alive
+   * while another is made.
+   */
+  _refresh_copy_lock(r);
+  copy = genders_copy(s->handle);
+  if (!copy)
+    handle->errnum = genders_errnum(s->handle);
+  _refresh_copy_unlock(r);
+
+  if (copy && !(c = (struct genders_refresh_copy *)malloc(sizeof(*c))))
+    {
+      genders_handle_destroy(copy);
+      handle->errnum = GENDERS_ERR_OUTMEM;
+    }
+
+  _refresh_lock(r);
+  if (c)
+    {
+      c->handle = copy;
+      c->inuse = 1;
+      c->next = s->copies;
+      s->copies = c;
+      old = NULL;
+    }
+  else
+    old = _refresh_snapshot_put(r, s);
+  _refresh_unlock(r);
+
+  if (old)
+    _refresh_snapshot_destroy(old);
+
+  return c ? c->handle : NULL;
+}
+
+int
+genders_refresh_release(genders_t handle, genders_t snapshot)
+{
+  struct genders_refresh *r;
+  struct genders_refresh_snapshot *s;
+  struct genders_refresh_copy *c = NULL;
+
+  if (_genders_handle_error_check(handle) < 0)
+    return -1;
+
+  if (!(r = handle->refresh))
+    {
+      handle->errnum = GENDERS_ERR_NOTLOADED;
+      return -1;
+    }
+
+  _refresh_lock(r);
+  for (s = r->snapshots; s; s = s->next)
+    {
+      for (c = s->copies; c; c = c->next)
+        {
+          if (c->handle == snapshot)
+            break;
+        }
+      if (c)
+        break;
+    }
+
+  if (!c || !c->inuse)
+    {
+      _refresh_unlock(r);
+      handle->errnum = GENDERS_ERR_PARAMETERS;
+      return -1;
+    }
+
+  c->inuse = 0;
+  s = _refresh_snapshot_put(r, s);
+  _refresh_unlock(r);
+
+  if (s)
+    _refresh_snapshot_destroy(s);
+
+  return 0;
+}
+
+void
+_genders_refresh_destroy(struct genders_refresh *r)
+{
+  struct genders_refresh_snapshot *s;
+
+  if (!r)
+    return;
+
+#if WITH_PTHREADS
+  /* wake the watcher and wait for any reload in progress */
+  if (write(r->stopfds[1], "", 1) == 1)
+    pthread_join(r->thread, NULL);
+  close(r->stopfds[0]);
+  close(r->stopfds[1]);
+  pthread_mutex_destroy(&r->mutex);
+  pthread_mutex_destroy(&r->copy_mutex);
+#endif /* WITH_PTHREADS */
+#if HAVE_SYS_INOTIFY_H
+  if (r->inotifyfd >= 0)
+    close(r->inotifyfd);
+#endif /* HAVE_SYS_INOTIFY_H */
+
+  while ((s = r->snapshots))
+    {
+      r->snapshots = s->next;
+      _refresh_snapshot_destroy(s);
+    }
+  free(r->filename);
+  free(r);
+}
@@ -33,9 +33,12 @@
 #if STDC_HEADERS
 #include <string.h>
 #endif /* STDC_HEADERS */
+#include <ctype.h>
+#include <errno.h>
 
 #include "genders.h"
 #include "genders_api.h"
+#include "genders_constants.h"
 #include "genders_util.h"
 #include "hash.h"
 #include "hostlist.h"
@@ -99,6 +102,17 @@ _genders_list_free_attrvallist(void *x)
   free(avc);
 }
 
+void
+_genders_list_free_genders_rule(void *x)
+{
+  genders_rule_t r;
+
+  /* the attrvals container belongs to the attrvalslist */
+  r = (genders_rule_t)x;
+  hostlist_destroy(r->nodes);
+  free(r);
+}
+
 int 
 _genders_handle_error_check(genders_t handle) 
 {
@@ -113,7 +127,7 @@ _genders_unloaded_handle_error_check(genders_t handle)
   if (_genders_handle_error_check(handle) < 0)
     return -1;
 
-  if (handle->is_loaded) 
+  if (handle->is_loaded || handle->refresh) 
     {
       handle->errnum = GENDERS_ERR_ISLOADED;
       return -1;
@@ -167,7 +181,9 @@ _genders_get_valptr(genders_t handle,
 		    char **val,
 		    int *subst_occurred)
 {
-  char *valptr, *nodenameptr, *valbufptr;
+  char *valptr, *valbufptr;
+  const char *nodenameptr;
+  char namebuf[GENDERS_MAXHOSTNAMELEN + 1];
 
   if (!(av->val_contains_subst)
       || (handle->flags & GENDERS_FLAG_RAW_VALUES))
@@ -192,14 +208,14 @@ _genders_get_valptr(genders_t handle,
 	    }
 	  else if ((*(valptr + 1)) == 'n') 
 	    {
-	      if ((strlen(av->val) - 2 + strlen(n->name)) > 
+	      nodenameptr = _genders_node_name(n, namebuf);
+	      if ((strlen(av->val) - 2 + strlen(nodenameptr)) > 
 		  (handle->maxvallen + 1)) 
 		{
 		  handle->errnum = GENDERS_ERR_INTERNAL;
 		  return -1;
 		}
 
-	      nodenameptr = n->name;
 	      while (*nodenameptr != '\0')
 		*(valbufptr)++ = *nodenameptr++;
 	      valptr++;
@@ -226,36 +242,29 @@ _genders_find_attrval(genders_t handle,
 		      const char *val,
 		      genders_attrval_t *avptr)
 {
-  genders_attrvals_container_t avc;
+  genders_attrval_t av;
   int retval = -1;
   
   *avptr = NULL;
 
-  if ((avc = hash_find(n->attrlist_index, attr)))
+  if ((av = hash_find(n->attrlist_index, attr)))
     {
-      genders_attrval_t av;
-      
-      if ((av = list_find_first(avc->attrvals, 
-				_genders_list_is_attr_in_attrvals, 
-				(char *)attr))) 
+      if (!val) 
+	{
+	  *avptr = av;
+	  goto out;
+	}
+      else if (av->val) 
 	{
-	  if (!val) 
+	  char *valptr;
+	  
+	  if (_genders_get_valptr(handle, n, av, &valptr, NULL) < 0)
+	    goto cleanup;
+
+	  if (!strcmp(valptr, val)) 
 	    {
 	      *avptr = av;
-              goto out;
-	    }
-	  else if (av->val) 
-	    {
-	      char *valptr;
-	      
-	      if (_genders_get_valptr(handle, n, av, &valptr, NULL) < 0)
-		goto cleanup;
-
-	      if (!strcmp(valptr, val)) 
-		{
-		  *avptr = av;
-                  goto out;
-		}
+	      goto out;
 	    }
 	}
     }
@@ -266,6 +275,78 @@ _genders_find_attrval(genders_t handle,
   return retval;  
 }
 
+int
+_genders_rules_isnode(genders_t handle, const char *node)
+{
+  ListIterator itr = NULL;
+  genders_rule_t r;
+  int rv = -1;
+
+  __list_iterator_create(itr, handle->ruleslist);
+  while ((r = list_next(itr)))
+    {
+      if (hostlist_find(r->nodes, node) >= 0)
+        break;
+    }
+  rv = (r) ? 1 : 0;
+
+ cleanup:
+  __list_iterator_destroy(itr);
+  return rv;
+}
+
+int
+_genders_rules_find_attrval(genders_t handle, 
+                            const char *node, 
+                            const char *attr, 
+                            const char *val,
+                            genders_attrval_t *avptr)
+{
+  ListIterator itr = NULL;
+  genders_rule_t r;
+  int retval = -1;
+
+  *avptr = NULL;
+
+  __list_iterator_create(itr, handle->ruleslist);
+  while ((r = list_next(itr)))
+    {
+      genders_attrval_t av;
+
+      /* a node can list an attribute only once, so the first rule
+       * listing both is the only one
+       */
+      if (!r->avc
+          || !(av = list_find_first(r->avc->attrvals, 
+                                    _genders_list_is_attr_in_attrvals, 
+                                    (char *)attr))
+          || hostlist_find(r->nodes, node) < 0)
+        continue;
+
+      if (!val) 
+        *avptr = av;
+      else if (av->val) 
+        {
+          struct genders_node n;
+          char *valptr;
+
+          /* substitution only needs the node name */
+          n.name = (char *)node;
+          if (_genders_get_valptr(handle, &n, av, &valptr, NULL) < 0)
+            goto cleanup;
+
+          if (!strcmp(valptr, val)) 
+            *avptr = av;
+        }
+      break;
+    }
+
+  retval = 0;
+ cleanup:
+  __list_iterator_destroy(itr);
+  return retval;  
+}
+
 static int
 _hash_reinsert(void *data, const void *key, void *arg)
 {
@@ -289,7 +370,9 @@ _hash_removeall(void *data, const void *key, void *arg)
 int
 _genders_rehash(genders_t handle,
                 hash_t *hash_ptr,
-                int *hash_size)
+                int *hash_size,
+                hash_key_f key_f,
+                hash_cmp_f cmp_f)
 {
   hash_t new_hash = NULL;
   int hash_num;
@@ -298,8 +381,8 @@ _genders_rehash(genders_t handle,
   (*hash_size) *= 2;
   __hash_create(new_hash,
                 (*hash_size),
-                (hash_key_f)hash_key_string,
-                (hash_cmp_f)strcmp,
+                key_f,
+                cmp_f,
                 NULL);
 
   hash_num = hash_count(*hash_ptr);
@@ -345,3 +428,163 @@ _genders_hash_copy(genders_t handle,
  cleanup:
   return retval;
 }
+
+/*
+ * _node_numbered
+ *
+ * Determine if 'name' is stored as a prefix and number, storing the
+ * length of the prefix, the number, and its width if so.
+ *
+ * Returns 1 if numbered, 0 if not
+ */
+static int
+_node_numbered(const char *name, int *prefixlen, unsigned int *num, int *width)
+{
+  int len, i;
+
+  len = strlen(name);
+  if (len > GENDERS_MAXHOSTNAMELEN)
+    return 0;
+
+  for (i = len; i > 0 && isdigit((unsigned char)name[i - 1]); i--)
+    ;
+  if (i == len || len - i > GENDERS_NODENUM_MAXWIDTH)
+    return 0;
+
+  *prefixlen = i;
+  *width = len - i;
+  *num = 0;
+  for (; i < len; i++)
+    *num = *num * 10 + (name[i] - '0');
+  return 1;
+}
+
+unsigned int
+_genders_node_key(const void *key)
+{
+  const struct genders_node *n = key;
+
+  if (n->name)
+    return hash_key_string(n->name);
+
+  /* consecutive numbers of a prefix land in consecutive slots */
+  return (hash_key_string(n->prefix) ^ n->num) * 31 + n->width;
+}
+
+int
+_genders_node_cmp(const void *key1, const void *key2)
+{
+  const struct genders_node *n1 = key1;
+  const struct genders_node *n2 = key2;
+
+  if (n1->name || n2->name)
+    return (n1->name && n2->name) ? strcmp(n1->name, n2->name) : 1;
+
+  if (n1->num != n2->num || n1->width != n2->width)
+    return 1;
+
+  return strcmp(n1->prefix, n2->prefix);
+}
+
+genders_node_t
+_genders_find_node(hash_t node_index, const char *name)
+{
+  char prefix[GENDERS_MAXHOSTNAMELEN + 1];
+  struct genders_node key;
+  int prefixlen;
+
+  if (_node_numbered(name, &prefixlen, &key.num, &key.width))
+    {
+      memcpy(prefix, name, prefixlen);
+      prefix[prefixlen] = '\0';
+      key.name = NULL;
+      key.prefix = prefix;
+    }
+  else
+    key.name = (char *)name;
+
+  return hash_find(node_index, &key);
+}
+
+int
+_genders_node_set_name(genders_t handle, genders_node_t n, const char *name)
+{
+  char prefix[GENDERS_MAXHOSTNAMELEN + 1];
+  char *p = NULL;
+  int prefixlen;
+
+  if (!_node_numbered(name, &prefixlen, &n->num, &n->width))
+    {
+      __xstrdup(n->name, name);
+      return 0;
+    }
+
+  memcpy(prefix, name, prefixlen);
+  prefix[prefixlen] = '\0';
+
+  if (!handle->nodeprefixes)
+    {
+      handle->nodeprefixes_size = GENDERS_NODEPREFIXES_INIT_SIZE;
+      __hash_create(handle->nodeprefixes,
+                    handle->nodeprefixes_size,
+                    (hash_key_f)hash_key_string,
+                    (hash_cmp_f)strcmp,
+                    NULL);
+    }
+
+  if (!(n->prefix = hash_find(handle->nodeprefixes, prefix)))
+    {
+      if (hash_count(handle->nodeprefixes) > handle->nodeprefixes_size * 2
+          && _genders_rehash(handle,
+                             &handle->nodeprefixes,
+                             &handle->nodeprefixes_size,
+                             (hash_key_f)hash_key_string,
+                             (hash_cmp_f)strcmp) < 0)
+        goto cleanup;
+
+      __xstrdup(p, prefix);
+      __hash_insert(handle->nodeprefixes, p, p);
+      n->prefix = p;
+    }
+
+  n->name = NULL;
+  return 0;
+
+ cleanup:
+  free(p);
+  return -1;
+}
+
+const char *
+_genders_node_name(genders_node_t n, char *buf)
+{
+  unsigned int num;
+  int len, i;
+
+  if (n->name)
+    return n->name;
+
+  len = strlen(n->prefix);
+  memcpy(buf, n->prefix, len);
+  for (i = len + n->width - 1, num = n->num; i >= len; i--, num /= 10)
+    buf[i] = '0' + num % 10;
+  buf[len + n->width] = '\0';
+  return buf;
+}
+
+static int
+_hash_free_data(void *data, const void *key, void *arg)
+{
+  free(data);
+  return 1;
+}
+
+void
+_genders_nodeprefixes_destroy(hash_t nodeprefixes)
+{
+  if (!nodeprefixes)
+    return;
+
+  hash_for_each(nodeprefixes, _hash_free_data, NULL);
+  hash_destroy(nodeprefixes);
+}
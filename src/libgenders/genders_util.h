@@ -127,6 +127,19 @@
 
 #define GENDERS_MAX(x,y) ((x > y) ? x : y)
 
+#define GENDERS_MIN(x,y) ((x < y) ? x : y)
+
+/* nanoseconds of a file's modify and change times, so an edit made
+ * in the same second as the last look at the file is still noticed
+ */
+#if HAVE_STRUCT_STAT_ST_MTIM
+#define GENDERS_MTIME_NSEC(st) ((st)->st_mtim.tv_nsec)
+#define GENDERS_CTIME_NSEC(st) ((st)->st_ctim.tv_nsec)
+#else /* !HAVE_STRUCT_STAT_ST_MTIM */
+#define GENDERS_MTIME_NSEC(st) 0
+#define GENDERS_CTIME_NSEC(st) 0
+#endif /* !HAVE_STRUCT_STAT_ST_MTIM */
+
 /* 
  * List API Helper Functions 
  */
@@ -177,6 +190,13 @@ void _genders_list_free_genders_attrval(void *x);
  */
 void _genders_list_free_attrvallist(void *x);
 
+/* 
+ * _genders_list_free_genders_rule
+ *
+ * Free genders_rule_t structure, but not its attrvals container
+ */
+void _genders_list_free_genders_rule(void *x);
+
 /* 
  * Common helper functions 
  */
@@ -193,7 +213,8 @@ int _genders_handle_error_check(genders_t handle);
 /* 
  * _genders_unloaded_handle_error_check
  *
- * Check if handle is proper and unloaded
+ * Check if handle is proper and unloaded, and not refreshing a
+ * database from genders_refresh_start()
  *
  * Returns 0 on success, -1 on error
  */
@@ -247,17 +268,43 @@ int _genders_find_attrval(genders_t handle,
 			  const char *val,
 			  genders_attrval_t *avptr);
 
+/* 
+ * _genders_rules_isnode
+ *
+ * Determine if a node is listed by any rule of a lazily loaded handle
+ *
+ * Returns 1 if it is, 0 if not, -1 on error
+ */
+int _genders_rules_isnode(genders_t handle, const char *node);
+
+/* 
+ * _genders_rules_find_attrval
+ *
+ * Find genders_attrval_t with attr or attr=val for a node in the
+ * rules of a lazily loaded handle
+ *
+ * Return 0 on success, -1 on error
+ */
+int _genders_rules_find_attrval(genders_t handle, 
+                                const char *node, 
+                                const char *attr, 
+                                const char *val,
+                                genders_attrval_t *avptr);
+
 /* 
  * _genders_rehash
  *
- * Rehash the specified hash into a larger hash.  Both hash_ptr and
- * size are in/out parameters.
+ * Rehash the specified hash into a larger hash, with the same key_f
+ * and cmp_f it was created with.  Both hash_ptr and size are in/out
+ * parameters.
  *
  * Returns 0 on success, -1 on error
  */
 int _genders_rehash(genders_t handle,
                     hash_t *hash_ptr,
-                    int *hash_size);
+                    int *hash_size,
+                    hash_key_f key_f,
+                    hash_cmp_f cmp_f);
 
 /*
  * _genders_hash_copy
@@ -270,4 +317,55 @@ int _genders_hash_copy(genders_t handle,
 		       hash_t *hash_src,
 		       hash_t *hash_dest);
 
+/*
+ * _genders_node_key
+ *
+ * Hash key function of a node_index, keyed by genders_node_t
+ */
+unsigned int _genders_node_key(const void *key);
+
+/*
+ * _genders_node_cmp
+ *
+ * Key comparison function of a node_index, keyed by genders_node_t
+ */
+int _genders_node_cmp(const void *key1, const void *key2);
+
+/*
+ * _genders_find_node
+ *
+ * Find the node named 'name' in node_index, without building its
+ * name.
+ *
+ * Returns node if found, NULL if not
+ */
+genders_node_t _genders_find_node(hash_t node_index, const char *name);
+
+/*
+ * _genders_node_set_name
+ *
+ * Set the name of node 'n' to 'name', as a prefix and number if it
+ * ends in one.  Prefixes are shared through the handle's
+ * nodeprefixes, created on first use.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int _genders_node_set_name(genders_t handle, genders_node_t n, const char *name);
+
+/*
+ * _genders_node_name
+ *
+ * Returns the name of node 'n', built in 'buf' if it is stored as a
+ * prefix and number.  'buf' must hold GENDERS_MAXHOSTNAMELEN + 1
+ * bytes.
+ */
+const char *_genders_node_name(genders_node_t n, char *buf);
+
+/*
+ * _genders_nodeprefixes_destroy
+ *
+ * Destroy the prefixes set by _genders_node_set_name()
+ */
+void _genders_nodeprefixes_destroy(hash_t nodeprefixes);
+
 #endif /* _GENDERS_COMMON_H */
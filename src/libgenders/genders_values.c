@@ -0,0 +1,472 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#if STDC_HEADERS
+#include <string.h>
+#endif /* STDC_HEADERS */
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+
+#include "genders.h"
+#include "genders_api.h"
+#include "genders_constants.h"
+#include "genders_util.h"
+#include "genders_values.h"
+#include "hash.h"
+#include "list.h"
+
+/*
+ * struct genders_values
+ *
+ * The values of attribute 'attr' that are numbers, sorted, and the
+ * List of nodes with each value.  Values equal as numbers but
+ * written differently, such as "8" and "08", are kept apart.
+ */
+struct genders_values {
+  char *attr;
+  int count;
+  double *nums;
+  List *nodes;
+};
+
+struct genders_numval {
+  double num;
+  List nodes;
+};
+
+/*
+ * struct genders_dict
+ *
+ * The distinct values of attribute 'attr', sorted by strcmp(3), and
+ * the List of nodes with each value.  The values are the keys of the
+ * attribute's value index.
+ */
+struct genders_dict {
+  char *attr;
+  int count;
+  char **vals;
+  List *nodes;
+};
+
+struct genders_strval {
+  char *val;
+  List nodes;
+};
+
+int
+_genders_value_number(const char *val, double *num)
+{
+  const char *p = val;
+  int digits = 0;
+
+  if (*p == '+' || *p == '-')
+    p++;
+  for (; isdigit((unsigned char)*p); p++)
+    digits++;
+  if (*p == '.')
+    for (p++; isdigit((unsigned char)*p); p++)
+      digits++;
+  if (*p != '\0' || !digits)
+    return 0;
+
+  *num = strtod(val, NULL);
+  return 1;
+}
+
+int
+_genders_value_glob(const char *pattern, const char *val)
+{
+  const char *star = NULL, *retry = NULL;
+
+  /* On a mismatch after a '*', let the '*' match one more character */
+  while (*val)
+    {
+      if (*pattern == '*')
+        {
+          star = ++pattern;
+          retry = val;
+        }
+      else if (*pattern == '?' || *pattern == *val)
+        {
+          pattern++;
+          val++;
+        }
+      else if (star)
+        {
+          pattern = star;
+          val = ++retry;
+        }
+      else
+        return 0;
+    }
+
+  while (*pattern == '*')
+    pattern++;
+  return (*pattern == '\0');
+}
+
+int
+_genders_range_contains(const struct genders_range *range, double num)
+{
+  if (range->lo_strict ? num <= range->lo : num < range->lo)
+    return 0;
+  if (range->hi_strict ? num >= range->hi : num > range->hi)
+    return 0;
+  return 1;
+}
+
+/*
+ * _values_add
+ *
+ * Add a value from an attribute's value index, if it is a number.
+ */
+static int
+_values_add(void *data, const void *key, void *arg)
+{
+  struct genders_numval **next = arg;
+
+  if (!_genders_value_number(key, &(*next)->num))
+    return 0;
+  (*next)->nodes = data;
+  (*next)++;
+  return 1;
+}
+
+static int
+_numval_cmp(const void *a, const void *b)
+{
+  double na = ((const struct genders_numval *)a)->num;
+  double nb = ((const struct genders_numval *)b)->num;
+
+  return (na > nb) - (na < nb);
+}
+
+/*
+ * _values_build
+ *
+ * Sort the numeric values of attr, adding them to attrval_numeric.
+ *
+ * Returns 0 on success, -1 on error
+ */
+static int
+_values_build(genders_t handle, const char *attr, struct genders_values **vp)
+{
+  struct genders_values *v = NULL;
+  struct genders_numval *numvals = NULL, *next;
+  hash_t valindex;
+  int i, count;
+
+  if (genders_index_attrvals(handle, attr) < 0)
+    return -1;
+
+  if (!handle->attrval_numeric)
+    __hash_create(handle->attrval_numeric,
+                  handle->numattrs,
+                  (hash_key_f)hash_key_string,
+                  (hash_cmp_f)strcmp,
+                  _genders_values_destroy);
+
+  __xmalloc(v, struct genders_values *, sizeof(struct genders_values));
+  __xstrdup(v->attr, attr);
+
+  if ((valindex = hash_find(handle->attrval_index, attr))
+      && (count = hash_count(valindex)))
+    {
+      __xmalloc(numvals, 
+                struct genders_numval *, 
+                sizeof(struct genders_numval) * count);
+      next = numvals;
+      v->count = hash_for_each(valindex, _values_add, &next);
+      qsort(numvals, v->count, sizeof(struct genders_numval), _numval_cmp);
+    }
+
+  if (v->count)
+    {
+      __xmalloc(v->nums, double *, sizeof(double) * v->count);
+      __xmalloc(v->nodes, List *, sizeof(List) * v->count);
+      for (i = 0; i < v->count; i++)
+        {
+          v->nums[i] = numvals[i].num;
+          v->nodes[i] = numvals[i].nodes;
+        }
+    }
+
+  __hash_insert(handle->attrval_numeric, v->attr, v);
+  free(numvals);
+  *vp = v;
+  return 0;
+
+ cleanup:
+  free(numvals);
+  _genders_values_destroy(v);
+  return -1;
+}
+
+/*
+ * _values_bound
+ *
+ * Returns the index of the first of the sorted numbers 'nums' above
+ * 'num', or at or above it if 'inclusive' is set.
+ */
+static int
+_values_bound(double *nums, int count, double num, int inclusive)
+{
+  int lo = 0, hi = count, mid;
+
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (inclusive ? nums[mid] < num : nums[mid] <= num)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+int
+_genders_values_numeric(genders_t handle, 
+                        const char *attr, 
+                        const struct genders_range *range,
+                        int build,
+                        List **lists,
+                        int *count)
+{
+  struct genders_values *v = NULL;
+  int first, last;
+
+  if (!handle->numattrs || !hash_find(handle->attr_index, attr))
+    return 0;
+
+  if (!handle->attrval_numeric
+      || !(v = hash_find(handle->attrval_numeric, attr)))
+    {
+      if (!build)
+        return 0;
+      if (_values_build(handle, attr, &v) < 0)
+        return -1;
+    }
+
+  first = _values_bound(v->nums, v->count, range->lo, !range->lo_strict);
+  last = _values_bound(v->nums, v->count, range->hi, range->hi_strict);
+
+  *lists = v->count ? v->nodes + first : NULL;
+  *count = GENDERS_MAX(last - first, 0);
+  return 1;
+}
+
+/*
+ * _dict_add
+ *
+ * Add a value from an attribute's value index.
+ */
+static int
+_dict_add(void *data, const void *key, void *arg)
+{
+  struct genders_strval **next = arg;
+
+  (*next)->val = (char *)key;
+  (*next)->nodes = data;
+  (*next)++;
+  return 1;
+}
+
+static int
+_strval_cmp(const void *a, const void *b)
+{
+  return strcmp(((const struct genders_strval *)a)->val,
+                ((const struct genders_strval *)b)->val);
+}
+
+/*
+ * _dict_build
+ *
+ * Sort the distinct values of attr, adding them to attrval_dict.
+ *
+ * Returns 0 on success, -1 on error
+ */
+static int
+_dict_build(genders_t handle, const char *attr, struct genders_dict **dp)
+{
+  struct genders_dict *d = NULL;
+  struct genders_strval *strvals = NULL, *next;
+  hash_t valindex;
+  int i, count;
+
+  if (genders_index_attrvals(handle, attr) < 0)
+    return -1;
+
+  if (!handle->attrval_dict)
+    __hash_create(handle->attrval_dict,
+                  handle->numattrs,
+                  (hash_key_f)hash_key_string,
+                  (hash_cmp_f)strcmp,
+                  _genders_dict_destroy);
+
+  __xmalloc(d, struct genders_dict *, sizeof(struct genders_dict));
+  __xstrdup(d->attr, attr);
+
+  if ((valindex = hash_find(handle->attrval_index, attr))
+      && (count = hash_count(valindex)))
+    {
+      __xmalloc(strvals, 
+                struct genders_strval *, 
+                sizeof(struct genders_strval) * count);
+      next = strvals;
+      d->count = hash_for_each(valindex, _dict_add, &next);
+      qsort(strvals, d->count, sizeof(struct genders_strval), _strval_cmp);
+
+      __xmalloc(d->vals, char **, sizeof(char *) * d->count);
+      __xmalloc(d->nodes, List *, sizeof(List) * d->count);
+      for (i = 0; i < d->count; i++)
+        {
+          d->vals[i] = strvals[i].val;
+          d->nodes[i] = strvals[i].nodes;
+        }
+    }
+
+  __hash_insert(handle->attrval_dict, d->attr, d);
+  free(strvals);
+  *dp = d;
+  return 0;
+
+ cleanup:
+  free(strvals);
+  _genders_dict_destroy(d);
+  return -1;
+}
+
+/*
+ * _dict_bound
+ *
+ * Returns the index of the first of the sorted values 'vals' whose
+ * first 'len' characters are at or above 'prefix'.
+ */
+static int
+_dict_bound(char **vals, int count, const char *prefix, int len)
+{
+  int lo = 0, hi = count, mid;
+
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (strncmp(vals[mid], prefix, len) < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+int
+_genders_values_glob(genders_t handle, 
+                     const char *attr, 
+                     const char *pattern,
+                     int build,
+                     List **lists,
+                     int *count)
+{
+  struct genders_dict *d = NULL;
+  List *matched = NULL;
+  int first, last, len, i;
+
+  if (!handle->numattrs || !hash_find(handle->attr_index, attr))
+    return 0;
+
+  if (!handle->attrval_dict
+      || !(d = hash_find(handle->attrval_dict, attr)))
+    {
+      if (!build)
+        return 0;
+      if (_dict_build(handle, attr, &d) < 0)
+        return -1;
+    }
+
+  /* Values matching the pattern all start with its literal prefix */
+  len = strcspn(pattern, "*?");
+  first = _dict_bound(d->vals, d->count, pattern, len);
+  for (last = first; 
+       last < d->count && !strncmp(d->vals[last], pattern, len); 
+       last++)
+    ;
+
+  *lists = NULL;
+  *count = 0;
+  if (first == last)
+    return 1;
+
+  __xmalloc(matched, List *, sizeof(List) * (last - first));
+  for (i = first; i < last; i++)
+    {
+      if (_genders_value_glob(pattern + len, d->vals[i] + len))
+        matched[(*count)++] = d->nodes[i];
+    }
+
+  if (!*count)
+    free(matched);
+  else
+    *lists = matched;
+  return 1;
+
+ cleanup:
+  return -1;
+}
+
+void
+_genders_values_destroy(void *data)
+{
+  struct genders_values *v = data;
+
+  if (!v)
+    return;
+
+  free(v->attr);
+  free(v->nums);
+  free(v->nodes);
+  free(v);
+}
+
+void
+_genders_dict_destroy(void *data)
+{
+  struct genders_dict *d = data;
+
+  if (!d)
+    return;
+
+  free(d->attr);
+  free(d->vals);
+  free(d->nodes);
+  free(d);
+}
@@ -0,0 +1,138 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+
+#ifndef _GENDERS_VALUES_H
+#define _GENDERS_VALUES_H 1
+
+#include "genders.h"
+#include "list.h"
+
+/*
+ * struct genders_range
+ *
+ * A range of numbers, from lo to hi.  An unbounded end is -HUGE_VAL
+ * or HUGE_VAL.
+ */
+struct genders_range {
+  double lo;
+  double hi;
+  int lo_strict;                /* lo itself is not in the range */
+  int hi_strict;                /* hi itself is not in the range */
+};
+
+/*
+ * _genders_value_number
+ *
+ * Determine if value 'val' is a decimal number, an optional sign
+ * followed by digits with an optional fraction, storing it in 'num'
+ * if so.
+ *
+ * Returns 1 if it is, 0 if not
+ */
+int _genders_value_number(const char *val, double *num);
+
+/*
+ * _genders_value_glob
+ *
+ * Determine if value 'val' matches 'pattern', in which '*' matches
+ * any string, including the empty string, and '?' matches any one
+ * character.
+ *
+ * Returns 1 if it does, 0 if not
+ */
+int _genders_value_glob(const char *pattern, const char *val);
+
+/*
+ * _genders_range_contains
+ *
+ * Returns 1 if 'num' is in 'range', 0 if not
+ */
+int _genders_range_contains(const struct genders_range *range, double num);
+
+/*
+ * _genders_values_numeric
+ *
+ * Find the Lists of nodes whose value of attr is a number in
+ * 'range', from attr's values sorted by number.  The sorted values
+ * are built on first use if 'build' is set, from the attribute's
+ * value index in attrval_index.  The Lists are stored in 'lists',
+ * one per value, and belong to the handle.
+ *
+ * Must not be called with a shared image or unexpanded rules.
+ *
+ * Returns 1 and the number of Lists in 'count', 0 if attr is not a
+ * node's attribute, or its values are not yet sorted and 'build' is
+ * not set.  Returns -1 on error.
+ */
+int _genders_values_numeric(genders_t handle, 
+                            const char *attr, 
+                            const struct genders_range *range,
+                            int build,
+                            List **lists,
+                            int *count);
+
+/*
+ * _genders_values_glob
+ *
+ * Find the Lists of nodes whose value of attr matches 'pattern',
+ * from attr's distinct values sorted by strcmp(3).  Only the values
+ * starting with the pattern's characters up to its first wildcard
+ * are tested.  The sorted values are built on first use if 'build'
+ * is set, from the attribute's value index in attrval_index.  The
+ * Lists are stored in an array in 'lists', one per value, that must
+ * be freed by the caller, while the Lists belong to the handle.
+ *
+ * Must not be called with a shared image or unexpanded rules.
+ *
+ * Returns 1 and the number of Lists in 'count', 0 if attr is not a
+ * node's attribute, or its values are not yet sorted and 'build' is
+ * not set.  Returns -1 on error.
+ */
+int _genders_values_glob(genders_t handle, 
+                         const char *attr, 
+                         const char *pattern,
+                         int build,
+                         List **lists,
+                         int *count);
+
+/*
+ * _genders_values_destroy
+ *
+ * Destroy the sorted values of an attribute, for use as the hash_del_f
+ * of attrval_numeric.
+ */
+void _genders_values_destroy(void *data);
+
+/*
+ * _genders_dict_destroy
+ *
+ * Destroy the sorted distinct values of an attribute, for use as the
+ * hash_del_f of attrval_dict.
+ */
+void _genders_dict_destroy(void *data);
+
+#endif /* _GENDERS_VALUES_H */
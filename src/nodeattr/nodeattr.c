@@ -41,6 +41,11 @@
 #include <getopt.h>
 #endif /* HAVE_GETOPT_H */
 #include <errno.h>
+#include <ctype.h>
+#include <sys/types.h>
+#if WITH_PTHREADS
+#include <pthread.h>
+#endif /* WITH_PTHREADS */
 
 #include "genders.h"
 #include "hash.h"
@@ -76,26 +81,39 @@ static struct option longopts[] = {
     { "diff", 1, 0, 'd'},
     { "expand", 0, 0, 'e'},
     { "compress", 0, 0, 'C'},
+    { "diff-structured", 0, 0, 'S'},
+    { "batch", 0, 0, 'B'},
+    { "explain", 0, 0, 'E'},
+    { "analyze", 0, 0, 'Z'},
+    { "shared", 0, 0, 'M'},
     { 0,0,0,0 },
 };
 #endif
 
 typedef enum { FMT_COMMA, FMT_NL, FMT_SPACE, FMT_HOSTLIST } fmt_t;
 
-static int test_attr(genders_t gp, char *node, char *attr, int vopt);
+struct nodeattr_options;
+
+static int parse_options(int argc, char *argv[], struct nodeattr_options *opts);
+static int run_query(genders_t gp, struct nodeattr_options *opts, FILE *out, int argc, char *argv[]);
+
+static int test_attr(genders_t gp, FILE *out, char *node, char *attr, int vopt);
 static int test_query(genders_t gp, char *node, char *query);
-static void list_attr_val(genders_t gp, char *attr, int Uopt);
-static void list_nodes(genders_t gp, char *attr, char *excludequery, fmt_t fmt);
-static void list_attrs(genders_t gp, char *node);
+static int list_attr_val(genders_t gp, FILE *out, char *attr, int Uopt);
+static int list_nodes(genders_t gp, FILE *out, char *attr, char *excludequery, fmt_t fmt);
+static int list_attrs(genders_t gp, FILE *out, char *node);
 static void usage(void);
-static void diff_genders(char *db1, char *db2);
+static void usage_print(void);
+static int diff_genders(char *db1, char *db2, int structured);
 static void expand(genders_t gp);
 static void compress(genders_t gp);
+static void batch(genders_t gp);
 
 /* Utility functions */
+static int _gend_error(genders_t gp, char *msg);
 static int _gend_error_exit(genders_t gp, char *msg);
 static void *_safe_malloc(size_t size);
-static void *_rangestr(hostlist_t hl, fmt_t fmt);
+static int _print_rangestr(FILE *out, hostlist_t hl, fmt_t fmt);
 static char *_val_create(genders_t gp);
 #if 0
 static char *_to_gendname(genders_t gp, char *val);
@@ -103,186 +121,290 @@ static char *_node_create(genders_t gp);
 static char *_attr_create(genders_t gp);
 #endif
 
-#define HOSTLIST_BUFLEN 1024
+#define BATCH_BUFLEN    65536
+
+#define BATCH_MAXARGS   64
+
+struct nodeattr_options {
+    int Aopt, lopt, qopt, Xopt, vopt, Qopt, Vopt, Uopt, kopt, dopt, eopt,
+      Copt, Sopt, Bopt, Eopt, Zopt, Mopt;
+    char *filename;
+    char *dfilename;
+    char *excludequery;
+    fmt_t qfmt;
+};
 
 int
 main(int argc, char *argv[])
 {
-    int c, errors;
-    int Aopt = 0, lopt = 0, qopt = 0, Xopt = 0, vopt = 0, Qopt = 0,
-      Vopt = 0, Uopt = 0, kopt = 0, dopt = 0, eopt = 0, Copt = 0;
-    char *filename = GENDERS_DEFAULT_FILE;
-    char *dfilename = NULL;
-    char *excludequery = NULL;
-    fmt_t qfmt = FMT_HOSTLIST;
+    struct nodeattr_options opts;
+    unsigned int flags = GENDERS_FLAG_DEFAULT;
+    int errors;
     genders_t gp;
 
+    memset(&opts, '\0', sizeof(struct nodeattr_options));
+    opts.filename = GENDERS_DEFAULT_FILE;
+    opts.qfmt = FMT_HOSTLIST;
+
+    if (parse_options(argc, argv, &opts) < 0)
+        usage();
+
+    /* genders database diff */
+    if (opts.dopt) {
+        int errcount = diff_genders(opts.filename, opts.dfilename, opts.Sopt);
+        
+        /* Historically differences are only reported, the structured
+         * output also reports them through the exit status like diff(1).
+         */
+        exit((opts.Sopt && errcount) ? 1 : 0);
+    }
+
+    /* Initialize genders package. */
+    gp = genders_handle_create();
+    if (!gp) {
+        fprintf(stderr, "nodeattr: out of memory\n");
+        exit(1);
+    }
+
+    /* parse check */
+    if (opts.kopt) {
+        errors = genders_parse(gp, opts.filename, NULL);
+        if (errors == -1 && genders_errnum(gp) != GENDERS_ERR_PARSE)
+            _gend_error_exit(gp, "genders_parse");
+        if (errors >= 0)
+            fprintf(stderr, "nodeattr: %d parse errors discovered\n", errors);
+        exit(errors);
+    }
+
+    /* A query over the whole database needs no per-node data, so keep
+     * the ranges of the database unexpanded.  Every other mode looks
+     * up nodes one at a time, which searches all of the ranges each
+     * time, or reports the work done by a query, so it loads the nodes
+     * up front.
+     */
+    if ((opts.qopt && !opts.Aopt) || opts.Eopt)
+        flags |= GENDERS_FLAG_LAZY_NODES;
+
+    if (opts.Mopt)
+        flags |= GENDERS_FLAG_SHARED_IMAGE;
+
+    if (genders_set_flags(gp, flags) < 0)
+        _gend_error_exit(gp, "genders_set_flags");
+
+    if (genders_load_data(gp, opts.filename) < 0)
+        _gend_error_exit(gp, opts.filename);
+
+    /* expand */
+    if (opts.eopt) {
+        expand(gp);
+        exit(0);
+    }
+
+    /* compress */
+    if (opts.Copt) {
+        compress(gp);
+        exit(0);
+    }
+
+    /* batch */
+    if (opts.Bopt) {
+        batch(gp);
+        exit(0);
+    }
+
+    exit(run_query(gp, &opts, stdout, argc, argv));
+}
+
+/* Returns 0 on success, -1 if the options are not a valid usage */
+static int
+parse_options(int argc, char *argv[], struct nodeattr_options *opts)
+{
+    int c;
+
     while ((c = GETOPT(argc, argv, OPTIONS, longopts)) != EOF) {
         switch (c) {
         case 'c':   /* --querycomma */
-            qfmt = FMT_COMMA;
-            qopt = 1;
+            opts->qfmt = FMT_COMMA;
+            opts->qopt = 1;
             break;
         case 'n':   /* --querynl */
-            qfmt = FMT_NL;
-            qopt = 1;
+            opts->qfmt = FMT_NL;
+            opts->qopt = 1;
             break;
         case 's':   /* --queryspace */
-            qfmt = FMT_SPACE;
-            qopt = 1;
+            opts->qfmt = FMT_SPACE;
+            opts->qopt = 1;
             break;
         case 'q':   /* --query */
-            qfmt = FMT_HOSTLIST;
-            qopt = 1;
+            opts->qfmt = FMT_HOSTLIST;
+            opts->qopt = 1;
             break;
         case 'X':   /* --excludequery */
-            excludequery = optarg;
-            Xopt = 1;
+            opts->excludequery = optarg;
+            opts->Xopt = 1;
             break;
         case 'A':   /* --allnodes */
-            Aopt = 1;
+            opts->Aopt = 1;
             break;
         case 'v':   /* --value */
-            vopt = 1;
+            opts->vopt = 1;
             break;
         case 'Q':   /* --testquery */
-            Qopt = 1;
+            opts->Qopt = 1;
             break;
         case 'V':   /* --values */
-            Vopt = 1;
+            opts->Vopt = 1;
             break;
         case 'U':   /* --unique */
-            Uopt = 1;
+            opts->Uopt = 1;
             break;
         case 'l':   /* --listattr */
-            lopt = 1;
+            opts->lopt = 1;
             break;
         case 'f':   /* --filename */
-            filename = optarg;
+            opts->filename = optarg;
             break;
         case 'k':   /* --check */ 
-            kopt = 1;
+            opts->kopt = 1;
             break;
         case 'd':   /* --diff */
-            dopt = 1;
-            dfilename = optarg;
+            opts->dopt = 1;
+            opts->dfilename = optarg;
             break;
         case 'e':   /* --expand */
-            eopt = 1;
+            opts->eopt = 1;
             break;
         case 'C':   /* --compress */
-            Copt = 1;
+            opts->Copt = 1;
             break;
-        default:
-            usage();
+        case 'S':   /* --diff-structured */
+            opts->Sopt = 1;
+            break;
+        case 'B':   /* --batch */
+            opts->Bopt = 1;
+            break;
+        case 'E':   /* --explain */
+            opts->Eopt = 1;
+            break;
+        case 'Z':   /* --analyze */
+            opts->Zopt = 1;
+            break;
+        case 'M':   /* --shared */
+            opts->Mopt = 1;
             break;
+        default:
+            return -1;
         }
     }
 
     /* check parameter inputs */
 
     /* specify correct option combinations */
-    if ((qopt + Qopt + Vopt + lopt + kopt + dopt + eopt + Copt) > 1)
-        usage();
+    if ((opts->qopt + opts->Qopt + opts->Vopt + opts->lopt + opts->kopt
+         + opts->dopt + opts->eopt + opts->Copt + opts->Bopt + opts->Eopt
+         + opts->Zopt) > 1)
+        return -1;
 
-    if ((qopt
-         || Qopt
-         || Vopt
-         || lopt
-         || kopt
-         || dopt
-         || eopt
-         || Copt)
-        && vopt)
-        usage();
+    if ((opts->qopt
+         || opts->Qopt
+         || opts->Vopt
+         || opts->lopt
+         || opts->kopt
+         || opts->dopt
+         || opts->eopt
+         || opts->Copt
+         || opts->Bopt
+         || opts->Eopt
+         || opts->Zopt)
+        && opts->vopt)
+        return -1;
 
-    if (Aopt && !qopt) {
-        qfmt = FMT_HOSTLIST;
-        qopt = 1;
+    if (opts->Aopt && !opts->qopt) {
+        opts->qfmt = FMT_HOSTLIST;
+        opts->qopt = 1;
     }
 
-    if (!qopt && Xopt)
-        usage();
+    if (!opts->qopt && opts->Xopt)
+        return -1;
 
-    if (!Vopt && Uopt)
-        usage();
+    if (!opts->Vopt && opts->Uopt)
+        return -1;
+
+    if (!opts->dopt && opts->Sopt)
+        return -1;
 
     /* specified correctly number of arguments */
-    if ((qopt 
-         && ((!Aopt && optind != (argc - 1))
-             || (Aopt && optind != argc))) 
-        || (!qopt
-            && !Qopt
-            && !Vopt
-            && !lopt
-            && !kopt
-            && !dopt
-            && !eopt
-            && !Copt
+    if ((opts->qopt 
+         && ((!opts->Aopt && optind != (argc - 1))
+             || (opts->Aopt && optind != argc))) 
+        || (!opts->qopt
+            && !opts->Qopt
+            && !opts->Vopt
+            && !opts->lopt
+            && !opts->kopt
+            && !opts->dopt
+            && !opts->eopt
+            && !opts->Copt
+            && !opts->Bopt
+            && !opts->Eopt
+            && !opts->Zopt
             && (optind != (argc - 1) && optind != (argc - 2)))
-        || (Qopt && (optind != (argc - 1) && optind != (argc - 2)))
-        || (Vopt && optind != (argc - 1))
-        || (lopt && (optind != argc && optind != (argc - 1)))
-        || (kopt && optind != argc)
-        || (dopt && optind != argc)
-        || (eopt && optind != argc)
-        || (Copt && optind != argc))
-        usage();
-
-    /* genders database diff */
-    if (dopt) {
-        diff_genders(filename, dfilename);
-        exit(0);
-    }
+        || (opts->Qopt && (optind != (argc - 1) && optind != (argc - 2)))
+        || (opts->Vopt && optind != (argc - 1))
+        || (opts->lopt && (optind != argc && optind != (argc - 1)))
+        || (opts->kopt && optind != argc)
+        || (opts->dopt && optind != argc)
+        || (opts->eopt && optind != argc)
+        || (opts->Copt && optind != argc)
+        || (opts->Bopt && optind != argc)
+        || ((opts->Eopt || opts->Zopt) && optind != (argc - 1)))
+        return -1;
 
-    /* Initialize genders package. */
-    gp = genders_handle_create();
-    if (!gp) {
-        fprintf(stderr, "nodeattr: out of memory\n");
-        exit(1);
-    }
+    return 0;
+}
 
-    /* parse check */
-    if (kopt) {
-        errors = genders_parse(gp, filename, NULL);
-        if (errors == -1 && genders_errnum(gp) != GENDERS_ERR_PARSE)
-            _gend_error_exit(gp, "genders_parse");
-        if (errors >= 0)
-            fprintf(stderr, "nodeattr: %d parse errors discovered\n", errors);
-        exit(errors);
-    }
+/* Run one of the query usages against a loaded database, writing
+ * its output to out.  Errors are reported on stderr.  Returns the
+ * exit status for nodeattr.
+ */
+static int
+run_query(genders_t gp, struct nodeattr_options *opts, FILE *out, int argc, char *argv[])
+{
+    /* Usage 1: list nodes with specified attribute, or all nodes */
+    if (opts->qopt) {
+        char *query;
+        int rv;
 
-    if (genders_load_data(gp, filename) < 0)
-        _gend_error_exit(gp, filename);
+        if (opts->Aopt)
+            rv = list_nodes(gp, out, NULL, NULL, opts->qfmt); 
+        else {
+            query = argv[optind++];
+            rv = list_nodes(gp, out, query, opts->excludequery, opts->qfmt);
+        }
 
-    /* expand */
-    if (eopt) {
-        expand(gp);
-        exit(0);
+        return (rv < 0 ? 1 : 0);
     }
 
-    /* compress */
-    if (Copt) {
-        compress(gp);
-        exit(0);
-    }
+    /* Usage 6:  output query plan, after evaluating it for --analyze */
+    if (opts->Eopt || opts->Zopt) {
+        char *query = argv[optind++];
+        int rv;
 
-    /* Usage 1: list nodes with specified attribute, or all nodes */
-    if (qopt) {
-        char *query;
+        if (opts->Eopt)
+            rv = genders_query_explain(gp, query, out);
+        else
+            rv = genders_query_analyze(gp, query, out);
 
-        if (Aopt)
-            list_nodes(gp, NULL, NULL, qfmt); 
-        else {
-            query = argv[optind++];
-            list_nodes(gp, query, excludequery, qfmt);
+        if (rv < 0) {
+            _gend_error(gp, query);
+            return 1;
         }
 
-        exit(0);
+        return 0;
     }
 
     /* Usage 2:  does node have attribute? */
-    if (!qopt && !Qopt && !Vopt && !lopt && !kopt && !dopt) {
+    if (!opts->Qopt && !opts->Vopt && !opts->lopt) {
         char *node = NULL, *attr = NULL;
         int result;
 
@@ -294,12 +416,12 @@ main(int argc, char *argv[])
             attr = argv[optind++];
         }
 
-        result = test_attr(gp, node, attr, vopt);
-        exit(result ? 0 : 1);
+        result = test_attr(gp, out, node, attr, opts->vopt);
+        return (result > 0 ? 0 : 1);
     }
 
     /* Usage 3:  does node meet query conditions */
-    if (Qopt) {
+    if (opts->Qopt) {
         char *node = NULL, *query = NULL;
         int result;
 
@@ -312,86 +434,253 @@ main(int argc, char *argv[])
         }
 
         result = test_query(gp, node, query);
-        exit(result ? 0 : 1);
+        return (result > 0 ? 0 : 1);
     }
 
     /* Usage 4:  output all attribute values */
-    if (Vopt) {
+    if (opts->Vopt) {
         char *attr = NULL;
 
         attr = argv[optind++];
 
-        if (strchr(attr, '='))  /* attr cannot be "attr=val" */
-            usage();
+        if (strchr(attr, '=')) {  /* attr cannot be "attr=val" */
+            usage_print();
+            return 1;
+        }
 
-        list_attr_val(gp, attr, Uopt);
+        if (list_attr_val(gp, out, attr, opts->Uopt) < 0)
+            return 1;
     }
 
     /* Usage 5:  list attributes */
-    if (lopt) {
+    if (opts->lopt) {
         char *node = NULL;
 
         if (optind == argc - 1)
             node = argv[optind++];
 
-        list_attrs(gp, node);
+        if (list_attrs(gp, out, node) < 0)
+            return 1;
     }
 
-    /*NOTREACHED*/
-    exit(0);
+    return 0;
 }
 
-static void 
-list_nodes(genders_t gp, char *query, char *excludequery, fmt_t qfmt)
+/* Split a batch request into arguments on white space.  Single or
+ * double quotes may be used to group words.  argv[0] is set to
+ * "nodeattr" for getopt.  Returns the argument count or -1 on error.
+ */
+static int
+_batch_args(char *line, char *argv[], int maxargs)
+{
+    int argc = 0;
+    char *p = line;
+
+    argv[argc++] = "nodeattr";
+
+    while (1) {
+        char *arg;
+
+        while (isspace((unsigned char)*p))
+            p++;
+
+        if (*p == '\0')
+            break;
+
+        if (argc == maxargs - 1)
+            return -1;
+
+        if (*p == '"' || *p == '\'') {
+            char quote = *p++;
+
+            arg = p;
+            if (!(p = strchr(p, quote)))
+                return -1;
+            *p++ = '\0';
+        }
+        else {
+            arg = p;
+            while (*p != '\0' && !isspace((unsigned char)*p))
+                p++;
+            if (*p != '\0')
+                *p++ = '\0';
+        }
+
+        argv[argc++] = arg;
+    }
+
+    argv[argc] = NULL;
+    return argc;
+}
+
+/* Run one batch request, writing its output to out.  Returns the
+ * exit status nodeattr would have returned for the request.
+ */
+static int
+_batch_request(genders_t gp, char *line, FILE *out)
+{
+    struct nodeattr_options opts;
+    char *argv[BATCH_MAXARGS + 1];
+    int argc;
+
+    if ((argc = _batch_args(line, argv, BATCH_MAXARGS)) < 0) {
+        fprintf(stderr, "nodeattr: invalid batch request\n");
+        return 1;
+    }
+
+    memset(&opts, '\0', sizeof(struct nodeattr_options));
+    opts.qfmt = FMT_HOSTLIST;
+
+    /* Reset getopt for the new argument vector; glibc only fully
+     * reinitializes with optind == 0.
+     */
+#ifdef __GLIBC__
+    optind = 0;
+#else
+    optind = 1;
+#endif
+
+    /* only query usages are allowed, the database is loaded */
+    if (parse_options(argc, argv, &opts) < 0
+        || opts.filename
+        || opts.kopt
+        || opts.dopt
+        || opts.eopt
+        || opts.Copt
+        || opts.Bopt) {
+        usage_print();
+        return 1;
+    }
+
+    return run_query(gp, &opts, out, argc, argv);
+}
+
+/* Read requests from stdin, one per line, in the same syntax as the
+ * query usages on the command line.  For each request a response
+ *
+ * <exit status> <number of lines>
+ * <output line 1>
+ * ...
+ *
+ * is written to stdout and flushed.  Blank lines are ignored.
+ */
+static void
+batch(genders_t gp)
+{
+    char line[BATCH_BUFLEN];
+
+    while (fgets(line, BATCH_BUFLEN, stdin)) {
+        char *p = line;
+        char *buf = NULL;
+        size_t len = 0, i;
+        int rv, lines, unterminated;
+
+        while (isspace((unsigned char)*p))
+            p++;
+        if (*p == '\0')
+            continue;
+
+        if (!strchr(line, '\n') && !feof(stdin)) {
+            int c;
+
+            /* discard the rest of an overlong request */
+            while ((c = getchar()) != EOF && c != '\n')
+                ;
+            fprintf(stderr, "nodeattr: batch request too long\n");
+            rv = 1;
+        }
+        else {
+            FILE *out;
+
+            /* Request output is collected in memory so that it can be
+             * counted before it is written.
+             */
+            if (!(out = open_memstream(&buf, &len))) {
+                fprintf(stderr, "open_memstream: %s\n", strerror(errno));
+                exit(1);
+            }
+
+            rv = _batch_request(gp, p, out);
+
+            if (fclose(out)) {
+                fprintf(stderr, "fclose: %s\n", strerror(errno));
+                exit(1);
+            }
+        }
+
+        lines = 0;
+        for (i = 0; i < len; i++) {
+            if (buf[i] == '\n')
+                lines++;
+        }
+        if ((unterminated = (len && buf[len - 1] != '\n')))
+            lines++;
+
+        printf("%d %d\n", rv, lines);
+        if (len)
+            fwrite(buf, 1, len, stdout);
+        if (unterminated)
+            printf("\n");
+        fflush(stdout);
+        free(buf);
+    }
+}
+
+static int 
+list_nodes(genders_t gp, FILE *out, char *query, char *excludequery, fmt_t qfmt)
 {
     char **nodes;
     int i, count;
-    int len;
-    hostlist_t hl;
-    char *str;
+    int len, rv = -1;
+    hostlist_t hl = NULL;
 
     if ((len = genders_nodelist_create(gp, &nodes)) < 0)
-        _gend_error_exit(gp, "genders_nodelist_create");
+        return _gend_error(gp, "genders_nodelist_create");
 
-    if ((count = genders_query(gp, nodes, len, query)) < 0)
-        _gend_error_exit(gp, query);
+    if ((count = genders_query(gp, nodes, len, query)) < 0) {
+        _gend_error(gp, query);
+        goto cleanup;
+    }
 
     /* Create a hostlist containing the list of nodes returned by the query */
     hl = hostlist_create(NULL);
     if (hl == NULL) {
         fprintf(stderr, "nodeattr: hostlist_create failed\n");
-        exit(1);
+        goto cleanup;
     }
     for (i = 0; i < count; i++) {
         if (hostlist_push(hl, nodes[i]) == 0) {
             fprintf(stderr, "nodeattr: hostlist_push failed\n");
-            exit(1);
+            goto cleanup;
         }
     }
 
     if (excludequery) {
         genders_nodelist_clear(gp, nodes);
       
-        if ((count = genders_query(gp, nodes, len, excludequery)) < 0)
-            _gend_error_exit(gp, excludequery);
+        if ((count = genders_query(gp, nodes, len, excludequery)) < 0) {
+            _gend_error(gp, excludequery);
+            goto cleanup;
+        }
     
         /* Do not check return code for == 0, node may not exist in hostlist */
         for (i = 0; i < count; i++)
             hostlist_delete(hl, nodes[i]);
     }
 
-    genders_nodelist_destroy(gp, nodes);
-
     hostlist_sort(hl);
-    str = _rangestr(hl, qfmt);
-    if (strlen(str) > 0)
-        printf("%s\n", str);
-    free(str);
-    hostlist_destroy(hl);
+    rv = _print_rangestr(out, hl, qfmt);
+
+ cleanup:
+    genders_nodelist_destroy(gp, nodes);
+    if (hl)
+        hostlist_destroy(hl);
+    return rv;
 }
 
+/* Returns 1 if node has the attribute, 0 if not, -1 on error */
 static int 
-test_attr(genders_t gp, char *node, char *attr, int vopt)
+test_attr(genders_t gp, FILE *out, char *node, char *attr, int vopt)
 {
     char *val = NULL;
     char *wantval;
@@ -400,40 +689,44 @@ test_attr(genders_t gp, char *node, char *attr, int vopt)
     if ((wantval = strchr(attr, '=')))  /* attr can actually be "attr=val" */
         *wantval++ ='\0';
    
-    if (vopt || wantval)
-        val = _val_create(gp); /* full of nulls initially */
+    if (vopt || wantval) {
+        if (!(val = _val_create(gp))) /* full of nulls initially */
+            return -1;
+    }
 
     if ((res = genders_testattr(gp, node, attr, val, genders_getmaxvallen(gp) + 1)) < 0)
-        _gend_error_exit(gp, "genders_testattr");
-
-    if (vopt) {
-        if (strlen(val) > 0)
-            printf("%s\n", val);
+        _gend_error(gp, "genders_testattr");
+    else {
+        if (vopt) {
+            if (strlen(val) > 0)
+                fprintf(out, "%s\n", val);
+        }
+        if (wantval && strcmp(wantval, val) != 0)
+            res = 0;
     }
-    if (wantval && strcmp(wantval, val) != 0)
-        res = 0;
     if (vopt || wantval)
         free(val);
     return res;
 }
 
+/* Returns 1 if node meets the query conditions, 0 if not, -1 on error */
 static int 
 test_query(genders_t gp, char *node, char *query)
 {
     int res;
 
     if ((res = genders_testquery(gp, node, query)) < 0)
-        _gend_error_exit(gp, "genders_testquery");
+        _gend_error(gp, "genders_testquery");
 
     return res;
 }
 
-static void
-list_attr_val(genders_t gp, char *attr, int Uopt)
+static int
+list_attr_val(genders_t gp, FILE *out, char *attr, int Uopt)
 {
-    char **nodes, **myvallist;
-    char *val;
-    int maxvallen, nlen, ncount, i, ret;
+    char **nodes, **myvallist = NULL;
+    char *val = NULL;
+    int maxvallen, nlen, ncount = 0, i, ret, rv = -1;
     unsigned int val_count = 0;
     
     /* achu: There is currently no library operation that offers
@@ -442,19 +735,24 @@ list_attr_val(genders_t gp, char *attr, int Uopt)
      */
 
     if ((nlen = genders_nodelist_create(gp, &nodes)) < 0)
-        _gend_error_exit(gp, "genders_getnodelist_create");
+        return _gend_error(gp, "genders_getnodelist_create");
 
-    if ((ncount = genders_getnodes(gp, nodes, nlen, attr, NULL)) < 0)
-        _gend_error_exit(gp, "genders_getnodes");
+    if ((ncount = genders_getnodes(gp, nodes, nlen, attr, NULL)) < 0) {
+        _gend_error(gp, "genders_getnodes");
+        ncount = 0;
+        goto cleanup;
+    }
+
+    if ((maxvallen = genders_getmaxvallen(gp)) < 0) {
+        _gend_error(gp, "genders_getmaxvallen");
+        goto cleanup;
+    }
 
     myvallist = (char **)_safe_malloc(ncount * sizeof(char **));
     for (i = 0; i < ncount; i++)
-        myvallist[i] = _val_create(gp);
+        myvallist[i] = (char *)_safe_malloc(maxvallen + 1);
 
-    val = _val_create(gp); /* full of nulls initially */
-
-    if ((maxvallen = genders_getmaxvallen(gp)) < 0)
-        _gend_error_exit(gp, "genders_getmaxvallen");
+    val = (char *)_safe_malloc(maxvallen + 1); /* full of nulls initially */
 
     for (i = 0; i < ncount; i++) {
         memset(val, '\0', maxvallen + 1);
@@ -462,8 +760,10 @@ list_attr_val(genders_t gp, char *attr, int Uopt)
                                     nodes[i],
                                     attr, 
                                     val, 
-                                    maxvallen + 1)) < 0)
-            _gend_error_exit(gp, "genders_testattr");
+                                    maxvallen + 1)) < 0) {
+            _gend_error(gp, "genders_testattr");
+            goto cleanup;
+        }
         if (ret && strlen(val)) {
             int j, store = 0;
             if (Uopt) {
@@ -486,44 +786,59 @@ list_attr_val(genders_t gp, char *attr, int Uopt)
     }
     
     for (i = 0; i < val_count; i++) {
-        printf("%s\n", myvallist[i]);
+        fprintf(out, "%s\n", myvallist[i]);
     }
+    rv = 0;
 
+ cleanup:
     genders_nodelist_destroy(gp, nodes);
-    for (i = 0; i < ncount; i++)
-        free(myvallist[i]);
-    free(myvallist);
+    if (myvallist) {
+        for (i = 0; i < ncount; i++)
+            free(myvallist[i]);
+        free(myvallist);
+    }
     free(val);
+    return rv;
 }
 
-static void 
-list_attrs(genders_t gp, char *node)
+static int 
+list_attrs(genders_t gp, FILE *out, char *node)
 {
     char **attrs, **vals;
     int len, vlen, count, i;
 
     if ((len = genders_attrlist_create(gp, &attrs)) < 0)
-        _gend_error_exit(gp, "genders_attrlist_create");
-    if ((vlen = genders_vallist_create(gp, &vals)) < 0)
-        _gend_error_exit(gp, "genders_vallist_create");
+        return _gend_error(gp, "genders_attrlist_create");
+    if ((vlen = genders_vallist_create(gp, &vals)) < 0) {
+        genders_attrlist_destroy(gp, attrs);
+        return _gend_error(gp, "genders_vallist_create");
+    }
     if (node) {
         if ((count = genders_getattr(gp, attrs, vals, len, node)) < 0)
-            _gend_error_exit(gp, "genders_getattr");
+            _gend_error(gp, "genders_getattr");
     } else {
         if ((count = genders_getattr_all(gp, attrs, len)) < 0)
-            _gend_error_exit(gp, "genders_getattr_all");
+            _gend_error(gp, "genders_getattr_all");
     }
     for (i = 0; i < count; i++)
         if (node && strlen(vals[i]) > 0)
-            printf("%s=%s\n", attrs[i], vals[i]);
+            fprintf(out, "%s=%s\n", attrs[i], vals[i]);
         else
-            printf("%s\n", attrs[i]);
+            fprintf(out, "%s\n", attrs[i]);
     genders_attrlist_destroy(gp, attrs);
     genders_vallist_destroy(gp, vals);
+    return (count < 0 ? -1 : 0);
 }
 
 static void 
 usage(void)
+{
+    usage_print();
+    exit(1);
+}
+
+static void 
+usage_print(void)
 {
     fprintf(stderr,
         "Usage: nodeattr [-f genders] [-q|-c|-n|-s] [-X exclude_query] query\n"
@@ -533,187 +848,283 @@ usage(void)
         "or     nodeattr [-f genders] -V [-U] attr\n"   
         "or     nodeattr [-f genders] -l [node]\n"
         "or     nodeattr [-f genders] -k\n"
-        "or     nodeattr [-f genders] -d genders\n"
+        "or     nodeattr [-f genders] -d genders [--diff-structured]\n"
         "or     nodeattr [-f genders] --expand\n"
         "or     nodeattr [-f genders] --compress\n"
+        "or     nodeattr [-f genders] --batch\n"
+        "or     nodeattr [-f genders] --explain|--analyze query\n"
+        "Usages that load the database also accept --shared\n"
             );
-    exit(1);
 }
 
-static int
-_diff(genders_t gh, genders_t dgh, char *filename, char *dfilename)
+/* A name (node or attribute) and optional value, remembering its
+ * position in the array it was taken from so results can be reported
+ * in the original order.
+ */
+struct diff_entry {
+    char *name;
+    char *val;
+    int index;
+};
+
+static int
+_diff_entry_cmp(const void *x, const void *y)
+{
+    return strcmp(((struct diff_entry *)x)->name, ((struct diff_entry *)y)->name);
+}
+
+static void
+_diff_entries_sort(struct diff_entry *e, char **names, char **vals, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        e[i].name = names[i];
+        e[i].val = vals ? vals[i] : NULL;
+        e[i].index = i;
+    }
+    qsort(e, count, sizeof(struct diff_entry), _diff_entry_cmp);
+}
+
+/* Sorted merge of two entry tables.  On return match[i] is the index
+ * in the second array of the name at index i of the first array, or
+ * -1 if it has no match, and dmatch[] likewise for the second array.
+ */
+static void
+_diff_merge(struct diff_entry *e, int count, 
+            struct diff_entry *de, int dcount,
+            int *match, int *dmatch)
+{
+    int i = 0, j = 0, rv;
+
+    for (i = 0; i < count; i++)
+        match[i] = -1;
+    for (j = 0; j < dcount; j++)
+        dmatch[j] = -1;
+
+    i = j = 0;
+    while (i < count && j < dcount) {
+        if (!(rv = strcmp(e[i].name, de[j].name))) {
+            match[e[i].index] = de[j].index;
+            dmatch[de[j].index] = e[i].index;
+            i++;
+            j++;
+        }
+        else if (rv < 0)
+            i++;
+        else
+            j++;
+    }
+}
+
+static int
+_diff_entries_find(struct diff_entry *e, int count, char *name)
+{
+    struct diff_entry key;
+
+    key.name = name;
+    return bsearch(&key, e, count, sizeof(struct diff_entry), _diff_entry_cmp) ? 1 : 0;
+}
+
+/* Per-database state for a diff */
+struct diff_db {
+    genders_t gh;
+    char *filename;
+    char **nodes;
+    int maxnodes, numnodes;
+    char **attrs;
+    int maxattrs, numattrs;
+    struct diff_entry *nodeentries;
+    struct diff_entry *attrentries;
+    int *nodematch;
+    int *attrmatch;
+    /* per node scratch space */
+    char **nattrs;
+    char **nvals;
+    int nattrscount;
+    struct diff_entry *nentries;
+    int *nmatch;
+};
+
+static void
+_diff_db_setup(struct diff_db *db)
+{
+    genders_t gh = db->gh;
+
+    if ((db->maxnodes = genders_nodelist_create(gh, &db->nodes)) < 0)
+        _gend_error_exit(gh, "genders_nodelist_create");
+
+    if ((db->numnodes = genders_getnodes(gh, db->nodes, db->maxnodes, NULL, NULL)) < 0)
+        _gend_error_exit(gh, "genders_getnodes");
+
+    if ((db->maxattrs = genders_attrlist_create(gh, &db->attrs)) < 0)
+        _gend_error_exit(gh, "genders_attrlist_create");
+
+    if ((db->numattrs = genders_getattr_all(gh, db->attrs, db->maxattrs)) < 0)
+        _gend_error_exit(gh, "genders_getattr_all");
+
+    if (genders_attrlist_create(gh, &db->nattrs) < 0)
+        _gend_error_exit(gh, "genders_attrlist_create");
+
+    if (genders_vallist_create(gh, &db->nvals) < 0)
+        _gend_error_exit(gh, "genders_vallist_create");
+
+    db->nattrscount = 0;
+
+    db->nodeentries = _safe_malloc(sizeof(struct diff_entry) * (db->numnodes + 1));
+    db->nodematch = _safe_malloc(sizeof(int) * (db->numnodes + 1));
+    _diff_entries_sort(db->nodeentries, db->nodes, NULL, db->numnodes);
+
+    db->attrentries = _safe_malloc(sizeof(struct diff_entry) * (db->numattrs + 1));
+    db->attrmatch = _safe_malloc(sizeof(int) * (db->numattrs + 1));
+    _diff_entries_sort(db->attrentries, db->attrs, NULL, db->numattrs);
+
+    db->nentries = _safe_malloc(sizeof(struct diff_entry) * (db->maxattrs + 1));
+    db->nmatch = _safe_malloc(sizeof(int) * (db->maxattrs + 1));
+}
+
+static void
+_diff_db_cleanup(struct diff_db *db)
+{
+    (void)genders_nodelist_destroy(db->gh, db->nodes);
+    (void)genders_attrlist_destroy(db->gh, db->attrs);
+    (void)genders_attrlist_destroy(db->gh, db->nattrs);
+    (void)genders_vallist_destroy(db->gh, db->nvals);
+    free(db->nodeentries);
+    free(db->nodematch);
+    free(db->attrentries);
+    free(db->attrmatch);
+    free(db->nentries);
+    free(db->nmatch);
+}
+
+/* Load the attributes of a node into the per node scratch space and
+ * sort them.
+ */
+static void
+_diff_db_node(struct diff_db *db, char *node)
 {
-    char **nodes = NULL, **dnodes = NULL;
-    int maxnodes, dmaxnodes, numnodes, dnumnodes;
-    char **attrs = NULL, **dattrs = NULL;
-    int maxattrs, dmaxattrs, numattrs, dnumattrs;
-    char **vals = NULL, **dvals = NULL, *dvalbuf = NULL;
-    int maxvals, dmaxvals, dmaxvallen;
-    int i, j, rv, errcount = 0;
+    int i;
 
-    /* Test #1: Determine if nodes match */
+    /* genders_getattr() leaves vals of attrs without values alone */
+    for (i = 0; i < db->nattrscount; i++)
+        db->nvals[i][0] = '\0';
 
-    if ((maxnodes = genders_nodelist_create(gh, &nodes)) < 0)
-        _gend_error_exit(gh, "genders_nodelist_create");
+    if ((db->nattrscount = genders_getattr(db->gh, 
+                                           db->nattrs, 
+                                           db->nvals, 
+                                           db->maxattrs, 
+                                           node)) < 0)
+        _gend_error_exit(db->gh, "genders_getattr");
 
-    if ((numnodes = genders_getnodes(gh, nodes, maxnodes, NULL, NULL)) < 0)
-        _gend_error_exit(gh, "genders_getnodes");
+    _diff_entries_sort(db->nentries, db->nattrs, db->nvals, db->nattrscount);
+}
 
-    if ((dmaxnodes = genders_nodelist_create(dgh, &dnodes)) < 0)
-        _gend_error_exit(gh, "genders_nodelist_create");
+static int
+_diff(struct diff_db *db, struct diff_db *ddb)
+{
+    char *dfilename = ddb->filename;
+    int i, j, errcount = 0;
 
-    if ((dnumnodes = genders_getnodes(dgh, dnodes, dmaxnodes, NULL, NULL)) < 0)
-        _gend_error_exit(dgh, "genders_getnodes");
+    /* Test #1: Determine if nodes match */
 
-    for (i = 0; i < numnodes; i++) {
-        if ((rv = genders_isnode(dgh, nodes[i])) < 0)
-            _gend_error_exit(dgh, "genders_isnode");
+    _diff_merge(db->nodeentries, db->numnodes, 
+                ddb->nodeentries, ddb->numnodes, 
+                db->nodematch, ddb->nodematch);
 
-        if (!rv) {
-            fprintf(stderr, "%s: Node \"%s\" does not exist\n", dfilename, nodes[i]);
+    for (i = 0; i < db->numnodes; i++) {
+        if (db->nodematch[i] < 0) {
+            fprintf(stderr, "%s: Node \"%s\" does not exist\n", dfilename, db->nodes[i]);
             errcount++;
         }
     }
 
-    for (i = 0; i < dnumnodes; i++) {
-        if ((rv = genders_isnode(gh, dnodes[i])) < 0)
-            _gend_error_exit(gh, "genders_isnode");
-
-        if (!rv) {
-            fprintf(stderr, "%s: Contains additional node \"%s\"\n", dfilename, dnodes[i]);
+    for (i = 0; i < ddb->numnodes; i++) {
+        if (ddb->nodematch[i] < 0) {
+            fprintf(stderr, "%s: Contains additional node \"%s\"\n", dfilename, ddb->nodes[i]);
             errcount++;
         }
     }
 
     /* Test #2: Determine if attributes match */
 
-    if ((maxattrs = genders_attrlist_create(gh, &attrs)) < 0)
-        _gend_error_exit(gh, "genders_attrlist_create");
-
-    if ((dmaxattrs = genders_attrlist_create(dgh, &dattrs)) < 0)
-        _gend_error_exit(dgh, "genders_attrlist_create");
-
-    if ((numattrs = genders_getattr_all(gh, attrs, maxattrs)) < 0)
-        _gend_error_exit(gh, "genders_getattr_all");
-
-    if ((dnumattrs = genders_getattr_all(dgh, dattrs, dmaxattrs)) < 0)
-        _gend_error_exit(dgh, "genders_getattr_all");
+    _diff_merge(db->attrentries, db->numattrs,
+                ddb->attrentries, ddb->numattrs,
+                db->attrmatch, ddb->attrmatch);
 
-    for (i = 0; i < numattrs; i++) {
-        if ((rv = genders_isattr(dgh, attrs[i])) < 0)
-            _gend_error_exit(dgh, "genders_isattr");
-
-        if (!rv) {
-            fprintf(stderr, "%s: Attribute \"%s\" does not exist\n", dfilename, attrs[i]);
+    for (i = 0; i < db->numattrs; i++) {
+        if (db->attrmatch[i] < 0) {
+            fprintf(stderr, "%s: Attribute \"%s\" does not exist\n", dfilename, db->attrs[i]);
             errcount++;
         }
     }
 
-    for (i = 0; i < dnumattrs; i++) {
-        if ((rv = genders_isattr(gh, dattrs[i])) < 0)
-            _gend_error_exit(gh, "genders_isattr");
-
-        if (!rv) {
-            fprintf(stderr, "%s: Contains additional attribute \"%s\"\n", dfilename, dattrs[i]);
+    for (i = 0; i < ddb->numattrs; i++) {
+        if (ddb->attrmatch[i] < 0) {
+            fprintf(stderr, "%s: Contains additional attribute \"%s\"\n", dfilename, ddb->attrs[i]);
             errcount++;
         }
     }
     
     /* Test #3: For each node, are the attributes and values identical */
 
-    if ((maxvals = genders_vallist_create(gh, &vals)) < 0)
-        _gend_error_exit(gh, "genders_vallist_create");
-
-    if ((dmaxvals = genders_vallist_create(dgh, &dvals)) < 0)
-        _gend_error_exit(dgh, "genders_vallist_create");
-
-    if ((dmaxvallen = genders_getmaxvallen(dgh)) < 0)
-        _gend_error_exit(dgh, "genders_maxvallen");
-
-    if (!(dvalbuf = malloc(dmaxvallen + 1))) {
-        fprintf(stderr, "nodeattr: out of memory\n");
-        exit(1);
-    }
-
-    for (i = 0; i < numnodes; i++) {
+    for (i = 0; i < db->numnodes; i++) {
+        char *node = db->nodes[i];
 
         /* Don't bother if the node doesn't exist, this issue has been
          * output already 
          */
-        if ((rv = genders_isnode(dgh, nodes[i])) < 0)
-            _gend_error_exit(dgh, "genders_isnode");
-
-        if (!rv)
+        if (db->nodematch[i] < 0)
             continue;
 
-        if (genders_attrlist_clear(gh, attrs) < 0)
-            _gend_error_exit(gh, "genders_attrlist_clear");
-
-        if (genders_vallist_clear(gh, vals) < 0)
-            _gend_error_exit(gh, "genders_vallist_clear");
+        _diff_db_node(db, node);
+        _diff_db_node(ddb, node);
 
-        if (genders_attrlist_clear(dgh, dattrs) < 0)
-            _gend_error_exit(dgh, "genders_attrlist_clear");
+        _diff_merge(db->nentries, db->nattrscount,
+                    ddb->nentries, ddb->nattrscount,
+                    db->nmatch, ddb->nmatch);
 
-        if (genders_vallist_clear(dgh, dvals) < 0)
-            _gend_error_exit(dgh, "genders_vallist_clear");
+        for (j = 0; j < db->nattrscount; j++) {
+            char *val, *dval;
 
-        if ((numattrs = genders_getattr(gh, 
-                                        attrs, 
-                                        vals, 
-                                        maxattrs, 
-                                        nodes[i])) < 0)
-          _gend_error_exit(gh, "genders_getattr");
-        
-        for (j = 0; j < numattrs; j++) {
-          
-            /* Don't bother if the attribute doesn't exist, this issue
-             * has been output already
-             */
-            if ((rv = genders_isattr(dgh, attrs[j])) < 0)
-                _gend_error_exit(dgh, "genders_isattr");
-
-            if (!rv)
-                continue;
-
-            memset(dvalbuf, '\0', dmaxvallen + 1);
-          
-            if ((rv = genders_testattr(dgh, 
-                                       nodes[i], 
-                                       attrs[j], 
-                                       dvalbuf, 
-                                       dmaxvallen + 1)) < 0)
-                _gend_error_exit(dgh, "genders_testattr");
+            if (db->nmatch[j] < 0) {
+                /* Don't bother if the attribute doesn't exist, this
+                 * issue has been output already
+                 */
+                if (!_diff_entries_find(ddb->attrentries, ddb->numattrs, db->nattrs[j]))
+                    continue;
 
-            if (!rv) {
                 fprintf(stderr, "%s: Node \"%s\" does not "
                         "contain attribute \"%s\"\n", 
-                        dfilename, nodes[i], attrs[j]);
+                        dfilename, node, db->nattrs[j]);
                 errcount++;
                 continue;
             }
 
-            if (strlen(vals[j])) {
-                if (strcmp(vals[j], dvalbuf)) {
-                    if (strlen(dvalbuf)) {
+            val = db->nvals[j];
+            dval = ddb->nvals[db->nmatch[j]];
+
+            if (strlen(val)) {
+                if (strcmp(val, dval)) {
+                    if (strlen(dval)) {
                         fprintf(stderr, "%s: Node \"%s\", attribute \"%s\" has "
                                 "a different value \"%s\"\n",
-                                dfilename, nodes[i], attrs[j], dvalbuf);
+                                dfilename, node, db->nattrs[j], dval);
                     }
                     else {
                         fprintf(stderr, "%s: Node \"%s\", attribute \"%s\" does "
                                 "not have a value\n",
-                                dfilename, nodes[i], attrs[j]);
+                                dfilename, node, db->nattrs[j]);
                     }
                     errcount++;
                     continue;
                 }
             }
             else {
-                if (strlen(dvalbuf)) {
+                if (strlen(dval)) {
                     fprintf(stderr, "%s: Node \"%s\", attribute \"%s\" has "
                             "a value \"%s\"\n",
-                            dfilename, nodes[i], attrs[j], dvalbuf);
+                            dfilename, node, db->nattrs[j], dval);
                     errcount++;
                     continue;
                 }
@@ -724,83 +1135,214 @@ _diff(genders_t gh, genders_t dgh, char *filename, char *dfilename)
          * case.  Only for existence of attributes.
          */
 
-        if ((dnumattrs = genders_getattr(dgh, 
-                                         dattrs, 
-                                         dvals, 
-                                         dmaxattrs, 
-                                         nodes[i])) < 0)
-          _gend_error_exit(dgh, "genders_getattr");
-        
-        for (j = 0; j < dnumattrs; j++) {
+        for (j = 0; j < ddb->nattrscount; j++) {
+
+            if (ddb->nmatch[j] >= 0)
+                continue;
 
             /* Don't bother if the attribute doesn't exist, this issue
              * has been output already
              */
-            if ((rv = genders_isattr(gh, dattrs[j])) < 0)
-                _gend_error_exit(dgh, "genders_isattr");
-
-            if (!rv)
+            if (!_diff_entries_find(db->attrentries, db->numattrs, ddb->nattrs[j]))
                 continue;
 
-            if ((rv = genders_testattr(gh, 
-                                       nodes[i], 
-                                       dattrs[j], 
-                                       NULL,
-                                       0)) < 0)
-                _gend_error_exit(gh, "genders_testattr");
-            
-            if (!rv) {
-                if (strlen(dvals[j])) {
-                    fprintf(stderr, "%s: Node \"%s\" contains "
-                            "an additional attribute value pair \"%s=%s\"\n", 
-                            dfilename, nodes[i], dattrs[j], dvals[j]);
-                }
-                else {
-                    fprintf(stderr, "%s: Node \"%s\" contains "
-                            "an additional attribute \"%s\"\n", 
-                            dfilename, nodes[i], dattrs[j]);
-                }
+            if (strlen(ddb->nvals[j])) {
+                fprintf(stderr, "%s: Node \"%s\" contains "
+                        "an additional attribute value pair \"%s=%s\"\n", 
+                        dfilename, node, ddb->nattrs[j], ddb->nvals[j]);
+            }
+            else {
+                fprintf(stderr, "%s: Node \"%s\" contains "
+                        "an additional attribute \"%s\"\n", 
+                        dfilename, node, ddb->nattrs[j]);
+            }
+            errcount++;
+        }
+    }
+
+    return errcount;
+}
+
+static void
+_diff_structured_attrval(char *attr, char *val)
+{
+    if (strlen(val))
+        printf(" %s=%s", attr, val);
+    else
+        printf(" %s", attr);
+}
+
+/* Machine readable diff, one line per difference, ordered by node
+ * name and then attribute name:
+ *
+ * added <node>
+ * removed <node>
+ * added <node> <attr>[=<val>]
+ * removed <node> <attr>[=<val>]
+ * changed <node> <attr>[=<val>] <attr>[=<newval>]
+ */
+static int
+_diff_structured(struct diff_db *db, struct diff_db *ddb)
+{
+    int i = 0, j = 0, rv, errcount = 0;
+
+    while (i < db->numnodes || j < ddb->numnodes) {
+        struct diff_entry *e = &db->nodeentries[i];
+        struct diff_entry *de = &ddb->nodeentries[j];
+        int k = 0, l = 0;
+
+        if (i == db->numnodes)
+            rv = 1;
+        else if (j == ddb->numnodes)
+            rv = -1;
+        else
+            rv = strcmp(e->name, de->name);
+
+        if (rv < 0) {
+            printf("removed %s\n", e->name);
+            errcount++;
+            i++;
+            continue;
+        }
+
+        if (rv > 0) {
+            printf("added %s\n", de->name);
+            errcount++;
+            j++;
+            continue;
+        }
+
+        _diff_db_node(db, e->name);
+        _diff_db_node(ddb, de->name);
+
+        while (k < db->nattrscount || l < ddb->nattrscount) {
+            struct diff_entry *a = &db->nentries[k];
+            struct diff_entry *da = &ddb->nentries[l];
+
+            if (k == db->nattrscount)
+                rv = 1;
+            else if (l == ddb->nattrscount)
+                rv = -1;
+            else
+                rv = strcmp(a->name, da->name);
+
+            if (rv < 0) {
+                printf("removed %s", e->name);
+                _diff_structured_attrval(a->name, a->val);
+                printf("\n");
                 errcount++;
-                continue;
+                k++;
+            }
+            else if (rv > 0) {
+                printf("added %s", e->name);
+                _diff_structured_attrval(da->name, da->val);
+                printf("\n");
+                errcount++;
+                l++;
+            }
+            else {
+                if (strcmp(a->val, da->val)) {
+                    printf("changed %s", e->name);
+                    _diff_structured_attrval(a->name, a->val);
+                    _diff_structured_attrval(da->name, da->val);
+                    printf("\n");
+                    errcount++;
+                }
+                k++;
+                l++;
             }
         }
+
+        i++;
+        j++;
     }
 
-    (void)genders_nodelist_destroy(gh, nodes);
-    (void)genders_nodelist_destroy(dgh, dnodes);
-    (void)genders_attrlist_destroy(gh, attrs);
-    (void)genders_attrlist_destroy(dgh, dattrs);
-    (void)genders_vallist_destroy(gh, vals);
-    (void)genders_vallist_destroy(dgh, dvals);
-    free(dvalbuf);
     return errcount;
 }
 
-static void 
-diff_genders(char *filename, char *dfilename)
+struct diff_load_data {
+    genders_t gh;
+    char *filename;
+    int rv;
+};
+
+static void *
+_diff_load(void *arg)
 {
-    genders_t gh, dgh;
+    struct diff_load_data *dld = (struct diff_load_data *)arg;
+
+    dld->rv = genders_load_data(dld->gh, dld->filename);
+    return NULL;
+}
 
-    gh = genders_handle_create();
-    if (!gh) {
+static int
+diff_genders(char *filename, char *dfilename, int structured)
+{
+    struct diff_load_data ld, dld;
+    struct diff_db db, ddb;
+    int errcount;
+#if WITH_PTHREADS
+    pthread_t thread;
+    int thread_created = 0;
+#endif /* WITH_PTHREADS */
+
+    memset(&db, '\0', sizeof(struct diff_db));
+    memset(&ddb, '\0', sizeof(struct diff_db));
+
+    ld.gh = genders_handle_create();
+    if (!ld.gh) {
         fprintf(stderr, "nodeattr: out of memory\n");
         exit(1);
     }
+    ld.filename = filename;
 
-    dgh = genders_handle_create();
-    if (!dgh) {
+    dld.gh = genders_handle_create();
+    if (!dld.gh) {
         fprintf(stderr, "nodeattr: out of memory\n");
         exit(1);
     }
+    dld.filename = dfilename;
+
+    /* The databases are independent, so load them concurrently when
+     * we can.  Fall back to loading serially if a thread cannot be
+     * created.
+     */
+#if WITH_PTHREADS
+    if (!pthread_create(&thread, NULL, _diff_load, &dld))
+        thread_created = 1;
+#endif /* WITH_PTHREADS */
+
+    _diff_load(&ld);
+
+#if WITH_PTHREADS
+    if (thread_created)
+        pthread_join(thread, NULL);
+    else
+#endif /* WITH_PTHREADS */
+        _diff_load(&dld);
     
-    if (genders_load_data(gh, filename) < 0)
-        _gend_error_exit(gh, filename);
+    if (ld.rv < 0)
+        _gend_error_exit(ld.gh, filename);
     
-    if (genders_load_data(dgh, dfilename) < 0)
-        _gend_error_exit(dgh, dfilename);
+    if (dld.rv < 0)
+        _gend_error_exit(dld.gh, dfilename);
+
+    db.gh = ld.gh;
+    db.filename = filename;
+    ddb.gh = dld.gh;
+    ddb.filename = dfilename;
 
-    if (_diff(gh, dgh, filename, dfilename) != 0)
-        return;
+    _diff_db_setup(&db);
+    _diff_db_setup(&ddb);
+
+    if (structured)
+        errcount = _diff_structured(&db, &ddb);
+    else
+        errcount = _diff(&db, &ddb);
+
+    _diff_db_cleanup(&db);
+    _diff_db_cleanup(&ddb);
+    return errcount;
 }
 
 static void
@@ -855,7 +1397,10 @@ expand(genders_t gp)
         exit(1);
     }
 
-    while ((node = hostlist_next(hlitr))) {
+    /* every node name is formatted into the same buffer */
+    node = (char *)_safe_malloc(maxnodenamelen + 1);
+
+    while (hostlist_next_host(hlitr, node, maxnodenamelen + 1) > 0) {
         if (genders_attrlist_clear(gp, attrs) < 0)
             _gend_error_exit(gp, "genders_attrlist_clear");
 
@@ -884,27 +1429,56 @@ expand(genders_t gp)
         }
 
         printf("\n");
-        free(node);
     }
 
+    free(node);
+    hostlist_iterator_destroy(hlitr);
     genders_nodelist_destroy(gp, nodes);
     genders_attrlist_destroy(gp, attrs);
     genders_vallist_destroy(gp, vals);
     hostlist_destroy(hl);
 }
 
+/* Nodes are identified by their ordinal, i.e. their index into the
+ * node list returned by genders_getnodes().  Every attr or attr=val
+ * key collects the ordinals of the nodes that have it.  Because
+ * nodes are walked in ordinal order, each set is built already
+ * sorted and two keys share a host set iff their ordinal arrays are
+ * identical.
+ */
 struct hosts_data {
     char *key;
-    hostlist_t hl;
+    int *ords;
+    int ordscount;
+    int ordslen;
+    unsigned int fingerprint;
+    unsigned int slot;
+    int index;
+};
+
+struct hash_attrval_data {
+    hash_t hattr;
+    struct hosts_data **hds;
+    int count;
+    int len;
 };
 
 struct attr_list {
     char *hostrange;
+    unsigned int hostrangelen;
+    int index;
     List l;
 };
 
+struct hash_hostrange_data {
+    char **nodes;
+    hash_t hset;
+    hash_t hrange;
+};
+
 struct store_hostrange_data {
-    List hlist;
+    struct attr_list **hranges;
+    int count;
     unsigned int maxhostrangelen;
 };
 
@@ -914,7 +1488,7 @@ _hosts_data_del(void *data)
     struct hosts_data *hd = (struct hosts_data *)data;
 
     free(hd->key);
-    hostlist_destroy(hd->hl);
+    free(hd->ords);
     free(hd);
 }
 
@@ -928,96 +1502,138 @@ _attr_list_del(void *data)
     free(al);
 }
 
-static void
-_hash_attrval(hash_t hattr, char *node, char *attr, char *val)
+static unsigned int
+_hosts_data_fingerprint(const struct hosts_data *hd)
 {
-    struct hosts_data *hd = NULL;
-    char *hashkey = NULL;
-    int keylen, attrlen, vallen;
-    
-    assert(hattr && node && attr && val);
+    return hd->fingerprint;
+}
 
-    attrlen = strlen(attr);
-    vallen = strlen(val);
-    keylen = attrlen + vallen;
+static int
+_hosts_data_cmp(const struct hosts_data *hd1, const struct hosts_data *hd2)
+{
+    if (hd1->fingerprint != hd2->fingerprint
+        || hd1->ordscount != hd2->ordscount)
+        return 1;
 
-    /* for equal sign */
-    if (vallen)
-        keylen++;
+    return memcmp(hd1->ords, hd2->ords, sizeof(int) * hd1->ordscount);
+}
 
-    /* for NUL char */
-    keylen++;
-    
-    if (!(hashkey = (char *)malloc(keylen))) {
-        fprintf(stderr, "malloc: %s\n", strerror(errno));
-        exit(1);
-    }
+/* Earlier versions walked attr=val keys in the order of a hash table
+ * with (numattrs + 1) * 4 slots, which is far too small to search
+ * once per-node values are involved.  Keys are now found through a
+ * properly sized table, and this reproduces the old walk: ascending
+ * slot, newest insertion first within a slot.
+ */
+static int
+_hosts_data_order_cmp(const void *x, const void *y)
+{
+    struct hosts_data *hd1 = *(struct hosts_data **)x;
+    struct hosts_data *hd2 = *(struct hosts_data **)y;
 
-    if (vallen)
-        snprintf(hashkey, keylen, "%s=%s", attr, val);
+    if (hd1->slot < hd2->slot)
+        return -1;
+    else if (hd1->slot > hd2->slot)
+        return 1;
     else
-        snprintf(hashkey, keylen, "%s", attr);
+        return hd2->index - hd1->index;
+}
 
-    if (!(hd = hash_find(hattr, hashkey))) {
-        if (!(hd = (struct hosts_data *)malloc(sizeof(struct hosts_data)))) {
-            fprintf(stderr, "malloc: %s\n", strerror(errno));
-            exit(1);
-        }
+static void
+_hash_attrval(struct hash_attrval_data *had, int ord, char *key)
+{
+    struct hosts_data *hd = NULL;
+
+    assert(had && ord >= 0 && key);
 
-        hd->key = hashkey;
-        if (!(hd->hl = hostlist_create(NULL))) {
-            fprintf(stderr, "hostlist_create: %s\n", strerror(errno));
+    if (!(hd = hash_find(had->hattr, key))) {
+        hd = (struct hosts_data *)_safe_malloc(sizeof(struct hosts_data));
+
+        if (!(hd->key = strdup(key))) {
+            fprintf(stderr, "strdup: %s\n", strerror(errno));
             exit(1);
         }
 
-        if (!hash_insert(hattr, hd->key, hd)) {
+        if (!hash_insert(had->hattr, hd->key, hd)) {
             fprintf(stderr, "hash_insert: %s\n", strerror(errno));
             exit(1);
         }
+
+        if (had->count == had->len) {
+            had->len = had->len ? had->len * 2 : 64;
+            if (!(had->hds = (struct hosts_data **)realloc(had->hds, sizeof(struct hosts_data *) * had->len))) {
+                fprintf(stderr, "realloc: %s\n", strerror(errno));
+                exit(1);
+            }
+        }
+        hd->index = had->count;
+        had->hds[had->count++] = hd;
     }
-    else
-        free(hashkey);
 
-    if (!hostlist_push(hd->hl, node)) {
-        fprintf(stderr, "hostlist_push: %s\n", strerror(errno));
-        exit(1);
+    if (hd->ordscount == hd->ordslen) {
+        hd->ordslen = hd->ordslen ? hd->ordslen * 2 : 4;
+        if (!(hd->ords = (int *)realloc(hd->ords, sizeof(int) * hd->ordslen))) {
+            fprintf(stderr, "realloc: %s\n", strerror(errno));
+            exit(1);
+        }
     }
+    hd->ords[hd->ordscount++] = ord;
 }
 
-static int
-_hash_hostrange(void *data, const void *key, void *arg)
+static char *
+_ords_rangestr(struct hash_hostrange_data *hhd, struct hosts_data *hd)
 {
-    struct hosts_data *hd = (struct hosts_data *)data;
-    hash_t *hrange = (hash_t *)arg;
-    char hostrange[HOSTLIST_BUFLEN + 1];
-    struct attr_list *al;
-
-    memset(hostrange, '\0', HOSTLIST_BUFLEN + 1);
-
-    hostlist_sort(hd->hl);
+    hostlist_t hl;
+    char *str;
+    ssize_t len;
+    int i;
 
-    if (hostlist_ranged_string(hd->hl, HOSTLIST_BUFLEN, hostrange) < 0) {
-        fprintf(stderr, "hostlist_ranged_string: %s\n", strerror(errno));
+    if (!(hl = hostlist_create(NULL))) {
+        fprintf(stderr, "hostlist_create: %s\n", strerror(errno));
         exit(1);
     }
 
-    if (!(al = hash_find(*hrange, hostrange))) {
-        if (!(al = (struct attr_list *)malloc(sizeof(struct attr_list)))) {
-            fprintf(stderr, "malloc: %s\n", strerror(errno));
-            exit(1);
-        }
-        
-        if (!(al->hostrange = strdup(hostrange))) {
-            fprintf(stderr, "strdup: %s\n", strerror(errno));
+    for (i = 0; i < hd->ordscount; i++) {
+        if (!hostlist_push_host(hl, hhd->nodes[hd->ords[i]])) {
+            fprintf(stderr, "hostlist_push_host: %s\n", strerror(errno));
             exit(1);
         }
-        
+    }
+
+    hostlist_sort(hl);
+
+    len = hostlist_ranged_write(hl, NULL, NULL);
+    str = (char *)_safe_malloc(len + 1);
+    hostlist_ranged_string(hl, len + 1, str);
+
+    hostlist_destroy(hl);
+    return str;
+}
+
+static void
+_hash_hostrange(struct hash_hostrange_data *hhd, struct hosts_data *hd)
+{
+    struct attr_list *al;
+
+    /* Only the first key seen with a given host set pays for
+     * building its range string.
+     */
+    if (!(al = hash_find(hhd->hset, hd))) {
+        al = (struct attr_list *)_safe_malloc(sizeof(struct attr_list));
+
+        al->hostrange = _ords_rangestr(hhd, hd);
+        al->hostrangelen = strlen(al->hostrange);
+
         if (!(al->l = list_create(NULL))) {
             fprintf(stderr, "list_create: %s\n", strerror(errno));
             exit(1);
         }
 
-        if (!hash_insert(*hrange, al->hostrange, al)) {
+        if (!hash_insert(hhd->hrange, al->hostrange, al)) {
+            fprintf(stderr, "hash_insert: %s\n", strerror(errno));
+            exit(1);
+        }
+
+        if (!hash_insert(hhd->hset, hd, al)) {
             fprintf(stderr, "hash_insert: %s\n", strerror(errno));
             exit(1);
         }
@@ -1027,8 +1643,6 @@ _hash_hostrange(void *data, const void *key, void *arg)
         fprintf(stderr, "list_append: %s\n", strerror(errno));
         exit(1);
     }
-
-    return 0;
 }
 
 static int
@@ -1036,50 +1650,41 @@ _store_hostrange(void *data, const void *key, void *arg)
 {
     struct attr_list *al = (struct attr_list *)data;
     struct store_hostrange_data *shd = (struct store_hostrange_data *)arg;
-    unsigned int len;
 
-    if (!list_append(shd->hlist, al)) {
-        fprintf(stderr, "list_append: %s\n", strerror(errno));
-        exit(1);
-    }
+    al->index = shd->count;
+    shd->hranges[shd->count++] = al;
 
-    len = strlen(al->hostrange);
-    if (len > shd->maxhostrangelen)
-        shd->maxhostrangelen = len;
+    if (al->hostrangelen > shd->maxhostrangelen)
+        shd->maxhostrangelen = al->hostrangelen;
 
     return 0;
 }
 
+/* Longest host range first.  Ties keep hash order, the same order
+ * the stable list_sort() used to produce.
+ */
 static int
-_hostrange_cmp(void *x, void *y)
+_hostrange_cmp(const void *x, const void *y)
 {
-    struct attr_list *al1 = (struct attr_list *)x;
-    struct attr_list *al2 = (struct attr_list *)y;
+    struct attr_list *al1 = *(struct attr_list **)x;
+    struct attr_list *al2 = *(struct attr_list **)y;
 
-    if (strlen(al1->hostrange) < strlen(al2->hostrange))
+    if (al1->hostrangelen < al2->hostrangelen)
         return 1;
-    else if (strlen(al1->hostrange) > strlen(al2->hostrange))
+    else if (al1->hostrangelen > al2->hostrangelen)
         return -1;
     else
-        return 0;
+        return al1->index - al2->index;
 }
 
-static int
-_output_hostrange(void *x, void *arg)
+static void
+_output_hostrange(struct attr_list *al, unsigned int maxhostrangelen)
 {
-    struct attr_list *al = (struct attr_list *)x;
-    unsigned int maxhostrangelen = *(unsigned int *)arg;
     char *attrval;
     ListIterator litr;
     int lcount, count = 0;
-    unsigned int numspace;
-    int i;
 
-    printf("%s", al->hostrange);
-    numspace = maxhostrangelen - strlen(al->hostrange);
-    for (i = 0; i < numspace; i++)
-        printf(" ");
-    printf(" ");
+    printf("%-*s ", maxhostrangelen, al->hostrange);
     
     lcount = list_count(al->l);
 
@@ -1102,7 +1707,6 @@ _output_hostrange(void *x, void *arg)
     printf("\n");
 
     list_iterator_destroy(litr);
-    return 0;
 }
 
 static void
@@ -1110,12 +1714,14 @@ compress(genders_t gp)
 {
     char **nodes, **attrs, **vals;
     int nodeslen, attrslen, valslen;
-    int nodescount, attrscount;
-    int numnodes, numattrs;
-    hash_t hattr = NULL;
-    hash_t hrange = NULL;
-    List hlist = NULL;
+    int nodescount, attrscount = 0;
+    int numnodes, numattrs, maxattrlen, maxvallen;
+    unsigned int orderslots;
+    struct hash_attrval_data had;
+    struct hash_hostrange_data hhd;
     struct store_hostrange_data shd;
+    char *key;
+    int keylen;
     int i, j;
 
     /* The basic idea behind this algorithm is that we will find every
@@ -1124,6 +1730,10 @@ compress(genders_t gp)
      * Then, we will find every attr or attr=val combination with the
      * same sets of hosts, than output a compressed hostrange output
      * for those hosts with every appropriate attr/attr=val.
+     *
+     * Host sets are kept as arrays of node ordinals and grouped by
+     * fingerprint, so a range string is only built once per distinct
+     * set rather than once per attr=val.
      */
 
     /* need to treat values w/ raw inputs in order to compress */
@@ -1136,16 +1746,26 @@ compress(genders_t gp)
     if ((numattrs = genders_getnumattrs(gp)) < 0)
         _gend_error_exit(gp, "genders_getnumattrs");
 
+    if ((maxattrlen = genders_getmaxattrlen(gp)) < 0)
+        _gend_error_exit(gp, "genders_getmaxattrlen");
+
+    if ((maxvallen = genders_getmaxvallen(gp)) < 0)
+        _gend_error_exit(gp, "genders_getmaxvallen");
+
     /* numattrs + 1, in case numattrs == 0
      *
      * (numattrs + 1) * 4, is an estimate on attribute=value pair
      * types, b/c we are keying off attr=val pairs, not just the
-     * attribute name.
+     * attribute name.  It is kept only to order the output, see
+     * _hosts_data_order_cmp().
      */
-    if (!(hattr = hash_create((numattrs + 1)*4, 
-                              (hash_key_f)hash_key_string,
-                              (hash_cmp_f)strcmp,
-                              _hosts_data_del))) {
+    orderslots = (numattrs + 1)*4;
+
+    memset(&had, '\0', sizeof(struct hash_attrval_data));
+    if (!(had.hattr = hash_create(orderslots + numnodes, 
+                                  (hash_key_f)hash_key_string,
+                                  (hash_cmp_f)strcmp,
+                                  _hosts_data_del))) {
         fprintf(stderr, "hash_create: %s\n", strerror(errno));
         exit(1);
     }
@@ -1162,74 +1782,112 @@ compress(genders_t gp)
     if ((nodescount = genders_getnodes(gp, nodes, nodeslen, NULL, NULL)) < 0)
         _gend_error_exit(gp, "genders_getnodes");
 
-    for (i = 0; i < nodescount; i++) {
-        if (genders_attrlist_clear(gp, attrs) < 0)
-            _gend_error_exit(gp, "genders_attrlist_clear");
+    /* attr + '=' + val + NUL */
+    keylen = maxattrlen + maxvallen + 2;
+    if (keylen < sizeof(NOATTRSFLAG))
+        keylen = sizeof(NOATTRSFLAG);
+    key = (char *)_safe_malloc(keylen);
 
-        if (genders_vallist_clear(gp, vals) < 0)
-            _gend_error_exit(gp, "genders_vallist_clear");
+    for (i = 0; i < nodescount; i++) {
+        /* genders_getattr() overwrites every attr it returns but
+         * leaves vals alone for attrs without a value, so only the
+         * vals filled in for the previous node need resetting.
+         */
+        for (j = 0; j < attrscount; j++)
+            vals[j][0] = '\0';
 
         if ((attrscount = genders_getattr(gp, attrs, vals, attrslen, nodes[i])) < 0)
             _gend_error_exit(gp, "genders_getattr");
 
         if (!attrscount) {
-            _hash_attrval(hattr, nodes[i], NOATTRSFLAG, "");
+            _hash_attrval(&had, i, NOATTRSFLAG);
             continue;
         }
         
-        for (j = 0 ; j < attrscount; j++)
-            _hash_attrval(hattr, nodes[i], attrs[j], vals[j]);
+        for (j = 0 ; j < attrscount; j++) {
+            if (vals[j][0])
+                snprintf(key, keylen, "%s=%s", attrs[j], vals[j]);
+            else
+                snprintf(key, keylen, "%s", attrs[j]);
+            _hash_attrval(&had, i, key);
+        }
+    }
+
+    free(key);
+
+    for (i = 0; i < had.count; i++) {
+        struct hosts_data *hd = had.hds[i];
+        unsigned int fp = 2166136261U;
+
+        /* FNV-1a over the node ordinals */
+        for (j = 0; j < hd->ordscount; j++) {
+            fp ^= (unsigned int)hd->ords[j];
+            fp *= 16777619U;
+        }
+        hd->fingerprint = fp;
+        hd->slot = hash_key_string(hd->key) % orderslots;
     }
 
+    qsort(had.hds, had.count, sizeof(struct hosts_data *), _hosts_data_order_cmp);
+
     /* Now, find all the common attributes for a particular hostrange */
 
-    if (!(hrange = hash_create(numnodes, 
-                              (hash_key_f)hash_key_string,
-                              (hash_cmp_f)strcmp,
-                              _attr_list_del))) {
+    if (!(hhd.hset = hash_create(numnodes, 
+                                 (hash_key_f)_hosts_data_fingerprint,
+                                 (hash_cmp_f)_hosts_data_cmp,
+                                 NULL))) {
         fprintf(stderr, "hash_create: %s\n", strerror(errno));
         exit(1);
     }
 
-    if (hash_for_each(hattr, _hash_hostrange, &hrange) < 0) {
-        fprintf(stderr, "hash_for_each: %s\n", strerror(errno));
+    /* hrange is never searched, but walking it reproduces the output
+     * order of earlier versions for host ranges of equal length.
+     */
+    if (!(hhd.hrange = hash_create(numnodes, 
+                                   (hash_key_f)hash_key_string,
+                                   (hash_cmp_f)strcmp,
+                                   _attr_list_del))) {
+        fprintf(stderr, "hash_create: %s\n", strerror(errno));
         exit(1);
     }
 
-    if (!(hlist = list_create(NULL))) {
-        fprintf(stderr, "list_create: %s\n", strerror(errno));
-        exit(1);
-    }
+    hhd.nodes = nodes;
 
-    shd.hlist = hlist;
+    for (i = 0; i < had.count; i++)
+        _hash_hostrange(&hhd, had.hds[i]);
+
+    shd.hranges = (struct attr_list **)_safe_malloc(sizeof(struct attr_list *) 
+                                                    * (hash_count(hhd.hrange) + 1));
+    shd.count = 0;
     shd.maxhostrangelen = 0;
 
-    if (hash_for_each(hrange, _store_hostrange, &shd) < 0) {
+    if (hash_for_each(hhd.hrange, _store_hostrange, &shd) < 0) {
         fprintf(stderr, "hash_for_each: %s\n", strerror(errno));
         exit(1);
     }
 
-    list_sort(hlist, _hostrange_cmp);
+    qsort(shd.hranges, shd.count, sizeof(struct attr_list *), _hostrange_cmp);
 
-    if (list_for_each(hlist, _output_hostrange, &shd.maxhostrangelen) < 0) {
-        fprintf(stderr, "list_for_each: %s\n", strerror(errno));
-        exit(1);
-    }
+    for (i = 0; i < shd.count; i++)
+        _output_hostrange(shd.hranges[i], shd.maxhostrangelen);
 
     genders_nodelist_destroy(gp, nodes);
     genders_attrlist_destroy(gp, attrs);
     genders_vallist_destroy(gp, vals);
-    hash_destroy(hattr);
-    hash_destroy(hrange);
-    list_destroy(hlist);
+    free(had.hds);
+    free(shd.hranges);
+    hash_destroy(hhd.hset);
+    hash_destroy(had.hattr);
+    hash_destroy(hhd.hrange);
 }
 
 /**
  ** Utility functions
  **/
 
+/* Report the error of gp for msg.  Returns -1. */
 static int 
-_gend_error_exit(genders_t gp, char *msg)
+_gend_error(genders_t gp, char *msg)
 {
     fprintf(stderr, "nodeattr: %s: %s\n", 
         msg, genders_strerror(genders_errnum(gp)));
@@ -1240,6 +1898,13 @@ _gend_error_exit(genders_t gp, char *msg)
         fprintf(stderr, "nodeattr: use -k to debug errors\n");
 #endif
     }
+    return -1;
+}
+
+static int 
+_gend_error_exit(genders_t gp, char *msg)
+{
+    _gend_error(gp, msg);
     exit(1);
 }
 
@@ -1256,48 +1921,50 @@ _safe_malloc(size_t size)
     return obj;
 }
 
-/* Create a host range string.  Caller must free result. */
-static void *
-_rangestr(hostlist_t hl, fmt_t qfmt)
+static int
+_fwrite_str(void *arg, const char *buf, size_t len)
+{
+    return fwrite(buf, 1, len, (FILE *)arg) == len ? 0 : -1;
+}
+
+/* Print a host range, or its hosts in qfmt, and a newline if it is
+ * not empty.  The string is written as it is built, so memory use
+ * does not grow with the number of hosts.
+ */
+static int
+_print_rangestr(FILE *out, hostlist_t hl, fmt_t qfmt)
 {
-    int size = 65536;
-    char *str = _safe_malloc(size);
+    ssize_t len;
 
-    /* FIXME: hostlist functions are supposed to return -1 on truncation.
-     * This doesn't seem to be working, so make initial size big enough.
-     */
-    if (qfmt == FMT_HOSTLIST) {
-        while (hostlist_ranged_string(hl, size, str) < 0) {
-            free(str); 
-            size += size;
-            str = (char *)_safe_malloc(size);
-        }
-    } else {
-        char sep = qfmt == FMT_SPACE ? ' ' : qfmt == FMT_COMMA ? ',' : '\n';
-        char *p;
+    if (qfmt == FMT_HOSTLIST)
+        len = hostlist_ranged_write(hl, _fwrite_str, out);
+    else {
+        char *sep = qfmt == FMT_SPACE ? " " : qfmt == FMT_COMMA ? "," : "\n";
 
-        while (hostlist_deranged_string(hl, size, str) < 0) {
-            free(str); 
-            size += size;
-            str = (char *)_safe_malloc(size);
-        }
-        for (p = str; p != NULL; ) {
-            if ((p = strchr(p, ',')))
-                *p++ = sep;
-        }
+        len = hostlist_deranged_write(hl, sep, _fwrite_str, out);
     }
-    return str;
+    if (len < 0) {
+        fprintf(stderr, "nodeattr: write: %s\n", strerror(errno));
+        return -1;
+    }
+    if (len > 0)
+        fprintf(out, "\n");
+    return 0;
 }
 
-/* Create a value string.  Caller must free result. */
+/* Create a value string.  Caller must free result.  Returns NULL
+ * on error.
+ */
 static char *
 _val_create(genders_t gp)
 {
     int maxvallen;
     char *val;
 
-    if ((maxvallen = genders_getmaxvallen(gp)) < 0) 
-        _gend_error_exit(gp, "genders_getmaxvallen");
+    if ((maxvallen = genders_getmaxvallen(gp)) < 0) {
+        _gend_error(gp, "genders_getmaxvallen");
+        return NULL;
+    }
     val = (char *)_safe_malloc(maxvallen + 1);
 
     return val;
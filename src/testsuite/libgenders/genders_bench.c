@@ -0,0 +1,208 @@
+/*****************************************************************************\
+ *  $Id$
+ *****************************************************************************
+ *  Copyright (C) 2007-2015 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  Produced at Lawrence Livermore National Laboratory (cf, DISCLAIMER).
+ *  Written by Jim Garlick <garlick@llnl.gov> and Albert Chu <chu11@llnl.gov>.
+ *  UCRL-CODE-2003-004.
+ *
+ *  This file is part of Genders, a cluster configuration database.
+ *  For details, see <http://www.llnl.gov/linux/genders/>.
+ *
+ *  Genders is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Genders is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
+\*****************************************************************************/
+
+/*
+ * Time libgenders lookups on an existing genders database.
+ *
+ * Usage: genders_bench <genders file> [iterations]
+ *
+ * Build with "make genders_bench".  Every lookup is made for every
+ * node, iterations times, using the last attribute listed for the
+ * node, which is the slowest to find on a wide line.  The times
+ * reported are per lookup, and exclude loading the database.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "genders.h"
+
+static genders_t handle;
+static char **nodes;
+static char **lastattrs;
+static char **lastvals;
+static int numnodes;
+static int iterations;
+
+static double
+_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+_err_exit(const char *func)
+{
+  fprintf(stderr, "%s: %s\n", func, genders_errormsg(handle));
+  exit(1);
+}
+
+static void
+_report(const char *name, double start, long ops)
+{
+  printf("%-20s %10.1f ns/op\n", name, (_now() - start) * 1e9 / ops);
+}
+
+/*
+ * _setup
+ *
+ * Load the database, and find the last attribute and value of every
+ * node.
+ */
+static void
+_setup(const char *filename)
+{
+  char **attrlist, **vallist;
+  int attrlist_len, i, count;
+
+  if (!(handle = genders_handle_create()))
+    {
+      fprintf(stderr, "genders_handle_create: out of memory\n");
+      exit(1);
+    }
+
+  if (genders_load_data(handle, filename) < 0)
+    _err_exit("genders_load_data");
+
+  if ((numnodes = genders_nodelist_create(handle, &nodes)) < 0)
+    _err_exit("genders_nodelist_create");
+
+  if ((numnodes = genders_getnodes(handle, nodes, numnodes, NULL, NULL)) < 0)
+    _err_exit("genders_getnodes");
+
+  if ((attrlist_len = genders_attrlist_create(handle, &attrlist)) < 0
+      || genders_vallist_create(handle, &vallist) < 0)
+    _err_exit("genders_attrlist_create");
+
+  if (!(lastattrs = calloc(numnodes, sizeof(char *)))
+      || !(lastvals = calloc(numnodes, sizeof(char *))))
+    {
+      fprintf(stderr, "calloc: out of memory\n");
+      exit(1);
+    }
+
+  for (i = 0; i < numnodes; i++)
+    {
+      if (genders_vallist_clear(handle, vallist) < 0
+          || (count = genders_getattr(handle, attrlist, vallist, attrlist_len, nodes[i])) < 0)
+        _err_exit("genders_getattr");
+
+      if (count)
+        {
+          lastattrs[i] = strdup(attrlist[count - 1]);
+          lastvals[i] = strdup(vallist[count - 1]);
+        }
+    }
+
+  genders_attrlist_destroy(handle, attrlist);
+  genders_vallist_destroy(handle, vallist);
+}
+
+int
+main(int argc, char **argv)
+{
+  char **nodelist;
+  int nodelist_len, i, j;
+  long ops;
+  double start;
+
+  if (argc < 2)
+    {
+      fprintf(stderr, "Usage: genders_bench <genders file> [iterations]\n");
+      exit(1);
+    }
+
+  iterations = argc > 2 ? atoi(argv[2]) : 10;
+
+  start = _now();
+  _setup(argv[1]);
+  printf("%-20s %10.3f s, %d nodes\n", "load", _now() - start, numnodes);
+
+  if (!numnodes)
+    exit(0);
+
+  ops = (long)numnodes * iterations;
+
+  start = _now();
+  for (j = 0; j < iterations; j++)
+    for (i = 0; i < numnodes; i++)
+      if (lastattrs[i] && genders_testattr(handle, nodes[i], lastattrs[i], NULL, 0) != 1)
+        _err_exit("genders_testattr");
+  _report("testattr", start, ops);
+
+  start = _now();
+  for (j = 0; j < iterations; j++)
+    for (i = 0; i < numnodes; i++)
+      if (genders_testattr(handle, nodes[i], "nosuchattr", NULL, 0) != 0)
+        _err_exit("genders_testattr");
+  _report("testattr missing", start, ops);
+
+  start = _now();
+  for (j = 0; j < iterations; j++)
+    for (i = 0; i < numnodes; i++)
+      if (lastattrs[i]
+          && genders_testattrval(handle, nodes[i], lastattrs[i], lastvals[i]) != 1)
+        _err_exit("genders_testattrval");
+  _report("testattrval", start, ops);
+
+  /* each call below may look at every node, times are per node */
+  start = _now();
+  for (j = 0; j < iterations; j++)
+    if (lastattrs[numnodes - 1] && lastvals[numnodes - 1][0]
+        && genders_isattrval(handle, lastattrs[numnodes - 1], lastvals[numnodes - 1]) != 1)
+      _err_exit("genders_isattrval");
+  _report("isattrval", start, ops);
+
+  start = _now();
+  for (j = 0; j < iterations; j++)
+    if (lastattrs[numnodes - 1]
+        && genders_isattrval(handle, lastattrs[numnodes - 1], "nosuchval") != 0)
+      _err_exit("genders_isattrval");
+  _report("isattrval missing", start, ops);
+
+  if ((nodelist_len = genders_nodelist_create(handle, &nodelist)) < 0)
+    _err_exit("genders_nodelist_create");
+  start = _now();
+  for (j = 0; j < iterations; j++)
+    if (lastattrs[0]
+        && genders_getnodes(handle, nodelist, nodelist_len, lastattrs[0], lastvals[0]) < 0)
+      _err_exit("genders_getnodes");
+  _report("getnodes attr=val", start, ops);
+
+  genders_nodelist_destroy(handle, nodelist);
+  genders_nodelist_destroy(handle, nodes);
+  genders_handle_destroy(handle);
+  exit(0);
+}
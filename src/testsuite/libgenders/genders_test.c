@@ -225,9 +225,12 @@ _test_functionality(void)
   errtotal += _functionality(genders_index_attrvals_functionality, "genders_index_attrvals");
   errtotal += _functionality(genders_query_functionality, "genders_query");
   errtotal += _functionality(genders_testquery_functionality, "genders_testquery");
+  errtotal += _functionality(genders_query_explain_functionality, "genders_query_explain");
+  errtotal += _functionality(genders_query_analyze_functionality, "genders_query_analyze");
   errtotal += _functionality(genders_parse_functionality, "genders_parse");
   errtotal += _functionality(genders_set_errnum_functionality, "genders_set_errnum");
   errtotal += _functionality(genders_copy_functionality, "genders_copy");
+  errtotal += _functionality(genders_refresh_functionality, "genders_refresh");
 
   return errtotal;
 }
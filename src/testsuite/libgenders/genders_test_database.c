@@ -1238,6 +1238,86 @@ genders_database_t genders_database_nodes_and_attrs_only_hostrange =
     &genders_database_data_nodes_and_attrs_only,
   };
 
+genders_database_data_t genders_database_data_nodes_and_attrs_only_large_suffix = 
+  {
+    "node1",
+    "attr1",
+    NULL,
+    NULL,
+    4,
+    2,
+    2,
+    24,
+    5,
+    0,
+    {"node1", "node18446744073709551615", "node18446744073709551613", "node18446744073709551614", NULL},
+    4,				
+    {"attr1", "attr2", NULL},
+    2,
+    {NULL},
+    0,
+    {
+      {
+	{"attr1", "attr2", NULL},
+	{"", "", NULL}, 
+	{NULL, NULL, NULL}, 
+	2,
+      },
+      {
+	{"attr1", "attr2", NULL},
+	{"", "", NULL}, 
+	{NULL, NULL, NULL}, 
+	2,
+      },
+      {
+	{"attr1", NULL},
+	{"", NULL}, 
+	{NULL, NULL}, 
+	1,
+      },
+      {
+	{"attr1", NULL},
+	{"", NULL}, 
+	{NULL, NULL}, 
+	1,
+      },
+    },
+    4,
+    {
+      {
+	NULL,
+	NULL,
+	{"node1", "node18446744073709551615", "node18446744073709551613", "node18446744073709551614", NULL},
+	4,
+      },
+      {
+	"",
+	"",
+	{"node1", "node18446744073709551615", "node18446744073709551613", "node18446744073709551614", NULL},
+	4,
+      },
+      {
+	"attr1",
+	NULL,
+	{"node1", "node18446744073709551615", "node18446744073709551613", "node18446744073709551614", NULL},
+	4,
+      },
+      {
+	"attr2",
+	NULL,
+	{"node1", "node18446744073709551615", NULL},
+	2,
+      },
+    },
+    4,
+  };
+
+genders_database_t genders_database_nodes_and_attrs_only_large_suffix = 
+  {
+    "testdatabases/genders.nodes_and_attrs_only_large_suffix",
+    &genders_database_data_nodes_and_attrs_only_large_suffix,
+  };
+
 genders_database_data_t genders_database_data_subst_escape_char = 
   {
     "node1",
@@ -1617,6 +1697,7 @@ genders_database_t *genders_functionality_databases[] =
     &genders_database_nodes_and_attrs_only,
     &genders_database_nodes_and_attrs_only_comma,
     &genders_database_nodes_and_attrs_only_hostrange,
+    &genders_database_nodes_and_attrs_only_large_suffix,
     &genders_database_subst_escape_char,
     &genders_database_subst_nodename,
     &genders_database_subst_nodename_comma,
@@ -108,6 +108,8 @@ typedef struct {
 extern genders_database_t genders_database_not_exist;
 extern genders_database_t genders_database_corner_case;
 extern genders_database_t genders_database_base;
+extern genders_database_t genders_database_test_1;
+extern genders_database_t genders_database_test_2;
 
 extern genders_parse_error_database_t genders_parse_error_databases[];
 
@@ -24,6 +24,10 @@
  *  with Genders.  If not, see <http://www.gnu.org/licenses/>.
 \*****************************************************************************/
 
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>		/* gethostname */
@@ -32,8 +36,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>       	/* stat() */
 #include <errno.h>
+#include <time.h>
 #include <assert.h>
 #include <fcntl.h>       	/* O_APPEND */
+#if WITH_PTHREADS
+#include <pthread.h>
+#endif /* WITH_PTHREADS */
 #if HAVE_PATHS_H
 #include <paths.h>		/* _PATH_DEVNULL */
 #endif /* HAVE_PATHS_H */
@@ -52,6 +60,23 @@
 #define MAXHOSTNAMELEN    64
 #endif /* MAXHOSTNAMELEN */
 
+#ifndef MAXPATHLEN
+#define MAXPATHLEN        4096
+#endif /* MAXPATHLEN */
+
+/* Times the database is replaced by genders_refresh_functionality,
+ * the minimum snapshots queried after each replacement, and seconds
+ * to wait for each replacement to be loaded.
+ */
+#define GENDERS_REFRESH_ROUNDS  20
+#define GENDERS_REFRESH_QUERIES 200
+#define GENDERS_REFRESH_TIMEOUT 10
+
+/* Threads checking snapshots while genders_refresh_functionality
+ * replaces the database.
+ */
+#define GENDERS_REFRESH_THREADS 4
+
 int
 genders_handle_create_functionality(int verbose)
 {
@@ -216,6 +241,218 @@ genders_load_data_functionality(int verbose)
       }
   }
 
+  /* Part C: Find parse errors without expanding the nodes, or
+   * when building a shared image
+   */
+  {
+    unsigned int flags[] = { GENDERS_FLAG_LAZY_NODES, GENDERS_FLAG_SHARED_IMAGE };
+    int f = 0, i = 0;
+    genders_parse_error_database_t *databases = &genders_parse_error_databases[0];
+
+    while (databases[i].filename != NULL)
+      {
+	genders_t handle;
+	int return_value, errnum, err;
+
+	if (!(handle = genders_handle_create()))
+	  genders_err_exit("genders_handle_create");
+
+	if (genders_set_flags(handle, flags[f]) < 0)
+	  genders_err_exit("genders_set_flags: %s", genders_errormsg(handle));
+
+	return_value = genders_load_data(handle, databases[i].filename);
+	errnum = genders_errnum(handle);
+
+	err = genders_return_value_errnum_check("genders_load_data",
+						num,
+						-1,
+						GENDERS_ERR_PARSE,
+						return_value,
+						errnum,
+						databases[i].filename,
+						verbose);
+
+	if (genders_handle_destroy(handle) < 0)
+	  genders_err_exit("genders_handle_destroy");
+
+	errcount += err;
+	num++;
+	if (++f == sizeof(flags) / sizeof(flags[0]))
+	  {
+	    f = 0;
+	    i++;
+	  }
+      }
+  }
+
+  /* Part D: Answer from the unexpanded nodes of the test databases,
+   * and from their shared images, first building then attaching
+   */
+  {
+    unsigned int flags[] = { GENDERS_FLAG_LAZY_NODES, 
+			     GENDERS_FLAG_SHARED_IMAGE, 
+			     GENDERS_FLAG_SHARED_IMAGE };
+    int f = 0, i = 0;
+    genders_database_t **databases = &genders_functionality_databases[0];
+
+    while (databases[i] != NULL)
+      {
+	genders_t handle;
+	genders_database_data_t *data = databases[i]->data;
+	char **nodelist, **attrlist, **vallist;
+	int nodelist_len, attrlist_len, vallist_len;
+	int j, k, return_value, errnum, err = 0;
+
+	if (!(handle = genders_handle_create()))
+	  genders_err_exit("genders_handle_create");
+
+	if (genders_set_flags(handle, flags[f]) < 0)
+	  genders_err_exit("genders_set_flags: %s", genders_errormsg(handle));
+
+	return_value = genders_load_data(handle, databases[i]->filename);
+	errnum = genders_errnum(handle);
+
+	err += genders_return_value_errnum_check("genders_load_data",
+						 num,
+						 0,
+						 GENDERS_ERR_SUCCESS,
+						 return_value,
+						 errnum,
+						 databases[i]->filename,
+						 verbose);
+	if (return_value < 0)
+	  {
+	    if (genders_handle_destroy(handle) < 0)
+	      genders_err_exit("genders_handle_destroy");
+	    errcount += err;
+	    num++;
+	    if (++f == sizeof(flags) / sizeof(flags[0]))
+	      {
+		f = 0;
+		i++;
+	      }
+	    continue;
+	  }
+
+	err += genders_return_value_check("genders_getnumnodes",
+					  num,
+					  data->numnodes,
+					  genders_getnumnodes(handle),
+					  databases[i]->filename,
+					  verbose);
+	err += genders_return_value_check("genders_getmaxattrs",
+					  num,
+					  data->maxattrs,
+					  genders_getmaxattrs(handle),
+					  databases[i]->filename,
+					  verbose);
+	err += genders_return_value_check("genders_getmaxvallen",
+					  num,
+					  data->maxvallen,
+					  genders_getmaxvallen(handle),
+					  databases[i]->filename,
+					  verbose);
+
+	if ((nodelist_len = genders_nodelist_create(handle, &nodelist)) < 0) 
+	  genders_err_exit("genders_nodelist_create: %s", genders_errormsg(handle));
+	if ((attrlist_len = genders_attrlist_create(handle, &attrlist)) < 0) 
+	  genders_err_exit("genders_attrlist_create: %s", genders_errormsg(handle));
+	if ((vallist_len = genders_vallist_create(handle, &vallist)) < 0) 
+	  genders_err_exit("genders_vallist_create: %s", genders_errormsg(handle));
+
+	for (j = 0; j < data->attrval_nodes_len; j++)
+	  {
+	    return_value = genders_getnodes(handle, 
+					    nodelist,
+					    nodelist_len,
+					    data->attrval_nodes[j].attr,
+					    data->attrval_nodes[j].val);
+	    errnum = genders_errnum(handle);
+	    
+	    err += genders_return_value_errnum_list_check("genders_getnodes",
+							  num,
+							  data->attrval_nodes[j].nodeslen,
+							  GENDERS_ERR_SUCCESS,
+							  data->attrval_nodes[j].nodes,
+							  data->attrval_nodes[j].nodeslen,
+							  return_value,
+							  errnum,
+							  nodelist,
+							  return_value,
+							  GENDERS_COMPARISON_MATCH,
+							  databases[i]->filename,
+							  verbose);
+	  }
+
+	for (j = 0; j < data->nodeslen; j++)
+	  {
+	    err += genders_return_value_check("genders_isnode",
+					      num,
+					      1,
+					      genders_isnode(handle, data->nodes[j]),
+					      databases[i]->filename,
+					      verbose);
+
+	    return_value = genders_getattr(handle, 
+					   attrlist, 
+					   vallist, 
+					   attrlist_len, 
+					   data->nodes[j]);
+	    errnum = genders_errnum(handle);
+
+	    err += genders_return_value_errnum_attrval_list_check("genders_getattr",
+								  num,
+								  data->node_attrvals[j].attrslen,
+								  GENDERS_ERR_SUCCESS,
+								  data->node_attrvals[j].attrs,
+								  data->node_attrvals[j].vals_string,
+								  data->node_attrvals[j].attrslen,
+								  return_value,
+								  errnum,
+								  attrlist,
+								  vallist,
+								  return_value,
+								  databases[i]->filename,
+								  verbose);
+
+	    for (k = 0; k < data->node_attrvals[j].attrslen; k++)
+	      err += genders_return_value_check("genders_testattrval",
+						num,
+						1,
+						genders_testattrval(handle,
+								    data->nodes[j],
+								    data->node_attrvals[j].attrs[k],
+								    data->node_attrvals[j].vals_input[k]),
+						databases[i]->filename,
+						verbose);
+	  }
+
+	err += genders_return_value_check("genders_isnode",
+					  num,
+					  0,
+					  genders_isnode(handle, GENDERS_DATABASE_INVALID_NODE),
+					  databases[i]->filename,
+					  verbose);
+
+	if (genders_nodelist_destroy(handle, nodelist) < 0)
+	  genders_err_exit("genders_nodelist_destroy: %s", genders_errormsg(handle));
+	if (genders_attrlist_destroy(handle, attrlist) < 0)
+	  genders_err_exit("genders_attrlist_destroy: %s", genders_errormsg(handle));
+	if (genders_vallist_destroy(handle, vallist) < 0)
+	  genders_err_exit("genders_vallist_destroy: %s", genders_errormsg(handle));
+	if (genders_handle_destroy(handle) < 0)
+	  genders_err_exit("genders_handle_destroy");
+
+	errcount += err;
+	num++;
+	if (++f == sizeof(flags) / sizeof(flags[0]))
+	  {
+	    f = 0;
+	    i++;
+	  }
+      }
+  }
+
   return errcount;
 }
 
@@ -590,8 +827,38 @@ _genders_set_flags_raw_values(int *num,
   if ((vallist_len = genders_vallist_create(handle, &vallist)) < 0) 
     genders_err_exit("genders_vallist_create: %s", genders_errormsg(handle));
 
+  /* Search by value first, so the values indexed with %n substituted
+   * must be dropped when the flags change
+   */
+  err = genders_return_value_check("genders_set_flags",
+				   (*num),
+				   1,
+				   genders_isattrval(handle, "escape4", "node1"),
+				   database->filename,
+				   verbose);
+  errcount += err;
+  (*num)++;
+
   if (genders_set_flags(handle, GENDERS_FLAG_RAW_VALUES) < 0)
     genders_err_exit("genders_set_flags: %s", genders_errormsg(handle));
+
+  err = genders_return_value_check("genders_set_flags",
+				   (*num),
+				   1,
+				   genders_isattrval(handle, "escape4", "%n"),
+				   database->filename,
+				   verbose);
+  errcount += err;
+  (*num)++;
+
+  err = genders_return_value_check("genders_set_flags",
+				   (*num),
+				   0,
+				   genders_isattrval(handle, "escape4", "node1"),
+				   database->filename,
+				   verbose);
+  errcount += err;
+  (*num)++;
  
   /* Note: we're cheating, vals_string represents the substituted
    * values, vals_input represents the raw values.  This is not what
@@ -626,6 +893,15 @@ _genders_set_flags_raw_values(int *num,
   if (genders_set_flags(handle, GENDERS_FLAG_DEFAULT) < 0)
     genders_err_exit("genders_set_flags: %s", genders_errormsg(handle));
 
+  err = genders_return_value_check("genders_set_flags",
+				   (*num),
+				   1,
+				   genders_isattrval(handle, "escape4", "node1"),
+				   database->filename,
+				   verbose);
+  errcount += err;
+  (*num)++;
+
   if (genders_attrlist_clear(handle, attrlist) < 0)
     genders_err_exit("genders_attrlist_clear: %s", genders_errormsg(handle));
 
@@ -2674,7 +2950,8 @@ genders_testquery_functionality(int verbose)
 
     while (databases[i] != NULL)
       {
-	int j, return_value, errnum, err;
+	int j, nodelist_len, numnodes, return_value, errnum, err;
+	char **nodelist;
       
 	if (!(handle = genders_handle_create()))
 	  genders_err_exit("genders_handle_create");
@@ -2682,6 +2959,12 @@ genders_testquery_functionality(int verbose)
 	if (genders_load_data(handle, databases[i]->filename) < 0)
 	  genders_err_exit("genders_load_data: %s", genders_errormsg(handle));
 	
+	if ((nodelist_len = genders_nodelist_create(handle, &nodelist)) < 0) 
+	  genders_err_exit("genders_nodelist_create: %s", genders_errormsg(handle));
+
+	if ((numnodes = genders_getnodes(handle, nodelist, nodelist_len, NULL, NULL)) < 0)
+	  genders_err_exit("genders_getnodes: %s", genders_errormsg(handle));
+	
 	j = 0;
 	while (databases[i]->tests->tests[j].query != NULL)
 	  {
@@ -2711,10 +2994,48 @@ genders_testquery_functionality(int verbose)
                     errcount += err;
                   }
               }
+
+            /* Nodes not in the query result */
+            {
+              int k, l;
+
+              for (k = 0; k < numnodes; k++)
+                {
+                  for (l = 0; l < databases[i]->tests->tests[j].nodeslen; l++)
+                    {
+                      if (!strcmp(nodelist[k], databases[i]->tests->tests[j].nodes[l]))
+                        break;
+                    }
+                  if (l < databases[i]->tests->tests[j].nodeslen)
+                    continue;
+
+                  return_value = genders_testquery(handle, 
+                                                   nodelist[k],
+                                                   databases[i]->tests->tests[j].query);
+                  errnum = genders_errnum(handle);
+
+                  sprintf(msgbuf, "%s: %s: \"%s\"", 
+                          databases[i]->filename,
+                          nodelist[k],
+                          databases[i]->tests->tests[j].query);
+                    
+                  err = genders_return_value_errnum_check("genders_testquery",
+                                                          num,
+                                                          0,
+                                                          GENDERS_ERR_SUCCESS,
+                                                          return_value,
+                                                          errnum,
+                                                          msgbuf,
+                                                          verbose);
+                  errcount += err;
+                }
+            }
 	    
 	    j++;
 	  }
 
+	if (genders_nodelist_destroy(handle, nodelist) < 0)
+	  genders_err_exit("genders_nodelist_destroy: %s", genders_errormsg(handle));
 	if (genders_handle_destroy(handle) < 0)
 	  genders_err_exit("genders_handle_destroy");
 	
@@ -2726,6 +3047,256 @@ genders_testquery_functionality(int verbose)
   return errcount;
 }
 
+int
+genders_query_explain_functionality(int verbose)
+{
+  char msgbuf[GENDERS_ERR_BUFLEN];
+  int errcount = 0;
+  int num = 0;
+  FILE *stream;
+
+  if (!(stream = tmpfile()))
+    genders_err_exit("tmpfile: %s", strerror(errno));
+
+  /* Part A: Parse error queries */
+  {
+    genders_t handle;
+    int return_value, errnum, err;
+    int i = 0;
+      
+    if (!(handle = genders_handle_create()))
+      genders_err_exit("genders_handle_create");
+	
+    if (genders_load_data(handle, genders_database_base.filename) < 0)
+      genders_err_exit("genders_load_data: %s", genders_errormsg(handle));
+	
+    while (genders_query_parse_error_tests[i] != NULL)
+      {
+	return_value = genders_query_explain(handle,
+                                             genders_query_parse_error_tests[i],
+                                             stream);
+	errnum = genders_errnum(handle);
+	
+	sprintf(msgbuf, "\"%s\"", genders_query_parse_error_tests[i]);
+	err = genders_return_value_errnum_check("genders_query_explain",
+						num,
+						-1,
+						GENDERS_ERR_SYNTAX,
+						return_value,
+						errnum,
+						msgbuf,
+						verbose);
+	errcount += err;
+	num++;
+	i++;
+      }
+
+    if (genders_handle_destroy(handle) < 0)
+      genders_err_exit("genders_handle_destroy");
+  }
+
+  /* Part B: Plans for queries */
+  {
+    genders_t handle;
+    genders_query_explain_tests_t *tests = &genders_query_explain_tests[0];
+    int return_value, errnum, err;
+    int i = 0;
+
+    if (!(handle = genders_handle_create()))
+      genders_err_exit("genders_handle_create");
+	
+    if (genders_load_data(handle, "testdatabases/genders.query_1") < 0)
+      genders_err_exit("genders_load_data: %s", genders_errormsg(handle));
+
+    while (tests[i].query != NULL)
+      {
+        char planbuf[GENDERS_QUERY_BUFLEN];
+        char *ptr;
+
+        rewind(stream);
+        if (ftruncate(fileno(stream), 0) < 0)
+          genders_err_exit("ftruncate: %s", strerror(errno));
+
+	return_value = genders_query_explain(handle, tests[i].query, stream);
+	errnum = genders_errnum(handle);
+
+        memset(planbuf, '\0', GENDERS_QUERY_BUFLEN);
+        rewind(stream);
+        if (!fgets(planbuf, GENDERS_QUERY_BUFLEN, stream))
+          planbuf[0] = '\0';
+        if ((ptr = strchr(planbuf, '\n')))
+          *ptr = '\0';
+
+	sprintf(msgbuf, "\"%s\"", tests[i].query);
+        err = genders_return_value_errnum_string_check("genders_query_explain",
+                                                       num,
+                                                       0,
+                                                       GENDERS_ERR_SUCCESS,
+                                                       tests[i].plan,
+                                                       return_value,
+                                                       errnum,
+                                                       planbuf,
+                                                       msgbuf,
+                                                       verbose);
+	errcount += err;
+	num++;
+	i++;
+      }
+
+    if (genders_handle_destroy(handle) < 0)
+      genders_err_exit("genders_handle_destroy");
+  }
+
+  /* Part C: Complex queries  */
+  {
+    int i = 0;
+    genders_t handle;
+    genders_query_functionality_tests_t **databases = &genders_query_functionality_tests[0];
+
+    while (databases[i] != NULL)
+      {
+	int j, return_value, errnum, err;
+      
+	if (!(handle = genders_handle_create()))
+	  genders_err_exit("genders_handle_create");
+	
+	if (genders_load_data(handle, databases[i]->filename) < 0)
+	  genders_err_exit("genders_load_data: %s", genders_errormsg(handle));
+	
+	j = 0;
+	while (databases[i]->tests->tests[j].query != NULL)
+	  {
+	    return_value = genders_query_explain(handle, 
+                                                 databases[i]->tests->tests[j].query,
+                                                 stream);
+	    errnum = genders_errnum(handle);
+
+	    sprintf(msgbuf, "%s: \"%s\"", 
+		    databases[i]->filename,
+		    databases[i]->tests->tests[j].query);
+	    err = genders_return_value_errnum_check("genders_query_explain",
+                                                    num,
+                                                    0,
+                                                    GENDERS_ERR_SUCCESS,
+                                                    return_value,
+                                                    errnum,
+                                                    msgbuf,
+                                                    verbose);
+	    errcount += err;
+	    j++;
+	  }
+
+	if (genders_handle_destroy(handle) < 0)
+	  genders_err_exit("genders_handle_destroy");
+	
+	num++;
+	i++;
+      }
+  }
+
+  fclose(stream);
+  return errcount;
+}
+
+int
+genders_query_analyze_functionality(int verbose)
+{
+  char msgbuf[GENDERS_ERR_BUFLEN];
+  int errcount = 0;
+  int num = 0;
+  FILE *stream;
+
+  if (!(stream = fopen(_PATH_DEVNULL, "w")))
+    genders_err_exit("fopen: %s: %s", _PATH_DEVNULL, strerror(errno));
+
+  /* Part A: Parse error queries */
+  {
+    genders_t handle;
+    int return_value, errnum, err;
+    int i = 0;
+      
+    if (!(handle = genders_handle_create()))
+      genders_err_exit("genders_handle_create");
+	
+    if (genders_load_data(handle, genders_database_base.filename) < 0)
+      genders_err_exit("genders_load_data: %s", genders_errormsg(handle));
+	
+    while (genders_query_parse_error_tests[i] != NULL)
+      {
+	return_value = genders_query_analyze(handle,
+                                             genders_query_parse_error_tests[i],
+                                             stream);
+	errnum = genders_errnum(handle);
+	
+	sprintf(msgbuf, "\"%s\"", genders_query_parse_error_tests[i]);
+	err = genders_return_value_errnum_check("genders_query_analyze",
+						num,
+						-1,
+						GENDERS_ERR_SYNTAX,
+						return_value,
+						errnum,
+						msgbuf,
+						verbose);
+	errcount += err;
+	num++;
+	i++;
+      }
+
+    if (genders_handle_destroy(handle) < 0)
+      genders_err_exit("genders_handle_destroy");
+  }
+
+  /* Part B: Complex queries  */
+  {
+    int i = 0;
+    genders_t handle;
+    genders_query_functionality_tests_t **databases = &genders_query_functionality_tests[0];
+
+    while (databases[i] != NULL)
+      {
+	int j, return_value, errnum, err;
+      
+	if (!(handle = genders_handle_create()))
+	  genders_err_exit("genders_handle_create");
+	
+	if (genders_load_data(handle, databases[i]->filename) < 0)
+	  genders_err_exit("genders_load_data: %s", genders_errormsg(handle));
+	
+	j = 0;
+	while (databases[i]->tests->tests[j].query != NULL)
+	  {
+	    return_value = genders_query_analyze(handle, 
+                                                 databases[i]->tests->tests[j].query,
+                                                 stream);
+	    errnum = genders_errnum(handle);
+
+	    sprintf(msgbuf, "%s: \"%s\"", 
+		    databases[i]->filename,
+		    databases[i]->tests->tests[j].query);
+	    err = genders_return_value_errnum_check("genders_query_analyze",
+                                                    num,
+                                                    databases[i]->tests->tests[j].nodeslen,
+                                                    GENDERS_ERR_SUCCESS,
+                                                    return_value,
+                                                    errnum,
+                                                    msgbuf,
+                                                    verbose);
+	    errcount += err;
+	    j++;
+	  }
+
+	if (genders_handle_destroy(handle) < 0)
+	  genders_err_exit("genders_handle_destroy");
+	
+	num++;
+	i++;
+      }
+  }
+
+  fclose(stream);
+  return errcount;
+}
+
 int
 genders_parse_functionality(int verbose)
 {
@@ -3224,3 +3795,318 @@ genders_copy_functionality(int verbose)
   return errcount;
 
 }
+
+/* 
+ * _genders_refresh_replace
+ *
+ * Replace 'dest' with a copy of 'src', written to a temporary file
+ * and renamed over 'dest' as a genders file should be replaced.
+ */
+static void
+_genders_refresh_replace(char *src, char *dest)
+{
+  char tmp[MAXPATHLEN+1];
+  char buf[GENDERS_DATABASE_BUFLEN];
+  FILE *in, *out;
+  size_t len;
+
+  snprintf(tmp, MAXPATHLEN+1, "%s.tmp", dest);
+
+  if (!(in = fopen(src, "r")))
+    genders_err_exit("fopen: %s: %s", src, strerror(errno));
+  if (!(out = fopen(tmp, "w")))
+    genders_err_exit("fopen: %s: %s", tmp, strerror(errno));
+  while ((len = fread(buf, 1, GENDERS_DATABASE_BUFLEN, in)) > 0)
+    {
+      if (fwrite(buf, 1, len, out) != len)
+	genders_err_exit("fwrite: %s: %s", tmp, strerror(errno));
+    }
+  fclose(in);
+  if (fclose(out))
+    genders_err_exit("fclose: %s: %s", tmp, strerror(errno));
+
+  if (rename(tmp, dest) < 0)
+    genders_err_exit("rename: %s: %s", tmp, strerror(errno));
+}
+
+/* 
+ * _genders_refresh_check
+ *
+ * Determine which database a snapshot holds, by its number of
+ * attributes, and check that every lookup in it agrees with that
+ * database.
+ *
+ * Returns the database index on success, -1 on any disagreement
+ */
+static int
+_genders_refresh_check(genders_t snapshot, genders_database_t **databases)
+{
+  genders_database_data_t *data;
+  char **nodelist;
+  int nodelist_len, numattrs, i, j, k, rv = -1;
+
+  if ((numattrs = genders_getnumattrs(snapshot)) < 0)
+    genders_err_exit("genders_getnumattrs: %s", genders_errormsg(snapshot));
+
+  for (i = 0; databases[i]; i++)
+    {
+      if (databases[i]->data->numattrs == numattrs)
+	break;
+    }
+  if (!databases[i])
+    return -1;
+  data = databases[i]->data;
+
+  if (genders_getnumnodes(snapshot) != data->numnodes)
+    return -1;
+
+  if ((nodelist_len = genders_nodelist_create(snapshot, &nodelist)) < 0) 
+    genders_err_exit("genders_nodelist_create: %s", genders_errormsg(snapshot));
+
+  for (j = 0; j < data->attrval_nodes_len; j++)
+    {
+      int count;
+
+      if (data->attrval_nodes[j].val)
+	count = genders_getnodes(snapshot,
+				 nodelist,
+				 nodelist_len,
+				 data->attrval_nodes[j].attr,
+				 data->attrval_nodes[j].val);
+      else
+	count = genders_query(snapshot,
+			      nodelist,
+			      nodelist_len,
+			      data->attrval_nodes[j].attr);
+
+      if (count != data->attrval_nodes[j].nodeslen)
+	goto cleanup;
+
+      for (k = 0; k < count; k++)
+	{
+	  int l;
+
+	  for (l = 0; l < data->attrval_nodes[j].nodeslen; l++)
+	    {
+	      if (!strcmp(nodelist[k], data->attrval_nodes[j].nodes[l]))
+		break;
+	    }
+	  if (l == data->attrval_nodes[j].nodeslen)
+	    goto cleanup;
+	}
+    }
+
+  rv = i;
+ cleanup:
+  if (genders_nodelist_destroy(snapshot, nodelist) < 0)
+    genders_err_exit("genders_nodelist_destroy: %s", genders_errormsg(snapshot));
+  return rv;
+}
+
+#if WITH_PTHREADS
+/*
+ * struct genders_refresh_reader
+ *
+ * A thread checking snapshots until told to stop.
+ */
+struct genders_refresh_reader {
+  pthread_t thread;
+  genders_t handle;
+  genders_database_t **databases;
+  int snapshots;
+  int errors;
+};
+
+static pthread_mutex_t _genders_refresh_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int _genders_refresh_stop;
+
+static void *
+_genders_refresh_reader(void *arg)
+{
+  struct genders_refresh_reader *reader = (struct genders_refresh_reader *)arg;
+  int stop = 0;
+
+  while (!stop)
+    {
+      genders_t snapshot;
+
+      if (!(snapshot = genders_refresh_acquire(reader->handle)))
+	{
+	  reader->errors++;
+	  break;
+	}
+
+      if (_genders_refresh_check(snapshot, reader->databases) < 0)
+	reader->errors++;
+
+      if (genders_refresh_release(reader->handle, snapshot) < 0)
+	reader->errors++;
+      reader->snapshots++;
+
+      pthread_mutex_lock(&_genders_refresh_mutex);
+      stop = _genders_refresh_stop;
+      pthread_mutex_unlock(&_genders_refresh_mutex);
+    }
+
+  return NULL;
+}
+#endif /* WITH_PTHREADS */
+
+int
+genders_refresh_functionality(int verbose)
+{
+  genders_database_t *databases[] = 
+    {
+      &genders_database_test_1,
+      &genders_database_test_2,
+      NULL,
+    };
+  char dir[] = "/tmp/genders_refresh.XXXXXX";
+  char filename[MAXPATHLEN+1];
+  genders_t handle, held;
+#if WITH_PTHREADS
+  struct genders_refresh_reader readers[GENDERS_REFRESH_THREADS];
+#endif /* WITH_PTHREADS */
+  int errcount = 0;
+  int num = 0;
+  int return_value, i;
+
+  if (!mkdtemp(dir))
+    genders_err_exit("mkdtemp: %s", strerror(errno));
+  snprintf(filename, MAXPATHLEN+1, "%s/genders", dir);
+
+  _genders_refresh_replace(databases[0]->filename, filename);
+
+  if (!(handle = genders_handle_create()))
+    genders_err_exit("genders_handle_create");
+
+  errcount += genders_return_value_check("genders_refresh_start",
+					 num++,
+					 0,
+					 genders_refresh_start(handle, filename),
+					 filename,
+					 verbose);
+
+  return_value = genders_load_data(handle, filename);
+  errcount += genders_return_value_errnum_check("genders_load_data",
+						num++,
+						-1,
+						GENDERS_ERR_ISLOADED,
+						return_value,
+						genders_errnum(handle),
+						filename,
+						verbose);
+
+  if (!(held = genders_refresh_acquire(handle)))
+    genders_err_exit("genders_refresh_acquire: %s", genders_errormsg(handle));
+
+#if WITH_PTHREADS
+  _genders_refresh_stop = 0;
+  for (i = 0; i < GENDERS_REFRESH_THREADS; i++)
+    {
+      readers[i].handle = handle;
+      readers[i].databases = databases;
+      readers[i].snapshots = 0;
+      readers[i].errors = 0;
+      if (pthread_create(&readers[i].thread, NULL, _genders_refresh_reader, &readers[i]))
+	genders_err_exit("pthread_create");
+    }
+#endif /* WITH_PTHREADS */
+
+  /* Hammer queries while the database is replaced, every snapshot
+   * must be entirely one database or the other.  A snapshot held
+   * across the reload must still answer for the old database, and
+   * no snapshot may be handed to two holders.  Reader threads do
+   * the same concurrently.
+   */
+  for (i = 1; i <= GENDERS_REFRESH_ROUNDS; i++)
+    {
+      int expected = i % 2, found = -1, queries = 0, err = 0;
+      time_t start = time(NULL);
+
+      _genders_refresh_replace(databases[expected]->filename, filename);
+
+      while ((found != expected || queries < GENDERS_REFRESH_QUERIES)
+	     && time(NULL) - start < GENDERS_REFRESH_TIMEOUT)
+	{
+	  genders_t snapshot;
+
+	  if (!(snapshot = genders_refresh_acquire(handle)))
+	    genders_err_exit("genders_refresh_acquire: %s", genders_errormsg(handle));
+
+	  if (snapshot == held)
+	    err++;
+
+	  if ((found = _genders_refresh_check(snapshot, databases)) < 0)
+	    err++;
+
+	  if (genders_refresh_release(handle, snapshot) < 0)
+	    genders_err_exit("genders_refresh_release: %s", genders_errormsg(handle));
+	  queries++;
+	}
+
+      err += genders_return_value_check("genders_refresh_acquire",
+					num++,
+					expected,
+					found,
+					filename,
+					verbose);
+
+      err += genders_return_value_check("genders_refresh_acquire",
+					num++,
+					!expected,
+					_genders_refresh_check(held, databases),
+					filename,
+					verbose);
+
+      if (verbose > 1)
+	fprintf(stderr, "genders_refresh: round %d: %d snapshots\n", i, queries);
+
+      if (genders_refresh_release(handle, held) < 0)
+	genders_err_exit("genders_refresh_release: %s", genders_errormsg(handle));
+      if (!(held = genders_refresh_acquire(handle)))
+	genders_err_exit("genders_refresh_acquire: %s", genders_errormsg(handle));
+
+      errcount += err;
+    }
+
+#if WITH_PTHREADS
+  pthread_mutex_lock(&_genders_refresh_mutex);
+  _genders_refresh_stop = 1;
+  pthread_mutex_unlock(&_genders_refresh_mutex);
+
+  for (i = 0; i < GENDERS_REFRESH_THREADS; i++)
+    {
+      pthread_join(readers[i].thread, NULL);
+
+      if (verbose > 1)
+	fprintf(stderr, "genders_refresh: thread %d: %d snapshots\n", i, readers[i].snapshots);
+
+      errcount += genders_return_value_check("genders_refresh_acquire",
+					     num++,
+					     0,
+					     readers[i].errors,
+					     filename,
+					     verbose);
+    }
+#endif /* WITH_PTHREADS */
+
+  return_value = genders_refresh_release(handle, handle);
+  errcount += genders_return_value_errnum_check("genders_refresh_release",
+						num++,
+						-1,
+						GENDERS_ERR_PARAMETERS,
+						return_value,
+						genders_errnum(handle),
+						filename,
+						verbose);
+
+  if (genders_refresh_release(handle, held) < 0)
+    genders_err_exit("genders_refresh_release: %s", genders_errormsg(handle));
+  if (genders_handle_destroy(handle) < 0)
+    genders_err_exit("genders_handle_destroy");
+
+  unlink(filename);
+  rmdir(dir);
+  return errcount;
+}
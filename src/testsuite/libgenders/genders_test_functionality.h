@@ -68,8 +68,11 @@ int genders_isattrval_functionality(int verbose);
 int genders_index_attrvals_functionality(int verbose);
 int genders_query_functionality(int verbose);
 int genders_testquery_functionality(int verbose);
+int genders_query_explain_functionality(int verbose);
+int genders_query_analyze_functionality(int verbose);
 int genders_parse_functionality(int verbose);
 int genders_set_errnum_functionality(int verbose);
 int genders_copy_functionality(int verbose);
+int genders_refresh_functionality(int verbose);
 
 #endif /* _GENDERS_TEST_FUNCTIONALITY_H */
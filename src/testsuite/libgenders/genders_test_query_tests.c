@@ -45,9 +45,41 @@ char *genders_query_parse_error_tests[] =
     "((attr1)",
     "(attr1))",
     "      ",
+    "attr1<",
+    "attr1>=",
+    "attr1<abc",
+    "<3",
+    ">=3",
+    "=3",
+    "1<attr1",
+    "1<=attr1<",
+    "1>attr1>0",
+    "attr1<<3",
+    "attr1<=3=4",
+    "*attr1",
     NULL,
   };
 
+/* First line of the plan for queries against genders.query_1 */
+genders_query_explain_tests_t genders_query_explain_tests[] = 
+  {
+    {"attr3", "attr3 (est 4, attr index)"},
+    {"attr4=val4", "attr4=val4 (est <=4, attr index)"},
+    {"attr4>3", "attr4>3 (est <=4, attr index)"},
+    {"attr4=val*", "attr4=val* (est <=4, attr index)"},
+    {"~attr3", "~attr3 (est 4, attr index)"},
+    {"fakeattr", "fakeattr (est 0, attr index)"},
+    {"attr1&&attr3", "intersection (est <=4, probe)"},
+    {"attr1||attr3", "union (est <=8, scan)"},
+    {"attr3--attr7", "difference (est <=4, probe)"},
+    {"fakeattr&&attr1", "intersection (est 0, empty)"},
+    {"attr3&&~attr7", "difference (est <=4, probe, rewrote A && ~B -> A -- B)"},
+    {"~attr7&&attr3", "difference (est <=4, probe, rewrote ~A && B -> B -- A)"},
+    {"attr3--~attr7", "intersection (est <=4, probe, rewrote A -- ~B -> A && B)"},
+    {"~attr3&&~attr7", "~union (est <=8, scan, rewrote ~A && ~B -> ~(A || B))"},
+    {NULL, NULL},
+  };
+
 genders_query_tests_t genders_query_functionality_tests_query_1_tests =
   {
     {
@@ -869,6 +901,67 @@ genders_query_tests_t genders_query_functionality_tests_query_1_tests =
 	{"node1", "node2", "node3", "node4", "node5", "node6", "node7", "node8", NULL},
 	8,
       },
+      /* complements rewritten by the query planner */
+      {
+	"attr3&&~attr7",
+	{"node2", "node4", NULL},
+	2,
+      },
+      {
+	"~attr7&&attr3",
+	{"node2", "node4", NULL},
+	2,
+      },
+      {
+	"attr3&&~attr8=val8",
+	{"node2", "node4", NULL},
+	2,
+      },
+      {
+	"attr3--~attr7",
+	{"node1", "node3", NULL},
+	2,
+      },
+      {
+	"~attr3&&~attr7",
+	{"node6", "node8", NULL},
+	2,
+      },
+      {
+	"~attr3--attr7",
+	{"node6", "node8", NULL},
+	2,
+      },
+      {
+	"~(attr3&&~attr7)",
+	{"node1", "node3", "node5", "node6", "node7", "node8", NULL},
+	6,
+      },
+      {
+	"(attr3||attr5)&&~(attr7||fakeattr)",
+	{"node2", "node4", "node6", "node8", NULL},
+	4,
+      },
+      {
+	"attr3&&attr9&&~attr10=val10",
+	{NULL},
+	0,
+      },
+      {
+	"fakeattr&&~attr1",
+	{NULL},
+	0,
+      },
+      {
+	"~fakeattr&&attr5",
+	{"node5", "node6", "node7", "node8", NULL},
+	4,
+      },
+      {
+	"attr1=fakeval--~attr3",
+	{NULL},
+	0,
+      },
       {
 	NULL,
 	{NULL},
@@ -2596,6 +2689,247 @@ genders_query_functionality_tests_t genders_query_functionality_tests_query_spec
     &genders_query_functionality_tests_query_special_chars_tests,
   };
 
+genders_query_tests_t genders_query_functionality_tests_query_numeric_tests =
+  {
+    {
+      /* 
+       * Comparison tests, non-numeric values never match
+       */
+      {
+	"mem<64",
+	{"node1", "node2", NULL},
+	2,
+      },
+      {
+	"mem<=64",
+	{"node1", "node2", "node3", NULL},
+	3,
+      },
+      {
+	"mem>64",
+	{"node4", "node5", NULL},
+	2,
+      },
+      {
+	"mem>=64",
+	{"node3", "node4", "node5", NULL},
+	3,
+      },
+      {
+	"32<=mem<256",
+	{"node2", "node3", "node4", NULL},
+	3,
+      },
+      {
+	"32<mem<=256",
+	{"node3", "node4", "node5", NULL},
+	3,
+      },
+      {
+	"5<mem<1",
+	{NULL},
+	0,
+      },
+      {
+	"mem>1000",
+	{NULL},
+	0,
+      },
+      {
+	"mem=64",
+	{"node3", NULL},
+	1,
+      },
+      {
+	"pos<0",
+	{"node1", NULL},
+	1,
+      },
+      {
+	"pos>=-2",
+	{"node1", "node2", "node3", "node4", "node5", NULL},
+	5,
+      },
+      {
+	"speed>3",
+	{"node3", "node5", NULL},
+	2,
+      },
+      {
+	"speed<=3",
+	{"node1", "node2", NULL},
+	2,
+      },
+      {
+	"rack<2",
+	{"node1", "node2", NULL},
+	2,
+      },
+      {
+	"rack>=0",
+	{"node1", "node2", "node3", "node4", "node5", "node6", NULL},
+	6,
+      },
+      {
+	"nosuchattr>1",
+	{NULL},
+	0,
+      },
+      /* 
+       * Comparisons combined with operators
+       */
+      {
+	"compute&&mem>=64",
+	{"node3", "node4", NULL},
+	2,
+      },
+      {
+	"mem>=64--login",
+	{"node3", "node4", NULL},
+	2,
+      },
+      {
+	"mem<32||mem>128",
+	{"node1", "node5", NULL},
+	2,
+      },
+      {
+	"~mem<64",
+	{"node3", "node4", "node5", "node6", "node7", NULL},
+	5,
+      },
+      {
+	"~(rack<=2)&&compute",
+	{"node6", NULL},
+	1,
+      },
+      {
+	NULL,
+	{NULL},
+	0
+      },
+    }
+  };
+
+genders_query_functionality_tests_t genders_query_functionality_tests_query_numeric = 
+  {
+    "testdatabases/genders.query_numeric",
+    &genders_query_functionality_tests_query_numeric_tests,
+  };
+
+genders_query_tests_t genders_query_functionality_tests_query_pattern_tests =
+  {
+    {
+      /* 
+       * Pattern tests, valueless attributes never match
+       */
+      {
+	"switch=ib-core*",
+	{"node1", "node2", NULL},
+	2,
+      },
+      {
+	"switch=ib-*",
+	{"node1", "node2", "node3", "node4", NULL},
+	4,
+      },
+      {
+	"switch=*core*",
+	{"node1", "node2", "node5", NULL},
+	3,
+      },
+      {
+	"switch=ib-edge?",
+	{"node3", "node4", NULL},
+	2,
+      },
+      {
+	"switch=ib-core?",
+	{"node1", NULL},
+	1,
+      },
+      {
+	"switch=*1",
+	{"node1", "node3", "node5", NULL},
+	3,
+      },
+      {
+	"switch=*",
+	{"node1", "node2", "node3", "node4", "node5", NULL},
+	5,
+      },
+      {
+	"switch=x*",
+	{NULL},
+	0,
+      },
+      {
+	"os=rhel9*",
+	{"node1", "node2", "node4", NULL},
+	3,
+      },
+      {
+	"os=rhel9.*",
+	{"node1", "node2", NULL},
+	2,
+      },
+      {
+	"os=rhel?.10",
+	{"node2", "node3", NULL},
+	2,
+      },
+      {
+	"os=rhel9",
+	{"node4", NULL},
+	1,
+      },
+      {
+	"os=node*",
+	{"node6", NULL},
+	1,
+      },
+      {
+	"nosuchattr=*",
+	{NULL},
+	0,
+      },
+      /* 
+       * Patterns combined with operators
+       */
+      {
+	"compute&&switch=*core*",
+	{"node1", "node2", NULL},
+	2,
+      },
+      {
+	"os=rhel*--os=rhel8*",
+	{"node1", "node2", "node4", NULL},
+	3,
+      },
+      {
+	"switch=ib-core*||os=sles*",
+	{"node1", "node2", "node5", NULL},
+	3,
+      },
+      {
+	"~switch=ib-*",
+	{"node5", "node6", NULL},
+	2,
+      },
+      {
+	NULL,
+	{NULL},
+	0
+      },
+    }
+  };
+
+genders_query_functionality_tests_t genders_query_functionality_tests_query_pattern = 
+  {
+    "testdatabases/genders.query_pattern",
+    &genders_query_functionality_tests_query_pattern_tests,
+  };
+
 genders_query_tests_t genders_query_functionality_tests_bugzilla414_1_tests =
   {
     {
@@ -2730,6 +3064,8 @@ genders_query_functionality_tests_t *genders_query_functionality_tests[] =
     &genders_query_functionality_tests_query_2_comma,
     &genders_query_functionality_tests_query_2_hostrange,
     &genders_query_functionality_tests_query_special_chars,
+    &genders_query_functionality_tests_query_numeric,
+    &genders_query_functionality_tests_query_pattern,
     &genders_query_functionality_tests_bugzilla414_1,
     &genders_query_functionality_tests_bugzilla414_2,
     &genders_query_functionality_tests_bugzilla414_3,
@@ -47,7 +47,13 @@ typedef struct {
   genders_query_tests_t *tests;
 } genders_query_functionality_tests_t;
 
+typedef struct {
+  char *query;
+  char *plan;
+} genders_query_explain_tests_t;
+
 extern char *genders_query_parse_error_tests[];
+extern genders_query_explain_tests_t genders_query_explain_tests[];
 extern genders_query_functionality_tests_t *genders_query_functionality_tests[];
 
 #endif /* _GENDERS_TEST_QUERY_TESTS_H */
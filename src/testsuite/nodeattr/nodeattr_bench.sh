@@ -0,0 +1,161 @@
+#!/bin/sh
+##*****************************************************************************
+## Benchmark nodeattr modes against a generated genders database.
+##
+## Usage: nodeattr_bench.sh [numnodes] [numattrs] [mode ...]
+##
+## Defaults to 40000 nodes with 60 attributes each, benchmarking
+## --compress.  The "ranges" mode instead queries a database of
+## numnodes nodes listed as a few large hostranges, and the "rules"
+## mode lists every value of an attribute from a database of numnodes
+## nodes written as one hostrange line per 32 nodes.  The "memory" mode
+## reports the total proportional set size (PSS) of NPROCS (default
+## 100) idle "nodeattr --batch" processes, each loading the database
+## privately and then from a --shared image.  Set NODEATTR to the
+## nodeattr binary to use.
+##*****************************************************************************
+
+numnodes=${1:-40000}
+numattrs=${2:-60}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] && shift
+modes=${*:-compress}
+
+NODEATTR=${NODEATTR:-../../nodeattr/nodeattr}
+db=${TMPDIR:-/tmp}/nodeattr_bench.$$
+
+trap 'rm -f $db $db.diff $db.batch $db.ranges $db.rules $db.fifo' 0 1 2 15
+
+# Attributes are a mix of cluster-wide flags, per-rack and
+# per-chassis values, striped values, and a few per-node unique
+# values, which is roughly what large site databases look like.
+[ "$modes" = ranges -o "$modes" = rules ] || awk -v nodes=$numnodes -v attrs=$numattrs 'BEGIN {
+    for (n = 1; n <= nodes; n++) {
+        line = sprintf("node%d ", n)
+        for (a = 0; a < attrs; a++) {
+            if (a) line = line ","
+            kind = a % 6
+            if (kind == 0)
+                line = line sprintf("flag%d", a)
+            else if (kind == 1)
+                line = line sprintf("rack%d=r%d", a, int((n - 1) / 64))
+            else if (kind == 2)
+                line = line sprintf("chassis%d=c%d", a, int((n - 1) / 8))
+            else if (kind == 3)
+                line = line sprintf("stripe%d=s%d", a, n % 4)
+            else if (kind == 4)
+                line = line sprintf("ip%d=10.%d.%d.%d", a, a, int(n / 256), n % 256)
+            else
+                line = line sprintf("role%d=%s", a, (n <= 16) ? "mgmt" : "compute")
+        }
+        print line
+    }
+}' > $db
+
+now() {
+    date +%s.%N
+}
+
+# memory_pss <nodeattr args ...>
+#
+# Start NPROCS nodeattr --batch processes blocked reading requests,
+# wait until each has loaded the database, and output their total PSS
+# in kB.
+memory_pss() {
+    rm -f $db.fifo
+    mkfifo $db.fifo
+    # hold the fifo open so the readers block instead of seeing EOF
+    exec 3<>$db.fifo
+    pids=
+    i=0
+    while [ $i -lt ${NPROCS:-100} ]; do
+        $NODEATTR -f $db "$@" --batch < $db.fifo > /dev/null 2>&1 3>&- &
+        pids="$pids $!"
+        i=`expr $i + 1`
+    done
+    # loaded once no process is running
+    while grep -q '^State:.*R' `for p in $pids; do echo /proc/$p/status; done` 2>/dev/null; do
+        sleep 1
+    done
+    sleep 1
+    total=`for p in $pids; do cat /proc/$p/smaps_rollup; done 2>/dev/null \
+        | awk '$1 == "Pss:" { kb += $2 } END { print kb + 0 }'`
+    exec 3>&-
+    wait
+    echo $total
+}
+
+for mode in $modes; do
+    if [ $mode = memory ]; then
+        shm_before=`ls /dev/shm 2>/dev/null`
+        # build the image first, so no process loads privately while
+        # another builds it
+        $NODEATTR -f $db --shared -q flag0 > /dev/null 2>&1
+        private=`memory_pss`
+        shared=`memory_pss --shared`
+        # remove the image of the benchmark database, it is deleted
+        for f in `ls /dev/shm 2>/dev/null`; do
+            echo "$shm_before" | grep -qx "$f" || rm -f /dev/shm/$f
+        done
+        echo "$mode: $numnodes nodes, $numattrs attrs, ${NPROCS:-100} processes: private $private kB, shared $shared kB"
+        continue
+    fi
+    case $mode in
+        compress) args="--compress" ;;
+        expand)   args="--expand" ;;
+        query)    args="-q flag0" ;;
+        complement)
+                  # planned as a difference, the complement is never built
+                  args="-c flag0&&~stripe3=s1" ;;
+        diff|diff-structured)
+                  # drop a node and change a value on every 100th node
+                  awk 'NR > 1 { if (NR % 100 == 0) sub(/role5=compute/, "role5=other"); print }' $db > $db.diff
+                  args="-d $db.diff"
+                  [ $mode = diff-structured ] && args="$args --diff-structured" ;;
+        batch)    # 1000 requests answered from a single load
+                  awk -v nodes=$numnodes 'BEGIN {
+                      for (i = 0; i < 1000; i++)
+                          printf "-v node%d rack1\n", i % nodes + 1
+                  }' > $db.batch
+                  args="--batch" ;;
+        ranges)   # a bracketed range holds at most 16384 hosts
+                  awk -v nodes=$numnodes 'BEGIN {
+                      step = 10000
+                      for (lo = 1; lo <= nodes; lo += step) {
+                          hi = (lo + step - 1 < nodes) ? lo + step - 1 : nodes
+                          all = all sprintf("%s%d-%d", all ? "," : "", lo, hi)
+                      }
+                      printf "node[%s] all,compute,os=rhel9\n", all
+                      printf "node[1-%d] rack=r0\n", (nodes < 16) ? nodes : 16
+                      printf "node[1-%d] mgmt,role=head\n", (nodes < 4) ? nodes : 4
+                  }' > $db.ranges
+                  args="-q rack&&~mgmt" ;;
+        rules)    # many rules, each too large to be expanded at load
+                  awk -v nodes=$numnodes 'BEGIN {
+                      for (lo = 1; lo <= nodes; lo += 32) {
+                          hi = (lo + 31 < nodes) ? lo + 31 : nodes
+                          printf "node[%d-%d] compute,chassis=c%d,rack=r%d\n", lo, hi, int(lo / 32), int(lo / 256)
+                      }
+                  }' > $db.rules
+                  args="-V rack" ;;
+        *)        args="$mode" ;;
+    esac
+    start=`now`
+    if [ $mode = batch ]; then
+        $NODEATTR -f $db $args < $db.batch > /dev/null 2>&1
+    elif [ $mode = ranges ]; then
+        $NODEATTR -f $db.ranges $args > /dev/null 2>&1
+    elif [ $mode = rules ]; then
+        $NODEATTR -f $db.rules $args > /dev/null 2>&1
+    else
+        $NODEATTR -f $db $args > /dev/null 2>&1
+    fi
+    rv=$?
+    # --diff-structured exits 1 when the databases differ
+    if [ $rv -ne 0 ] && ! [ $mode = diff-structured -a $rv -eq 1 ]; then
+        echo "nodeattr -f $db $args: failed"
+        exit 1
+    fi
+    end=`now`
+    echo "$mode: $numnodes nodes, $numattrs attrs: `awk -v s=$start -v e=$end 'BEGIN { printf "%.3f", e - s }'` seconds"
+done
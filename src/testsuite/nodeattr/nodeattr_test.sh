@@ -0,0 +1,90 @@
+#!/bin/sh
+##*****************************************************************************
+## Regression tests for nodeattr output.
+##
+## Output of each mode is compared byte for byte against the files in
+## expected/.  Tests run from $srcdir, so databases are named relative
+## to it.  Set NODEATTR to the nodeattr binary to test.
+##*****************************************************************************
+
+srcdir=${srcdir:-.}
+NODEATTR=${NODEATTR:-../../nodeattr/nodeattr}
+NODEATTR=`cd \`dirname $NODEATTR\` && pwd`/`basename $NODEATTR`
+out=${TMPDIR:-/tmp}/nodeattr_test.$$
+
+trap 'rm -f $out' 0 1 2 15
+
+cd $srcdir || exit 1
+
+libdbs=../libgenders/testdatabases
+dbs=testdatabases
+
+failures=0
+
+# check_output <expected file> <expected exit status> <nodeattr args ...>
+check_output() {
+    exp=expected/$1
+    status=$2
+    shift 2
+    $NODEATTR "$@" > $out 2>&1
+    rv=$?
+    if [ $rv -ne $status ]; then
+        echo "FAIL: nodeattr $*: exit status $rv, expected $status"
+        failures=`expr $failures + 1`
+    elif ! cmp -s $exp $out; then
+        echo "FAIL: nodeattr $*: output differs from $exp"
+        diff $exp $out | head -20
+        failures=`expr $failures + 1`
+    fi
+}
+
+for db in $libdbs/genders.base_hostrange \
+          $libdbs/genders.equal_sign_in_value \
+          $libdbs/genders.nodes_and_attrs_only_hostrange \
+          $libdbs/genders.nodes_only_many \
+          $libdbs/genders.query_1 \
+          $libdbs/genders.query_2 \
+          ../../../genders.sample \
+          $dbs/genders.compress_mixed_1 \
+          $dbs/genders.compress_mixed_2; do
+    check_output `basename $db`.compress 0 -f $db --compress
+done
+
+check_output genders.query_1.diff 0 \
+    -f $libdbs/genders.query_1 -d $libdbs/genders.query_2
+check_output genders.diff_mixed_1.diff 0 \
+    -f $dbs/genders.compress_mixed_1 -d $dbs/genders.diff_mixed_1
+check_output genders.diff_mixed_1.rdiff 0 \
+    -f $dbs/genders.diff_mixed_1 -d $dbs/genders.compress_mixed_1
+check_output genders.diff_mixed_1.sdiff 1 \
+    -f $dbs/genders.compress_mixed_1 -d $dbs/genders.diff_mixed_1 --diff-structured
+check_output genders.empty 0 \
+    -f $dbs/genders.compress_mixed_1 -d $dbs/genders.compress_mixed_1 --diff-structured
+
+# batch responses must match running each request on its own
+check_output genders.query_1.batch 0 \
+    -f $libdbs/genders.query_1 --batch < batch.requests
+
+# and from a shared image of the database
+check_output genders.query_1.batch 0 \
+    -f $libdbs/genders.query_1 --shared --batch < batch.requests
+
+# query plans
+query='(attr3&&~attr7)||(~attr5&&~attr9)--attr10=val10'
+check_output genders.query_1.explain 0 \
+    -f $libdbs/genders.query_1 --explain "$query"
+
+# evaluation times vary, so they are masked before comparing
+$NODEATTR -f $libdbs/genders.query_1 --analyze "$query" 2>&1 \
+    | sed 's/[0-9.]* ms/X ms/' > $out
+if ! cmp -s expected/genders.query_1.analyze $out; then
+    echo "FAIL: nodeattr --analyze $query: output differs"
+    diff expected/genders.query_1.analyze $out | head -20
+    failures=`expr $failures + 1`
+fi
+
+if [ $failures -ne 0 ]; then
+    echo "Total Failures: $failures"
+    exit 1
+fi
+exit 0